@@ -1,13 +1,43 @@
 #include "client_application.h"
 #include "../common/ssh_session.h"
 #include "../common/transport_tcp.h"
+#include "../common/transport_udp.h"
 #include "../common/protocol.h"
+#include "../common/stream_bridge.h"
+#include "../common/connection_racer.h"
+#include "../common/session_recording.h"
 #include "../client/control_panel.h"
+#include "../client/desktop_window.h"
 #include "../client/connection_dialog.h"
 
 #include <QApplication>
 #include <QMessageBox>
 #include <iostream>
+#include <sstream>
+
+namespace {
+    ConnectionRacer::Candidate DesktopCandidate(TransportMode mode, const std::string& host, int port,
+                                                const std::string& password) {
+        ConnectionRacer::Candidate c;
+        c.mode = mode;
+        c.host = host;
+        c.name = std::string(mode == TransportMode::UDP ? "UDP " : "TCP ") + host + ":" + std::to_string(port);
+        if (mode == TransportMode::UDP) {
+            c.create = []() { return std::unique_ptr<ITransport>(new UDPClientTransport()); };
+            c.connect = [host, port](ITransport& t) { return static_cast<UDPClientTransport&>(t).connect(host, port); };
+        } else {
+            c.create = [password]() {
+                auto tcp = std::make_unique<TCPClientTransport>();
+                // 桌面流用 SSH 口令做预共享密钥加密；口令不对时服务端的第一条记录通不过认证，
+                // connect 返回 false，这条路径不会赢得竞速
+                tcp->setEncryption(true, password);
+                return std::unique_ptr<ITransport>(std::move(tcp));
+            };
+            c.connect = [host, port](ITransport& t) { return static_cast<TCPClientTransport&>(t).connect(host, port); };
+        }
+        return c;
+    }
+}
 
 ClientApplication::ClientApplication() = default;
 
@@ -18,6 +48,12 @@ ClientApplication::~ClientApplication() {
     if (sshSession_) {
         sshSession_->disconnect();
     }
+    bulkForwarder_.reset();
+    interactiveForwarder_.reset();
+    if (streamMux_) {
+        std::shared_ptr<StreamMux> mux = streamMux_;
+        EventLoop::shared().runSync([mux]() { mux->reset(); });
+    }
 }
 
 bool ClientApplication::setupConnections(const ConnectionConfig& cfg) {
@@ -27,8 +63,77 @@ bool ClientApplication::setupConnections(const ConnectionConfig& cfg) {
     }
     targetHost_ = targetHost;
 
+    // 先建桌面连接，SSH/SFTP 复用它而不再单独穿透一次。
+    // 控制面板接管回调之前，SSH 握手就已经要走复用流；
+    // 竞速胜出前服务端不会主动发消息（Ping 由传输层自己应答），此时再挂回调不会漏
+    auto attachStreams = [this](ITransport* transport) {
+        auto mux = std::make_shared<StreamMux>(EventLoop::shared(), true,
+            [transport](const BinaryData& msg) { return transport->send(msg); });
+        TransportCallbacks cb;
+        cb.onDisconnected = [mux]() { mux->reset(); };
+        cb.onBuffer = [mux](const BufferRef& data) { mux->handleMessage(data.data(), data.size()); };
+        transport->setCallbacks(cb);
+        streamMux_ = mux;
+    };
+
+    ConnectionRacer racer;
+    auto addPaths = [&](TransportMode mode) {
+        // 勾选了 EasyTier 时虚拟 IP 优先，直连地址随后
+        racer.add(DesktopCandidate(mode, targetHost, cfg.desktopPort, cfg.password));
+        if (targetHost != cfg.host) racer.add(DesktopCandidate(mode, cfg.host, cfg.desktopPort, cfg.password));
+    };
+    if (cfg.racePaths) {
+        // 所有路径错开并行握手，选中的协议排在前面；P2P/中继的候选同样可以加进来
+        TransportMode other = cfg.desktopTransport == TransportMode::UDP ? TransportMode::TCP : TransportMode::UDP;
+        addPaths(cfg.desktopTransport);
+        addPaths(other);
+    } else {
+        racer.add(DesktopCandidate(cfg.desktopTransport, targetHost, cfg.desktopPort, cfg.password));
+    }
+
+    ConnectionRacer::Result raced;
+    bool desktopOk = racer.race(raced);
+    std::unique_ptr<ITransport> dt = std::move(raced.transport);
+    if (desktopOk) {
+        // 设置了 RC_RECORD_SESSION 时把收到的每条桌面消息录下来，供离线回放压测解码和渲染
+        if (const char* recordPath = getenv("RC_RECORD_SESSION")) {
+            auto recorder = std::make_shared<SessionRecorder>();
+            if (recorder->open(recordPath, SessionRecording::Side::Client)) {
+                dt = std::make_unique<RecordingTransport>(std::move(dt), recorder);
+            }
+        }
+        targetHost_ = raced.candidate.host;
+        std::ostringstream path;
+        path << raced.candidate.name << ", handshake " << static_cast<int>(raced.handshakeMs + 0.5) << "ms";
+        desktopPath_ = path.str();
+        attachStreams(dt.get());
+        desktopTransportPtr_ = dt.get();
+        desktopTransport_ = std::move(dt);
+
+        // SFTP 走批量流，终端走交互流：文件传输挤不掉视频，也不拖慢按键回显
+        bulkForwarder_ = std::make_unique<LocalStreamForwarder>(
+            EventLoop::shared(), streamMux_, Desktop::StreamService::Ssh, false);
+        interactiveForwarder_ = std::make_unique<LocalStreamForwarder>(
+            EventLoop::shared(), streamMux_, Desktop::StreamService::Ssh, true);
+        if (!bulkForwarder_->start()) bulkForwarder_.reset();
+        if (!interactiveForwarder_->start()) interactiveForwarder_.reset();
+    } else {
+        streamMux_.reset();
+        QMessageBox::warning(nullptr, "Desktop Warning",
+            "Could not connect to desktop service. Desktop will be unavailable.");
+    }
+
     sshSession_ = std::make_unique<SshSession>();
-    if (!sshSession_->connect(targetHost, cfg.sshPort, cfg.username, cfg.password)) {
+    bool sshOk = false;
+    if (bulkForwarder_) {
+        sshOk = sshSession_->connect("127.0.0.1", bulkForwarder_->port(), cfg.username, cfg.password);
+        if (!sshOk) {
+            std::cerr << "[Client] SSH over desktop link failed, connecting directly" << std::endl;
+            sshSession_ = std::make_unique<SshSession>();
+        }
+    }
+    sshTunneled_ = sshOk;
+    if (!sshOk && !sshSession_->connect(targetHost, cfg.sshPort, cfg.username, cfg.password)) {
         QMessageBox::critical(nullptr, "SSH Connection Failed",
             QString::fromStdString(sshSession_->getError()));
         return false;
@@ -39,19 +144,51 @@ bool ClientApplication::setupConnections(const ConnectionConfig& cfg) {
             "SFTP initialization failed. File manager may not work.");
     }
 
-    auto dt = std::make_unique<TCPClientTransport>();
-    if (dt->connect(targetHost, cfg.desktopPort)) {
-        desktopTransportPtr_ = dt.get();
-        desktopTransport_ = std::move(dt);
-    } else {
-        QMessageBox::warning(nullptr, "Desktop Warning",
-            "Could not connect to desktop service. Desktop will be unavailable.");
+    return true;
+}
+
+int ClientApplication::replay(const std::string& spec) {
+    std::string path;
+    SessionRecording::Speed speed;
+    SessionRecording::ParseReplaySpec(spec, path, speed);
+    auto transport = std::make_unique<ReplayTransport>(path, speed);
+    ReplayTransport* replay = transport.get();
+    desktopTransportPtr_ = replay;
+    desktopTransport_ = std::move(transport);
+
+    InputControlState inputState;
+    DesktopWindow window;
+    window.init(replay, &inputState);
+    TransportCallbacks cb;
+    cb.onConnected = []() { std::cout << "[Replay] Playback started" << std::endl; };
+    cb.onDisconnected = []() { std::cout << "[Replay] Recorded session ended" << std::endl; };
+    // 录下的复用流消息没有对应的流，交给桌面窗口时会被忽略
+    cb.onBuffer = [&window](const BufferRef& data) { window.handleMessage(data); };
+    replay->setCallbacks(cb);
+    if (!replay->start()) {
+        QMessageBox::critical(nullptr, "Replay Error",
+            QString::fromStdString("Cannot replay " + path));
+        return 1;
     }
 
-    return true;
+    window.setWindowTitle("Remote Desktop [Replay: " + QString::fromStdString(path) + "]");
+    QObject::connect(&window, &DesktopWindow::closed, qApp, &QApplication::quit, Qt::QueuedConnection);
+    window.show();
+
+    int result = qApp->exec();
+    replay->disconnect();
+    SessionReplay::Stats stats = replay->wait();
+    std::cout << "[Replay] " << stats.messages << " messages (" << stats.bytes << " bytes) in "
+              << stats.elapsedMs << "ms, max late " << stats.maxLateMs << "ms, "
+              << replay->sentMessages() << " messages sent" << std::endl;
+    return result;
 }
 
 int ClientApplication::exec() {
+    // 设置了 RC_REPLAY_SESSION=<路径>[:max] 时跳过连接对话框，离线回放 RC_RECORD_SESSION 录下的会话，
+    // 压测解码和渲染；带 :max 时不按录制间隔等待
+    if (const char* replaySpec = getenv("RC_REPLAY_SESSION")) return replay(replaySpec);
+
     ConnectionDialog dlg;
     if (dlg.exec() != QDialog::Accepted) return 0;
 
@@ -66,15 +203,21 @@ int ClientApplication::exec() {
                      + " | via EasyTier Service";
     }
 
+    if (!desktopPath_.empty()) connectInfo += " | Desktop: " + desktopPath_;
+
     ControlPanelConfig panelConfig;
     panelConfig.sshSession = sshSession_.get();
     panelConfig.desktopTransport = desktopTransportPtr_;
     panelConfig.modeText = modeText;
     panelConfig.connectInfo = connectInfo;
+    panelConfig.streamMux = streamMux_.get();
     panelConfig.sshHost = targetHost_;
     panelConfig.sshPort = cfg.sshPort;
     panelConfig.sshUser = cfg.username;
     panelConfig.sshPassword = cfg.password;
+    if (interactiveForwarder_) panelConfig.sshTunnelPort = interactiveForwarder_->port();
+    if (bulkForwarder_) panelConfig.sftpTunnelPort = bulkForwarder_->port();
+    panelConfig.sshSessionTunneled = sshTunneled_;
 
     ControlPanel controlPanel;
     controlPanel.setConfig(panelConfig);
@@ -6,8 +6,9 @@
 #include "../common/protocol.h"
 
 class SshSession;
-class TCPClientTransport;
 class ITransport;
+class StreamMux;
+class LocalStreamForwarder;
 struct ConnectionConfig;
 
 class ClientApplication {
@@ -19,11 +20,19 @@ public:
 
 private:
     bool setupConnections(const ConnectionConfig& cfg);
+    // 不连接服务器，把录制文件回放进桌面窗口，spec 为 <路径>[:max]
+    int replay(const std::string& spec);
 
     std::unique_ptr<SshSession> sshSession_;
-    std::unique_ptr<TCPClientTransport> desktopTransport_;
+    std::unique_ptr<ITransport> desktopTransport_;
     ITransport* desktopTransportPtr_ = nullptr;
+    // 终端和 SFTP 经本地转发端口复用桌面连接
+    std::shared_ptr<StreamMux> streamMux_;
+    std::unique_ptr<LocalStreamForwarder> bulkForwarder_;
+    std::unique_ptr<LocalStreamForwarder> interactiveForwarder_;
     std::string targetHost_;
+    std::string desktopPath_;       // 竞速选中的桌面路径，显示在控制面板上
+    bool sshTunneled_ = false;      // sshSession_ 经桌面链路连接
 };
 
 #endif
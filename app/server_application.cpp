@@ -1,7 +1,10 @@
 #include "server_application.h"
 #include "../server/desktop_service.h"
+#include "../server/frame_source_capture.h"
 #include "../common/transport_tcp.h"
+#include "../common/transport_udp.h"
 #include "../common/easytier_control.h"
+#include "../common/session_recording.h"
 #include "../client/server_settings_dialog.h"
 #include "../client/server_status_dialog.h"
 #include "../client/service_manager_dialog.h"
@@ -34,6 +37,8 @@ int ServerApplication::exec() {
     ServerSettings settings = settingsDlg.getSettings();
     useEasyTier_ = settings.useEasyTier;
     desktopPort_ = settings.desktopPort;
+    maxViewers_ = settings.maxViewers;
+    desktopUdp_ = settings.desktopTransport == TransportMode::UDP;
     sshPort_ = settings.sshPort;
     sshPassword_ = settings.sshPassword;
 
@@ -98,23 +103,70 @@ int ServerApplication::exec() {
 
     // Step 4: Start desktop service
     auto service = std::make_unique<DesktopService>();
+    // 设置了 RC_CAPTURE_SOURCE 时用合成画面或原始帧文件代替桌面（见 FrameSourcing::Create），供压测和长时间运行测试
+    if (const char* sourceSpec = getenv("RC_CAPTURE_SOURCE")) {
+        auto source = FrameSourcing::Create(sourceSpec);
+        if (!source) {
+            QMessageBox::critical(nullptr, "Error", QString("Invalid RC_CAPTURE_SOURCE: %1").arg(sourceSpec));
+            return 1;
+        }
+        service->setCaptureSource(std::make_unique<FrameSourceCapture>(std::move(source)));
+    }
     if (!service->init()) {
         QMessageBox::critical(nullptr, "Error", "Desktop service init failed!");
         return 1;
     }
 
-    auto transport = std::make_unique<TCPServerTransport>(desktopPort_);
-    if (!transport->start()) {
-        QMessageBox::critical(nullptr, "TCP Error", "Failed to start TCP transport.");
+    std::unique_ptr<IServerTransport> transport;
+    // 设置了 RC_REPLAY_SESSION=<路径>[:max] 时不监听端口，把录下的观看者消息回放给桌面服务，
+    // 离线压测输入和控制路径；服务端发出的消息只计数后丢弃
+    ReplayServerTransport* replay = nullptr;
+    if (const char* replaySpec = getenv("RC_REPLAY_SESSION")) {
+        std::string replayPath;
+        SessionRecording::Speed speed;
+        SessionRecording::ParseReplaySpec(replaySpec, replayPath, speed);
+        auto replayTransport = std::make_unique<ReplayServerTransport>(replayPath, speed);
+        replay = replayTransport.get();
+        transport = std::move(replayTransport);
+    } else if (desktopUdp_) {
+        transport = std::make_unique<UDPServerTransport>(desktopPort_);
+    } else {
+        auto tcp = std::make_unique<TCPServerTransport>(desktopPort_, maxViewers_);
+        tcp->setEncryption(true, sshPassword_);
+        transport = std::move(tcp);
+    }
+    // 设置了 RC_RECORD_SESSION 时录下各观看者发来的消息，供离线回放压测输入路径
+    const char* recordPath = getenv("RC_RECORD_SESSION");
+    if (recordPath && !replay) {
+        auto recorder = std::make_shared<SessionRecorder>();
+        if (recorder->open(recordPath, SessionRecording::Side::Server)) {
+            transport = std::make_unique<RecordingServerTransport>(std::move(transport), recorder);
+        }
+    }
+    // 回放一开始就交付消息，要等桌面服务挂上回调、采集线程跑起来之后再启动
+    if (!replay && !transport->start()) {
+        QMessageBox::critical(nullptr, desktopUdp_ ? "UDP Error" : "TCP Error",
+            desktopUdp_ ? "Failed to start UDP transport." : "Failed to start TCP transport.");
         return 1;
     }
 
     service->setTransport(transport.get());
+    // 客户端的终端和 SFTP 可复用桌面连接，转到本机的 SSH 服务
+    service->allowStreamService(Desktop::StreamService::Ssh, sshPort_);
     service->start();
 
     desktopService_ = std::move(service);
     desktopTransport_ = std::move(transport);
 
+    if (replay) {
+        if (!replay->start()) {
+            QMessageBox::critical(nullptr, "Replay Error",
+                QString("Cannot replay RC_REPLAY_SESSION: %1").arg(getenv("RC_REPLAY_SESSION")));
+            return 1;
+        }
+        std::cout << "[Server] Replaying recorded session" << std::endl;
+    }
+
     // Step 5: Show status dialog
     ServerStatusDialog dialog;
     dialog.setInfo(myVirtualIp_, useEasyTier_, desktopPort_, sshPort_,
@@ -129,5 +181,12 @@ int ServerApplication::exec() {
     dialog.show();
 
     qApp->exec();
+    if (replay) {
+        desktopTransport_->stop();
+        SessionReplay::Stats stats = replay->wait();
+        std::cout << "[Server] Replayed " << stats.messages << " messages (" << stats.bytes << " bytes) in "
+                  << stats.elapsedMs << "ms, max late " << stats.maxLateMs << "ms, "
+                  << replay->sentMessages() << " messages sent" << std::endl;
+    }
     return 0;
 }
@@ -5,7 +5,7 @@
 #include <string>
 
 class DesktopService;
-class TCPServerTransport;
+class IServerTransport;
 class ServerStatusDialog;
 
 class ServerApplication {
@@ -17,13 +17,15 @@ public:
 
 private:
     int desktopPort_ = 12345;
+    int maxViewers_ = 1;
+    bool desktopUdp_ = false;
     int sshPort_ = 2222;
     std::string sshPassword_;
     std::string myVirtualIp_;
     bool useEasyTier_ = false;
 
     std::unique_ptr<DesktopService> desktopService_;
-    std::unique_ptr<TCPServerTransport> desktopTransport_;
+    std::unique_ptr<IServerTransport> desktopTransport_;
 };
 
 #endif
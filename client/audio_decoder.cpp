@@ -1,6 +1,7 @@
 
 #define NOMINMAX
 #include "audio_decoder.h"
+#include "pooled_media_buffer.h"
 #include <iostream>
 #include <algorithm>
 #include <mfapi.h>
@@ -122,13 +123,9 @@ bool AudioDecoder::decode(const uint8_t* aacData, int aacSize, std::vector<uint8
     pcmOut.clear();
     if (!initialized_ || aacSize <= 0) return false;
 
-    IMFSample* sample = nullptr;
-    HRESULT hr = MFCreateSample(&sample);
-    if (FAILED(hr)) return false;
-
     IMFMediaBuffer* buf = nullptr;
-    hr = MFCreateMemoryBuffer((DWORD)aacSize, &buf);
-    if (FAILED(hr)) { sample->Release(); return false; }
+    HRESULT hr = MFCreateMemoryBuffer((DWORD)aacSize, &buf);
+    if (FAILED(hr)) return false;
 
     BYTE* ptr = nullptr;
     hr = buf->Lock(&ptr, nullptr, nullptr);
@@ -138,8 +135,30 @@ bool AudioDecoder::decode(const uint8_t* aacData, int aacSize, std::vector<uint8
         buf->SetCurrentLength((DWORD)aacSize);
     }
 
-    sample->AddBuffer(buf);
+    bool ok = decodeBuffer(buf, pcmOut);
     buf->Release();
+    return ok;
+}
+
+bool AudioDecoder::decode(const BufferRef& msg, size_t offset, std::vector<uint8_t>& pcmOut) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    pcmOut.clear();
+    if (!initialized_ || msg.size() <= offset) return false;
+
+    IMFMediaBuffer* buf = nullptr;
+    if (FAILED(PooledMediaBuffer::Create(msg, offset, msg.size() - offset, &buf))) return false;
+
+    bool ok = decodeBuffer(buf, pcmOut);
+    buf->Release();
+    return ok;
+}
+
+bool AudioDecoder::decodeBuffer(IMFMediaBuffer* buf, std::vector<uint8_t>& pcmOut) {
+    IMFSample* sample = nullptr;
+    HRESULT hr = MFCreateSample(&sample);
+    if (FAILED(hr)) return false;
+
+    sample->AddBuffer(buf);
     sample->SetSampleTime(0);
 
     hr = decoder_->ProcessInput(0, sample, 0);
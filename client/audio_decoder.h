@@ -5,8 +5,10 @@
 #include <cstdint>
 #include <vector>
 #include <mutex>
+#include "../common/buffer_pool.h"
 
 struct IMFTransform;
+struct IMFMediaBuffer;
 
 class AudioDecoder {
 public:
@@ -17,6 +19,8 @@ public:
     void cleanup();
 
     bool decode(const uint8_t* aacData, int aacSize, std::vector<uint8_t>& pcmOut);
+    // 零拷贝：直接把池化消息 [offset, end) 交给解码器
+    bool decode(const BufferRef& msg, size_t offset, std::vector<uint8_t>& pcmOut);
 
     int sampleRate() const { return sampleRate_; }
     int channels() const { return channels_; }
@@ -24,6 +28,7 @@ public:
 
 private:
     bool initDecoder();
+    bool decodeBuffer(IMFMediaBuffer* buf, std::vector<uint8_t>& pcmOut);
     bool processOutput(std::vector<uint8_t>& pcmOut);
 
     IMFTransform* decoder_ = nullptr;
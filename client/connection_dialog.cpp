@@ -43,6 +43,11 @@ void ConnectionDialog::createUI() {
     QFormLayout* desktopForm = new QFormLayout(desktopGroup);
     leDesktopPort_ = new QLineEdit("12345");
     desktopForm->addRow("Desktop port:", leDesktopPort_);
+    chkUdp_ = new QCheckBox("Use UDP (for lossy networks, server must match)");
+    desktopForm->addRow("", chkUdp_);
+    chkRace_ = new QCheckBox("Try all paths in parallel and keep the fastest");
+    chkRace_->setChecked(true);
+    desktopForm->addRow("", chkRace_);
     mainLayout->addWidget(desktopGroup);
 
     // EasyTier group
@@ -109,6 +114,8 @@ void ConnectionDialog::onConnect() {
     config_.password = lePassword_->text().toStdString();
 
     config_.desktopPort = leDesktopPort_->text().toInt();
+    config_.desktopTransport = chkUdp_->isChecked() ? TransportMode::UDP : TransportMode::TCP;
+    config_.racePaths = chkRace_->isChecked();
 
     config_.useEasyTier = chkEasyTier_->isChecked();
     config_.easytierServerVip = leServerVip_->text().toStdString();
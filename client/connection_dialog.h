@@ -6,6 +6,7 @@
 #include <QCheckBox>
 #include <QPushButton>
 #include <string>
+#include "../common/transport.h"
 
 struct ConnectionConfig {
     // SSH (to our embedded SSH server)
@@ -14,8 +15,11 @@ struct ConnectionConfig {
     std::string username;
     std::string password;
 
-    // Desktop (separate TCP transport)
+    // Desktop (separate TCP or UDP transport)
     int desktopPort = 12345;
+    TransportMode desktopTransport = TransportMode::TCP;
+    // 并行尝试所有路径（直连/EasyTier × TCP/UDP），保留握手最快的；desktopTransport 决定先后
+    bool racePaths = true;
 
     // EasyTier
     bool useEasyTier = false;
@@ -43,6 +47,8 @@ private:
     QLineEdit* leUsername_;
     QLineEdit* lePassword_;
     QLineEdit* leDesktopPort_;
+    QCheckBox* chkUdp_;
+    QCheckBox* chkRace_;
 
     QCheckBox* chkEasyTier_;
     QLineEdit* leServerVip_;
@@ -3,11 +3,15 @@
 #include "ssh_terminal.h"
 #include "desktop_window.h"
 #include "../common/ssh_session.h"
+#include "../common/stream_mux.h"
 #include <QGroupBox>
 #include <QFrame>
 #include <QApplication>
 #include <QMessageBox>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 #include <wchar.h>
 
 static std::wstring widen(const std::string& utf8) {
@@ -22,11 +26,12 @@ static std::wstring widen(const std::string& utf8) {
 ControlPanel::ControlPanel(QWidget* parent)
     : QMainWindow(parent) {
     setWindowTitle("JC Tool - Remote Control");
-    setFixedSize(350, 500);
+    setFixedSize(350, 530);
     createUI();
 }
 
 ControlPanel::~ControlPanel() {
+    stopAutoReconnect();
     QMutexLocker lock(&windowMtx_);
     auto safeDelete = [](auto& ptr) {
         if (ptr) {
@@ -114,6 +119,15 @@ void ControlPanel::createUI() {
     connect(chkAudio_, &QCheckBox::toggled, this, &ControlPanel::onAudioToggled);
     inputLayout->addWidget(chkAudio_);
 
+    // 服务端有多个显示器时才可用；最后一项拼接全部显示器
+    QHBoxLayout* monitorLayout = new QHBoxLayout();
+    monitorLayout->addWidget(new QLabel("Monitor"));
+    cmbMonitor_ = new QComboBox();
+    cmbMonitor_->setEnabled(false);
+    connect(cmbMonitor_, QOverload<int>::of(&QComboBox::activated), this, &ControlPanel::onMonitorActivated);
+    monitorLayout->addWidget(cmbMonitor_, 1);
+    inputLayout->addLayout(monitorLayout);
+
     mainLayout->addWidget(inputGroup);
     mainLayout->addStretch();
 
@@ -129,6 +143,8 @@ void ControlPanel::createUI() {
 
 void ControlPanel::setConfig(const ControlPanelConfig& config) {
     config_ = config;
+    sftpTunneled_ = config.sshSessionTunneled;
+    sftpStale_ = false;
     lblMode_->setText(QString("Mode: %1").arg(QString::fromStdString(config.modeText)));
     lblInfo_->setText(QString::fromStdString(config.connectInfo));
 }
@@ -137,8 +153,13 @@ void ControlPanel::setupDesktopTransportCallbacks() {
     if (!config_.desktopTransport) return;
     TransportCallbacks cb;
     cb.onConnected = []() { std::cout << "[Desktop] Connected" << std::endl; };
-    cb.onDisconnected = []() { std::cout << "[Desktop] Disconnected" << std::endl; };
-    cb.onMessage = [this](const BinaryData& data) {
+    cb.onDisconnected = [this]() {
+        std::cout << "[Desktop] Disconnected" << std::endl;
+        if (config_.streamMux) config_.streamMux->reset();
+        QMetaObject::invokeMethod(this, "onDesktopLinkLost", Qt::QueuedConnection);
+    };
+    cb.onBuffer = [this](const BufferRef& data) {
+        if (config_.streamMux && config_.streamMux->handleMessage(data.data(), data.size())) return;
         QMutexLocker lock(&windowMtx_);
         if (desktopWindow_) desktopWindow_->handleMessage(data);
     };
@@ -155,6 +176,10 @@ bool ControlPanel::ensureDesktopConnected() {
         return false;
     }
     if (config_.desktopTransport->isConnected()) return true;
+    if (reconnecting_) {
+        updateStatus("Desktop reconnecting, please wait...");
+        return false;
+    }
 
     updateStatus("Reconnecting desktop...");
     btnDesktop_->setEnabled(false);
@@ -187,6 +212,8 @@ void ControlPanel::toggleDesktop() {
     auto* dw = new DesktopWindow();
     dw->init(config_.desktopTransport, &inputState_);
     connect(dw, &DesktopWindow::closed, this, &ControlPanel::onDesktopWindowClosed);
+    connect(dw, &DesktopWindow::resumeFailed, this, &ControlPanel::onDesktopResumeFailed);
+    connect(dw, &DesktopWindow::monitorsChanged, this, &ControlPanel::onMonitorsChanged);
     dw->setWindowTitle("Remote Desktop [" + QString::fromStdString(config_.modeText) + "]");
     dw->show();
 
@@ -211,11 +238,19 @@ void ControlPanel::toggleSftp() {
         return;
     }
 
-    if (!config_.sshSession || !config_.sshSession->isConnected()) {
+    if (!config_.sshSession) {
         QMessageBox::critical(this, "Error", "SSH not connected");
         return;
     }
+    // 会话已失效：后台重连，连上后再打开窗口
+    if (sftpReconnecting_ || sftpStale_ || !config_.sshSession->isConnected()) {
+        startSftpReconnect(true);
+        return;
+    }
+    openSftpWindow();
+}
 
+void ControlPanel::openSftpWindow() {
     auto* sw = new SftpWindow(config_.sshSession);
     connect(sw, &SftpWindow::closed, this, &ControlPanel::onSftpWindowClosed);
     sw->show();
@@ -238,8 +273,8 @@ void ControlPanel::toggleSshTerminal() {
     }
 
     auto* termSession = new SshSession();
-    if (!termSession->connect(config_.sshHost, config_.sshPort,
-                               config_.sshUser, config_.sshPassword)) {
+    bool tunneled = false;
+    if (!connectSsh(termSession, config_.sshTunnelPort, tunneled)) {
         QMessageBox::critical(this, "Terminal Error",
             QString("SSH connection failed: %1")
                 .arg(QString::fromStdString(termSession->getError())));
@@ -257,9 +292,11 @@ void ControlPanel::toggleSshTerminal() {
 }
 
 void ControlPanel::onExternalTerminal() {
+    // 外部终端同样优先经桌面链路，链路断开时直连
+    bool tunnel = config_.sshTunnelPort && config_.desktopTransport && config_.desktopTransport->isConnected();
     std::string sshCmd = "ssh -o StrictHostKeyChecking=accept-new "
-        + config_.sshUser + "@" + config_.sshHost
-        + " -p " + std::to_string(config_.sshPort);
+        + config_.sshUser + "@" + (tunnel ? std::string("127.0.0.1") : config_.sshHost)
+        + " -p " + std::to_string(tunnel ? config_.sshTunnelPort : config_.sshPort);
 
     std::wstring wcmd = widen(sshCmd);
 
@@ -307,10 +344,148 @@ void ControlPanel::onDesktopWindowClosed() {
     btnDesktop_->setText("Remote Desktop");
     updateStatus("Desktop closed");
     sendAudioEnable(false);
+    cmbMonitor_->clear();
+    cmbMonitor_->setEnabled(false);
     QMutexLocker lock(&windowMtx_);
     desktopWindow_.clear();
 }
 
+void ControlPanel::onDesktopLinkLost() {
+    if (shuttingDown_) return;
+    // 经链路的 SFTP 会话已随复用流关闭；窗口开着就立即改为直连，否则等下次打开时再连
+    if (sftpTunneled_) {
+        sftpStale_ = true;
+        if (sftpWindow_) startSftpReconnect(false);
+    }
+
+    // 没有打开桌面窗口、也没有复用流时不必在后台重连，下次打开桌面时再连
+    if (reconnecting_ || !config_.desktopTransport || (!desktopWindow_ && !config_.streamMux)) return;
+    if (reconnectThread_.joinable()) reconnectThread_.join();
+
+    updateStatus("Desktop link lost, reconnecting...");
+    reconnecting_ = true;
+    ITransport* transport = config_.desktopTransport;
+    reconnectThread_ = std::thread([this, transport]() {
+        using namespace std::chrono;
+        static const int BACKOFF_MS[] = { 0, 200, 500, 1000, 2000 };
+        auto deadline = steady_clock::now() + milliseconds(Desktop::RESUME_GRACE_MS);
+        bool restored = false;
+
+        for (int attempt = 0; !shuttingDown_ && steady_clock::now() < deadline; attempt++) {
+            int waitMs = BACKOFF_MS[std::min<size_t>(attempt, std::size(BACKOFF_MS) - 1)];
+            // 分段等待，退出时不必等满一个退避间隔
+            for (int waited = 0; waited < waitMs && !shuttingDown_; waited += 50) {
+                std::this_thread::sleep_for(milliseconds(50));
+            }
+            if (shuttingDown_) break;
+            std::cout << "[Desktop] Auto-reconnect attempt " << attempt + 1 << std::endl;
+            if (transport->reconnect()) {
+                restored = true;
+                break;
+            }
+        }
+
+        reconnecting_ = false;
+        if (shuttingDown_) return;
+        QMetaObject::invokeMethod(this, restored ? "onDesktopLinkRestored" : "onDesktopReconnectFailed",
+                                  Qt::QueuedConnection);
+    });
+}
+
+void ControlPanel::onDesktopLinkRestored() {
+    if (reconnectThread_.joinable()) reconnectThread_.join();
+    // 断开期间没能直连的 SFTP 会话重新经链路建立；已经直连上的保持不动，不打断正在进行的传输
+    if (sftpStale_ && sftpWindow_) startSftpReconnect(false);
+    if (!desktopWindow_) {
+        updateStatus("Desktop reconnected");
+        return;
+    }
+    updateStatus("Desktop reconnected, resuming session");
+    desktopWindow_->resumeStream();
+}
+
+void ControlPanel::onDesktopReconnectFailed() {
+    if (reconnectThread_.joinable()) reconnectThread_.join();
+    updateStatus("Desktop connection lost");
+}
+
+void ControlPanel::onDesktopResumeFailed() {
+    // 会话已过期：按新观看者重新请求，音频开关也要重新告诉服务端
+    if (!desktopWindow_) return;
+    updateStatus("Session expired, restarting stream");
+    desktopWindow_->requestStream();
+    if (chkAudio_->isChecked()) sendAudioEnable(true);
+}
+
+bool ControlPanel::connectSsh(SshSession* session, int tunnelPort, bool& tunneled) {
+    tunneled = false;
+    if (tunnelPort && config_.desktopTransport && config_.desktopTransport->isConnected()) {
+        if (session->connect("127.0.0.1", tunnelPort, config_.sshUser, config_.sshPassword)) {
+            tunneled = true;
+            return true;
+        }
+        std::cerr << "[SSH] Connection over desktop link failed, connecting directly" << std::endl;
+    }
+    return session->connect(config_.sshHost, config_.sshPort, config_.sshUser, config_.sshPassword);
+}
+
+void ControlPanel::startSftpReconnect(bool openWindow) {
+    SshSession* session = config_.sshSession;
+    if (!session || shuttingDown_) return;
+    sftpOpenPending_ = sftpOpenPending_ || openWindow;
+    if (sftpReconnecting_) return;
+    if (sftpThread_.joinable()) sftpThread_.join();
+
+    // 重连期间会话不可用，窗口先禁用，免得界面线程同时操作它
+    if (sftpWindow_) sftpWindow_->setEnabled(false);
+    btnSftp_->setEnabled(false);
+    updateStatus("SFTP reconnecting...");
+    sftpReconnecting_ = true;
+    sftpThread_ = std::thread([this, session]() {
+        session->disconnect();
+        bool tunneled = false;
+        bool ok = connectSsh(session, config_.sftpTunnelPort, tunneled);
+        if (!ok) {
+            std::cerr << "[SSH] SFTP session reconnect failed: " << session->getError() << std::endl;
+        } else if (!session->sftpInit()) {
+            std::cerr << "[SSH] SFTP init failed: " << session->getError() << std::endl;
+        }
+        if (shuttingDown_) return;
+        QMetaObject::invokeMethod(this, [this, ok, tunneled]() { onSftpReconnected(ok, tunneled); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void ControlPanel::onSftpReconnected(bool ok, bool tunneled) {
+    if (sftpThread_.joinable()) sftpThread_.join();
+    sftpReconnecting_ = false;
+    btnSftp_->setEnabled(true);
+    if (sftpWindow_) sftpWindow_->setEnabled(true);
+    bool openWindow = sftpOpenPending_;
+    sftpOpenPending_ = false;
+
+    if (!ok) {
+        sftpStale_ = true;
+        updateStatus("SFTP disconnected");
+        if (openWindow) {
+            QMessageBox::critical(this, "Error",
+                QString("SSH not connected: %1").arg(QString::fromStdString(config_.sshSession->getError())));
+        }
+        return;
+    }
+    sftpTunneled_ = tunneled;
+    sftpStale_ = false;
+    std::cout << "[SSH] SFTP session reconnected " << (tunneled ? "over desktop link" : "directly") << std::endl;
+    updateStatus(tunneled ? "SFTP reconnected" : "SFTP reconnected directly");
+    if (openWindow && !sftpWindow_) openSftpWindow();
+}
+
+void ControlPanel::stopAutoReconnect() {
+    shuttingDown_ = true;
+    if (reconnectThread_.joinable()) reconnectThread_.join();
+    if (sftpThread_.joinable()) sftpThread_.join();
+}
+
 void ControlPanel::onSftpWindowClosed() {
     btnSftp_->setText("SFTP File Manager");
     updateStatus("SFTP closed");
@@ -325,6 +500,7 @@ void ControlPanel::onDisconnect() {
     auto reply = QMessageBox::question(this, "Confirm",
         "Disconnect and exit?", QMessageBox::Yes | QMessageBox::No);
     if (reply != QMessageBox::Yes) return;
+    stopAutoReconnect();
 
     auto safeDelete = [](auto& ptr) {
         if (ptr) {
@@ -354,6 +530,22 @@ void ControlPanel::onAudioToggled(bool checked) {
     sendAudioEnable(checked);
 }
 
+void ControlPanel::onMonitorsChanged(const QStringList& names, int selected) {
+    cmbMonitor_->clear();
+    for (int i = 0; i < names.size(); i++) cmbMonitor_->addItem(names[i], i);
+    if (names.size() > 1) cmbMonitor_->addItem("All Monitors (span)", -1);
+    int current = cmbMonitor_->findData(selected);
+    cmbMonitor_->setCurrentIndex(current >= 0 ? current : 0);
+    cmbMonitor_->setEnabled(names.size() > 1);
+}
+
+void ControlPanel::onMonitorActivated(int comboIndex) {
+    if (comboIndex < 0 || !desktopWindow_) return;
+    int index = cmbMonitor_->itemData(comboIndex).toInt();
+    desktopWindow_->selectMonitor(index);
+    updateStatus(index < 0 ? "Showing all monitors" : QString("Showing monitor %1").arg(index + 1));
+}
+
 void ControlPanel::sendAudioEnable(bool enabled) {
     if (config_.desktopTransport && config_.desktopTransport->isConnected()) {
         auto msg = MessageBuilder::AudioEnableMsg(enabled);
@@ -5,6 +5,7 @@
 #include <QLabel>
 #include <QPushButton>
 #include <QCheckBox>
+#include <QComboBox>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QGroupBox>
@@ -13,6 +14,7 @@
 #include <QMutex>
 #include <atomic>
 #include <memory>
+#include <thread>
 #include "../common/protocol.h"
 #include "../common/transport.h"
 
@@ -20,6 +22,7 @@ class SshSession;
 class SftpWindow;
 class SshTerminalWindow;
 class DesktopWindow;
+class StreamMux;
 
 struct InputControlState {
     std::atomic<bool> mouseMove{true};
@@ -30,12 +33,20 @@ struct InputControlState {
 struct ControlPanelConfig {
     SshSession* sshSession = nullptr;
     ITransport* desktopTransport = nullptr;
+    // 复用桌面连接的终端/SFTP 流，Stream* 消息先交给它
+    StreamMux* streamMux = nullptr;
     std::string modeText;
     std::string connectInfo;
+    // SSH 服务的直连地址，桌面链路断开时终端和 SFTP 改走这里
     std::string sshHost;
     int sshPort = 2222;
     std::string sshUser;
     std::string sshPassword;
+    // 经桌面链路转发到 SSH 的本机端口，终端走交互流、SFTP 走批量流；0 表示没有转发
+    int sshTunnelPort = 0;
+    int sftpTunnelPort = 0;
+    // sshSession 当前连的是 sftpTunnelPort
+    bool sshSessionTunneled = false;
 };
 
 class ControlPanel : public QMainWindow {
@@ -61,12 +72,26 @@ private slots:
     void onMouseClickToggled(bool checked);
     void onKeyboardToggled(bool checked);
     void onAudioToggled(bool checked);
+    void onMonitorsChanged(const QStringList& names, int selected);
+    void onMonitorActivated(int comboIndex);
+    void onDesktopLinkLost();
+    void onDesktopLinkRestored();
+    void onDesktopReconnectFailed();
+    void onDesktopResumeFailed();
 
 private:
     void createUI();
     void updateStatus(const QString& text);
     bool ensureDesktopConnected();
     void sendAudioEnable(bool enabled);
+    void stopAutoReconnect();
+    // 桌面链路在线时经 tunnelPort 连接，否则（或转发失败时）直连 SSH
+    bool connectSsh(SshSession* session, int tunnelPort, bool& tunneled);
+    // 在后台线程重连 SFTP 用的 sshSession（连不上要等满 SSH 超时），结果转回界面线程；
+    // 对象原地重连，SftpWindow 持有的指针保持有效。openWindow 表示连上后打开 SFTP 窗口
+    void startSftpReconnect(bool openWindow);
+    void onSftpReconnected(bool ok, bool tunneled);
+    void openSftpWindow();
 
     QLabel* lblMode_;
     QLabel* lblInfo_;
@@ -80,6 +105,7 @@ private:
     QCheckBox* chkMouseClick_;
     QCheckBox* chkKeyboard_;
     QCheckBox* chkAudio_;
+    QComboBox* cmbMonitor_;
 
     ControlPanelConfig config_;
 
@@ -89,6 +115,19 @@ private:
     QMutex windowMtx_;
 
     InputControlState inputState_;
+
+    // 桌面窗口打开或终端/SFTP 复用桌面连接时链路断开，后台按退避间隔重连，
+    // 在服务端的续连宽限期内恢复会话
+    std::thread reconnectThread_;
+    std::atomic<bool> reconnecting_{false};
+    std::atomic<bool> shuttingDown_{false};
+
+    // SFTP 会话经桌面链路时随链路断开失效，直连回退或链路恢复后重连；标志只在界面线程访问
+    bool sftpTunneled_ = false;
+    bool sftpStale_ = false;
+    bool sftpReconnecting_ = false;
+    bool sftpOpenPending_ = false;
+    std::thread sftpThread_;
 };
 
 #endif
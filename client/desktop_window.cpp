@@ -3,9 +3,12 @@
 #include <QVBoxLayout>
 #include <QCloseEvent>
 #include <QPainter>
+#include <QCursor>
+#include <QPixmap>
 #include <QApplication>
 #include <QScreen>
 #include <iostream>
+#include <algorithm>
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
@@ -31,6 +34,8 @@ DesktopWindow::DesktopWindow(QWidget* parent)
     // --- 【修改】绑定渲染信号 ---
     // 依然监听信号，但 updateDisplay 内部只需调用 update()
     connect(this, &DesktopWindow::frameReady, this, &DesktopWindow::updateDisplay);
+    connect(this, &DesktopWindow::inputPermissionChanged, this, &DesktopWindow::onInputPermissionChanged);
+    connect(this, &DesktopWindow::cursorChanged, this, &DesktopWindow::applyCursor);
 
     // --- 【保留】流控与解码初始化 ---
     decoding_ = true;
@@ -49,6 +54,7 @@ DesktopWindow::DesktopWindow(QWidget* parent)
 }
 
 DesktopWindow::~DesktopWindow() {
+    inputBatcher_->stop();
     decoding_ = false;
     queueCV_.notify_all();
     audioDecoding_ = false;
@@ -109,18 +115,65 @@ void DesktopWindow::joinAudioDecodeThread() {
 void DesktopWindow::init(ITransport* transport, InputControlState* inputState) {
     transport_ = transport;
     inputState_ = inputState;
+    inputBatcher_->start([this](const BinaryData& msg) {
+        return transport_ && transport_->isConnected() && transport_->send(msg);
+    });
+}
+
+void DesktopWindow::sendHello() {
+    // 每条新连接上都先声明能力，旧服务器忽略它，照旧发不带 VideoFrameInfo 的帧
+    transport_->send(MessageBuilder::Hello(Desktop::PROTOCOL_VERSION, Desktop::SUPPORTED_CAPABILITIES));
+    haveVideoSeq_ = false;
+    // 新连接上的服务器可能是旧版本，确认 CAP_INPUT_BATCH 之前逐条发送
+    inputBatcher_->setBatching(false);
+    // 旧服务器不发指针，在收到形状之前用系统指针
+    {
+        std::lock_guard<std::mutex> lock(cursorMtx_);
+        hasCursorShape_ = false;
+        cursorVisible_ = false;
+    }
+    emit cursorChanged();
 }
 
 void DesktopWindow::requestStream() {
     if (transport_ && transport_->isConnected()) {
         std::cout << "[Desktop] Requesting stream..." << std::endl;
+        sendHello();
         auto ready = MessageBuilder::ClientReady();
         transport_->send(ready);
     }
 }
 
+void DesktopWindow::resumeStream() {
+    if (!transport_ || !transport_->isConnected()) return;
+
+    Desktop::SessionTokenBytes token;
+    {
+        std::lock_guard<std::mutex> lock(tokenMtx_);
+        if (!hasSessionToken_) {
+            requestStream();
+            return;
+        }
+        token = sessionToken_;
+    }
+    std::cout << "[Desktop] Resuming session..." << std::endl;
+    // 断线前排队的帧已经过时，续连后服务端从关键帧重新开始
+    {
+        std::lock_guard<std::mutex> lock(queueMtx_);
+        std::queue<BufferRef> empty;
+        std::swap(videoQueue_, empty);
+    }
+    sendHello();
+    transport_->send(MessageBuilder::ResumeSession(token));
+}
+
+void DesktopWindow::selectMonitor(int index) {
+    if (!transport_ || !transport_->isConnected()) return;
+    transport_->send(MessageBuilder::SelectMonitor(index < 0 ? Desktop::MONITOR_SPAN : static_cast<uint8_t>(index)));
+}
+
 // 网络回调线程：仅负责分发消息，不执行耗时操作
-void DesktopWindow::handleMessage(const BinaryData& data) {
+void DesktopWindow::handleMessage(const BufferRef& data) {
     if (data.empty()) return;
 
     auto type = static_cast<Desktop::MsgType>(data[0]);
@@ -130,15 +183,21 @@ void DesktopWindow::handleMessage(const BinaryData& data) {
             handleScreenInfo(data);
             break;
 
-        case Desktop::MsgType::VideoFrame:
-            if (data.size() > 2) {
+        case Desktop::MsgType::VideoFrame: {
+            Desktop::VideoFrameView view;
+            if (!Desktop::ParseVideoFrame(data.data(), data.size(), view) || data.size() <= view.payloadOffset) break;
+            // 有观看者不支持 VideoFrameInfo 时服务端改发不带序号的帧，序号仍在递增；
+            // 这期间的帧不算丢失，恢复带序号后从第一帧重新计起
+            if (view.hasInfo) trackVideoSeq(view);
+            else haveVideoSeq_ = false;
+            {
                 std::lock_guard<std::mutex> lock(queueMtx_);
 
                 if (videoQueue_.size() > 3) {
                     int dropCount = videoQueue_.size();
                     intervalFramesDropped_ += dropCount;
 
-                    std::queue<BinaryData> empty;
+                    std::queue<BufferRef> empty;
                     std::swap(videoQueue_, empty);
 
                     if (transport_ && transport_->isConnected()) {
@@ -151,11 +210,53 @@ void DesktopWindow::handleMessage(const BinaryData& data) {
                 queueCV_.notify_one();
             }
             break;
+        }
+
+        case Desktop::MsgType::Hello:
+            if (data.size() >= 1 + sizeof(Desktop::HelloMsg)) {
+                Desktop::HelloMsg hello;
+                memcpy(&hello, data.data() + 1, sizeof(hello));
+                std::cout << "[Desktop] Server protocol v" << hello.version
+                          << ", capabilities 0x" << std::hex << hello.capabilities << std::dec << std::endl;
+                inputBatcher_->setBatching((hello.capabilities & Desktop::CAP_INPUT_BATCH) != 0);
+            }
+            break;
+
+        case Desktop::MsgType::MonitorList: {
+            std::vector<Desktop::MonitorInfo> monitors;
+            uint8_t selected = 0;
+            if (!Desktop::ParseMonitorList(data.data(), data.size(), monitors, selected)) break;
+            QStringList names;
+            for (size_t i = 0; i < monitors.size(); i++) {
+                const auto& m = monitors[i];
+                names << QString("Monitor %1 (%2x%3)%4").arg(i + 1).arg(m.width).arg(m.height)
+                             .arg((m.flags & Desktop::MONITOR_PRIMARY) ? " - Primary" : "");
+            }
+            emit monitorsChanged(names, selected == Desktop::MONITOR_SPAN ? -1 : static_cast<int>(selected));
+            break;
+        }
 
         case Desktop::MsgType::AudioConfig:
             handleAudioConfig(data);
             break;
 
+        case Desktop::MsgType::CursorShape:
+            handleCursorShape(data);
+            break;
+
+        case Desktop::MsgType::CursorPosition:
+            if (data.size() >= 1 + sizeof(Desktop::CursorPositionMsg)) {
+                Desktop::CursorPositionMsg m;
+                memcpy(&m, data.data() + 1, sizeof(m));
+                {
+                    std::lock_guard<std::mutex> lock(cursorMtx_);
+                    cursorVisible_ = m.visible != 0;
+                    cursorPos_ = QPoint(m.x, m.y);
+                }
+                emit cursorChanged();
+            }
+            break;
+
         case Desktop::MsgType::AudioData:
             if (data.size() > 1) {
                 std::lock_guard<std::mutex> lock(audioQueueMtx_);
@@ -164,12 +265,41 @@ void DesktopWindow::handleMessage(const BinaryData& data) {
             }
             break;
 
+        case Desktop::MsgType::InputPermission: {
+            bool allowed = (data.size() > 1 && data[1] != 0);
+            if (allowed != inputAllowed_.exchange(allowed)) {
+                emit inputPermissionChanged(allowed);
+            }
+            break;
+        }
+
+        case Desktop::MsgType::SessionToken:
+            if (data.size() >= 1 + Desktop::SESSION_TOKEN_SIZE) {
+                std::lock_guard<std::mutex> lock(tokenMtx_);
+                memcpy(sessionToken_.data(), data.data() + 1, sessionToken_.size());
+                hasSessionToken_ = true;
+            }
+            break;
+
+        case Desktop::MsgType::ResumeResult: {
+            bool ok = (data.size() > 1 && data[1] != 0);
+            std::cout << "[Desktop] Session resume " << (ok ? "accepted" : "rejected") << std::endl;
+            if (!ok) {
+                {
+                    std::lock_guard<std::mutex> lock(tokenMtx_);
+                    hasSessionToken_ = false;
+                }
+                emit resumeFailed();
+            }
+            break;
+        }
+
         case Desktop::MsgType::AudioEnable: {
             bool enable = (data.size() > 1 && data[1] != 0);
             if (!enable) {
                 {
                     std::lock_guard<std::mutex> al(audioQueueMtx_);
-                    std::queue<BinaryData> empty;
+                    std::queue<BufferRef> empty;
                     std::swap(audioQueue_, empty);
                 }
                 audioDecoder_.cleanup();
@@ -184,7 +314,7 @@ void DesktopWindow::handleMessage(const BinaryData& data) {
     }
 }
 
-void DesktopWindow::handleScreenInfo(const BinaryData& data) {
+void DesktopWindow::handleScreenInfo(const BufferRef& data) {
     if (data.size() < 1 + sizeof(Desktop::ScreenInfo)) return;
 
     auto* info = reinterpret_cast<const Desktop::ScreenInfo*>(data.data() + 1);
@@ -196,7 +326,7 @@ void DesktopWindow::handleScreenInfo(const BinaryData& data) {
     // 清空旧分辨率帧
     {
         std::lock_guard<std::mutex> lock(queueMtx_);
-        std::queue<BinaryData> empty;
+        std::queue<BufferRef> empty;
         std::swap(videoQueue_, empty);
     }
 
@@ -214,7 +344,7 @@ void DesktopWindow::handleScreenInfo(const BinaryData& data) {
     }
 }
 
-void DesktopWindow::handleAudioConfig(const BinaryData& data) {
+void DesktopWindow::handleAudioConfig(const BufferRef& data) {
     if (data.size() < 8) return;
 
     int32_t sampleRate;
@@ -248,7 +378,7 @@ void DesktopWindow::handleAudioConfig(const BinaryData& data) {
 
 void DesktopWindow::audioDecodeLoop() {
     while (audioDecoding_) {
-        BinaryData data;
+        BufferRef data;
         {
             std::unique_lock<std::mutex> lock(audioQueueMtx_);
             audioQueueCV_.wait(lock, [this] {
@@ -261,22 +391,39 @@ void DesktopWindow::audioDecodeLoop() {
 
         if (!audioReady_) continue;
 
-        const uint8_t* aacData = data.data() + 1;
-        int aacSize = (int)data.size() - 1;
-
         std::vector<uint8_t> pcm;
-        if (audioDecoder_.decode(aacData, aacSize, pcm) && !pcm.empty()) {
+        if (audioDecoder_.decode(data, 1, pcm) && !pcm.empty()) {
             audioPlayer_.play(pcm.data(), (int)pcm.size());
         }
     }
 }
 
+// 网络回调线程：按帧序号发现缺帧，告诉服务端缺的是哪一帧
+void DesktopWindow::trackVideoSeq(const Desktop::VideoFrameView& view) {
+    uint32_t seq = view.info.seq;
+    if (view.keyframe) {
+        awaitingKeyframe_ = false;
+    } else if (haveVideoSeq_ && seq != nextVideoSeq_) {
+        uint32_t missing = seq - nextVideoSeq_;
+        intervalFramesMissing_ += missing;
+        // 一次缺口只请求一次，关键帧到达前不重复
+        if (!awaitingKeyframe_ && transport_ && transport_->isConnected()) {
+            std::cout << "[Desktop] Missing " << missing << " frame(s) from #" << nextVideoSeq_
+                      << ", requesting keyframe" << std::endl;
+            transport_->send(MessageBuilder::KeyframeRequest(nextVideoSeq_));
+            awaitingKeyframe_ = true;
+        }
+    }
+    haveVideoSeq_ = true;
+    nextVideoSeq_ = seq + 1;
+}
+
 // 独立的视频解码线程：消费者模式
 void DesktopWindow::decodeLoop() {
     std::vector<uint8_t> rgbData;
     
     while (decoding_) {
-        BinaryData data;
+        BufferRef data;
         {
             std::unique_lock<std::mutex> lock(queueMtx_);
             queueCV_.wait(lock, [this] { return !videoQueue_.empty() || !decoding_; });
@@ -286,13 +433,12 @@ void DesktopWindow::decodeLoop() {
             videoQueue_.pop();
         }
 
-        const uint8_t* rawH265 = data.data() + 2;
-        size_t rawSize = data.size() - 2;
-
         auto decodeStart = std::chrono::steady_clock::now();
 
         bool success = false;
         int w = 0, h = 0, stride = 0;
+        Desktop::VideoFrameView view;
+        Desktop::ParseVideoFrame(data.data(), data.size(), view);
 
 
 
@@ -301,7 +447,7 @@ void DesktopWindow::decodeLoop() {
             std::lock_guard<std::mutex> decLock(decoderMtx_);
             if (!decoderReady_) continue;
             
-            success = decoder_.decode(rawH265, static_cast<int>(rawSize), rgbData);
+            success = decoder_.decode(data, view.payloadOffset, rgbData);
             if (success) {
                 w = decoder_.getWidth();
                 h = decoder_.getHeight();
@@ -315,6 +461,7 @@ void DesktopWindow::decodeLoop() {
             auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(decodeEnd - decodeStart).count();
             intervalDecodeTimeMs_ += static_cast<uint64_t>(duration);
             intervalFramesDecoded_++;
+            if (view.hasInfo) recordFrameLatency(view.info);
 
             checkAndAdjustStreamQuality();
 
@@ -373,11 +520,96 @@ void DesktopWindow::updateDisplay() {
     update(); 
 }
 
-void DesktopWindow::sendInput(const Desktop::InputEvent& ev) {
-    if (transport_ && transport_->isConnected()) {
-        auto msg = MessageBuilder::InputEvent(ev);
-        transport_->send(msg);
+void DesktopWindow::onInputPermissionChanged(bool allowed) {
+    static const QString kViewOnly = " (View only)";
+    QString title = windowTitle();
+    if (title.endsWith(kViewOnly)) title.chop(kViewOnly.size());
+    setWindowTitle(allowed ? title : title + kViewOnly);
+    std::cout << "[Desktop] Input " << (allowed ? "enabled" : "disabled (view only)") << std::endl;
+    applyCursor();
+}
+
+void DesktopWindow::handleCursorShape(const BufferRef& data) {
+    Desktop::CursorShapeHeader header;
+    const uint8_t* pixels = nullptr;
+    if (!Desktop::ParseCursorShape(data.data(), data.size(), header, pixels)) return;
+
+    std::lock_guard<std::mutex> lock(cursorMtx_);
+    auto it = cursorShapes_.find(header.shapeId);
+    if (pixels) {
+        CursorImage img;
+        img.image = QImage(pixels, header.width, header.height, header.width * 4, QImage::Format_ARGB32).copy();
+        img.hotX = header.hotX;
+        img.hotY = header.hotY;
+        // 服务端认为已淘汰而重发的形状移到队尾，与服务端的顺序保持一致
+        if (it != cursorShapes_.end()) {
+            cursorOrder_.erase(std::find(cursorOrder_.begin(), cursorOrder_.end(), header.shapeId));
+            it->second = std::move(img);
+        } else {
+            cursorShapes_[header.shapeId] = std::move(img);
+        }
+        cursorOrder_.push_back(header.shapeId);
+        if (cursorOrder_.size() > Desktop::CURSOR_CACHE_SIZE) {
+            cursorShapes_.erase(cursorOrder_.front());
+            cursorOrder_.pop_front();
+        }
+    } else if (it == cursorShapes_.end()) {
+        std::cerr << "[Desktop] Unknown cursor shape " << header.shapeId << std::endl;
+        return;
+    }
+    cursorShapeId_ = header.shapeId;
+    hasCursorShape_ = true;
+    emit cursorChanged();
+}
+
+bool DesktopWindow::localCursorMode() const {
+    return inputAllowed_ && inputState_ && inputState_->mouseMove.load();
+}
+
+void DesktopWindow::applyCursor() {
+    // 画在画面上的指针随位置重绘
+    if (!updateLocalCursor()) update();
+}
+
+bool DesktopWindow::updateLocalCursor() {
+    bool local = localCursorMode();
+    uint32_t shapeId = 0;
+    bool visible = false;
+    CursorImage img;
+    {
+        std::lock_guard<std::mutex> lock(cursorMtx_);
+        if (local && hasCursorShape_) {
+            shapeId = cursorShapeId_;
+            visible = cursorVisible_;
+            auto it = cursorShapes_.find(shapeId);
+            if (it != cursorShapes_.end()) img = it->second;
+            else local = false;
+        } else {
+            local = false;
+        }
     }
+
+    if (!local) {
+        if (cursorApplied_) {
+            unsetCursor();
+            cursorApplied_ = false;
+        }
+        return false;
+    }
+    if (cursorApplied_ && shapeId == appliedShapeId_ && visible == appliedVisible_) return true;
+    // 远端指针隐藏时（比如打字、全屏视频）本地也隐藏
+    if (visible) setCursor(QCursor(QPixmap::fromImage(img.image), img.hotX, img.hotY));
+    else setCursor(Qt::BlankCursor);
+    cursorApplied_ = true;
+    appliedShapeId_ = shapeId;
+    appliedVisible_ = visible;
+    return true;
+}
+
+void DesktopWindow::sendInput(const Desktop::InputEvent& ev) {
+    // 只读观看者的输入服务端也会丢弃，这里直接不发
+    if (!inputAllowed_) return;
+    inputBatcher_->push(ev);
 }
 
 bool DesktopWindow::convertToImageCoords(int wx, int wy, int& ix, int& iy) {
@@ -589,14 +821,50 @@ void DesktopWindow::checkAndAdjustStreamQuality() {
             lastFpsChangeTime_ = now;
         }
 
+        ClockEstimate est = clockEstimate();
+        if (est.valid) {
+            std::cout << "[Quality] RTT=" << est.rttMs << "ms (min " << est.minRttMs
+                      << "ms) clock offset=" << est.offsetMs << "ms" << std::endl;
+        }
+        if (intervalLatencySamples_ > 0) {
+            std::cout << "[Quality] Capture-to-decode latency avg=" << intervalLatencyUs_ / intervalLatencySamples_ / 1000.0
+                      << "ms max=" << intervalLatencyMaxUs_ / 1000.0
+                      << "ms (encode avg=" << intervalEncodeUs_ / intervalLatencySamples_ / 1000.0
+                      << "ms), missing frames=" << intervalFramesMissing_.load() << std::endl;
+        }
+
         // 重置区间统计（保持不变）
         intervalFramesDecoded_ = 0;
         intervalFramesDropped_ = 0;
         intervalDecodeTimeMs_ = 0;
+        intervalFramesMissing_ = 0;
+        intervalLatencyUs_ = 0;
+        intervalLatencyMaxUs_ = 0;
+        intervalEncodeUs_ = 0;
+        intervalLatencySamples_ = 0;
         lastStatsTime_ = now;
     }
 }
 
+// 解码线程：采集时刻按时钟偏差换算到本地，得到采集到解码完成的端到端时延
+void DesktopWindow::recordFrameLatency(const Desktop::VideoFrameInfo& info) {
+    ClockEstimate est = clockEstimate();
+    if (!est.valid) return;
+    int64_t captureLocalUs = info.captureUs - static_cast<int64_t>(est.offsetMs * 1000.0);
+    int64_t latencyUs = ClockSyncing::NowUs() - captureLocalUs;
+    if (latencyUs < 0) return;
+    intervalLatencyUs_ += static_cast<uint64_t>(latencyUs);
+    intervalLatencyMaxUs_ = std::max<uint64_t>(intervalLatencyMaxUs_, static_cast<uint64_t>(latencyUs));
+    intervalEncodeUs_ += static_cast<uint64_t>(std::max<int64_t>(0, info.encodeEndUs - info.encodeStartUs));
+    intervalLatencySamples_++;
+}
+
+ClockEstimate DesktopWindow::clockEstimate() const {
+    ClockEstimate est;
+    if (transport_) transport_->clockEstimate(est);
+    return est;
+}
+
 // --- 新增：冷却完成时发送配置 ---
 void DesktopWindow::onResizeCooldown() {
     if (transport_ && transport_->isConnected() && pendingResizeWidth_ > 0) {
@@ -637,6 +905,17 @@ void DesktopWindow::paintEvent(QPaintEvent* event) {
     // 4. 绘制到屏幕
     painter.drawImage(x, y, scaledImg);
 
+    // 5. 不在操作时画出服务端的指针，按原始大小绘制，热点对准缩放后的位置；
+    // 操作权限或鼠标开关可能刚变过，顺便检查一次
+    if (!updateLocalCursor()) {
+        std::lock_guard<std::mutex> lock(cursorMtx_);
+        auto it = cursorShapes_.find(cursorShapeId_);
+        if (hasCursorShape_ && cursorVisible_ && it != cursorShapes_.end()) {
+            int cx = x + static_cast<int>(int64_t(cursorPos_.x()) * scaledImg.width() / imageToDraw.width());
+            int cy = y + static_cast<int>(int64_t(cursorPos_.y()) * scaledImg.height() / imageToDraw.height());
+            painter.drawImage(cx - it->second.hotX, cy - it->second.hotY, it->second.image);
+        }
+    }
 
 }
 
@@ -6,13 +6,17 @@
 #include <thread>
 #include <mutex>
 #include <queue>
+#include <deque>
+#include <map>
 #include <condition_variable>
 #include <atomic>
 #include <chrono>
 #include <QTimer>
+#include <QStringList>
 
 #include "../common/transport.h"
 #include "../common/protocol.h"
+#include "../common/input_batch.h"
 #include "media_decoder.h"
 #include "audio_decoder.h"
 #include "audio_player.h"
@@ -28,24 +32,37 @@ public:
 
     void init(ITransport* transport, InputControlState* inputState);
     void requestStream();
-    void handleMessage(const BinaryData& data);
+    // 重连后优先凭令牌续连，保留解码器和流配置；没有令牌时等同 requestStream()
+    void resumeStream();
+    void handleMessage(const BufferRef& data);
+    // index 为服务端显示器列表的下标，-1 拼接全部显示器
+    void selectMonitor(int index);
 
     QSize displayedImageSize();
+    // 传输层测得的 RTT 与时钟偏差，尚无样本时 valid 为 false
+    ClockEstimate clockEstimate() const;
 
 signals:
     void frameReady();
     void closed();
+    void inputPermissionChanged(bool allowed);
+    void resumeFailed();
+    // 服务端的显示器列表（声明了 CAP_MONITORS 才会收到），selected 为 -1 表示拼接
+    void monitorsChanged(const QStringList& names, int selected);
+    void cursorChanged();
 
 private slots:
     void updateDisplay();
     void onResizeCooldown();
+    void onInputPermissionChanged(bool allowed);
+    void applyCursor();
 
 private:
     std::thread decodeThread_;
     std::atomic<bool> decoding_{false};
     std::mutex queueMtx_;
     std::condition_variable queueCV_;
-    std::queue<BinaryData> videoQueue_;
+    std::queue<BufferRef> videoQueue_;
 
     MediaDecoder decoder_;
     bool decoderReady_ = false;
@@ -57,12 +74,43 @@ private:
     int screenHeight_ = 0;
     ITransport* transport_ = nullptr;
     InputControlState* inputState_ = nullptr;
+    std::atomic<bool> inputAllowed_{true};   // 多人观看时服务端只允许一人操作
+    // 合并鼠标移动、按服务器能力打包输入；Qt 线程写入，事件循环里定时发送
+    std::shared_ptr<InputBatcher> inputBatcher_ = std::make_shared<InputBatcher>();
+
+    // 帧序号连续性，由网络回调线程维护；发起新的请求时清零
+    std::atomic<bool> haveVideoSeq_{false};
+    uint32_t nextVideoSeq_ = 0;
+    bool awaitingKeyframe_ = false;
+
+    // 服务端单独发来的指针（声明了 CAP_CURSOR 才会收到）。本地在操作时直接换成窗口的鼠标指针，
+    // 跟手移动；只看不操作时按服务端的位置画在画面上
+    struct CursorImage {
+        QImage image;
+        int hotX = 0;
+        int hotY = 0;
+    };
+    std::mutex cursorMtx_;
+    std::map<uint32_t, CursorImage> cursorShapes_;
+    std::deque<uint32_t> cursorOrder_;      // 先进先出，与服务端的淘汰顺序一致
+    bool hasCursorShape_ = false;
+    uint32_t cursorShapeId_ = 0;
+    bool cursorVisible_ = false;
+    QPoint cursorPos_;                      // 热点在编码图像上的坐标
+    // 以下只在 UI 线程访问：已经设置到窗口上的指针
+    bool cursorApplied_ = false;
+    uint32_t appliedShapeId_ = 0;
+    bool appliedVisible_ = false;
+
+    std::mutex tokenMtx_;
+    bool hasSessionToken_ = false;
+    Desktop::SessionTokenBytes sessionToken_{};
 
     std::thread audioDecodeThread_;
     std::atomic<bool> audioDecoding_{false};
     std::mutex audioQueueMtx_;
     std::condition_variable audioQueueCV_;
-    std::queue<BinaryData> audioQueue_;
+    std::queue<BufferRef> audioQueue_;
     AudioDecoder audioDecoder_;
     AudioPlayer audioPlayer_;
     bool audioReady_ = false;
@@ -82,6 +130,11 @@ private:
     uint64_t intervalFramesDecoded_ = 0;
     uint64_t intervalFramesDropped_ = 0;
     uint64_t intervalDecodeTimeMs_ = 0;
+    std::atomic<uint64_t> intervalFramesMissing_{0};   // 网络线程按帧序号统计
+    uint64_t intervalLatencyUs_ = 0;
+    uint64_t intervalLatencyMaxUs_ = 0;
+    uint64_t intervalEncodeUs_ = 0;
+    uint64_t intervalLatencySamples_ = 0;
     std::chrono::steady_clock::time_point lastStatsTime_;
     std::chrono::steady_clock::time_point lastFpsChangeTime_;
     std::chrono::steady_clock::time_point frameReadyTime_;
@@ -96,8 +149,15 @@ private:
     void logStatistics();
     void decodeLoop();
     void audioDecodeLoop();
-    void handleScreenInfo(const BinaryData& data);
-    void handleAudioConfig(const BinaryData& data);
+    void sendHello();
+    void trackVideoSeq(const Desktop::VideoFrameView& view);
+    void recordFrameLatency(const Desktop::VideoFrameInfo& info);
+    void handleScreenInfo(const BufferRef& data);
+    void handleAudioConfig(const BufferRef& data);
+    void handleCursorShape(const BufferRef& data);
+    bool localCursorMode() const;
+    // 按当前模式设置或撤掉窗口的鼠标指针，返回是否由窗口指针代替了画面上的指针
+    bool updateLocalCursor();
     void sendInput(const Desktop::InputEvent& ev);
     bool convertToImageCoords(int wx, int wy, int& ix, int& iy);
 
@@ -1,5 +1,6 @@
 
 #include "media_decoder.h"
+#include "pooled_media_buffer.h"
 #define NOMINMAX
 #include <iostream>
 #include <algorithm>
@@ -199,13 +200,9 @@ bool MediaDecoder::decode(const uint8_t* data, int size, std::vector<uint8_t>& b
 
     if (!initialized_ || size < 4) return false;
 
-    IMFSample* sample = nullptr;
-    HRESULT hr = MFCreateSample(&sample);
-    if (FAILED(hr)) return false;
-
     IMFMediaBuffer* buf = nullptr;
-    hr = MFCreateMemoryBuffer((DWORD)size, &buf);
-    if (FAILED(hr)) { sample->Release(); return false; }
+    HRESULT hr = MFCreateMemoryBuffer((DWORD)size, &buf);
+    if (FAILED(hr)) return false;
 
     BYTE* dataPtr = nullptr;
     hr = buf->Lock(&dataPtr, nullptr, nullptr);
@@ -215,8 +212,31 @@ bool MediaDecoder::decode(const uint8_t* data, int size, std::vector<uint8_t>& b
         buf->SetCurrentLength((DWORD)size);
     }
 
-    sample->AddBuffer(buf);
+    bool ok = decodeBuffer(buf, bgraOut);
+    buf->Release();
+    return ok;
+}
+
+bool MediaDecoder::decode(const BufferRef& msg, size_t offset, std::vector<uint8_t>& bgraOut) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    bgraOut.clear();
+
+    if (!initialized_ || msg.size() < offset + 4) return false;
+
+    IMFMediaBuffer* buf = nullptr;
+    if (FAILED(PooledMediaBuffer::Create(msg, offset, msg.size() - offset, &buf))) return false;
+
+    bool ok = decodeBuffer(buf, bgraOut);
     buf->Release();
+    return ok;
+}
+
+bool MediaDecoder::decodeBuffer(IMFMediaBuffer* buf, std::vector<uint8_t>& bgraOut) {
+    IMFSample* sample = nullptr;
+    HRESULT hr = MFCreateSample(&sample);
+    if (FAILED(hr)) return false;
+
+    sample->AddBuffer(buf);
     sample->SetSampleTime(0);
 
     hr = decoder_->ProcessInput(0, sample, 0);
@@ -5,8 +5,10 @@
 #include <vector>
 #include <mutex>
 #include <cstdint>
+#include "../common/buffer_pool.h"
 
 struct IMFTransform;
+struct IMFMediaBuffer;
 struct IMFMediaType;
 struct IMFSample;
 
@@ -18,6 +20,8 @@ public:
     bool init(int width, int height);
     void cleanup();
     bool decode(const uint8_t* data, int size, std::vector<uint8_t>& bgraOut);
+    // 零拷贝：直接把池化消息 [offset, end) 交给解码器
+    bool decode(const BufferRef& msg, size_t offset, std::vector<uint8_t>& bgraOut);
 
     int getWidth() const { return width_; }
     int getHeight() const { return height_; }
@@ -25,6 +29,7 @@ public:
 
 private:
     bool initDecoder();
+    bool decodeBuffer(IMFMediaBuffer* buf, std::vector<uint8_t>& bgraOut);
     bool processOutput(std::vector<uint8_t>& bgraOut);
     static void nv12ToBgra(const uint8_t* nv12, uint8_t* bgra, int w, int h, int strideY, int strideUV, int alignedH);
 
@@ -0,0 +1,71 @@
+#include "pooled_media_buffer.h"
+#include <new>
+
+PooledMediaBuffer::PooledMediaBuffer(const BufferRef& ref, size_t offset, size_t length)
+    : ref_(ref) {
+    data_ = ref_.data() + offset;
+    maxLength_ = static_cast<DWORD>(length);
+    curLength_ = maxLength_;
+}
+
+HRESULT PooledMediaBuffer::Create(const BufferRef& ref, size_t offset, size_t length, IMFMediaBuffer** out) {
+    if (!out) return E_POINTER;
+    *out = nullptr;
+    if (!ref || offset + length > ref.size()) return E_INVALIDARG;
+
+    auto* buf = new (std::nothrow) PooledMediaBuffer(ref, offset, length);
+    if (!buf) return E_OUTOFMEMORY;
+    *out = buf;
+    return S_OK;
+}
+
+STDMETHODIMP PooledMediaBuffer::QueryInterface(REFIID riid, void** ppv) {
+    if (!ppv) return E_POINTER;
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(IMFMediaBuffer)) {
+        *ppv = static_cast<IMFMediaBuffer*>(this);
+        AddRef();
+        return S_OK;
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+}
+
+STDMETHODIMP_(ULONG) PooledMediaBuffer::AddRef() {
+    return ++refCount_;
+}
+
+STDMETHODIMP_(ULONG) PooledMediaBuffer::Release() {
+    ULONG count = --refCount_;
+    if (count == 0) delete this;
+    return count;
+}
+
+STDMETHODIMP PooledMediaBuffer::Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) {
+    if (!ppbBuffer) return E_POINTER;
+    *ppbBuffer = data_;
+    if (pcbMaxLength) *pcbMaxLength = maxLength_;
+    if (pcbCurrentLength) *pcbCurrentLength = curLength_;
+    return S_OK;
+}
+
+STDMETHODIMP PooledMediaBuffer::Unlock() {
+    return S_OK;
+}
+
+STDMETHODIMP PooledMediaBuffer::GetCurrentLength(DWORD* pcbCurrentLength) {
+    if (!pcbCurrentLength) return E_POINTER;
+    *pcbCurrentLength = curLength_;
+    return S_OK;
+}
+
+STDMETHODIMP PooledMediaBuffer::SetCurrentLength(DWORD cbCurrentLength) {
+    if (cbCurrentLength > maxLength_) return E_INVALIDARG;
+    curLength_ = cbCurrentLength;
+    return S_OK;
+}
+
+STDMETHODIMP PooledMediaBuffer::GetMaxLength(DWORD* pcbMaxLength) {
+    if (!pcbMaxLength) return E_POINTER;
+    *pcbMaxLength = maxLength_;
+    return S_OK;
+}
@@ -0,0 +1,36 @@
+#ifndef POOLED_MEDIA_BUFFER_H
+#define POOLED_MEDIA_BUFFER_H
+
+#include <mfobjects.h>
+#include <atomic>
+#include "../common/buffer_pool.h"
+
+// ==================== 池化缓冲的 IMFMediaBuffer 包装 ====================
+// 把 BufferRef 中的一段直接交给 MFT，不再拷贝到 MFCreateMemoryBuffer。
+// 包装对象持有一个引用，MFT 释放样本之前池化缓冲不会被回收。
+class PooledMediaBuffer : public IMFMediaBuffer {
+public:
+    static HRESULT Create(const BufferRef& ref, size_t offset, size_t length, IMFMediaBuffer** out);
+
+    STDMETHODIMP QueryInterface(REFIID riid, void** ppv) override;
+    STDMETHODIMP_(ULONG) AddRef() override;
+    STDMETHODIMP_(ULONG) Release() override;
+
+    STDMETHODIMP Lock(BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength) override;
+    STDMETHODIMP Unlock() override;
+    STDMETHODIMP GetCurrentLength(DWORD* pcbCurrentLength) override;
+    STDMETHODIMP SetCurrentLength(DWORD cbCurrentLength) override;
+    STDMETHODIMP GetMaxLength(DWORD* pcbMaxLength) override;
+
+private:
+    PooledMediaBuffer(const BufferRef& ref, size_t offset, size_t length);
+    ~PooledMediaBuffer() = default;
+
+    std::atomic<ULONG> refCount_{1};
+    BufferRef ref_;
+    BYTE* data_ = nullptr;
+    DWORD maxLength_ = 0;
+    DWORD curLength_ = 0;
+};
+
+#endif // POOLED_MEDIA_BUFFER_H
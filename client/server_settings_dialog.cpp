@@ -9,6 +9,7 @@
 #include <QApplication>
 #include <QPointer>
 #include <thread>
+#include <algorithm>
 #include <windows.h>
 #include <winsvc.h>
 
@@ -125,6 +126,10 @@ void ServerSettingsDialog::createUI() {
 
     leDesktopPort_ = new QLineEdit("12345");
     desktopForm->addRow("Desktop Port:", leDesktopPort_);
+    leMaxViewers_ = new QLineEdit("1");
+    desktopForm->addRow("Max Viewers:", leMaxViewers_);
+    chkUdp_ = new QCheckBox("Use UDP (for lossy networks, single viewer)");
+    desktopForm->addRow("", chkUdp_);
     main->addWidget(desktopGroup);
 
     main->addStretch();
@@ -267,6 +272,8 @@ ServerSettings ServerSettingsDialog::getSettings() const {
     ServerSettings s;
     s.useEasyTier = chkEasyTier_->isChecked();
     s.desktopPort = leDesktopPort_->text().toInt();
+    s.maxViewers = std::max(1, leMaxViewers_->text().toInt());
+    s.desktopTransport = chkUdp_->isChecked() ? TransportMode::UDP : TransportMode::TCP;
     s.sshPort = leSshPort_->text().toInt();
     s.sshPassword = leSshPassword_->text().toStdString();
     return s;
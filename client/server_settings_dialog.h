@@ -10,10 +10,13 @@
 #include <atomic>
 #include <string>
 #include "../common/easytier_control.h"
+#include "../common/transport.h"
 
 struct ServerSettings {
     bool useEasyTier = false;
     int desktopPort = 12345;
+    int maxViewers = 1;      // 同时观看的客户端数，只有第一个可以操作
+    TransportMode desktopTransport = TransportMode::TCP;   // UDP 模式只支持一个观看者
     int sshPort = 2222;
     std::string sshPassword;
 };
@@ -48,6 +51,8 @@ private:
     QLineEdit* leSshPassword_;
 
     QLineEdit* leDesktopPort_;
+    QLineEdit* leMaxViewers_;
+    QCheckBox* chkUdp_;
     QTimer* refreshTimer_;
     std::atomic<bool> refreshBusy_{false};
 };
@@ -0,0 +1,246 @@
+#include "bandwidth_estimator.h"
+#include "clock_sync.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace BandwidthEstimation;
+
+// ==================== 接收端反馈记录 ====================
+void VideoFeedbackRecorder::reset() {
+    nextIndex_ = 0;
+    firstPending_ = 0;
+    pending_.clear();
+    lastFeedbackUs_ = 0;
+}
+
+BinaryData VideoFeedbackRecorder::onFrameArrived(int64_t arrivalUs) {
+    if (pending_.empty()) firstPending_ = nextIndex_;
+    pending_.push_back(arrivalUs);
+    nextIndex_++;
+
+    bool due = arrivalUs - lastFeedbackUs_ >= FEEDBACK_INTERVAL_MS * 1000LL;
+    if (!due && pending_.size() < MAX_FEEDBACK_FRAMES) return {};
+
+    BinaryData msg = MessageBuilder::VideoFeedback(firstPending_, pending_.data(),
+                                                   static_cast<uint16_t>(pending_.size()));
+    pending_.clear();
+    lastFeedbackUs_ = arrivalUs;
+    return msg;
+}
+
+// ==================== 基于时延的带宽估计 ====================
+BandwidthEstimator::BandwidthEstimator(int startBitrate)
+    : target_(std::clamp(startBitrate, MIN_BITRATE, MAX_BITRATE)) {}
+
+void BandwidthEstimator::onFrameSent(int64_t sendUs, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    sent_.push_back({ nextSentIndex_++, sendUs, bytes });
+    if (sent_.size() > MAX_SENT_RECORDS) sent_.pop_front();
+}
+
+void BandwidthEstimator::onFeedback(const uint8_t* data, size_t size, double rttMs) {
+    if (size < 1 + sizeof(Desktop::VideoFeedbackHeader)) return;
+    Desktop::VideoFeedbackHeader hdr;
+    memcpy(&hdr, data + 1, sizeof(hdr));
+    if (size < 1 + sizeof(hdr) + hdr.count * sizeof(int64_t)) return;
+    const uint8_t* times = data + 1 + sizeof(hdr);
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (rttMs > 0) rttMs_ = rttMs;
+
+    bool matched = false;
+    for (uint16_t i = 0; i < hdr.count; i++) {
+        uint32_t index = hdr.firstIndex + i;
+        // 反馈按序到达，更早的发送记录不会再被用到
+        while (!sent_.empty() && static_cast<int32_t>(sent_.front().index - index) < 0) sent_.pop_front();
+        if (sent_.empty() || sent_.front().index != index) continue;
+
+        int64_t arrivalUs;
+        memcpy(&arrivalUs, times + i * sizeof(int64_t), sizeof(arrivalUs));
+        onFrameArrivedLocked(sent_.front(), arrivalUs);
+        lastAckedIndex_ = index;
+        sent_.pop_front();
+        matched = true;
+    }
+    if (!matched) return;
+
+    updateRateLocked(ClockSyncing::NowUs() / 1000.0);
+    valid_ = true;
+}
+
+void BandwidthEstimator::onFrameArrivedLocked(const SentFrame& frame, int64_t arrivalUs) {
+    arrivals_.emplace_back(arrivalUs, frame.bytes);
+    while (!arrivals_.empty() && arrivalUs - arrivals_.front().first > INCOMING_WINDOW_MS * 1000LL) {
+        arrivals_.pop_front();
+    }
+    owds_.emplace_back(arrivalUs, arrivalUs - frame.sendUs);
+    while (!owds_.empty() && arrivalUs - owds_.front().first > BASE_DELAY_WINDOW_MS * 1000LL) {
+        owds_.pop_front();
+    }
+
+    if (!havePrev_) {
+        havePrev_ = true;
+        firstArrivalUs_ = arrivalUs;
+        prevSendUs_ = frame.sendUs;
+        prevArrivalUs_ = arrivalUs;
+        return;
+    }
+
+    // 相邻两帧的时延变化：正值说明这一帧在路上多排了队
+    double deltaMs = ((arrivalUs - prevArrivalUs_) - (frame.sendUs - prevSendUs_)) / 1000.0;
+    prevSendUs_ = frame.sendUs;
+    prevArrivalUs_ = arrivalUs;
+
+    double arrivalMs = (arrivalUs - firstArrivalUs_) / 1000.0;
+    accumulatedDelayMs_ += deltaMs;
+    smoothedDelayMs_ = TRENDLINE_SMOOTHING * smoothedDelayMs_ + (1 - TRENDLINE_SMOOTHING) * accumulatedDelayMs_;
+    numDeltas_++;
+
+    window_.emplace_back(arrivalMs, smoothedDelayMs_);
+    if (window_.size() > TRENDLINE_WINDOW) window_.pop_front();
+
+    double trend = prevTrend_;
+    if (window_.size() >= TRENDLINE_MIN_POINTS) {
+        // 最小二乘求斜率：排队时延随时间增长的速度
+        double sumX = 0, sumY = 0;
+        for (auto& p : window_) { sumX += p.first; sumY += p.second; }
+        double avgX = sumX / window_.size(), avgY = sumY / window_.size();
+        double num = 0, den = 0;
+        for (auto& p : window_) {
+            num += (p.first - avgX) * (p.second - avgY);
+            den += (p.first - avgX) * (p.first - avgX);
+        }
+        if (den > 0) trend = num / den;
+    }
+
+    usage_ = detectLocked(trend, arrivalMs);
+    prevTrend_ = trend;
+}
+
+BandwidthEstimator::Usage BandwidthEstimator::detectLocked(double trend, double arrivalMs) {
+    if (numDeltas_ < 2) return Usage::Normal;
+
+    double modified = std::min<double>(numDeltas_, 60) * trend * TRENDLINE_GAIN;
+    Usage usage = usage_;
+    if (modified > thresholdMs_) {
+        if (overuseStartMs_ < 0) overuseStartMs_ = arrivalMs;
+        // 持续超过门限且仍在上升才算过载
+        if (arrivalMs - overuseStartMs_ >= OVERUSE_TIME_MS && trend >= prevTrend_) {
+            usage = Usage::Over;
+        }
+    } else if (modified < -thresholdMs_) {
+        overuseStartMs_ = -1;
+        usage = Usage::Under;
+    } else {
+        overuseStartMs_ = -1;
+        usage = Usage::Normal;
+    }
+
+    updateThresholdLocked(modified, arrivalMs);
+    return usage;
+}
+
+void BandwidthEstimator::updateThresholdLocked(double modifiedTrend, double arrivalMs) {
+    if (lastThresholdUpdateMs_ < 0) lastThresholdUpdateMs_ = arrivalMs;
+
+    double absTrend = std::fabs(modifiedTrend);
+    // 突发的大尖峰不参与门限调整，否则门限会被一次抖动抬高
+    if (absTrend > thresholdMs_ + 15) {
+        lastThresholdUpdateMs_ = arrivalMs;
+        return;
+    }
+
+    double k = absTrend < thresholdMs_ ? THRESHOLD_DOWN_GAIN : THRESHOLD_UP_GAIN;
+    double dt = std::min(arrivalMs - lastThresholdUpdateMs_, 100.0);
+    thresholdMs_ += k * (absTrend - thresholdMs_) * dt;
+    thresholdMs_ = std::clamp(thresholdMs_, 6.0, 600.0);
+    lastThresholdUpdateMs_ = arrivalMs;
+}
+
+void BandwidthEstimator::updateRateLocked(double nowMs) {
+    if (lastUpdateMs_ < 0) lastUpdateMs_ = nowMs;
+    double dt = std::min(nowMs - lastUpdateMs_, 1000.0) / 1000.0;
+    lastUpdateMs_ = nowMs;
+
+    if (usage_ == Usage::Over) {
+        decreaseLocked(nowMs, "delay increasing");
+        return;
+    }
+    // 瓶颈队列正在排空或仍有明显积压，保持当前速率等它排完
+    if (usage_ == Usage::Under || queueDelayMsLocked() > QUEUE_HOLD_MS) return;
+
+    double incoming = incomingBpsLocked();
+    // 到达速率明显超过上次拥塞点，说明链路变好了，重新按乘性增长探测
+    if (lastCongestionBps_ > 0 && incoming > lastCongestionBps_ * 1.25) lastCongestionBps_ = 0;
+
+    double target = target_;
+    double increase;
+    if (lastCongestionBps_ > 0 && target > lastCongestionBps_ * 0.75) {
+        // 接近上次拥塞点：每个 RTT 只加半帧
+        double avgFrameBits = 0;
+        if (!arrivals_.empty()) {
+            for (auto& a : arrivals_) avgFrameBits += a.second * 8.0;
+            avgFrameBits /= arrivals_.size();
+        }
+        increase = std::max(1000.0, avgFrameBits * 0.5 * dt * 1000.0 / std::max(rttMs_, 100.0));
+    } else {
+        increase = target * (std::pow(1 + MULTIPLICATIVE_GROWTH, dt) - 1);
+    }
+
+    double next = target + increase;
+    if (incoming > 0) next = std::min(next, std::max(target, incoming * MAX_RATE_OVER_INCOMING + 10000));
+    target_ = static_cast<int>(std::clamp<double>(next, MIN_BITRATE, MAX_BITRATE));
+}
+
+void BandwidthEstimator::decreaseLocked(double nowMs, const char* reason) {
+    // 降速要等上一次降速的效果反映到反馈里：至少一个 RTT，且降速后发出的帧已被确认
+    if (lastDecreaseMs_ >= 0 && nowMs - lastDecreaseMs_ < std::max(rttMs_, 200.0)) return;
+    if (decreaseGuarded_ && static_cast<int32_t>(lastAckedIndex_ - decreaseGuardIndex_) < 0) return;
+    lastDecreaseMs_ = nowMs;
+    decreaseGuarded_ = true;
+    decreaseGuardIndex_ = nextSentIndex_;
+
+    int before = target_;
+    double incoming = incomingBpsLocked();
+    double base = incoming > 0 ? std::min<double>(incoming, before) : before;
+    // 已经积压了较长的队列时多降一些，让它在一秒左右排空，而不是以 15% 的余量慢慢排
+    double queueMs = queueDelayMsLocked();
+    double factor = DECREASE_FACTOR;
+    if (queueMs > QUEUE_HOLD_MS) factor = std::min(factor, 1.0 - std::min(MAX_DRAIN_FRACTION, queueMs / 1000.0));
+    int after = static_cast<int>(std::clamp<double>(base * factor, MIN_BITRATE, MAX_BITRATE));
+    if (incoming > 0) lastCongestionBps_ = incoming;
+    target_ = after;
+
+    std::cout << "[BWE] Overuse (" << reason << "): " << before / 1000 << " -> " << after / 1000
+              << " kbps, incoming " << static_cast<int>(incoming / 1000) << " kbps, queue "
+              << static_cast<int>(queueMs) << " ms" << std::endl;
+}
+
+void BandwidthEstimator::onSenderDrop() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    decreaseLocked(ClockSyncing::NowUs() / 1000.0, "send queue overflow");
+}
+
+double BandwidthEstimator::incomingBpsLocked() const {
+    if (arrivals_.size() < 2) return 0;
+    double spanMs = (arrivals_.back().first - arrivals_.front().first) / 1000.0;
+    // 窗口太短时速率没有意义
+    if (spanMs < 200) return 0;
+    size_t bytes = 0;
+    // 第一帧的到达时刻是窗口起点，它的字节不计入
+    for (size_t i = 1; i < arrivals_.size(); i++) bytes += arrivals_[i].second;
+    return bytes * 8.0 * 1000.0 / spanMs;
+}
+
+double BandwidthEstimator::queueDelayMsLocked() const {
+    if (owds_.empty()) return 0;
+    int64_t minOwd = owds_.front().second;
+    for (auto& o : owds_) minOwd = std::min(minOwd, o.second);
+    return (owds_.back().second - minOwd) / 1000.0;
+}
+
+double BandwidthEstimator::incomingBitrate() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return incomingBpsLocked();
+}
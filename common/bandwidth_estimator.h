@@ -0,0 +1,140 @@
+#ifndef BANDWIDTH_ESTIMATOR_H
+#define BANDWIDTH_ESTIMATOR_H
+
+#include "protocol.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace BandwidthEstimation {
+    constexpr int MIN_BITRATE = 300000;
+    constexpr int MAX_BITRATE = 100000000;
+
+    // 接收端每隔这么久（或攒够这么多帧）回报一次到达时刻
+    constexpr int FEEDBACK_INTERVAL_MS = 100;
+    constexpr size_t MAX_FEEDBACK_FRAMES = 32;
+    // 发送端最多保留这么多帧的发送记录等待配对
+    constexpr size_t MAX_SENT_RECORDS = 256;
+
+    // 趋势线滤波：对累计时延做指数平滑后在窗口内做线性回归
+    constexpr size_t TRENDLINE_WINDOW = 20;
+    constexpr size_t TRENDLINE_MIN_POINTS = 8;      // 启动阶段窗口未满时也尽早给出斜率
+    constexpr double TRENDLINE_SMOOTHING = 0.9;
+    constexpr double TRENDLINE_GAIN = 4.0;
+    // 自适应门限（毫秒）及其上调/下调系数
+    constexpr double INITIAL_THRESHOLD_MS = 12.5;
+    constexpr double THRESHOLD_UP_GAIN = 0.0087;
+    constexpr double THRESHOLD_DOWN_GAIN = 0.039;
+    // 持续超过门限这么久才判定过载，避免单帧抖动触发降速
+    constexpr double OVERUSE_TIME_MS = 10.0;
+
+    // 过载时降到实际到达速率的这个比例
+    constexpr double DECREASE_FACTOR = 0.85;
+    // 远离上次拥塞点时每秒乘性增长的比例
+    constexpr double MULTIPLICATIVE_GROWTH = 0.08;
+    // 上调不超过实际到达速率的这个倍数：应用受限时估计不会无限上漂
+    constexpr double MAX_RATE_OVER_INCOMING = 1.5;
+    constexpr int INCOMING_WINDOW_MS = 1000;
+
+    // 排队时延 = 单向时延 - 窗口内最小单向时延（两端时钟偏差在相减时抵消）
+    constexpr int BASE_DELAY_WINDOW_MS = 10000;
+    // 积压超过这么多时不再上调，降速时额外减掉约一秒内排空积压所需的速率
+    constexpr double QUEUE_HOLD_MS = 100.0;
+    constexpr double MAX_DRAIN_FRACTION = 0.5;
+}
+
+// ==================== 接收端反馈记录 ====================
+// 传输层按顺序为每个完整收到的视频帧计数，记下到达时刻（本端单调时钟），
+// 攒够一批后打包成 VideoFeedback 发回。帧序号与发送端逐帧对应，
+// 因此只适用于可靠有序的传输。只在收包线程里调用。
+class VideoFeedbackRecorder {
+public:
+    void reset();
+    // 每收到一个视频帧调用；返回需要发给对端的反馈，不需要发送时为空
+    BinaryData onFrameArrived(int64_t arrivalUs);
+
+private:
+    uint32_t nextIndex_ = 0;
+    uint32_t firstPending_ = 0;
+    std::vector<int64_t> pending_;
+    int64_t lastFeedbackUs_ = 0;
+};
+
+// ==================== 基于时延的带宽估计 ====================
+// GCC 式的发送端估计：把相邻两帧的 到达间隔 - 发送间隔 累加成排队时延，
+// 用趋势线斜率判断瓶颈队列是在增长（过载）、排空（欠载）还是平稳，
+// 再用 AIMD 调整目标码率：过载时降到实际到达速率的 85%，平稳时
+// 远离上次拥塞点乘性增长、接近时加性增长。发送队列因拥塞丢帧也按过载处理。
+// 收到第一份反馈之前 targetBitrate() 返回 0，表示没有估计（对端不支持反馈）。
+// 各入口由内部锁串行化：发送记录和反馈在事件循环线程，丢帧通知可能来自采集线程。
+class BandwidthEstimator {
+public:
+    explicit BandwidthEstimator(int startBitrate = Config::VIDEO_BITRATE);
+
+    // 第 n 次调用对应对端收到的第 n 个视频帧
+    void onFrameSent(int64_t sendUs, size_t bytes);
+    void onFeedback(const uint8_t* data, size_t size, double rttMs);
+    void onSenderDrop();
+
+    // 任意线程调用
+    int targetBitrate() const { return valid_ ? target_.load() : 0; }
+    double incomingBitrate() const;
+
+private:
+    enum class Usage { Normal, Over, Under };
+
+    struct SentFrame {
+        uint32_t index;
+        int64_t sendUs;
+        size_t bytes;
+    };
+
+    void onFrameArrivedLocked(const SentFrame& frame, int64_t arrivalUs);
+    Usage detectLocked(double trend, double arrivalMs);
+    void updateThresholdLocked(double modifiedTrend, double arrivalMs);
+    void updateRateLocked(double nowMs);
+    void decreaseLocked(double nowMs, const char* reason);
+    double incomingBpsLocked() const;
+    double queueDelayMsLocked() const;
+
+    mutable std::mutex mtx_;
+    std::deque<SentFrame> sent_;
+    uint32_t nextSentIndex_ = 0;
+
+    // 上一帧
+    bool havePrev_ = false;
+    int64_t prevSendUs_ = 0;
+    int64_t prevArrivalUs_ = 0;
+    int64_t firstArrivalUs_ = 0;
+
+    // 趋势线
+    double accumulatedDelayMs_ = 0;
+    double smoothedDelayMs_ = 0;
+    size_t numDeltas_ = 0;
+    std::deque<std::pair<double, double>> window_;   // (到达时刻 ms, 平滑时延 ms)
+
+    // 过载检测
+    double thresholdMs_ = BandwidthEstimation::INITIAL_THRESHOLD_MS;
+    double lastThresholdUpdateMs_ = -1;
+    double overuseStartMs_ = -1;
+    double prevTrend_ = 0;
+    Usage usage_ = Usage::Normal;
+
+    // 速率控制
+    std::atomic<int> target_;
+    std::atomic<bool> valid_{false};
+    double lastUpdateMs_ = -1;
+    double lastDecreaseMs_ = -1;
+    // 降速后，要等降速之后发出的帧被确认，才允许因同一段排队再次降速；
+    // 否则反馈里还在排队的旧帧会让码率被连续砍到底
+    bool decreaseGuarded_ = false;
+    uint32_t decreaseGuardIndex_ = 0;
+    uint32_t lastAckedIndex_ = 0;
+    double lastCongestionBps_ = 0;      // 上次过载时的到达速率，0 表示未知
+    double rttMs_ = 100;
+    std::deque<std::pair<int64_t, size_t>> arrivals_;   // 最近一秒的 (到达时刻, 字节数)
+    std::deque<std::pair<int64_t, int64_t>> owds_;      // 最近十秒的 (到达时刻, 到达 - 发送)
+};
+
+#endif // BANDWIDTH_ESTIMATOR_H
@@ -0,0 +1,118 @@
+#include "buffer_pool.h"
+#include <cstring>
+
+// ==================== PooledBuffer ====================
+PooledBuffer::PooledBuffer(size_t capacity, int sizeClass)
+    : storage_(new uint8_t[capacity]), capacity_(capacity), sizeClass_(sizeClass) {}
+
+// ==================== BufferRef ====================
+BufferRef::BufferRef(PooledBuffer* buf) : buf_(buf) {
+    if (buf_) buf_->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferRef::BufferRef(const BufferRef& other) : buf_(other.buf_) {
+    if (buf_) buf_->refs_.fetch_add(1, std::memory_order_relaxed);
+}
+
+BufferRef::BufferRef(BufferRef&& other) noexcept : buf_(other.buf_) {
+    other.buf_ = nullptr;
+}
+
+BufferRef& BufferRef::operator=(const BufferRef& other) {
+    if (this != &other) {
+        BufferRef tmp(other);
+        std::swap(buf_, tmp.buf_);
+    }
+    return *this;
+}
+
+BufferRef& BufferRef::operator=(BufferRef&& other) noexcept {
+    if (this != &other) {
+        reset();
+        buf_ = other.buf_;
+        other.buf_ = nullptr;
+    }
+    return *this;
+}
+
+BufferRef::~BufferRef() {
+    reset();
+}
+
+void BufferRef::reset() {
+    if (!buf_) return;
+    if (buf_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        BufferPool::shared().release(buf_);
+    }
+    buf_ = nullptr;
+}
+
+// ==================== BufferPool ====================
+BufferPool& BufferPool::shared() {
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::~BufferPool() {
+    for (auto& list : free_) {
+        for (auto* buf : list) delete buf;
+        list.clear();
+    }
+}
+
+int BufferPool::sizeClassFor(size_t size) {
+    size_t classSize = MIN_CLASS_SIZE;
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        if (size <= classSize) return i;
+        classSize <<= 1;
+    }
+    return -1;
+}
+
+size_t BufferPool::maxFreeFor(int sizeClass) {
+    // 小缓冲（音频、控制消息）多留一些，大缓冲（关键帧）只留几个
+    size_t classSize = MIN_CLASS_SIZE << sizeClass;
+    if (classSize <= 64 * 1024) return 32;
+    if (classSize <= 1024 * 1024) return 8;
+    return 2;
+}
+
+BufferRef BufferPool::acquire(size_t size) {
+    int sizeClass = sizeClassFor(size);
+    PooledBuffer* buf = nullptr;
+
+    if (sizeClass >= 0) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto& list = free_[sizeClass];
+        if (!list.empty()) {
+            buf = list.back();
+            list.pop_back();
+        }
+    }
+
+    if (!buf) {
+        size_t capacity = sizeClass >= 0 ? (MIN_CLASS_SIZE << sizeClass) : size;
+        buf = new PooledBuffer(capacity, sizeClass);
+    }
+
+    buf->size_ = size;
+    return BufferRef(buf);
+}
+
+BufferRef BufferPool::copyOf(const uint8_t* data, size_t size) {
+    BufferRef ref = acquire(size);
+    if (size > 0) memcpy(ref.data(), data, size);
+    return ref;
+}
+
+void BufferPool::release(PooledBuffer* buf) {
+    if (buf->sizeClass_ >= 0) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto& list = free_[buf->sizeClass_];
+        if (list.size() < maxFreeFor(buf->sizeClass_)) {
+            list.push_back(buf);
+            return;
+        }
+    }
+    delete buf;
+}
@@ -0,0 +1,90 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class BufferPool;
+
+// ==================== 池化缓冲 ====================
+// 由 BufferPool 分配和回收，只能通过 BufferRef 访问
+class PooledBuffer {
+public:
+    uint8_t* data() { return storage_.get(); }
+    const uint8_t* data() const { return storage_.get(); }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    friend class BufferPool;
+    friend class BufferRef;
+
+    PooledBuffer(size_t capacity, int sizeClass);
+
+    std::unique_ptr<uint8_t[]> storage_;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    int sizeClass_ = -1;
+    std::atomic<int> refs_{0};
+};
+
+// ==================== 引用计数句柄 ====================
+// 拷贝只增加引用计数，最后一个句柄释放时缓冲归还到池中
+class BufferRef {
+public:
+    BufferRef() = default;
+    BufferRef(const BufferRef& other);
+    BufferRef(BufferRef&& other) noexcept;
+    BufferRef& operator=(const BufferRef& other);
+    BufferRef& operator=(BufferRef&& other) noexcept;
+    ~BufferRef();
+
+    uint8_t* data() { return buf_ ? buf_->data() : nullptr; }
+    const uint8_t* data() const { return buf_ ? buf_->data() : nullptr; }
+    size_t size() const { return buf_ ? buf_->size() : 0; }
+    bool empty() const { return size() == 0; }
+    uint8_t operator[](size_t i) const { return buf_->data()[i]; }
+    explicit operator bool() const { return buf_ != nullptr; }
+
+    void reset();
+
+private:
+    friend class BufferPool;
+    explicit BufferRef(PooledBuffer* buf);
+
+    PooledBuffer* buf_ = nullptr;
+};
+
+// ==================== 缓冲池 ====================
+// 按 2 的幂分级，每级保留少量空闲缓冲，稳态下收包不再触发堆分配
+class BufferPool {
+public:
+    static BufferPool& shared();
+
+    BufferRef acquire(size_t size);
+    BufferRef copyOf(const uint8_t* data, size_t size);
+
+private:
+    friend class BufferRef;
+
+    BufferPool() = default;
+    ~BufferPool();
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    void release(PooledBuffer* buf);
+    static int sizeClassFor(size_t size);
+    static size_t maxFreeFor(int sizeClass);
+
+    static constexpr size_t MIN_CLASS_SIZE = 4 * 1024;
+    static constexpr int NUM_CLASSES = 15;    // 4KB .. 64MB
+
+    std::mutex mtx_;
+    std::vector<PooledBuffer*> free_[NUM_CLASSES];
+};
+
+#endif // BUFFER_POOL_H
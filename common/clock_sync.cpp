@@ -0,0 +1,93 @@
+#include "clock_sync.h"
+#include <algorithm>
+
+int64_t ClockSyncing::NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+BinaryData ClockSyncing::MakePong(const uint8_t* ping, size_t size, int64_t recvUs) {
+    if (size < 1 + sizeof(Desktop::PingMsg)) return {};
+    Desktop::PingMsg p;
+    memcpy(&p, ping + 1, sizeof(p));
+    return MessageBuilder::Pong(p, recvUs, NowUs());
+}
+
+void ClockSync::start(SendFn send) {
+    std::weak_ptr<ClockSync> weak = shared_from_this();
+    uint32_t generation = 0;
+    loop_.runSync([this, &send, &generation]() {
+        send_ = std::move(send);
+        running_ = true;
+        generation = ++generation_;
+    });
+    loop_.post([weak, generation]() {
+        if (auto self = weak.lock()) self->tick(generation);
+    });
+}
+
+void ClockSync::stop() {
+    // 在循环线程里清掉发送函数，返回后不会再经由它发送
+    loop_.runSync([this]() {
+        running_ = false;
+        send_ = nullptr;
+    });
+}
+
+void ClockSync::tick(uint32_t generation) {
+    if (!running_ || generation != generation_) return;
+    if (send_) send_(MessageBuilder::Ping(nextSeq_++, ClockSyncing::NowUs()));
+
+    std::weak_ptr<ClockSync> weak = shared_from_this();
+    loop_.runAfter(std::chrono::milliseconds(ClockSyncing::PING_INTERVAL_MS), [weak, generation]() {
+        if (auto self = weak.lock()) self->tick(generation);
+    });
+}
+
+bool ClockSync::intercept(const uint8_t* data, size_t size, const SendFn& reply) {
+    if (size == 0) return false;
+    switch (static_cast<Desktop::MsgType>(data[0])) {
+        case Desktop::MsgType::Ping: {
+            BinaryData pong = ClockSyncing::MakePong(data, size, ClockSyncing::NowUs());
+            if (!pong.empty() && reply) reply(pong);
+            return true;
+        }
+        case Desktop::MsgType::Pong:
+            onPong(data, size);
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ClockSync::onPong(const uint8_t* data, size_t size) {
+    int64_t t4 = ClockSyncing::NowUs();
+    if (size < 1 + sizeof(Desktop::PongMsg)) return false;
+    Desktop::PongMsg pong;
+    memcpy(&pong, data + 1, sizeof(pong));
+
+    int64_t t1 = pong.pingSendUs, t2 = pong.recvUs, t3 = pong.sendUs;
+    if (t1 > t4 || t3 < t2) return false;
+
+    double rttMs = ((t4 - t1) - (t3 - t2)) / 1000.0;
+    double offsetMs = ((t2 - t1) + (t3 - t4)) / 2000.0;
+    if (rttMs < 0) rttMs = 0;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    samples_.push_back({ rttMs, offsetMs });
+    if (samples_.size() > ClockSyncing::SAMPLE_WINDOW) samples_.pop_front();
+
+    auto best = std::min_element(samples_.begin(), samples_.end(),
+                                 [](const Sample& a, const Sample& b) { return a.rttMs < b.rttMs; });
+    estimate_.minRttMs = best->rttMs;
+    estimate_.offsetMs = best->offsetMs;
+    estimate_.rttMs = estimate_.valid ? estimate_.rttMs * 7 / 8 + rttMs / 8 : rttMs;
+    estimate_.valid = true;
+    estimate_.samples++;
+    return true;
+}
+
+ClockEstimate ClockSync::estimate() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return estimate_;
+}
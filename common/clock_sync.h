@@ -0,0 +1,71 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include "protocol.h"
+#include "event_loop.h"
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// ==================== 往返时延与时钟偏差 ====================
+struct ClockEstimate {
+    bool valid = false;
+    double rttMs = 0;           // 平滑后的 RTT（已扣除对端处理时间）
+    double minRttMs = 0;        // 最近窗口内的最小 RTT
+    // 对端单调时钟 - 本端单调时钟（毫秒），对端时间戳减去它即换算到本端
+    double offsetMs = 0;
+    uint64_t samples = 0;
+};
+
+namespace ClockSyncing {
+    constexpr int PING_INTERVAL_MS = 1000;
+    // 偏差取窗口内 RTT 最小的样本：排队最少的样本往返最对称，估计最准
+    constexpr size_t SAMPLE_WINDOW = 8;
+
+    // 两端共同使用的单调时钟，微秒
+    int64_t NowUs();
+
+    // 对收到的 Ping 生成 Pong；recvUs 为收到 Ping 的时刻
+    BinaryData MakePong(const uint8_t* ping, size_t size, int64_t recvUs);
+}
+
+// NTP 式测量：本端发 Ping[t1]，对端回 Pong[t1, t2 收到, t3 发出]，本端在 t4 收到，
+//   RTT    = (t4 - t1) - (t3 - t2)
+//   offset = ((t2 - t1) + (t3 - t4)) / 2
+// start() 后在事件循环里每秒发一次 Ping；stop() 返回后不再调用发送函数。
+class ClockSync : public std::enable_shared_from_this<ClockSync> {
+public:
+    using SendFn = std::function<bool(const BinaryData&)>;
+
+    explicit ClockSync(EventLoop& loop = EventLoop::shared()) : loop_(loop) {}
+
+    void start(SendFn send);
+    void stop();
+
+    // 传输层收到每条消息时先交给它：Ping 立即经 reply 回 Pong，Pong 计入估计。
+    // 返回 true 表示消息已处理，不再交给上层
+    bool intercept(const uint8_t* data, size_t size, const SendFn& reply);
+    bool onPong(const uint8_t* data, size_t size);
+    ClockEstimate estimate() const;
+
+private:
+    struct Sample {
+        double rttMs;
+        double offsetMs;
+    };
+
+    void tick(uint32_t generation);
+
+    EventLoop& loop_;
+    SendFn send_;                   // 只在循环线程里访问
+    bool running_ = false;
+    uint32_t generation_ = 0;       // 每次 start() 递增，旧的定时链自行结束
+    uint32_t nextSeq_ = 0;
+
+    mutable std::mutex mtx_;
+    std::deque<Sample> samples_;
+    ClockEstimate estimate_;
+};
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,137 @@
+#include "connection_racer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace ConnectionRacing;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+    // 竞速线程与 race() 共享；race() 返回后输掉的线程仍持有它直到自己结束
+    struct RaceState {
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool decided = false;
+        std::vector<ConnectionRacer::Attempt> attempts;
+        std::vector<std::unique_ptr<ITransport>> transports;
+    };
+
+    double ElapsedMs(Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+}
+
+bool ConnectionRacer::race(Result& out) {
+    if (candidates_.empty()) return false;
+
+    auto state = std::make_shared<RaceState>();
+    state->attempts.resize(candidates_.size());
+    state->transports.resize(candidates_.size());
+    for (size_t i = 0; i < candidates_.size(); i++) state->attempts[i].name = candidates_[i].name;
+
+    auto launch = [&](size_t i) {
+        state->attempts[i].started = true;
+        std::cout << "[Race] Trying " << candidates_[i].name << std::endl;
+        Candidate c = candidates_[i];
+        std::thread([state, i, c]() {
+            auto t0 = Clock::now();
+            std::unique_ptr<ITransport> transport = c.create();
+            bool ok = transport && c.connect(*transport);
+            double ms = ElapsedMs(t0);
+
+            std::unique_lock<std::mutex> lock(state->mtx);
+            auto& a = state->attempts[i];
+            a.finished = true;
+            a.succeeded = ok;
+            a.handshakeMs = ms;
+            if (ok && !state->decided) {
+                state->transports[i] = std::move(transport);
+            }
+            state->cv.notify_all();
+            lock.unlock();
+
+            // 已经分出胜负的晚到者自己断开
+            if (transport) transport->disconnect();
+        }).detach();
+    };
+
+    auto raceStart = Clock::now();
+    auto deadline = raceStart + RACE_TIMEOUT;
+    size_t next = 0;
+    auto nextStart = raceStart;
+    bool settling = false;
+    auto settleDeadline = deadline;
+
+    std::unique_lock<std::mutex> lock(state->mtx);
+    for (;;) {
+        auto now = Clock::now();
+        if (now >= deadline) break;
+
+        size_t running = 0;
+        const Attempt* fastest = nullptr;
+        for (auto& a : state->attempts) {
+            if (a.started && !a.finished) running++;
+            if (a.succeeded && (!fastest || a.handshakeMs < fastest->handshakeMs)) fastest = &a;
+        }
+
+        if (fastest && !settling) {
+            // 已在握手的路径如果 RTT 更短，会在这段时间内完成
+            settling = true;
+            auto wait = std::min<std::chrono::milliseconds>(MAX_SETTLE,
+                std::chrono::milliseconds(static_cast<int64_t>(fastest->handshakeMs)));
+            settleDeadline = now + wait;
+        }
+        if (settling && (running == 0 || now >= settleDeadline)) break;
+        if (!fastest && next == candidates_.size() && running == 0) break;   // 全部失败
+
+        // 还没有路径成功时按错开时间启动下一个；全部在跑的都失败了就不再等
+        if (!settling && next < candidates_.size() && (now >= nextStart || running == 0)) {
+            launch(next++);
+            nextStart = now + STAGGER;
+            continue;
+        }
+
+        auto wakeAt = settling ? settleDeadline : deadline;
+        if (!settling && next < candidates_.size()) wakeAt = std::min(wakeAt, nextStart);
+        state->cv.wait_until(lock, wakeAt);
+    }
+    state->decided = true;
+
+    size_t winner = candidates_.size();
+    for (size_t i = 0; i < state->attempts.size(); i++) {
+        auto& a = state->attempts[i];
+        if (!a.succeeded || !state->transports[i]) continue;
+        if (winner == candidates_.size() || a.handshakeMs < state->attempts[winner].handshakeMs) winner = i;
+    }
+
+    std::vector<std::unique_ptr<ITransport>> losers;
+    for (size_t i = 0; i < state->transports.size(); i++) {
+        if (i != winner && state->transports[i]) losers.push_back(std::move(state->transports[i]));
+    }
+    if (winner < candidates_.size()) out.transport = std::move(state->transports[winner]);
+    out.attempts = state->attempts;
+    lock.unlock();
+
+    for (auto& t : losers) t->disconnect();
+
+    for (auto& a : out.attempts) {
+        if (!a.started) continue;
+        std::cout << "[Race]   " << a.name << ": ";
+        if (a.succeeded) std::cout << "connected in " << a.handshakeMs << "ms";
+        else if (a.finished) std::cout << "failed after " << a.handshakeMs << "ms";
+        else std::cout << "still pending";
+        std::cout << std::endl;
+    }
+
+    if (winner == candidates_.size()) {
+        std::cerr << "[Race] No path connected within " << ElapsedMs(raceStart) << "ms" << std::endl;
+        return false;
+    }
+    out.candidate = candidates_[winner];
+    out.handshakeMs = out.attempts[winner].handshakeMs;
+    std::cout << "[Race] Using " << out.candidate.name << " (handshake " << out.handshakeMs
+              << "ms, decided after " << ElapsedMs(raceStart) << "ms)" << std::endl;
+    return true;
+}
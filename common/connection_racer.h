@@ -0,0 +1,59 @@
+#ifndef CONNECTION_RACER_H
+#define CONNECTION_RACER_H
+
+#include "transport.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ConnectionRacing {
+    // 相邻两次尝试的错开时间（RFC 8305 建议 250ms）；前一个失败则立即开始下一个
+    constexpr std::chrono::milliseconds STAGGER{250};
+    // 第一条路径连上后再等一会，让已经在握手的其他路径比一比 RTT，最多等这么久
+    constexpr std::chrono::milliseconds MAX_SETTLE{300};
+    constexpr std::chrono::milliseconds RACE_TIMEOUT{15000};
+}
+
+// ==================== 连接竞速 ====================
+// Happy Eyeballs：按优先级错开启动各条候选路径（直连 TCP、EasyTier 虚拟 IP、
+// UDP、P2P、中继……），各自在独立线程里阻塞握手，记录握手耗时，
+// 留下耗时最短的那条，其余的断开丢弃。输掉的尝试在后台自行收尾，race() 不等它们。
+class ConnectionRacer {
+public:
+    struct Candidate {
+        std::string name;           // 日志和界面显示，如 "TCP 10.144.0.1:12345"
+        std::string host;           // 连接成功后其他服务（SSH 直连兜底）使用的地址
+        TransportMode mode = TransportMode::TCP;
+        std::function<std::unique_ptr<ITransport>()> create;
+        // 阻塞直到握手成功或失败，在竞速线程里调用
+        std::function<bool(ITransport&)> connect;
+    };
+
+    struct Attempt {
+        std::string name;
+        bool started = false;
+        bool finished = false;
+        bool succeeded = false;
+        double handshakeMs = 0;     // 从本次尝试开始到握手完成
+    };
+
+    struct Result {
+        std::unique_ptr<ITransport> transport;
+        Candidate candidate;
+        double handshakeMs = 0;
+        std::vector<Attempt> attempts;
+    };
+
+    void add(Candidate candidate) { candidates_.push_back(std::move(candidate)); }
+    bool empty() const { return candidates_.empty(); }
+
+    // 阻塞直到选出路径或全部失败/超时
+    bool race(Result& out);
+
+private:
+    std::vector<Candidate> candidates_;
+};
+
+#endif // CONNECTION_RACER_H
@@ -0,0 +1,219 @@
+#include "datagram_link.h"
+#include <iostream>
+#include <mutex>
+#include <random>
+
+// ==================== UDP 套接字链路 ====================
+UdpSocketLink::UdpSocketLink(EventLoop& loop) : loop_(loop), recvBuf_(64 * 1024) {}
+
+UdpSocketLink::~UdpSocketLink() {
+    close();
+}
+
+bool UdpSocketLink::createSocket() {
+    sock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock_ == INVALID_SOCKET) {
+        std::cerr << "[UDP] socket() failed: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+    NetCompat::SetNoInherit(sock_);
+
+    // 关键帧会瞬间产生上千个包，内核缓冲要够大
+    int bufSize = 4 * 1024 * 1024;
+    setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, (char*)&bufSize, sizeof(bufSize));
+    setsockopt(sock_, SOL_SOCKET, SO_SNDBUF, (char*)&bufSize, sizeof(bufSize));
+    return true;
+}
+
+bool UdpSocketLink::bind(int port) {
+    if (!createSocket()) return false;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (::bind(sock_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "[UDP] bind() port " << port << " failed: " << WSAGetLastError() << std::endl;
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return false;
+    }
+    return true;
+}
+
+bool UdpSocketLink::connect(const std::string& ip, int port) {
+    if (!createSocket()) return false;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+        std::cerr << "[UDP] Invalid IP: " << ip << std::endl;
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return false;
+    }
+    if (::connect(sock_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "[UDP] connect() failed: " << WSAGetLastError() << std::endl;
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return false;
+    }
+    peer_ = addr;
+    connected_ = true;
+    return true;
+}
+
+bool UdpSocketLink::open(ReceiveFn onReceive) {
+    if (sock_ == INVALID_SOCKET) return false;
+    onReceive_ = std::move(onReceive);
+    NetCompat::SetNonBlocking(sock_, true);
+    loop_.add(sock_, EventLoop::EV_READ, [this](uint32_t) { onReadable(); });
+    return true;
+}
+
+void UdpSocketLink::close() {
+    if (sock_ == INVALID_SOCKET) return;
+    SOCKET s = sock_;
+    loop_.runSync([this, s]() { loop_.remove(s); });
+    closesocket(sock_);
+    sock_ = INVALID_SOCKET;
+}
+
+void UdpSocketLink::onReadable() {
+    for (int i = 0; i < 256 && sock_ != INVALID_SOCKET; i++) {
+        sockaddr_in from = {};
+        socklen_t fromLen = sizeof(from);
+        int n = recvfrom(sock_, (char*)recvBuf_.data(), (int)recvBuf_.size(), 0,
+                         (sockaddr*)&from, &fromLen);
+        if (n < 0) {
+            // Windows 上 ICMP 端口不可达会让下一次 recvfrom 报错，跳过继续读
+            if (NetCompat::WouldBlock(WSAGetLastError())) return;
+            continue;
+        }
+        if (!connected_) {
+            if (peerLocked_ && (from.sin_addr.s_addr != peer_.sin_addr.s_addr ||
+                                from.sin_port != peer_.sin_port)) {
+                continue;
+            }
+            lastFrom_ = from;
+        }
+        if (onReceive_) onReceive_(recvBuf_.data(), static_cast<size_t>(n));
+    }
+}
+
+bool UdpSocketLink::send(const uint8_t* data, size_t size) {
+    if (sock_ == INVALID_SOCKET) return false;
+    int r;
+    if (connected_) {
+        r = ::send(sock_, (const char*)data, (int)size, NetCompat::SEND_FLAGS);
+    } else {
+        if (!peerLocked_) return false;
+        r = sendto(sock_, (const char*)data, (int)size, NetCompat::SEND_FLAGS,
+                   (sockaddr*)&peer_, sizeof(peer_));
+    }
+    // 发送缓冲满时直接丢弃，由上层的 FEC / 重传兜底
+    return r == static_cast<int>(size);
+}
+
+void UdpSocketLink::lockPeer() {
+    if (connected_) return;
+    peer_ = lastFrom_;
+    peerLocked_ = true;
+}
+
+void UdpSocketLink::releasePeer() {
+    if (connected_) return;
+    peerLocked_ = false;
+}
+
+// ==================== 进程内有损回环 ====================
+namespace {
+
+struct LoopbackEnd {
+    std::mutex mtx;
+    IDatagramLink::ReceiveFn onReceive;
+    bool open = false;
+};
+
+struct LoopbackWire {
+    LossyLoopback::Params params;
+    std::mutex mtx;
+    std::mt19937 rng;
+    std::uniform_real_distribution<double> unit{0.0, 1.0};
+};
+
+class LoopbackLink : public IDatagramLink {
+public:
+    LoopbackLink(EventLoop& loop, std::shared_ptr<LoopbackWire> wire,
+                 std::shared_ptr<LoopbackEnd> self, std::shared_ptr<LoopbackEnd> peer)
+        : loop_(loop), wire_(std::move(wire)), self_(std::move(self)), peer_(std::move(peer)) {}
+
+    ~LoopbackLink() override { close(); }
+
+    bool open(ReceiveFn onReceive) override {
+        std::lock_guard<std::mutex> lock(self_->mtx);
+        self_->onReceive = std::move(onReceive);
+        self_->open = true;
+        return true;
+    }
+
+    void close() override {
+        // 等循环线程里正在进行的投递结束，之后不会再回调
+        loop_.runSync([this]() {
+            std::lock_guard<std::mutex> lock(self_->mtx);
+            self_->open = false;
+            self_->onReceive = nullptr;
+        });
+    }
+
+    bool send(const uint8_t* data, size_t size) override {
+        int delayMs = wire_->params.delayMs;
+        {
+            std::lock_guard<std::mutex> lock(wire_->mtx);
+            if (wire_->unit(wire_->rng) < wire_->params.lossRate) return true;   // 模拟丢包
+            if (wire_->params.jitterMs > 0) {
+                delayMs += static_cast<int>(wire_->unit(wire_->rng) * wire_->params.jitterMs);
+            }
+        }
+
+        auto packet = std::make_shared<std::vector<uint8_t>>(data, data + size);
+        std::shared_ptr<LoopbackEnd> peer = peer_;
+        auto deliver = [peer, packet]() {
+            // 拷贝一份再回调：接收方可能在回调里关闭自己
+            ReceiveFn fn;
+            {
+                std::lock_guard<std::mutex> lock(peer->mtx);
+                if (!peer->open) return;
+                fn = peer->onReceive;
+            }
+            if (fn) fn(packet->data(), packet->size());
+        };
+        if (delayMs > 0) loop_.runAfter(std::chrono::milliseconds(delayMs), deliver);
+        else loop_.post(deliver);
+        return true;
+    }
+
+    EventLoop& loop() override { return loop_; }
+
+private:
+    EventLoop& loop_;
+    std::shared_ptr<LoopbackWire> wire_;
+    std::shared_ptr<LoopbackEnd> self_;
+    std::shared_ptr<LoopbackEnd> peer_;
+};
+
+} // namespace
+
+LossyLoopback::LinkPair LossyLoopback::CreatePair(const Params& params, EventLoop& loop) {
+    auto wire = std::make_shared<LoopbackWire>();
+    wire->params = params;
+    wire->rng.seed(params.seed);
+
+    auto a = std::make_shared<LoopbackEnd>();
+    auto b = std::make_shared<LoopbackEnd>();
+    return {
+        std::unique_ptr<IDatagramLink>(new LoopbackLink(loop, wire, a, b)),
+        std::unique_ptr<IDatagramLink>(new LoopbackLink(loop, wire, b, a))
+    };
+}
@@ -0,0 +1,81 @@
+#ifndef DATAGRAM_LINK_H
+#define DATAGRAM_LINK_H
+
+#include "net_compat.h"
+#include "event_loop.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ==================== 数据报链路 ====================
+// UDP 会话下面的一层：只负责把整包发给对端、把收到的包交上来。
+// 实际网络用 UdpSocketLink，测试用进程内的 LossyLoopback。
+// 接收回调都在 loop() 的线程里执行。
+class IDatagramLink {
+public:
+    using ReceiveFn = std::function<void(const uint8_t* data, size_t size)>;
+
+    virtual ~IDatagramLink() = default;
+
+    virtual bool open(ReceiveFn onReceive) = 0;
+    virtual void close() = 0;
+    virtual bool send(const uint8_t* data, size_t size) = 0;
+
+    // 服务端：把最近一个包的来源锁定为对端，之后忽略其他地址；release 解除锁定
+    virtual void lockPeer() {}
+    virtual void releasePeer() {}
+
+    virtual EventLoop& loop() = 0;
+};
+
+// ==================== UDP 套接字链路 ====================
+class UdpSocketLink : public IDatagramLink {
+public:
+    explicit UdpSocketLink(EventLoop& loop = EventLoop::shared());
+    ~UdpSocketLink();
+
+    // 二选一：服务端绑定端口等待对端，客户端绑定临时端口并指定对端
+    bool bind(int port);
+    bool connect(const std::string& ip, int port);
+
+    bool open(ReceiveFn onReceive) override;
+    void close() override;
+    bool send(const uint8_t* data, size_t size) override;
+    void lockPeer() override;
+    void releasePeer() override;
+    EventLoop& loop() override { return loop_; }
+
+private:
+    bool createSocket();
+    void onReadable();
+
+    EventLoop& loop_;
+    SOCKET sock_ = INVALID_SOCKET;
+    ReceiveFn onReceive_;
+    bool connected_ = false;        // 客户端：套接字已 connect，直接 send
+    bool peerLocked_ = false;       // 服务端：只接受 peer_ 的包
+    sockaddr_in peer_ = {};
+    sockaddr_in lastFrom_ = {};
+    std::vector<uint8_t> recvBuf_;
+};
+
+// ==================== 进程内有损回环 ====================
+// 两端在同一个事件循环里互发，按参数随机丢包并加延迟/抖动，用于在本机
+// 复现弱网下的 FEC、NACK 和可靠子流行为
+class LossyLoopback {
+public:
+    struct Params {
+        double lossRate = 0.0;      // 0..1，每个包独立丢弃的概率
+        int delayMs = 0;            // 单向固定延迟
+        int jitterMs = 0;           // 额外随机延迟上限
+        uint32_t seed = 1;          // 随机数种子，便于复现
+    };
+
+    using LinkPair = std::pair<std::unique_ptr<IDatagramLink>, std::unique_ptr<IDatagramLink>>;
+    static LinkPair CreatePair(const Params& params, EventLoop& loop = EventLoop::shared());
+};
+
+#endif // DATAGRAM_LINK_H
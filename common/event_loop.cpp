@@ -0,0 +1,352 @@
+#include "event_loop.h"
+#include <condition_variable>
+#include <iostream>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+EventLoop& EventLoop::shared() {
+    // 故意不析构：静态对象的销毁顺序不可控，循环线程随进程一起退出
+    static EventLoop* loop = [] {
+        auto* l = new EventLoop();
+        l->start();
+        return l;
+    }();
+    return *loop;
+}
+
+EventLoop::EventLoop() {}
+
+EventLoop::~EventLoop() {
+    stop();
+}
+
+bool EventLoop::start() {
+    if (running_) return true;
+    if (!backendInit()) {
+        std::cerr << "[EventLoop] Backend init failed: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+
+    wakeSock_ = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (wakeSock_ == INVALID_SOCKET ||
+        bind(wakeSock_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        getsockname(wakeSock_, (sockaddr*)&addr, &len) == SOCKET_ERROR ||
+        connect(wakeSock_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "[EventLoop] Wakeup socket setup failed: " << WSAGetLastError() << std::endl;
+        if (wakeSock_ != INVALID_SOCKET) closesocket(wakeSock_);
+        wakeSock_ = INVALID_SOCKET;
+        backendClose();
+        return false;
+    }
+    NetCompat::SetNonBlocking(wakeSock_, true);
+    NetCompat::SetNoInherit(wakeSock_);
+    addNow(wakeSock_, EV_READ, [this](uint32_t) { drainWakeup(); });
+
+    running_ = true;
+    thread_ = std::thread(&EventLoop::loop, this);
+    return true;
+}
+
+void EventLoop::stop() {
+    if (!running_.exchange(false)) return;
+    wakeup();
+    if (thread_.joinable()) {
+        if (inLoopThread()) thread_.detach();
+        else thread_.join();
+    }
+
+    for (auto& kv : watches_) kv.second->active = false;
+    watches_.clear();
+    if (wakeSock_ != INVALID_SOCKET) {
+        closesocket(wakeSock_);
+        wakeSock_ = INVALID_SOCKET;
+    }
+    backendClose();
+
+    std::lock_guard<std::mutex> lock(taskMtx_);
+    tasks_.clear();
+    while (!timers_.empty()) timers_.pop();
+}
+
+bool EventLoop::inLoopThread() const {
+    return loopThreadId_.load() == std::this_thread::get_id();
+}
+
+void EventLoop::loop() {
+    loopThreadId_ = std::this_thread::get_id();
+    std::vector<std::pair<SOCKET, uint32_t>> ready;
+
+    while (running_) {
+        ready.clear();
+        backendWait(nextTimeoutMs(), ready);
+
+        for (auto& r : ready) {
+            auto it = watches_.find(r.first);
+            if (it == watches_.end()) continue;
+            // 持有引用：处理函数里可能 remove 自己
+            std::shared_ptr<Watch> w = it->second;
+            if (w->active) w->handler(r.second);
+        }
+
+        runTimers();
+        runTasks();
+    }
+}
+
+// ==================== 任务与定时器 ====================
+void EventLoop::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(taskMtx_);
+        tasks_.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+void EventLoop::runAfter(std::chrono::milliseconds delay, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(taskMtx_);
+        timers_.push({ Clock::now() + delay, timerSeq_++, std::move(task) });
+    }
+    wakeup();
+}
+
+void EventLoop::runInLoop(Task task) {
+    if (inLoopThread()) task();
+    else post(std::move(task));
+}
+
+void EventLoop::runSync(Task task) {
+    // 循环未运行时没有并发访问者，直接执行
+    if (inLoopThread() || !running_) {
+        task();
+        return;
+    }
+
+    // 循环可能在等待期间停止，调用方先返回时任务不能再碰调用方的栈，状态放在共享对象里。
+    // claimed 保证任务只执行一次：循环没来得及执行就由调用方自己执行
+    struct SyncState {
+        Task task;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::atomic<bool> claimed{false};
+        bool done = false;
+    };
+    auto state = std::make_shared<SyncState>();
+    state->task = std::move(task);
+    post([state]() {
+        if (state->claimed.exchange(true)) return;
+        state->task();
+        std::lock_guard<std::mutex> lock(state->mtx);
+        state->done = true;
+        state->cv.notify_all();
+    });
+
+    std::unique_lock<std::mutex> lock(state->mtx);
+    while (!state->done && running_) {
+        state->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+    if (state->done) return;
+    if (!state->claimed.exchange(true)) {
+        // 循环已停止，任务不会再被执行
+        lock.unlock();
+        state->task();
+        return;
+    }
+    // 循环线程正在执行它，等它做完
+    state->cv.wait(lock, [&]() { return state->done; });
+}
+
+void EventLoop::runTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(taskMtx_);
+        tasks.swap(tasks_);
+    }
+    for (auto& t : tasks) t();
+}
+
+void EventLoop::runTimers() {
+    auto now = Clock::now();
+    for (;;) {
+        Task task;
+        {
+            std::lock_guard<std::mutex> lock(taskMtx_);
+            if (timers_.empty() || timers_.top().when > now) break;
+            task = std::move(const_cast<Timer&>(timers_.top()).task);
+            timers_.pop();
+        }
+        task();
+    }
+}
+
+int EventLoop::nextTimeoutMs() {
+    // 上限 1 秒：即使漏了唤醒也能及时看到 running_ 变化
+    std::lock_guard<std::mutex> lock(taskMtx_);
+    if (!tasks_.empty()) return 0;
+    if (timers_.empty()) return 1000;
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        timers_.top().when - Clock::now()).count();
+    if (wait < 0) return 0;
+    return wait > 1000 ? 1000 : static_cast<int>(wait);
+}
+
+void EventLoop::wakeup() {
+    if (wakePending_.exchange(true)) return;
+    char b = 0;
+    send(wakeSock_, &b, 1, NetCompat::SEND_FLAGS);
+}
+
+void EventLoop::drainWakeup() {
+    // 先清标志再读空：期间新投递的任务会重新发唤醒字节
+    wakePending_ = false;
+    char buf[64];
+    while (recv(wakeSock_, buf, sizeof(buf), 0) > 0) {}
+}
+
+// ==================== 注册 ====================
+void EventLoop::add(SOCKET sock, uint32_t events, IoHandler handler) {
+    runInLoop([this, sock, events, handler = std::move(handler)]() mutable {
+        addNow(sock, events, std::move(handler));
+    });
+}
+
+void EventLoop::modify(SOCKET sock, uint32_t events) {
+    runInLoop([this, sock, events]() { modifyNow(sock, events); });
+}
+
+void EventLoop::remove(SOCKET sock) {
+    runInLoop([this, sock]() { removeNow(sock); });
+}
+
+void EventLoop::addNow(SOCKET sock, uint32_t events, IoHandler handler) {
+    removeNow(sock);
+    auto w = std::make_shared<Watch>();
+    w->sock = sock;
+    w->events = events;
+    w->handler = std::move(handler);
+    watches_[sock] = w;
+    backendAdd(*w);
+}
+
+void EventLoop::modifyNow(SOCKET sock, uint32_t events) {
+    auto it = watches_.find(sock);
+    if (it == watches_.end() || it->second->events == events) return;
+    it->second->events = events;
+    backendModify(*it->second);
+}
+
+void EventLoop::removeNow(SOCKET sock) {
+    auto it = watches_.find(sock);
+    if (it == watches_.end()) return;
+    it->second->active = false;
+    backendRemove(*it->second);
+    watches_.erase(it);
+}
+
+// ==================== 后端 ====================
+#if defined(__linux__)
+
+static uint32_t ToEpollEvents(uint32_t events) {
+    uint32_t e = 0;
+    if (events & EventLoop::EV_READ) e |= EPOLLIN;
+    if (events & EventLoop::EV_WRITE) e |= EPOLLOUT;
+    return e;
+}
+
+bool EventLoop::backendInit() {
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    return epollFd_ >= 0;
+}
+
+void EventLoop::backendClose() {
+    if (epollFd_ >= 0) {
+        ::close(epollFd_);
+        epollFd_ = -1;
+    }
+}
+
+void EventLoop::backendAdd(Watch& w) {
+    epoll_event ev = {};
+    ev.events = ToEpollEvents(w.events);
+    ev.data.fd = w.sock;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, w.sock, &ev);
+}
+
+void EventLoop::backendModify(Watch& w) {
+    epoll_event ev = {};
+    ev.events = ToEpollEvents(w.events);
+    ev.data.fd = w.sock;
+    epoll_ctl(epollFd_, EPOLL_CTL_MOD, w.sock, &ev);
+}
+
+void EventLoop::backendRemove(Watch& w) {
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, w.sock, nullptr);
+}
+
+void EventLoop::backendWait(int timeoutMs, std::vector<std::pair<SOCKET, uint32_t>>& ready) {
+    epoll_event events[256];
+    int n = epoll_wait(epollFd_, events, 256, timeoutMs);
+    for (int i = 0; i < n; i++) {
+        uint32_t flags = 0;
+        if (events[i].events & EPOLLIN) flags |= EV_READ;
+        if (events[i].events & EPOLLOUT) flags |= EV_WRITE;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) flags |= EV_ERROR | EV_READ;
+        SOCKET fd = events[i].data.fd;
+        ready.emplace_back(fd, flags);
+    }
+}
+
+#else   // WSAPoll / poll
+
+bool EventLoop::backendInit() {
+    pollDirty_ = true;
+    return true;
+}
+
+void EventLoop::backendClose() {
+    pollFds_.clear();
+}
+
+void EventLoop::backendAdd(Watch&) { pollDirty_ = true; }
+void EventLoop::backendModify(Watch&) { pollDirty_ = true; }
+void EventLoop::backendRemove(Watch&) { pollDirty_ = true; }
+
+void EventLoop::backendWait(int timeoutMs, std::vector<std::pair<SOCKET, uint32_t>>& ready) {
+    if (pollDirty_) {
+        pollFds_.clear();
+        pollFds_.reserve(watches_.size());
+        for (auto& kv : watches_) {
+            decltype(pollFds_)::value_type p = {};
+            p.fd = kv.first;
+            if (kv.second->events & EV_READ) p.events |= POLLIN;
+            if (kv.second->events & EV_WRITE) p.events |= POLLOUT;
+            pollFds_.push_back(p);
+        }
+        pollDirty_ = false;
+    }
+
+#ifdef _WIN32
+    int n = WSAPoll(pollFds_.data(), static_cast<ULONG>(pollFds_.size()), timeoutMs);
+#else
+    int n = ::poll(pollFds_.data(), pollFds_.size(), timeoutMs);
+#endif
+    if (n <= 0) return;
+
+    for (auto& p : pollFds_) {
+        if (p.revents == 0) continue;
+        uint32_t flags = 0;
+        if (p.revents & POLLIN) flags |= EV_READ;
+        if (p.revents & POLLOUT) flags |= EV_WRITE;
+        if (p.revents & (POLLERR | POLLHUP | POLLNVAL)) flags |= EV_ERROR | EV_READ;
+        ready.emplace_back(p.fd, flags);
+    }
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "net_compat.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#endif
+
+// ==================== 事件循环 ====================
+// 单线程就绪通知循环：所有套接字的读写回调和投递的任务都在循环线程里执行，
+// 连接数增加不会增加线程。后端按平台选择：Linux 用 epoll，
+// Windows 用 WSAPoll，其他 POSIX 系统用 poll。
+class EventLoop {
+public:
+    enum : uint32_t {
+        EV_READ  = 0x01,
+        EV_WRITE = 0x02,
+        EV_ERROR = 0x04    // 出错或挂断，处理函数随后读到 0 / 错误
+    };
+    using IoHandler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+
+    // 进程内共享的循环，首次使用时启动，进程退出前一直运行
+    static EventLoop& shared();
+
+    EventLoop();
+    ~EventLoop();
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    bool start();
+    void stop();
+
+    // 以下均可在任意线程调用，实际操作在循环线程里执行。
+    // 套接字必须是非阻塞的；remove() 之后不会再回调它的处理函数。
+    void add(SOCKET sock, uint32_t events, IoHandler handler);
+    void modify(SOCKET sock, uint32_t events);
+    void remove(SOCKET sock);
+
+    void post(Task task);
+    void runAfter(std::chrono::milliseconds delay, Task task);
+    // 在循环线程里执行并等待完成；已在循环线程内则直接执行，等待期间循环停止时由调用方执行
+    void runSync(Task task);
+    bool inLoopThread() const;
+
+private:
+    struct Watch {
+        SOCKET sock;
+        uint32_t events;
+        IoHandler handler;
+        bool active = true;
+    };
+    struct Timer {
+        Clock::time_point when;
+        uint64_t seq;
+        Task task;
+        bool operator>(const Timer& o) const {
+            return when != o.when ? when > o.when : seq > o.seq;
+        }
+    };
+
+    void loop();
+    void runInLoop(Task task);
+    void wakeup();
+    void drainWakeup();
+    void runTasks();
+    void runTimers();
+    int nextTimeoutMs();
+
+    void addNow(SOCKET sock, uint32_t events, IoHandler handler);
+    void modifyNow(SOCKET sock, uint32_t events);
+    void removeNow(SOCKET sock);
+
+    // 后端：注册变更 + 等待就绪，就绪项写入 ready
+    bool backendInit();
+    void backendClose();
+    void backendAdd(Watch& w);
+    void backendModify(Watch& w);
+    void backendRemove(Watch& w);
+    void backendWait(int timeoutMs, std::vector<std::pair<SOCKET, uint32_t>>& ready);
+
+    std::thread thread_;
+    std::atomic<std::thread::id> loopThreadId_{};
+    std::atomic<bool> running_{false};
+
+    std::unordered_map<SOCKET, std::shared_ptr<Watch>> watches_;
+
+    std::mutex taskMtx_;
+    std::vector<Task> tasks_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+    uint64_t timerSeq_ = 0;
+
+    // 唤醒用的回环 UDP 套接字：自己给自己发一个字节，三种后端都能等待它
+    SOCKET wakeSock_ = INVALID_SOCKET;
+    std::atomic<bool> wakePending_{false};
+
+#if defined(__linux__)
+    int epollFd_ = -1;
+#else
+    bool pollDirty_ = true;
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> pollFds_;
+#else
+    std::vector<struct pollfd> pollFds_;
+#endif
+#endif
+};
+
+#endif // EVENT_LOOP_H
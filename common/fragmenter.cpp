@@ -0,0 +1,385 @@
+#include "fragmenter.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace Fragmenting;
+
+namespace {
+    // 接收端：发送端放弃的帧剩余分片不会再来，多等几个帧间隔吸收抖动后回收
+    constexpr int RECEIVE_DEADLINE_FRAMES = 4;
+    // 每次 pump 最多发出的片数，避免批量数据长时间占住事件循环
+    constexpr int MAX_PIECES_PER_PUMP = 64;
+
+    bool IsKeyframe(const BufferRef& msg) {
+        return msg.size() > 1 && (msg[1] & Desktop::VIDEO_KEYFRAME) != 0;
+    }
+
+    // 消息号回绕后仍能比较先后
+    bool IdAfter(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) > 0;
+    }
+
+    size_t PieceLen(const BufferRef& msg, uint16_t count, uint16_t next) {
+        if (count == 0) return msg.size();
+        size_t off = static_cast<size_t>(next) * FRAGMENT_PAYLOAD;
+        return Desktop::FRAGMENT_HEADER_SIZE + std::min(FRAGMENT_PAYLOAD, msg.size() - off);
+    }
+}
+
+// ==================== 分片发送 ====================
+void FragmentSender::start(SendFn send) {
+    loop_.runSync([this, &send]() { send_ = std::move(send); });
+    std::lock_guard<std::mutex> lock(mtx_);
+    running_ = true;
+    generation_++;
+    pumpQueued_ = false;
+    awaitingKeyframe_ = false;
+}
+
+void FragmentSender::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        running_ = false;
+        generation_++;
+        for (auto& q : queues_) q.clear();
+        video_ = Outgoing();
+        pumpQueued_ = false;
+    }
+    // 等正在进行的 pump 结束
+    loop_.runSync([this]() { send_ = nullptr; });
+}
+
+void FragmentSender::setPacingRate(int bitsPerSec, int fps) {
+    pacer_.setRate(bitsPerSec, fps);
+    if (fps > 0) frameIntervalMs_ = std::max(1, 1000 / fps);
+}
+
+void FragmentSender::setOnVideoDropped(std::function<void()> cb) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    onVideoDropped_ = std::move(cb);
+}
+
+bool FragmentSender::submit(const BufferRef& msg) {
+    if (msg.empty()) return false;
+    if (msg.size() > MAX_MESSAGE_SIZE) {
+        std::cerr << "[Fragment] Message too large: " << msg.size() << " bytes" << std::endl;
+        return false;
+    }
+    SendPriority prio = SendScheduling::Classify(msg.data(), msg.size());
+
+    Outgoing o;
+    o.msg = msg;
+    if (msg.size() > MAX_MESSAGE) {
+        o.count = static_cast<uint16_t>((msg.size() + FRAGMENT_PAYLOAD - 1) / FRAGMENT_PAYLOAD);
+    }
+
+    bool dropped = false;
+    std::function<void()> onDropped;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!running_) return false;
+        o.id = nextId_++;
+        if (prio == SendPriority::Video) {
+            enqueueVideoLocked(std::move(o), dropped);
+        } else {
+            queues_[static_cast<int>(prio)].push_back(std::move(o));
+        }
+        wakeLocked();
+        if (dropped) onDropped = onVideoDropped_;
+    }
+    if (onDropped) onDropped();
+    return true;
+}
+
+void FragmentSender::enqueueVideoLocked(Outgoing o, bool& dropped) {
+    auto& q = queues_[static_cast<int>(SendPriority::Video)];
+
+    if (IsKeyframe(o.msg)) {
+        // 新关键帧让所有尚未开始发送的帧都失去意义
+        droppedVideo_ += q.size();
+        q.clear();
+        awaitingKeyframe_ = false;
+        q.push_back(std::move(o));
+        return;
+    }
+
+    if (awaitingKeyframe_) {
+        droppedVideo_++;
+        return;
+    }
+
+    if (q.size() >= MAX_QUEUED_VIDEO) {
+        droppedVideo_ += q.size() + 1;
+        q.clear();
+        awaitingKeyframe_ = true;
+        dropped = true;
+        return;
+    }
+    q.push_back(std::move(o));
+}
+
+void FragmentSender::wakeLocked() {
+    if (pumpQueued_) return;
+    pumpQueued_ = true;
+    std::weak_ptr<FragmentSender> weak = shared_from_this();
+    uint32_t generation = generation_;
+    loop_.post([weak, generation]() {
+        if (auto self = weak.lock()) self->pump(generation);
+    });
+}
+
+void FragmentSender::scheduleRetry(uint32_t generation, int64_t waitUs) {
+    std::weak_ptr<FragmentSender> weak = shared_from_this();
+    auto delay = std::chrono::milliseconds(std::max<int64_t>(1, (waitUs + 999) / 1000));
+    loop_.runAfter(delay, [weak, generation]() {
+        if (auto self = weak.lock()) self->pump(generation);
+    });
+}
+
+bool FragmentSender::nextLocked(Clock::time_point now, Outgoing*& out, bool& isVideo,
+                                int64_t& waitUs, bool& dropped) {
+    isVideo = false;
+    waitUs = 0;
+
+    // 控制 > 实时 > 视频 > 批量；视频发送中途也先让紧急消息插队
+    for (int p = 0; p < static_cast<int>(SendPriority::Video); p++) {
+        auto& q = queues_[p];
+        if (q.empty()) continue;
+        out = &q.front();
+        return true;
+    }
+
+    auto& vq = queues_[static_cast<int>(SendPriority::Video)];
+    if (!video_.msg && !vq.empty()) {
+        video_ = std::move(vq.front());
+        vq.pop_front();
+    }
+    while (video_.msg) {
+        if (!video_.started) {
+            video_.started = true;
+            video_.deadlineMs = frameIntervalMs_ * (1 + (IsKeyframe(video_.msg) ? KEYFRAME_DEADLINE_FRAMES : 1));
+            video_.deadline = now + std::chrono::milliseconds(video_.deadlineMs + DEADLINE_SLACK_MS);
+            pacer_.beginFrame(video_.msg.size(), now);
+        }
+
+        if (now > video_.deadline) {
+            // 过期分片不再发送：本帧剩余部分和排在后面的依赖帧都作废，等下一个关键帧
+            std::cerr << "[Fragment] Video frame expired at fragment " << video_.next
+                      << "/" << std::max<uint16_t>(1, video_.count) << ", abandoning" << std::endl;
+            droppedVideo_++;
+            dropped = true;
+            pacer_.endFrame(now);
+            video_ = Outgoing();
+            while (!vq.empty() && !IsKeyframe(vq.front().msg)) {
+                vq.pop_front();
+                droppedVideo_++;
+            }
+            awaitingKeyframe_ = vq.empty();
+            if (!vq.empty()) {
+                video_ = std::move(vq.front());
+                vq.pop_front();
+            }
+            continue;
+        }
+
+        size_t len = PieceLen(video_.msg, video_.count, video_.next);
+        auto wait = pacer_.delayFor(len, now);
+        if (wait.count() > 0) {
+            waitUs = wait.count();
+            break;
+        }
+        pacer_.consume(len, now);
+        out = &video_;
+        isVideo = true;
+        return true;
+    }
+
+    // 批量数据填视频的空隙；视频被节拍器拦住时也照发
+    auto& bq = queues_[static_cast<int>(SendPriority::Bulk)];
+    if (bq.empty()) return false;
+    out = &bq.front();
+    waitUs = 0;
+    return true;
+}
+
+BinaryData FragmentSender::buildPiece(const Outgoing& o, bool droppable) const {
+    if (o.count == 0) return BinaryData(o.msg.data(), o.msg.data() + o.msg.size());
+
+    size_t off = static_cast<size_t>(o.next) * FRAGMENT_PAYLOAD;
+    size_t len = std::min(FRAGMENT_PAYLOAD, o.msg.size() - off);
+
+    Desktop::FragmentHeader h{};
+    h.flags = droppable ? Desktop::FRAGMENT_DROPPABLE : 0;
+    h.msgId = o.id;
+    h.index = o.next;
+    h.count = o.count;
+    h.totalSize = static_cast<uint32_t>(o.msg.size());
+    h.deadlineMs = droppable ? static_cast<uint16_t>(std::min(o.deadlineMs, 0xFFFF)) : 0;
+    auto hdr = MessageBuilder::FragmentHeader(h);
+
+    BinaryData piece;
+    piece.reserve(hdr.size() + len);
+    piece.insert(piece.end(), hdr.begin(), hdr.end());
+    piece.insert(piece.end(), o.msg.data() + off, o.msg.data() + off + len);
+    return piece;
+}
+
+void FragmentSender::pump(uint32_t generation) {
+    for (int n = 0; n < MAX_PIECES_PER_PUMP; n++) {
+        BinaryData piece;
+        bool isVideo = false;
+        int64_t waitUs = 0;
+        bool dropped = false;
+        std::function<void()> onDropped;
+        int from = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (!running_ || generation != generation_) return;
+
+            Outgoing* o = nullptr;
+            bool have = nextLocked(Clock::now(), o, isVideo, waitUs, dropped);
+            if (dropped) onDropped = onVideoDropped_;
+            if (have) {
+                piece = buildPiece(*o, isVideo);
+                from = isVideo ? static_cast<int>(SendPriority::Video)
+                               : static_cast<int>(SendScheduling::Classify(o->msg.data(), o->msg.size()));
+            } else if (waitUs > 0) {
+                scheduleRetry(generation, waitUs);
+            } else {
+                pumpQueued_ = false;
+            }
+        }
+        if (onDropped) onDropped();
+        if (piece.empty()) return;
+
+        bool ok = send_ && send_(piece);
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!running_ || generation != generation_) return;
+        if (!ok) {
+            // 通道暂时拒收：可靠消息原样重试，视频分片重试到过期为止
+            scheduleRetry(generation, RETRY_MS * 1000);
+            return;
+        }
+
+        // pump 是唯一出队的地方，队首仍是刚发出的那条；视频帧在 video_ 里
+        Outgoing& o = isVideo ? video_ : queues_[from].front();
+        o.next++;
+        if (o.count == 0 || o.next >= o.count) {
+            if (isVideo) {
+                pacer_.endFrame(Clock::now());
+                video_ = Outgoing();
+            } else {
+                queues_[from].pop_front();
+            }
+        }
+    }
+
+    // 片数用完还有数据：让出事件循环后继续
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_ || generation != generation_) return;
+    std::weak_ptr<FragmentSender> weak = shared_from_this();
+    loop_.post([weak, generation]() {
+        if (auto self = weak.lock()) self->pump(generation);
+    });
+}
+
+// ==================== 分片重组 ====================
+bool FragmentAssembler::feed(const uint8_t* data, size_t size, BufferRef& out) {
+    if (size == 0 || data[0] != static_cast<uint8_t>(Desktop::MsgType::Fragment)) return false;
+    if (size < Desktop::FRAGMENT_HEADER_SIZE) return true;
+
+    Desktop::FragmentHeader h;
+    memcpy(&h, data + 1, sizeof(h));
+    const uint8_t* payload = data + Desktop::FRAGMENT_HEADER_SIZE;
+    size_t len = size - Desktop::FRAGMENT_HEADER_SIZE;
+
+    size_t off = static_cast<size_t>(h.index) * FRAGMENT_PAYLOAD;
+    bool last = (h.index + 1 == h.count);
+    if (h.count == 0 || h.index >= h.count || h.totalSize > MAX_MESSAGE_SIZE ||
+        off + len > h.totalSize || (last ? off + len != h.totalSize : len != FRAGMENT_PAYLOAD)) {
+        std::cerr << "[Fragment] Malformed fragment " << h.index << "/" << h.count << std::endl;
+        return true;
+    }
+
+    bool droppable = (h.flags & Desktop::FRAGMENT_DROPPABLE) != 0;
+    auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    expireLocked(now);
+
+    // 更新的视频已经交付，这一帧即使凑齐也过时了
+    if (droppable && haveVideo_ && !IdAfter(h.msgId, lastVideoId_)) return true;
+
+    auto it = assemblies_.find(h.msgId);
+    if (it == assemblies_.end()) {
+        if (assemblies_.size() >= MAX_ASSEMBLIES) {
+            // 先回收视频，可靠消息只在实在放不下时才丢
+            auto victim = std::find_if(assemblies_.begin(), assemblies_.end(),
+                                       [](const std::pair<const uint32_t, Assembly>& a) { return a.second.droppable; });
+            if (victim == assemblies_.end()) {
+                victim = assemblies_.begin();
+                std::cerr << "[Fragment] Too many partial messages, dropping message " << victim->first << std::endl;
+            } else {
+                abandonedVideo_++;
+            }
+            assemblies_.erase(victim);
+        }
+        Assembly a;
+        a.data = BufferPool::shared().acquire(h.totalSize);
+        a.count = h.count;
+        a.have.assign(h.count, 0);
+        a.droppable = droppable;
+        a.expires = now + std::chrono::milliseconds(droppable
+            ? static_cast<int>(h.deadlineMs) * RECEIVE_DEADLINE_FRAMES
+            : RELIABLE_TIMEOUT_MS);
+        it = assemblies_.emplace(h.msgId, std::move(a)).first;
+    }
+
+    Assembly& a = it->second;
+    if (a.count != h.count || a.data.size() != h.totalSize) return true;
+    if (a.have[h.index]) return true;
+    a.have[h.index] = 1;
+    a.received++;
+    memcpy(a.data.data() + off, payload, len);
+    if (a.received < a.count) return true;
+
+    out = std::move(a.data);
+    assemblies_.erase(it);
+    if (droppable) {
+        haveVideo_ = true;
+        lastVideoId_ = h.msgId;
+        // 比它旧的残缺视频帧不会再有用
+        for (auto i = assemblies_.begin(); i != assemblies_.end();) {
+            if (i->second.droppable && !IdAfter(i->first, lastVideoId_)) {
+                abandonedVideo_++;
+                i = assemblies_.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+    return true;
+}
+
+void FragmentAssembler::expireLocked(Clock::time_point now) {
+    for (auto it = assemblies_.begin(); it != assemblies_.end();) {
+        if (now < it->second.expires) {
+            ++it;
+            continue;
+        }
+        if (it->second.droppable) {
+            abandonedVideo_++;
+        } else {
+            std::cerr << "[Fragment] Reliable message " << it->first << " timed out with "
+                      << it->second.received << "/" << it->second.count << " fragments" << std::endl;
+        }
+        it = assemblies_.erase(it);
+    }
+}
+
+void FragmentAssembler::reset() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    assemblies_.clear();
+    haveVideo_ = false;
+}
@@ -0,0 +1,132 @@
+#ifndef FRAGMENTER_H
+#define FRAGMENTER_H
+
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "event_loop.h"
+#include "pacer.h"
+#include "send_scheduler.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace Fragmenting {
+    // 数据通道单条消息的安全上限（含分片头），超过的消息在应用层切片
+    constexpr size_t MAX_MESSAGE = 16 * 1024;
+    constexpr size_t FRAGMENT_PAYLOAD = MAX_MESSAGE - Desktop::FRAGMENT_HEADER_SIZE;
+
+    // 节拍器把一帧摊到一个帧间隔内发完，分片比这个计划再晚一个帧间隔即过期。
+    // 未设置帧率时按 30fps 计算；定时器精度有限，再放宽一点
+    constexpr int DEFAULT_FPS = 30;
+    constexpr int DEADLINE_SLACK_MS = 5;
+    // 关键帧放弃后编码端只会再产出一个同样大的关键帧，链路一个帧间隔发不完时
+    // 会一直发不出去，因此关键帧的有效期放宽到若干帧间隔
+    constexpr int KEYFRAME_DEADLINE_FRAMES = 15;
+    // 通道拒收（发送缓冲满）后多久重试
+    constexpr int RETRY_MS = 5;
+
+    // 视频最多积压两帧
+    constexpr size_t MAX_QUEUED_VIDEO = 2;
+
+    // 接收端：可靠消息的分片超过该时长仍未凑齐，视为对端已放弃（断开重连）
+    constexpr int RELIABLE_TIMEOUT_MS = 30000;
+    constexpr size_t MAX_ASSEMBLIES = 64;
+    constexpr uint32_t MAX_MESSAGE_SIZE = 64 * 1024 * 1024;
+}
+
+// ==================== 分片发送 ====================
+// P2P 数据通道对单条消息的长度和重传行为不可控，大消息在这里切成带消息号的
+// Fragment。控制/输入优先、完整可靠，一片不丢；视频分片比节拍计划晚一个帧间隔即过期（关键帧放宽），
+// 发不出去的过期分片连同本帧剩余部分一起放弃，之后的依赖帧也不再发送，直到
+// 下一个关键帧，并通过 onVideoDropped 通知编码端尽快产出恢复帧。
+// 不超过 MAX_MESSAGE 的消息原样发送。submit() 可在任意线程调用，实际发送在事件循环里。
+class FragmentSender : public std::enable_shared_from_this<FragmentSender> {
+public:
+    using SendFn = std::function<bool(const BinaryData&)>;
+
+    explicit FragmentSender(EventLoop& loop = EventLoop::shared()) : loop_(loop) {}
+
+    void start(SendFn send);
+    // 清空队列，返回后不再调用发送函数
+    void stop();
+
+    bool submit(const BufferRef& msg);
+
+    // 任意线程调用：视频按码率节拍发出，帧率同时决定视频分片的有效期
+    void setPacingRate(int bitsPerSec, int fps);
+    void setOnVideoDropped(std::function<void()> cb);
+    uint64_t droppedVideoFrames() const { return droppedVideo_; }
+
+private:
+    using Clock = Pacer::Clock;
+
+    struct Outgoing {
+        BufferRef msg;
+        uint32_t id = 0;
+        uint16_t count = 0;         // 0 表示不分片，整条发出
+        uint16_t next = 0;
+        bool started = false;
+        int deadlineMs = 0;
+        Clock::time_point deadline;
+    };
+
+    void wakeLocked();
+    void pump(uint32_t generation);
+    // 选出下一片；视频被节拍器拦住时返回 false 并给出等待时长
+    bool nextLocked(Clock::time_point now, Outgoing*& out, bool& isVideo, int64_t& waitUs, bool& dropped);
+    void enqueueVideoLocked(Outgoing o, bool& dropped);
+    BinaryData buildPiece(const Outgoing& o, bool droppable) const;
+    void scheduleRetry(uint32_t generation, int64_t waitUs);
+
+    EventLoop& loop_;
+    SendFn send_;                   // 只在循环线程里访问
+
+    std::mutex mtx_;
+    bool running_ = false;
+    uint32_t generation_ = 0;
+    bool pumpQueued_ = false;       // 已有 pump 排队或定时，避免重复唤醒
+    uint32_t nextId_ = 0;
+    std::deque<Outgoing> queues_[static_cast<int>(SendPriority::Count)];
+    Outgoing video_;                // 正在发送的视频帧，msg 为空表示没有
+    bool awaitingKeyframe_ = false;
+    std::function<void()> onVideoDropped_;
+    std::atomic<int> frameIntervalMs_{1000 / Fragmenting::DEFAULT_FPS};
+    std::atomic<uint64_t> droppedVideo_{0};
+    Pacer pacer_;
+};
+
+// ==================== 分片重组 ====================
+// 按消息号收集分片，凑齐后交出完整消息。可丢弃（视频）的消息超过有效期或
+// 更新的视频已交付时直接放弃，不会把过时的帧交给解码器。可在任意线程调用。
+class FragmentAssembler {
+public:
+    // 返回 true 表示是 Fragment 消息（已消费），凑齐时经 out 交出原消息
+    bool feed(const uint8_t* data, size_t size, BufferRef& out);
+    void reset();
+    uint64_t abandonedVideo() const { return abandonedVideo_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Assembly {
+        BufferRef data;
+        uint16_t count = 0;
+        uint16_t received = 0;
+        std::vector<uint8_t> have;
+        bool droppable = false;
+        Clock::time_point expires;
+    };
+
+    void expireLocked(Clock::time_point now);
+
+    std::mutex mtx_;
+    std::map<uint32_t, Assembly> assemblies_;
+    uint32_t lastVideoId_ = 0;
+    bool haveVideo_ = false;
+    std::atomic<uint64_t> abandonedVideo_{0};
+};
+
+#endif // FRAGMENTER_H
@@ -0,0 +1,461 @@
+#include "frame_source.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace FrameSourcing;
+
+namespace {
+    // "1920x1080"，可带 "@60"
+    bool ParseSize(const std::string& text, int& width, int& height, int* fps) {
+        int w = 0, h = 0, f = 0;
+        char tail = 0;
+        int n = fps ? sscanf(text.c_str(), "%dx%d@%d%c", &w, &h, &f, &tail)
+                    : sscanf(text.c_str(), "%dx%d%c", &w, &h, &tail);
+        if (n < 2 || (fps && n == 3 && f <= 0) || n > (fps ? 3 : 2)) return false;
+        if (w < MIN_DIMENSION || h < MIN_DIMENSION || w > MAX_DIMENSION || h > MAX_DIMENSION) return false;
+        // 编码器要求偶数尺寸
+        width = w & ~1;
+        height = h & ~1;
+        if (fps && n == 3) *fps = f;
+        return true;
+    }
+}
+
+std::unique_ptr<IFrameSource> FrameSourcing::Create(const std::string& spec) {
+    const std::string kSynthetic = "synthetic:";
+    const std::string kFile = "file:";
+
+    if (spec.compare(0, kSynthetic.size(), kSynthetic) == 0) {
+        std::string rest = spec.substr(kSynthetic.size());
+        std::string name = rest.substr(0, rest.find(':'));
+        Pattern pattern;
+        if (name == "scroll") pattern = Pattern::ScrollingText;
+        else if (name == "video") pattern = Pattern::Video;
+        else if (name == "static") pattern = Pattern::Static;
+        else {
+            std::cerr << "[FrameSource] Unknown synthetic pattern '" << name << "' (scroll, video, static)" << std::endl;
+            return nullptr;
+        }
+        int width = DEFAULT_WIDTH, height = DEFAULT_HEIGHT;
+        if (name.size() < rest.size() && !ParseSize(rest.substr(name.size() + 1), width, height, nullptr)) {
+            std::cerr << "[FrameSource] Bad size in '" << spec << "'" << std::endl;
+            return nullptr;
+        }
+        std::cout << "[FrameSource] Synthetic " << name << " " << width << "x" << height << std::endl;
+        return std::make_unique<SyntheticFrameSource>(pattern, width, height);
+    }
+
+    if (spec.compare(0, kFile.size(), kFile) == 0) {
+        // 路径里可能有盘符的冒号，尺寸从最后一个冒号之后取
+        std::string rest = spec.substr(kFile.size());
+        size_t colon = rest.rfind(':');
+        int width = 0, height = 0, fps = DEFAULT_FPS;
+        if (colon == std::string::npos || colon == 0 || !ParseSize(rest.substr(colon + 1), width, height, &fps)) {
+            std::cerr << "[FrameSource] Expected file:<path>:WxH[@fps], got '" << spec << "'" << std::endl;
+            return nullptr;
+        }
+        auto source = std::make_unique<RawFrameFileSource>();
+        if (!source->open(rest.substr(0, colon), width, height, fps)) return nullptr;
+        return source;
+    }
+
+    std::cerr << "[FrameSource] Unknown source '" << spec << "'" << std::endl;
+    return nullptr;
+}
+
+// ==================== 合成画面 ====================
+namespace {
+    constexpr uint32_t DESKTOP_TOP = 0xFF1E3A5F;
+    constexpr uint32_t DESKTOP_BOTTOM = 0xFF3C6E91;
+    constexpr uint32_t WINDOW_FACE = 0xFFF3F3F3;
+    constexpr uint32_t WINDOW_TITLE = 0xFF2B579A;
+    constexpr uint32_t TEXT_COLOR = 0xFF202020;
+    constexpr uint32_t TASKBAR = 0xFF202428;
+    constexpr uint32_t CLOCK_COLOR = 0xFFE0E0E0;
+    constexpr int TITLE_HEIGHT = 28;
+    constexpr int TASKBAR_HEIGHT = 40;
+
+    // 七段数码管的笔画：a b c d e f g
+    constexpr uint8_t SEGMENTS[10] = { 0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F };
+
+    uint32_t Blend(uint32_t a, uint32_t b, int t, int range) {
+        auto ch = [&](int shift) {
+            int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+            return static_cast<uint32_t>(ca + (cb - ca) * t / range) << shift;
+        };
+        return 0xFF000000 | ch(16) | ch(8) | ch(0);
+    }
+}
+
+SyntheticFrameSource::SyntheticFrameSource(Pattern pattern, int width, int height, uint32_t seed)
+    : pattern_(pattern), width_(width), height_(height), rng_(seed ? seed : 1),
+      canvas_(size_t(width) * height) {
+    drawBackground();
+
+    // 一个占据大半屏幕的窗口：滚动时是它的正文，视频时是播放区域
+    Rect window = { width_ / 8, height_ / 10, width_ * 7 / 8, height_ - TASKBAR_HEIGHT - height_ / 20 };
+    switch (pattern_) {
+        case Pattern::ScrollingText:
+            drawWindow(window);
+            area_ = { window.left + 8, window.top + TITLE_HEIGHT + 8, window.right - 8, window.bottom - 8 };
+            for (int y = area_.top; y + LINE_HEIGHT <= area_.bottom; y += LINE_HEIGHT) {
+                drawTextLine(&canvas_[size_t(y) * width_ + area_.left], width_, area_.right - area_.left, LINE_HEIGHT);
+            }
+            nextLine_.resize(size_t(area_.right - area_.left) * LINE_HEIGHT);
+            break;
+        case Pattern::Video: {
+            drawWindow(window);
+            // 16:9 的播放区域居中放在窗口里，左上角对齐到偶数像素
+            int w = (window.right - window.left - 16) & ~1;
+            int h = std::min((window.bottom - window.top - TITLE_HEIGHT - 16) & ~1, (w * 9 / 16) & ~1);
+            w = std::min(w, (h * 16 / 9) & ~1);
+            int left = (window.left + window.right - w) / 2 & ~1;
+            int top = (window.top + TITLE_HEIGHT + window.bottom - h) / 2 & ~1;
+            area_ = { left, top, left + w, top + h };
+            break;
+        }
+        case Pattern::Static:
+            drawWindow(window);
+            drawWindow({ width_ / 3, height_ / 4, width_ * 3 / 4, height_ * 2 / 3 });
+            // 时钟在任务栏右侧，光标在前面那个窗口的第一行文字后面
+            area_ = { width_ - 96, height_ - TASKBAR_HEIGHT + 8, width_ - 16, height_ - 8 };
+            caret_ = { width_ / 3 + 8 + 40 * CHAR_WIDTH, height_ / 4 + TITLE_HEIGHT + 10,
+                       width_ / 3 + 10 + 40 * CHAR_WIDTH, height_ / 4 + TITLE_HEIGHT + 10 + LINE_HEIGHT - 2 };
+            break;
+    }
+}
+
+uint32_t SyntheticFrameSource::random() {
+    // xorshift32，够快，且同一种子结果确定
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 17;
+    rng_ ^= rng_ << 5;
+    return rng_;
+}
+
+void SyntheticFrameSource::fill(const Rect& r, uint32_t color) {
+    int left = std::max(0, r.left), right = std::min(width_, r.right);
+    int top = std::max(0, r.top), bottom = std::min(height_, r.bottom);
+    for (int y = top; y < bottom; y++) {
+        std::fill(&canvas_[size_t(y) * width_ + left], &canvas_[size_t(y) * width_ + right], color);
+    }
+}
+
+void SyntheticFrameSource::drawBackground() {
+    int desktop = height_ - TASKBAR_HEIGHT;
+    for (int y = 0; y < desktop; y++) {
+        uint32_t c = Blend(DESKTOP_TOP, DESKTOP_BOTTOM, y, desktop);
+        std::fill(&canvas_[size_t(y) * width_], &canvas_[size_t(y + 1) * width_], c);
+    }
+    fill({ 0, desktop, width_, height_ }, TASKBAR);
+}
+
+void SyntheticFrameSource::drawWindow(const Rect& r) {
+    fill({ r.left - 1, r.top - 1, r.right + 1, r.bottom + 1 }, 0xFF000000);
+    fill(r, WINDOW_FACE);
+    fill({ r.left, r.top, r.right, r.top + TITLE_HEIGHT }, WINDOW_TITLE);
+    if (pattern_ != Pattern::Static) return;
+    // 静止桌面的窗口里放几行字，编码器在这些地方要保住细节
+    int width = r.right - r.left - 16;
+    for (int y = r.top + TITLE_HEIGHT + 8; y + LINE_HEIGHT <= r.bottom - 8; y += LINE_HEIGHT) {
+        drawTextLine(&canvas_[size_t(y) * width_ + r.left + 8], width_, width, LINE_HEIGHT);
+    }
+}
+
+void SyntheticFrameSource::drawTextLine(uint32_t* dst, int stride, int width, int rows) {
+    for (int y = 0; y < rows; y++) std::fill(dst + size_t(y) * stride, dst + size_t(y) * stride + width, WINDOW_FACE);
+    int columns = width / CHAR_WIDTH;
+    int length = static_cast<int>(random() % (columns + 1));
+    // 每个字是 5x9 的随机点阵，空格把它们分成长短不一的词
+    for (int col = 0; col < length; col++) {
+        uint32_t r = random();
+        if (r % 6 == 0) continue;
+        uint64_t bits = (uint64_t(r) << 32) | random();
+        for (int gy = 0; gy < 9; gy++) {
+            for (int gx = 0; gx < 5; gx++) {
+                if (bits >> (gy * 5 + gx) & 1) dst[size_t(4 + gy) * stride + col * CHAR_WIDTH + 1 + gx] = TEXT_COLOR;
+            }
+        }
+    }
+}
+
+void SyntheticFrameSource::drawClock(int seconds) {
+    fill(area_, TASKBAR);
+    int digits[4] = { seconds / 600 % 6, seconds / 60 % 10, seconds / 10 % 6, seconds % 10 };
+    const int w = 12, h = 22, t = 2;
+    for (int i = 0; i < 4; i++) {
+        int x = area_.left + 4 + i * (w + 6) + (i >= 2 ? 6 : 0);
+        int y = area_.top + 1;
+        uint8_t s = SEGMENTS[digits[i]];
+        if (s & 0x01) fill({ x, y, x + w, y + t }, CLOCK_COLOR);
+        if (s & 0x02) fill({ x + w - t, y, x + w, y + h / 2 }, CLOCK_COLOR);
+        if (s & 0x04) fill({ x + w - t, y + h / 2, x + w, y + h }, CLOCK_COLOR);
+        if (s & 0x08) fill({ x, y + h - t, x + w, y + h }, CLOCK_COLOR);
+        if (s & 0x10) fill({ x, y + h / 2, x + t, y + h }, CLOCK_COLOR);
+        if (s & 0x20) fill({ x, y, x + t, y + h / 2 }, CLOCK_COLOR);
+        if (s & 0x40) fill({ x, y + h / 2 - t / 2, x + w, y + h / 2 + t / 2 }, CLOCK_COLOR);
+    }
+    // 分和秒之间的冒号
+    int cx = area_.left + 4 + 2 * (w + 6) - 2;
+    fill({ cx, area_.top + 7, cx + t, area_.top + 9 }, CLOCK_COLOR);
+    fill({ cx, area_.top + 15, cx + t, area_.top + 17 }, CLOCK_COLOR);
+}
+
+bool SyntheticFrameSource::next(Changes& changes) {
+    if (first_) {
+        first_ = false;
+        start_ = Clock::now();
+        if (pattern_ == Pattern::Static) {
+            clockSeconds_ = 0;
+            drawClock(0);
+        } else if (pattern_ == Pattern::Video) {
+            nextVideo(changes);
+        }
+        frame_++;
+        changes.setFull();
+        return true;
+    }
+
+    bool changed = false;
+    switch (pattern_) {
+        case Pattern::ScrollingText: changed = nextScroll(changes); break;
+        case Pattern::Video: changed = nextVideo(changes); break;
+        case Pattern::Static: changed = nextStatic(changes); break;
+    }
+    if (changed) frame_++;
+    return changed;
+}
+
+bool SyntheticFrameSource::nextScroll(Changes& changes) {
+    const int areaWidth = area_.right - area_.left;
+    const size_t rowBytes = size_t(areaWidth) * sizeof(uint32_t);
+    // 文本区内整体上移，和浏览器平滑滚动一样每帧整块都变
+    for (int y = area_.top; y < area_.bottom - SCROLL_PX; y++) {
+        memcpy(&canvas_[size_t(y) * width_ + area_.left], &canvas_[size_t(y + SCROLL_PX) * width_ + area_.left], rowBytes);
+    }
+    for (int i = 0; i < SCROLL_PX; i++) {
+        if (nextLineOffset_ == LINE_HEIGHT) {
+            drawTextLine(nextLine_.data(), areaWidth, areaWidth, LINE_HEIGHT);
+            nextLineOffset_ = 0;
+        }
+        int y = area_.bottom - SCROLL_PX + i;
+        memcpy(&canvas_[size_t(y) * width_ + area_.left], &nextLine_[size_t(nextLineOffset_) * areaWidth], rowBytes);
+        nextLineOffset_++;
+    }
+    changes.full = false;
+    changes.dirty.assign(1, area_);
+    return true;
+}
+
+bool SyntheticFrameSource::nextVideo(Changes& changes) {
+    // 缓慢移动的彩色渐变，叠加逐像素噪声和一个来回运动的亮块，没有两帧相同
+    const int w = area_.right - area_.left;
+    const int h = area_.bottom - area_.top;
+    const int t = static_cast<int>(frame_);
+    const int box = std::max(16, h / 6);
+    int bx = t * 7 % (2 * (w - box));
+    int by = t * 5 % (2 * (h - box));
+    if (bx >= w - box) bx = 2 * (w - box) - bx;
+    if (by >= h - box) by = 2 * (h - box) - by;
+    for (int y = 0; y < h; y++) {
+        uint32_t* row = &canvas_[size_t(area_.top + y) * width_ + area_.left];
+        bool boxRow = y >= by && y < by + box;
+        for (int x = 0; x < w; x++) {
+            uint32_t noise = random();
+            int r = ((x + t * 3) >> 2) + (noise & 15);
+            int g = ((y + t * 2) >> 2) + (noise >> 4 & 15);
+            int b = ((x + y) / 8 + t) + (noise >> 8 & 15);
+            if (boxRow && x >= bx && x < bx + box) r = g = b = 235;
+            row[x] = 0xFF000000 | uint32_t(r & 0xFF) << 16 | uint32_t(g & 0xFF) << 8 | uint32_t(b & 0xFF);
+        }
+    }
+    changes.full = false;
+    changes.dirty.assign(1, area_);
+    return true;
+}
+
+bool SyntheticFrameSource::nextStatic(Changes& changes) {
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start_).count();
+    changes.full = false;
+    changes.dirty.clear();
+
+    int seconds = static_cast<int>(ms / 1000);
+    if (seconds != clockSeconds_) {
+        clockSeconds_ = seconds;
+        drawClock(seconds);
+        changes.dirty.push_back(area_);
+    }
+    bool caretOn = (ms / CARET_BLINK_MS) % 2 == 0;
+    if (caretOn != caretOn_) {
+        caretOn_ = caretOn;
+        fill(caret_, caretOn ? TEXT_COLOR : WINDOW_FACE);
+        changes.dirty.push_back(caret_);
+    }
+    return !changes.dirty.empty();
+}
+
+// ==================== 原始帧回放 ====================
+RawFrameFileSource::~RawFrameFileSource() {
+    close();
+}
+
+bool RawFrameFileSource::open(const std::string& path, int width, int height, int fps, bool loop) {
+    close();
+    frameBytes_ = size_t(width) * height * 4;
+    if (width <= 0 || height <= 0 || fps <= 0) return false;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[FrameSource] Cannot open " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && static_cast<uint64_t>(fileSize.QuadPart) >= frameBytes_) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cerr << "[FrameSource] Cannot map " << path << " (smaller than one " << width << "x" << height << " frame?)" << std::endl;
+        return false;
+    }
+    fileHandle_ = file;
+    mapping_ = mapping;
+    base_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "[FrameSource] Cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= frameBytes_) {
+        view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        std::cerr << "[FrameSource] Cannot map " << path << " (smaller than one " << width << "x" << height << " frame?)" << std::endl;
+        return false;
+    }
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    base_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    width_ = width;
+    height_ = height;
+    fps_ = fps;
+    loop_ = loop;
+    frameCount_ = size_ / frameBytes_;
+    current_ = base_;
+    shown_ = 0;
+    if (size_ % frameBytes_ != 0) {
+        std::cerr << "[FrameSource] " << path << " ends with a partial frame, ignoring its last "
+                  << size_ % frameBytes_ << " bytes" << std::endl;
+    }
+    std::cout << "[FrameSource] Replaying " << path << ": " << frameCount_ << " frames of "
+              << width_ << "x" << height_ << " at " << fps_ << " fps" << (loop_ ? ", looping" : "") << std::endl;
+    return true;
+}
+
+void RawFrameFileSource::close() {
+    if (base_) {
+#ifdef _WIN32
+        UnmapViewOfFile(base_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        CloseHandle(static_cast<HANDLE>(fileHandle_));
+        mapping_ = nullptr;
+        fileHandle_ = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(base_), size_);
+#endif
+    }
+    base_ = nullptr;
+    size_ = 0;
+    frameCount_ = 0;
+    current_ = nullptr;
+}
+
+bool RawFrameFileSource::next(Changes& changes) {
+    if (!base_) return false;
+    auto now = Clock::now();
+    if (shown_ == 0) {
+        start_ = now;
+        shown_ = 1;
+        current_ = base_;
+        changes.setFull();
+        return true;
+    }
+
+    // 按经过的时间算出该显示哪一帧，调用得比帧率快时返回没有变化
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count();
+    uint64_t due = static_cast<uint64_t>(us) * fps_ / 1000000;
+    if (!loop_) due = std::min<uint64_t>(due, frameCount_ - 1);
+    if (due + 1 <= shown_) return false;
+    shown_ = due + 1;
+
+    const uint8_t* prev = current_;
+    current_ = base_ + (due % frameCount_) * frameBytes_;
+    if (current_ == prev) return false;
+    diff(prev, current_, changes);
+    return changes.full || !changes.dirty.empty();
+}
+
+void RawFrameFileSource::diff(const uint8_t* prev, const uint8_t* cur, Changes& changes) const {
+    changes.full = false;
+    changes.dirty.clear();
+    const size_t stride = size_t(width_) * 4;
+    // 每一行块里连续变化的块合成一个矩形
+    for (int top = 0; top < height_; top += DIFF_TILE) {
+        int bottom = std::min(height_, top + DIFF_TILE);
+        int runStart = -1;
+        for (int left = 0; left <= width_; left += DIFF_TILE) {
+            bool changed = false;
+            if (left < width_) {
+                size_t bytes = size_t(std::min(DIFF_TILE, width_ - left)) * 4;
+                for (int y = top; y < bottom && !changed; y++) {
+                    size_t offset = size_t(y) * stride + size_t(left) * 4;
+                    changed = memcmp(prev + offset, cur + offset, bytes) != 0;
+                }
+            }
+            if (changed && runStart < 0) runStart = left;
+            if (!changed && runStart >= 0) {
+                changes.dirty.push_back({ runStart, top, std::min(width_, left), bottom });
+                runStart = -1;
+            }
+        }
+    }
+    if (changes.dirty.size() > MAX_DIRTY_RECTS) {
+        Rect box = changes.dirty.front();
+        for (const Rect& r : changes.dirty) {
+            box.left = std::min(box.left, r.left);
+            box.top = std::min(box.top, r.top);
+            box.right = std::max(box.right, r.right);
+            box.bottom = std::max(box.bottom, r.bottom);
+        }
+        changes.dirty.assign(1, box);
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// ==================== 不依赖桌面的画面来源 ====================
+// 给压测和长时间运行测试用：按固定模式合成画面，或者回放事先录好的原始帧，
+// 不需要显卡和桌面会话。服务端经 FrameSourceCapture 接到编码器上，也可以单独驱动
+namespace FrameSourcing {
+    // 像素坐标，right/bottom 不含
+    struct Rect {
+        int32_t left;
+        int32_t top;
+        int32_t right;
+        int32_t bottom;
+    };
+
+    // 相对上一帧的变化；full 表示按整帧处理
+    struct Changes {
+        bool full = true;
+        std::vector<Rect> dirty;
+
+        void setFull() { full = true; dirty.clear(); }
+    };
+
+    enum class Pattern {
+        ScrollingText,  // 文档/终端滚动：文本区域每帧整体上移几行像素，底部补上新的文字
+        Video,          // 画面中间一块每帧全部变化，带噪声，编码代价接近播放视频
+        Static          // 静止桌面：只有每秒走一次的时钟和闪烁的光标
+    };
+
+    constexpr int DEFAULT_WIDTH = 1920;
+    constexpr int DEFAULT_HEIGHT = 1080;
+    constexpr int DEFAULT_FPS = 30;
+    constexpr int MIN_DIMENSION = 320;     // 合成画面的布局按这个下限设计
+    constexpr int MAX_DIMENSION = 8192;
+    // 回放时逐块比较前后两帧得出脏矩形，块太多时合并为外接矩形
+    constexpr int DIFF_TILE = 64;
+    constexpr size_t MAX_DIRTY_RECTS = 32;
+}
+
+class IFrameSource {
+public:
+    virtual ~IFrameSource() = default;
+
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+    // 推进到下一帧。返回 false 表示画面没有变化，changes 此时无意义；
+    // 返回 true 时 changes 给出相对上一帧变化的区域
+    virtual bool next(FrameSourcing::Changes& changes) = 0;
+    // 当前画面，BGRA，行距 width()*4，下一次 next() 之前有效
+    virtual const uint8_t* pixels() const = 0;
+};
+
+namespace FrameSourcing {
+    // 按规格字符串创建，写错时打印原因并返回空：
+    //   synthetic:scroll|video|static[:WxH]
+    //   file:<路径>:WxH[@fps]     首尾相接的原始 BGRA 帧，例如
+    //                             ffmpeg -i clip.mp4 -pix_fmt bgra -f rawvideo clip.bgra
+    std::unique_ptr<IFrameSource> Create(const std::string& spec);
+}
+
+// ==================== 合成画面 ====================
+// 同一种子生成的画面完全相同，便于比较不同版本的编码和传输结果。宽高不小于 MIN_DIMENSION
+class SyntheticFrameSource : public IFrameSource {
+public:
+    SyntheticFrameSource(FrameSourcing::Pattern pattern, int width, int height, uint32_t seed = 1);
+
+    int width() const override { return width_; }
+    int height() const override { return height_; }
+    bool next(FrameSourcing::Changes& changes) override;
+    const uint8_t* pixels() const override { return reinterpret_cast<const uint8_t*>(canvas_.data()); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint32_t random();
+    void fill(const FrameSourcing::Rect& r, uint32_t color);
+    void drawBackground();
+    void drawWindow(const FrameSourcing::Rect& r);
+    // 在 rows 行高的缓冲里画一行随机长度的文字
+    void drawTextLine(uint32_t* dst, int stride, int width, int rows);
+    void drawClock(int seconds);
+
+    bool nextScroll(FrameSourcing::Changes& changes);
+    bool nextVideo(FrameSourcing::Changes& changes);
+    bool nextStatic(FrameSourcing::Changes& changes);
+
+    static constexpr int CHAR_WIDTH = 8;
+    static constexpr int LINE_HEIGHT = 18;
+    static constexpr int SCROLL_PX = 3;     // 每帧滚动的像素，约一秒两屏行
+    static constexpr int CARET_BLINK_MS = 500;
+
+    FrameSourcing::Pattern pattern_;
+    int width_;
+    int height_;
+    uint32_t rng_;
+    std::vector<uint32_t> canvas_;      // 0xAARRGGBB，在小端机器上即 BGRA 字节序
+    bool first_ = true;
+    uint64_t frame_ = 0;
+    FrameSourcing::Rect area_{};        // 变化的区域：文本区、视频区或时钟
+    FrameSourcing::Rect caret_{};
+    // 滚动：下一行文字先画在这里，每帧从中取 SCROLL_PX 行补到文本区底部
+    std::vector<uint32_t> nextLine_;
+    int nextLineOffset_ = LINE_HEIGHT;
+    // 静止桌面：时钟和光标按墙上时间变化
+    Clock::time_point start_;
+    int clockSeconds_ = -1;
+    bool caretOn_ = false;
+};
+
+// ==================== 原始帧回放 ====================
+// 只读映射一个原始帧文件，按帧率根据经过的时间取帧（跟不上时跳帧），到末尾后从头循环。
+// 画面直接指向映射内存，不再拷贝；脏矩形由前后两帧逐块比较得出
+class RawFrameFileSource : public IFrameSource {
+public:
+    RawFrameFileSource() = default;
+    ~RawFrameFileSource();
+
+    RawFrameFileSource(const RawFrameFileSource&) = delete;
+    RawFrameFileSource& operator=(const RawFrameFileSource&) = delete;
+
+    bool open(const std::string& path, int width, int height, int fps, bool loop = true);
+    void close();
+    size_t frameCount() const { return frameCount_; }
+
+    int width() const override { return width_; }
+    int height() const override { return height_; }
+    bool next(FrameSourcing::Changes& changes) override;
+    const uint8_t* pixels() const override { return current_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void diff(const uint8_t* prev, const uint8_t* cur, FrameSourcing::Changes& changes) const;
+
+    const uint8_t* base_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+    int width_ = 0;
+    int height_ = 0;
+    int fps_ = FrameSourcing::DEFAULT_FPS;
+    bool loop_ = true;
+    size_t frameBytes_ = 0;
+    size_t frameCount_ = 0;
+    const uint8_t* current_ = nullptr;
+    uint64_t shown_ = 0;                // 已经交出的帧号（不取模），0 表示还没开始
+    Clock::time_point start_;
+};
+
+#endif // FRAME_SOURCE_H
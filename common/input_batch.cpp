@@ -0,0 +1,196 @@
+#include "input_batch.h"
+
+namespace {
+    void PutVarint(BinaryData& out, uint32_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    void PutSigned(BinaryData& out, int32_t v) {
+        uint32_t u = static_cast<uint32_t>(v);
+        PutVarint(out, (u << 1) ^ (v < 0 ? 0xFFFFFFFFu : 0));
+    }
+
+    bool GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (p == end) return false;
+            uint8_t b = *p++;
+            v |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool GetSigned(const uint8_t*& p, const uint8_t* end, int32_t& v) {
+        uint32_t u;
+        if (!GetVarint(p, end, u)) return false;
+        v = static_cast<int32_t>((u >> 1) ^ (0u - (u & 1)));
+        return true;
+    }
+}
+
+bool InputBatching::Append(BinaryData& msg, const Desktop::InputEvent& ev, int32_t& lastX, int32_t& lastY) {
+    bool mouse = ev.type == 0;
+    if (mouse ? (ev.key < 0 || ev.key > Desktop::INPUT_BATCH_KEY_MASK)
+              : (ev.type != 1 || ev.x != 0 || ev.y != 0)) return false;
+    uint8_t tag = ev.flags ? Desktop::INPUT_BATCH_HAS_FLAGS : 0;
+
+    if (msg.empty()) msg.push_back(static_cast<uint8_t>(Desktop::MsgType::InputBatch));
+    if (mouse) {
+        msg.push_back(tag | static_cast<uint8_t>(ev.key));
+        // 差值按 32 位回绕计算，解码端同样回绕，任意坐标都能还原
+        PutSigned(msg, static_cast<int32_t>(static_cast<uint32_t>(ev.x) - static_cast<uint32_t>(lastX)));
+        PutSigned(msg, static_cast<int32_t>(static_cast<uint32_t>(ev.y) - static_cast<uint32_t>(lastY)));
+        lastX = ev.x;
+        lastY = ev.y;
+    } else {
+        // 键盘事件不带坐标（恒为 0），也不参与鼠标坐标的差分
+        msg.push_back(tag | Desktop::INPUT_BATCH_KEYBOARD);
+        PutSigned(msg, ev.key);
+    }
+    if (ev.flags) PutSigned(msg, ev.flags);
+    return true;
+}
+
+bool InputBatching::Decode(const uint8_t* data, size_t size, std::vector<Desktop::InputEvent>& out) {
+    out.clear();
+    if (size < 1 || data[0] != static_cast<uint8_t>(Desktop::MsgType::InputBatch)) return false;
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+    int32_t lastX = 0, lastY = 0;
+
+    while (p < end) {
+        uint8_t tag = *p++;
+        Desktop::InputEvent ev{};
+        if (tag & Desktop::INPUT_BATCH_KEYBOARD) {
+            ev.type = 1;
+            if (!GetSigned(p, end, ev.key)) return false;
+        } else {
+            int32_t dx, dy;
+            if (!GetSigned(p, end, dx) || !GetSigned(p, end, dy)) return false;
+            ev.type = 0;
+            ev.key = tag & Desktop::INPUT_BATCH_KEY_MASK;
+            lastX = static_cast<int32_t>(static_cast<uint32_t>(lastX) + static_cast<uint32_t>(dx));
+            lastY = static_cast<int32_t>(static_cast<uint32_t>(lastY) + static_cast<uint32_t>(dy));
+            ev.x = lastX;
+            ev.y = lastY;
+        }
+        if ((tag & Desktop::INPUT_BATCH_HAS_FLAGS) && !GetSigned(p, end, ev.flags)) return false;
+        out.push_back(ev);
+    }
+    return true;
+}
+
+// ==================== 客户端输入合并 ====================
+void InputBatcher::start(SendFn send) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    send_ = std::move(send);
+    running_ = true;
+    pending_.clear();
+}
+
+void InputBatcher::stop() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    running_ = false;
+    send_ = nullptr;
+    pending_.clear();
+    generation_++;
+    timerArmed_ = false;
+}
+
+void InputBatcher::setBatching(bool enabled) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (batching_ == enabled) return;
+    // 已攒下的事件按原来的格式先发出，两种消息不会交错乱序
+    flushLocked();
+    batching_ = enabled;
+}
+
+void InputBatcher::push(const Desktop::InputEvent& ev) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!running_) return;
+    stats_.events++;
+
+    if (InputBatching::IsMove(ev)) {
+        if (!pending_.empty() && InputBatching::IsMove(pending_.back())) {
+            pending_.back() = ev;
+            stats_.coalesced++;
+            return;
+        }
+        pending_.push_back(ev);
+        if (pending_.size() >= InputBatching::MAX_BATCH_EVENTS) {
+            flushLocked();
+            return;
+        }
+        if (!timerArmed_) {
+            timerArmed_ = true;
+            std::weak_ptr<InputBatcher> weak = shared_from_this();
+            uint32_t generation = generation_;
+            loop_.runAfter(std::chrono::milliseconds(InputBatching::COALESCE_MS), [weak, generation]() {
+                auto self = weak.lock();
+                if (!self) return;
+                std::lock_guard<std::mutex> lock(self->mtx_);
+                if (generation == self->generation_) self->flushLocked();
+            });
+        }
+        return;
+    }
+
+    // 按键、滚轮、键盘：连同之前的移动一起立即发出
+    pending_.push_back(ev);
+    flushLocked();
+}
+
+void InputBatcher::flush() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    flushLocked();
+}
+
+InputBatcher::Stats InputBatcher::stats() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stats_;
+}
+
+void InputBatcher::flushLocked() {
+    generation_++;
+    timerArmed_ = false;
+    if (pending_.empty()) return;
+    if (!running_ || !send_) {
+        pending_.clear();
+        return;
+    }
+
+    if (!batching_) {
+        for (const auto& ev : pending_) sendSingleLocked(ev);
+        pending_.clear();
+        return;
+    }
+
+    BinaryData msg;
+    int32_t lastX = 0, lastY = 0;
+    for (const auto& ev : pending_) {
+        if (InputBatching::Append(msg, ev, lastX, lastY)) continue;
+        // 批里放不下的事件单独发，先把它前面的部分发出去以保持顺序
+        if (msg.size() > 1) {
+            send_(msg);
+            stats_.messages++;
+        }
+        msg.clear();
+        lastX = lastY = 0;
+        sendSingleLocked(ev);
+    }
+    if (msg.size() > 1) {
+        send_(msg);
+        stats_.messages++;
+    }
+    pending_.clear();
+}
+
+void InputBatcher::sendSingleLocked(const Desktop::InputEvent& ev) {
+    send_(MessageBuilder::InputEvent(ev));
+    stats_.messages++;
+}
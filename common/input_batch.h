@@ -0,0 +1,73 @@
+#ifndef INPUT_BATCH_H
+#define INPUT_BATCH_H
+
+#include "protocol.h"
+#include "event_loop.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace InputBatching {
+    // 连续的纯鼠标移动在这个窗口内只保留最后一个位置（约一个 120Hz 刷新周期）
+    constexpr int COALESCE_MS = 8;
+    // 一批最多的事件数，攒够立即发出
+    constexpr size_t MAX_BATCH_EVENTS = 64;
+
+    // 纯移动：鼠标、key 为 0，可以被后一个移动取代
+    inline bool IsMove(const Desktop::InputEvent& ev) {
+        return ev.type == 0 && ev.key == 0;
+    }
+
+    // 把一个事件追加到 InputBatch 消息，lastX/lastY 是批内上一个鼠标事件的坐标。
+    // 批格式表达不了的事件（未知类型、key 超出标记位）返回 false，不改动 msg
+    bool Append(BinaryData& msg, const Desktop::InputEvent& ev, int32_t& lastX, int32_t& lastY);
+    // 解析整条 InputBatch（含类型字节），任何一处越界或截断都视为整批无效
+    bool Decode(const uint8_t* data, size_t size, std::vector<Desktop::InputEvent>& out);
+}
+
+// ==================== 客户端输入合并 ====================
+// 按键、滚轮和键盘事件立即发出，排在它们之前尚未发出的移动一并带上，顺序与产生时完全一致；
+// 纯移动等待 COALESCE_MS，期间更新的移动直接取代队尾的移动。
+// 服务器声明 CAP_INPUT_BATCH 后一批事件打包成一条 InputBatch，否则逐条发 InputEvent。
+// push() 可在任意线程调用，定时发送在事件循环里
+class InputBatcher : public std::enable_shared_from_this<InputBatcher> {
+public:
+    using SendFn = std::function<bool(const BinaryData&)>;
+
+    struct Stats {
+        uint64_t events = 0;        // push 进来的事件
+        uint64_t coalesced = 0;     // 被后一个移动取代的移动
+        uint64_t messages = 0;      // 实际发出的消息
+    };
+
+    explicit InputBatcher(EventLoop& loop = EventLoop::shared()) : loop_(loop) {}
+
+    void start(SendFn send);
+    // 丢弃未发出的事件，返回后不再调用发送函数
+    void stop();
+
+    void setBatching(bool enabled);
+    void push(const Desktop::InputEvent& ev);
+    void flush();
+
+    Stats stats() const;
+
+private:
+    void flushLocked();
+    void sendSingleLocked(const Desktop::InputEvent& ev);
+
+    EventLoop& loop_;
+
+    mutable std::mutex mtx_;        // 发送也在锁内进行，保证各线程发出的顺序与 push 一致
+    SendFn send_;
+    bool running_ = false;
+    bool batching_ = false;
+    std::vector<Desktop::InputEvent> pending_;
+    uint32_t generation_ = 0;       // 每次发出后递增，作废已排定的定时发送
+    bool timerArmed_ = false;
+    Stats stats_;
+};
+
+#endif // INPUT_BATCH_H
@@ -0,0 +1,140 @@
+#ifndef NET_COMPAT_H
+#define NET_COMPAT_H
+
+// 套接字 API 的平台差异集中在这里：Windows 使用 Winsock，
+// 其他平台映射到 BSD socket，传输层和协议层因此可以在 Linux 上编译和压测
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+using SOCKET = int;
+constexpr SOCKET INVALID_SOCKET = -1;
+constexpr int SOCKET_ERROR = -1;
+constexpr int SD_BOTH = SHUT_RDWR;
+
+inline int closesocket(SOCKET s) { return ::close(s); }
+inline int WSAGetLastError() { return errno; }
+
+#define WSAEWOULDBLOCK    EWOULDBLOCK
+#define WSAECONNREFUSED   ECONNREFUSED
+#define WSAETIMEDOUT      ETIMEDOUT
+#define WSAENETUNREACH    ENETUNREACH
+#define WSAEADDRNOTAVAIL  EADDRNOTAVAIL
+#define WSAEADDRINUSE     EADDRINUSE
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+namespace NetCompat {
+#ifdef _WIN32
+    using IoBuf = WSABUF;
+    // 对端断开时 send() 直接返回错误，不需要额外标志
+    constexpr int SEND_FLAGS = 0;
+
+    inline IoBuf MakeIoBuf(const void* data, size_t size) {
+        WSABUF b;
+        b.buf = static_cast<char*>(const_cast<void*>(data));
+        b.len = static_cast<ULONG>(size);
+        return b;
+    }
+    inline size_t IoLen(const IoBuf& b) { return b.len; }
+    inline void IoAdvance(IoBuf& b, size_t n) { b.buf += n; b.len -= static_cast<ULONG>(n); }
+#else
+    using IoBuf = struct iovec;
+    // 对端断开时不要触发 SIGPIPE 杀掉进程
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+
+    inline IoBuf MakeIoBuf(const void* data, size_t size) {
+        struct iovec b;
+        b.iov_base = const_cast<void*>(data);
+        b.iov_len = size;
+        return b;
+    }
+    inline size_t IoLen(const IoBuf& b) { return b.iov_len; }
+    inline void IoAdvance(IoBuf& b, size_t n) {
+        b.iov_base = static_cast<char*>(b.iov_base) + n;
+        b.iov_len -= n;
+    }
+#endif
+
+    inline bool WouldBlock(int err) {
+#ifdef _WIN32
+        return err == WSAEWOULDBLOCK;
+#else
+        return err == EAGAIN || err == EWOULDBLOCK || err == EINTR;
+#endif
+    }
+
+    inline bool SetNonBlocking(SOCKET sock, bool enable) {
+#ifdef _WIN32
+        u_long mode = enable ? 1 : 0;
+        return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+        int flags = fcntl(sock, F_GETFL, 0);
+        if (flags < 0) return false;
+        flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+        return fcntl(sock, F_SETFL, flags) == 0;
+#endif
+    }
+
+    // 子进程（SSH 会话、服务管理）不继承网络句柄
+    inline void SetNoInherit(SOCKET sock) {
+#ifdef _WIN32
+        SetHandleInformation((HANDLE)sock, HANDLE_FLAG_INHERIT, 0);
+#else
+        fcntl(sock, F_SETFD, FD_CLOEXEC);
+#endif
+    }
+
+    // 非阻塞聚集发送：返回写出的字节数，0 表示缓冲已满需等待可写，-1 表示出错
+    inline long SendV(SOCKET sock, IoBuf* bufs, size_t count) {
+#ifdef _WIN32
+        DWORD sent = 0;
+        if (WSASend(sock, bufs, static_cast<DWORD>(count), &sent, 0, nullptr, nullptr) == SOCKET_ERROR) {
+            return WouldBlock(WSAGetLastError()) ? 0 : -1;
+        }
+        return static_cast<long>(sent);
+#else
+        struct msghdr msg = {};
+        msg.msg_iov = bufs;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(sock, &msg, SEND_FLAGS);
+        if (sent < 0) return WouldBlock(errno) ? 0 : -1;
+        return static_cast<long>(sent);
+#endif
+    }
+
+    // 非阻塞接收：返回读到的字节数，0 表示对端关闭，-1 表示暂时无数据，-2 表示出错
+    inline long Recv(SOCKET sock, void* buf, size_t len) {
+        int r = recv(sock, static_cast<char*>(buf), static_cast<int>(len), 0);
+        if (r > 0) return r;
+        if (r == 0) return 0;
+        return WouldBlock(WSAGetLastError()) ? -1 : -2;
+    }
+}
+
+#endif // NET_COMPAT_H
@@ -0,0 +1,666 @@
+#include "net_emulator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace NetEmulation;
+
+namespace {
+    BufferRef GatherToBuffer(const ConstBuffer* parts, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) total += parts[i].size;
+        BufferRef msg = BufferPool::shared().acquire(total);
+        size_t off = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (parts[i].size == 0) continue;
+            memcpy(msg.data() + off, parts[i].data, parts[i].size);
+            off += parts[i].size;
+        }
+        return msg;
+    }
+
+    BinaryData ToBinary(const BufferRef& msg) {
+        return BinaryData(msg.data(), msg.data() + msg.size());
+    }
+
+    bool ParseNumber(const std::string& s, double& out) {
+        if (s.empty()) return false;
+        char* end = nullptr;
+        out = strtod(s.c_str(), &end);
+        return end && *end == '\0';
+    }
+
+    bool ApplyKey(Conditions& c, const std::string& key, double v) {
+        if (key == "delay") c.delayMs = static_cast<int>(v);
+        else if (key == "jitter") c.jitterMs = static_cast<int>(v);
+        else if (key == "bw") c.bandwidthKbps = static_cast<int>(v);
+        else if (key == "queue") c.queueBytes = static_cast<size_t>(v);
+        else if (key == "loss") c.lossRate = v;
+        else if (key == "burst") c.burstEnter = v;
+        else if (key == "burst_len") c.burstExit = v >= 1.0 ? 1.0 / v : 1.0;
+        else if (key == "burst_loss") c.burstLoss = v;
+        else if (key == "reorder") c.reorderRate = v;
+        else if (key == "reorder_delay") c.reorderDelayMs = static_cast<int>(v);
+        else if (key == "retransmit") c.retransmit = v != 0;
+        else return false;
+        return true;
+    }
+}
+
+// ==================== 脚本 ====================
+bool NetEmulation::ParseSchedule(const std::string& text, Schedule& out) {
+    out.clear();
+    Conditions current;
+    std::istringstream lines(text);
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(lines, line)) {
+        lineNo++;
+        auto hash = line.find('#');
+        if (hash != std::string::npos) line.resize(hash);
+
+        std::istringstream tokens(line);
+        std::string tok;
+        if (!(tokens >> tok)) continue;
+
+        double at = 0;
+        if (!ParseNumber(tok, at) || at < 0) {
+            std::cerr << "[NetEm] Line " << lineNo << ": expected start time in ms, got '" << tok << "'" << std::endl;
+            return false;
+        }
+        Step step;
+        step.atMs = static_cast<int>(at);
+        step.conditions = current;     // 未写的参数沿用上一步
+
+        while (tokens >> tok) {
+            auto eq = tok.find('=');
+            double v = 0;
+            if (eq == std::string::npos || !ParseNumber(tok.substr(eq + 1), v) ||
+                !ApplyKey(step.conditions, tok.substr(0, eq), v)) {
+                std::cerr << "[NetEm] Line " << lineNo << ": bad parameter '" << tok << "'" << std::endl;
+                return false;
+            }
+        }
+        if (!out.empty() && step.atMs < out.back().atMs) {
+            std::cerr << "[NetEm] Line " << lineNo << ": steps must be in time order" << std::endl;
+            return false;
+        }
+        out.push_back(step);
+        current = step.conditions;
+    }
+    return true;
+}
+
+bool NetEmulation::LoadSchedule(const std::string& path, Schedule& out) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "[NetEm] Cannot open " << path << std::endl;
+        return false;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ParseSchedule(ss.str(), out);
+}
+
+// ==================== 单向损伤管道 ====================
+NetEmulator::NetEmulator(EventLoop& loop, uint32_t seed)
+    : loop_(loop), scheduleStart_(Clock::now()), rng_(seed) {}
+
+void NetEmulator::setSchedule(Schedule schedule) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    schedule_ = std::move(schedule);
+    scheduleStart_ = Clock::now();
+}
+
+void NetEmulator::setConditions(const Conditions& conditions) {
+    Step step;
+    step.conditions = conditions;
+    setSchedule({ step });
+}
+
+void NetEmulator::setLossless(bool lossless) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    lossless_ = lossless;
+}
+
+Conditions NetEmulator::conditions() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return currentLocked(Clock::now());
+}
+
+NetEmulator::Stats NetEmulator::stats() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stats_;
+}
+
+Conditions NetEmulator::currentLocked(Clock::time_point now) const {
+    auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now - scheduleStart_).count();
+    const Step* active = nullptr;
+    for (auto& s : schedule_) {
+        if (s.atMs > elapsedMs) break;
+        active = &s;
+    }
+    return active ? active->conditions : Conditions();
+}
+
+bool NetEmulator::lossLocked(const Conditions& c) {
+    if (c.burstEnter > 0) {
+        if (bad_) {
+            if (unit_(rng_) < c.burstExit) bad_ = false;
+        } else if (unit_(rng_) < c.burstEnter) {
+            bad_ = true;
+        }
+    } else {
+        bad_ = false;
+    }
+    double p = bad_ ? c.burstLoss : c.lossRate;
+    return p > 0 && unit_(rng_) < p;
+}
+
+void NetEmulator::submit(const BufferRef& msg, DeliverFn deliver) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mtx_);
+    stats_.submitted++;
+    Conditions c = currentLocked(now);
+    if (lossless_) c.retransmit = true;
+
+    // 瓶颈：按带宽串行发出，队列里积压的字节超过容量就尾丢弃
+    Clock::time_point depart = now;
+    if (c.bandwidthKbps > 0) {
+        for (auto it = inQueue_.begin(); it != inQueue_.end() && it->first <= now;) {
+            queuedBytes_ -= it->second;
+            it = inQueue_.erase(it);
+        }
+        if (!lossless_ && queuedBytes_ > 0 && queuedBytes_ + msg.size() > c.queueBytes) {
+            stats_.queueDrops++;
+            return;
+        }
+        auto txUs = static_cast<int64_t>(msg.size()) * 8 * 1000 / c.bandwidthKbps;
+        depart = std::max(now, linkFreeAt_) + std::chrono::microseconds(txUs);
+        linkFreeAt_ = depart;
+        inQueue_.emplace(depart, msg.size());
+        queuedBytes_ += msg.size();
+    }
+
+    bool lost = lossLocked(c);
+    if (lost && !c.retransmit) {
+        stats_.lost++;
+        return;
+    }
+
+    auto arrival = depart + std::chrono::milliseconds(c.delayMs);
+    if (c.jitterMs > 0) {
+        arrival += std::chrono::microseconds(static_cast<int64_t>(unit_(rng_) * c.jitterMs * 1000));
+    }
+    if (lost) {
+        stats_.retransmitted++;
+        arrival += std::chrono::milliseconds(std::max(MIN_RETRANSMIT_MS, 2 * c.delayMs + c.jitterMs));
+    }
+    if (c.reorderRate > 0 && unit_(rng_) < c.reorderRate) {
+        stats_.reordered++;
+        arrival += std::chrono::milliseconds(c.reorderDelayMs);
+    } else {
+        arrival = std::max(arrival, lastArrival_);
+        lastArrival_ = arrival;
+    }
+
+    inFlight_.emplace(arrival, Pending{ msg, std::move(deliver) });
+    armLocked(arrival);
+}
+
+void NetEmulator::armLocked(Clock::time_point at) {
+    if (at >= armedAt_) return;
+    armedAt_ = at;
+    auto waitUs = std::chrono::duration_cast<std::chrono::microseconds>(at - Clock::now()).count();
+    std::weak_ptr<NetEmulator> weak = shared_from_this();
+    uint32_t generation = generation_;
+    auto task = [weak, generation]() {
+        if (auto self = weak.lock()) self->fire(generation);
+    };
+    if (waitUs <= 0) loop_.post(task);
+    else loop_.runAfter(std::chrono::milliseconds((waitUs + 999) / 1000), task);
+}
+
+void NetEmulator::fire(uint32_t generation) {
+    std::vector<Pending> due;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (generation != generation_) return;
+        auto now = Clock::now();
+        armedAt_ = Clock::time_point::max();
+        while (!inFlight_.empty() && inFlight_.begin()->first <= now) {
+            due.push_back(std::move(inFlight_.begin()->second));
+            inFlight_.erase(inFlight_.begin());
+        }
+        stats_.delivered += due.size();
+        if (!inFlight_.empty()) armLocked(inFlight_.begin()->first);
+    }
+    for (auto& p : due) {
+        if (p.deliver) p.deliver(p.msg);
+    }
+}
+
+void NetEmulator::clear() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        generation_++;
+        inFlight_.clear();
+        inQueue_.clear();
+        queuedBytes_ = 0;
+        armedAt_ = Clock::time_point::max();
+        lastArrival_ = Clock::time_point();
+        linkFreeAt_ = Clock::time_point();
+        bad_ = false;
+    }
+    // 等循环线程里正在进行的投递结束
+    loop_.runSync([]() {});
+}
+
+// ==================== 客户端装饰器 ====================
+EmulatedTransport::EmulatedTransport(std::unique_ptr<ITransport> inner, EventLoop& loop, uint32_t seed)
+    : inner_(std::move(inner)),
+      up_(std::make_shared<NetEmulator>(loop, seed)),
+      down_(std::make_shared<NetEmulator>(loop, seed + 1)) {}
+
+EmulatedTransport::~EmulatedTransport() {
+    up_->clear();
+    down_->clear();
+}
+
+bool EmulatedTransport::send(const BinaryData& data) {
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
+
+bool EmulatedTransport::sendv(const ConstBuffer* parts, size_t count) {
+    if (!inner_->isConnected()) return false;
+    up_->submit(GatherToBuffer(parts, count), [this](const BufferRef& msg) {
+        ConstBuffer part{ msg.data(), msg.size() };
+        inner_->sendv(&part, 1);
+    });
+    return true;
+}
+
+bool EmulatedTransport::isConnected() const {
+    return inner_->isConnected();
+}
+
+void EmulatedTransport::disconnect() {
+    up_->clear();
+    down_->clear();
+    inner_->disconnect();
+}
+
+void EmulatedTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    callbacks_ = callbacks;
+    TransportCallbacks inner = callbacks;
+    if (callbacks.onBuffer) {
+        inner.onBuffer = [this](const BufferRef& msg) {
+            down_->submit(msg, [this](const BufferRef& m) {
+                if (callbacks_.onBuffer) callbacks_.onBuffer(m);
+            });
+        };
+    }
+    if (callbacks.onMessage) {
+        inner.onMessage = [this](const BinaryData& data) {
+            down_->submit(BufferPool::shared().copyOf(data.data(), data.size()), [this](const BufferRef& m) {
+                if (callbacks_.onMessage) callbacks_.onMessage(ToBinary(m));
+            });
+        };
+    }
+    // 断开后在途消息不再送达
+    inner.onDisconnected = [this]() {
+        down_->clear();
+        if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+    };
+    inner_->setCallbacks(inner);
+}
+
+bool EmulatedTransport::reconnect() {
+    up_->clear();
+    down_->clear();
+    return inner_->reconnect();
+}
+
+bool EmulatedTransport::clockEstimate(ClockEstimate& out) const {
+    return inner_->clockEstimate(out);
+}
+
+// ==================== 服务端装饰器 ====================
+EmulatedServerTransport::EmulatedServerTransport(std::unique_ptr<IServerTransport> inner, EventLoop& loop, uint32_t seed)
+    : inner_(std::move(inner)),
+      up_(std::make_shared<NetEmulator>(loop, seed)),
+      down_(std::make_shared<NetEmulator>(loop, seed + 1)) {}
+
+EmulatedServerTransport::~EmulatedServerTransport() {
+    up_->clear();
+    down_->clear();
+}
+
+bool EmulatedServerTransport::start() {
+    return inner_->start();
+}
+
+void EmulatedServerTransport::stop() {
+    up_->clear();
+    down_->clear();
+    inner_->stop();
+}
+
+bool EmulatedServerTransport::send(const BinaryData& data) {
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
+
+bool EmulatedServerTransport::sendv(const ConstBuffer* parts, size_t count) {
+    return sendBuffer(GatherToBuffer(parts, count));
+}
+
+bool EmulatedServerTransport::sendBuffer(const BufferRef& msg) {
+    if (!inner_->hasClient()) return false;
+    up_->submit(msg, [this](const BufferRef& m) { inner_->sendBuffer(m); });
+    return true;
+}
+
+bool EmulatedServerTransport::sendTo(ClientId id, const BinaryData& data) {
+    if (!inner_->hasClient()) return false;
+    up_->submit(BufferPool::shared().copyOf(data.data(), data.size()), [this, id](const BufferRef& m) {
+        inner_->sendTo(id, ToBinary(m));
+    });
+    return true;
+}
+
+bool EmulatedServerTransport::hasClient() const {
+    return inner_->hasClient();
+}
+
+void EmulatedServerTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    callbacks_ = callbacks;
+    TransportCallbacks inner = callbacks;
+    if (callbacks.onMessage) {
+        inner.onMessage = [this](const BinaryData& data) {
+            down_->submit(BufferPool::shared().copyOf(data.data(), data.size()), [this](const BufferRef& m) {
+                if (callbacks_.onMessage) callbacks_.onMessage(ToBinary(m));
+            });
+        };
+    }
+    if (callbacks.onClientMessage) {
+        inner.onClientMessage = [this](ClientId id, const BinaryData& data) {
+            down_->submit(BufferPool::shared().copyOf(data.data(), data.size()), [this, id](const BufferRef& m) {
+                if (callbacks_.onClientMessage) callbacks_.onClientMessage(id, ToBinary(m));
+            });
+        };
+    }
+    inner_->setCallbacks(inner);
+}
+
+void EmulatedServerTransport::setSubscribed(ClientId id, bool subscribed) {
+    inner_->setSubscribed(id, subscribed);
+}
+
+size_t EmulatedServerTransport::clientCount() const {
+    return inner_->clientCount();
+}
+
+void EmulatedServerTransport::disconnectClient(ClientId id) {
+    inner_->disconnectClient(id);
+}
+
+void EmulatedServerTransport::setPacingRate(int bitsPerSec, int fps) {
+    inner_->setPacingRate(bitsPerSec, fps);
+}
+
+bool EmulatedServerTransport::clockEstimate(ClientId id, ClockEstimate& out) const {
+    return inner_->clockEstimate(id, out);
+}
+
+int EmulatedServerTransport::targetBitrate(ClientId id) const {
+    return inner_->targetBitrate(id);
+}
+
+// ==================== 数据报链路装饰器 ====================
+EmulatedLink::EmulatedLink(std::unique_ptr<IDatagramLink> inner, uint32_t seed)
+    : inner_(std::move(inner)),
+      up_(std::make_shared<NetEmulator>(inner_->loop(), seed)),
+      down_(std::make_shared<NetEmulator>(inner_->loop(), seed + 1)) {}
+
+EmulatedLink::~EmulatedLink() {
+    close();
+}
+
+bool EmulatedLink::open(ReceiveFn onReceive) {
+    onReceive_ = std::move(onReceive);
+    return inner_->open([this](const uint8_t* data, size_t size) {
+        down_->submit(BufferPool::shared().copyOf(data, size), [this](const BufferRef& m) {
+            if (onReceive_) onReceive_(m.data(), m.size());
+        });
+    });
+}
+
+void EmulatedLink::close() {
+    up_->clear();
+    inner_->close();
+    down_->clear();
+}
+
+bool EmulatedLink::send(const uint8_t* data, size_t size) {
+    up_->submit(BufferPool::shared().copyOf(data, size), [this](const BufferRef& m) {
+        inner_->send(m.data(), m.size());
+    });
+    return true;
+}
+
+// ==================== TCP 转发代理 ====================
+// 一对转发的套接字：side 0 是接入的客户端，side 1 是到目标的连接。
+// 从 side i 读出的数据经 pipes[i] 写到另一侧。只在循环线程里访问
+class EmulatedTcpProxy::Conn : public std::enable_shared_from_this<Conn> {
+public:
+    Conn(EventLoop& loop, std::shared_ptr<NetEmulator> up, std::shared_ptr<NetEmulator> down,
+         SOCKET client, SOCKET target)
+        : loop_(loop) {
+        pipes_[0] = std::move(up);
+        pipes_[1] = std::move(down);
+        sides_[0].sock = client;
+        sides_[1].sock = target;
+    }
+
+    void start(std::function<void(Conn*)> onClosed) {
+        onClosed_ = std::move(onClosed);
+        // 处理函数持有强引用，remove() 之后连接随之释放
+        auto self = shared_from_this();
+        for (int i = 0; i < 2; i++) {
+            sides_[i].interest = EventLoop::EV_READ;
+            loop_.add(sides_[i].sock, EventLoop::EV_READ, [self, i](uint32_t events) { self->onIo(i, events); });
+        }
+    }
+
+    void close() {
+        if (closed_) return;
+        closed_ = true;
+        for (auto& s : sides_) {
+            loop_.remove(s.sock);
+            closesocket(s.sock);
+            s.sock = INVALID_SOCKET;
+        }
+        if (onClosed_) onClosed_(this);
+    }
+
+private:
+    struct Side {
+        SOCKET sock = INVALID_SOCKET;
+        std::vector<uint8_t> out;   // 已出管道、等待写进本侧套接字
+        size_t inPipe = 0;          // 从本侧读出、还在管道里的字节
+        uint32_t interest = 0;
+    };
+
+    // 管道里和对侧写缓冲里的积压不超过瓶颈队列容量时才继续读
+    bool canRead(int i) const {
+        return sides_[i].inPipe + sides_[1 - i].out.size() < pipes_[i]->conditions().queueBytes;
+    }
+
+    void onIo(int i, uint32_t events) {
+        if (closed_) return;
+        if (events & EventLoop::EV_WRITE) flush(i);
+        if (!closed_ && (events & (EventLoop::EV_READ | EventLoop::EV_ERROR))) read(i);
+    }
+
+    void read(int i) {
+        Side& s = sides_[i];
+        std::weak_ptr<Conn> weak = shared_from_this();
+        while (!closed_ && canRead(i)) {
+            uint8_t buf[16 * 1024];
+            long r = NetCompat::Recv(s.sock, buf, sizeof(buf));
+            if (r == -1) break;
+            if (r <= 0) {
+                close();
+                return;
+            }
+            s.inPipe += static_cast<size_t>(r);
+            pipes_[i]->submit(BufferPool::shared().copyOf(buf, static_cast<size_t>(r)), [weak, i](const BufferRef& m) {
+                if (auto self = weak.lock()) self->arrive(i, m);
+            });
+        }
+        update(i);
+    }
+
+    void arrive(int from, const BufferRef& m) {
+        if (closed_) return;
+        sides_[from].inPipe -= m.size();
+        Side& dst = sides_[1 - from];
+        dst.out.insert(dst.out.end(), m.data(), m.data() + m.size());
+        flush(1 - from);
+    }
+
+    void flush(int i) {
+        Side& s = sides_[i];
+        size_t written = 0;
+        while (written < s.out.size()) {
+            int r = send(s.sock, reinterpret_cast<const char*>(s.out.data() + written),
+                         static_cast<int>(s.out.size() - written), NetCompat::SEND_FLAGS);
+            if (r > 0) {
+                written += static_cast<size_t>(r);
+                continue;
+            }
+            if (r < 0 && NetCompat::WouldBlock(WSAGetLastError())) break;
+            close();
+            return;
+        }
+        s.out.erase(s.out.begin(), s.out.begin() + written);
+        update(i);
+        // 积压减少后对侧可能可以继续读
+        if (!closed_ && (sides_[1 - i].interest & EventLoop::EV_READ) == 0 && canRead(1 - i)) read(1 - i);
+    }
+
+    void update(int i) {
+        if (closed_) return;
+        Side& s = sides_[i];
+        uint32_t want = 0;
+        if (canRead(i)) want |= EventLoop::EV_READ;
+        if (!s.out.empty()) want |= EventLoop::EV_WRITE;
+        if (want != s.interest) {
+            s.interest = want;
+            loop_.modify(s.sock, want);
+        }
+    }
+
+    EventLoop& loop_;
+    std::shared_ptr<NetEmulator> pipes_[2];
+    Side sides_[2];
+    bool closed_ = false;
+    std::function<void(Conn*)> onClosed_;
+};
+
+EmulatedTcpProxy::EmulatedTcpProxy(const std::string& targetIp, int targetPort, EventLoop& loop, uint32_t seed)
+    : loop_(loop),
+      targetIp_(targetIp),
+      targetPort_(targetPort),
+      up_(std::make_shared<NetEmulator>(loop, seed)),
+      down_(std::make_shared<NetEmulator>(loop, seed + 1)) {
+    up_->setLossless(true);
+    down_->setLossless(true);
+}
+
+EmulatedTcpProxy::~EmulatedTcpProxy() {
+    stop();
+}
+
+bool EmulatedTcpProxy::start(int listenPort) {
+    listenSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket_ == INVALID_SOCKET) {
+        std::cerr << "[NetEm] socket() failed: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+    NetCompat::SetNoInherit(listenSocket_);
+    int reuse = 1;
+    setsockopt(listenSocket_, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(listenPort));
+    socklen_t len = sizeof(addr);
+    if (bind(listenSocket_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listenSocket_, 8) == SOCKET_ERROR ||
+        getsockname(listenSocket_, (sockaddr*)&addr, &len) == SOCKET_ERROR) {
+        std::cerr << "[NetEm] Failed to listen on loopback: " << WSAGetLastError() << std::endl;
+        closesocket(listenSocket_);
+        listenSocket_ = INVALID_SOCKET;
+        return false;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    NetCompat::SetNonBlocking(listenSocket_, true);
+    loop_.add(listenSocket_, EventLoop::EV_READ, [this](uint32_t) { onAcceptable(); });
+    std::cout << "[NetEm] Proxy 127.0.0.1:" << port_ << " -> " << targetIp_ << ":" << targetPort_ << std::endl;
+    return true;
+}
+
+void EmulatedTcpProxy::stop() {
+    if (listenSocket_ == INVALID_SOCKET) return;
+    SOCKET sock = listenSocket_;
+    listenSocket_ = INVALID_SOCKET;
+    loop_.runSync([this, sock]() {
+        loop_.remove(sock);
+        closesocket(sock);
+        auto conns = std::move(conns_);
+        conns_.clear();
+        for (auto& c : conns) c->close();
+    });
+    up_->clear();
+    down_->clear();
+}
+
+void EmulatedTcpProxy::onAcceptable() {
+    for (;;) {
+        SOCKET client = accept(listenSocket_, nullptr, nullptr);
+        if (client == INVALID_SOCKET) break;
+
+        // 目标通常在本机或局域网，阻塞连接很快返回
+        SOCKET target = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(targetPort_));
+        inet_pton(AF_INET, targetIp_.c_str(), &addr.sin_addr);
+        if (target == INVALID_SOCKET || ::connect(target, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+            std::cerr << "[NetEm] Cannot reach " << targetIp_ << ":" << targetPort_ << ": " << WSAGetLastError() << std::endl;
+            if (target != INVALID_SOCKET) closesocket(target);
+            closesocket(client);
+            continue;
+        }
+
+        int flag = 1;
+        for (SOCKET s : { client, target }) {
+            NetCompat::SetNoInherit(s);
+            NetCompat::SetNonBlocking(s, true);
+            setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+        }
+        auto conn = std::make_shared<Conn>(loop_, up_, down_, client, target);
+        conns_.push_back(conn);
+        conn->start([this](Conn* closed) {
+            conns_.erase(std::remove_if(conns_.begin(), conns_.end(),
+                [closed](const std::shared_ptr<Conn>& c) { return c.get() == closed; }), conns_.end());
+        });
+    }
+}
@@ -0,0 +1,237 @@
+#ifndef NET_EMULATOR_H
+#define NET_EMULATOR_H
+
+#include "transport.h"
+#include "datagram_link.h"
+#include "buffer_pool.h"
+#include "event_loop.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+// ==================== 网络条件 ====================
+namespace NetEmulation {
+    struct Conditions {
+        int delayMs = 0;                // 单向固定时延
+        int jitterMs = 0;               // 额外随机时延上限；不重排时只会让消息扎堆到达
+        int bandwidthKbps = 0;          // 瓶颈带宽，0 不限
+        size_t queueBytes = 256 * 1024; // 瓶颈队列容量，排不下的消息尾丢弃
+        double lossRate = 0.0;          // 0..1，每条消息独立丢弃的概率
+        // Gilbert-Elliott 突发丢包：每条消息以 burstEnter 的概率进入坏状态，
+        // 坏状态下按 burstLoss 丢包，以 burstExit 的概率恢复（平均突发长度 1/burstExit）
+        double burstEnter = 0.0;
+        double burstExit = 0.5;
+        double burstLoss = 1.0;
+        double reorderRate = 0.0;       // 被选中的消息额外延迟 reorderDelayMs，让后面的消息先到
+        int reorderDelayMs = 30;
+        // 丢失的消息在一次重传超时后送达而不是消失，后面的消息一起等（模拟 TCP 的队头阻塞）
+        bool retransmit = false;
+    };
+
+    // 从 atMs（相对 setSchedule 的时刻）起生效，直到下一步
+    struct Step {
+        int atMs = 0;
+        Conditions conditions;
+    };
+    using Schedule = std::vector<Step>;
+
+    // 丢包重传的最小超时
+    constexpr int MIN_RETRANSMIT_MS = 200;
+
+    // 文本脚本，每行一步："<毫秒> key=value ..."，未写的参数沿用上一步，# 之后为注释。
+    // key: delay jitter bw(kbps) queue(bytes) loss burst burst_len burst_loss reorder reorder_delay retransmit
+    //   0     delay=20 bw=8000
+    //   5000  bw=1500 loss=0.02      # 5 秒后降速并开始丢包
+    //   15000 bw=8000 loss=0
+    bool ParseSchedule(const std::string& text, Schedule& out);
+    bool LoadSchedule(const std::string& path, Schedule& out);
+}
+
+// ==================== 单向损伤管道 ====================
+// 消息依次经过：瓶颈带宽与队列（排不下尾丢弃）→ 随机/突发丢包 → 时延与抖动 → 可选重排，
+// 然后在事件循环里按到达时刻交给 deliver。没有被选中重排的消息保持先后顺序。
+// 全部在进程内完成，随机数按种子生成，同一脚本可复现。submit() 可在任意线程调用。
+class NetEmulator : public std::enable_shared_from_this<NetEmulator> {
+public:
+    using DeliverFn = std::function<void(const BufferRef&)>;
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t delivered = 0;
+        uint64_t lost = 0;
+        uint64_t queueDrops = 0;        // 瓶颈队列满
+        uint64_t reordered = 0;
+        uint64_t retransmitted = 0;
+    };
+
+    explicit NetEmulator(EventLoop& loop = EventLoop::shared(), uint32_t seed = 1);
+
+    // 从现在起按脚本变化；空脚本表示理想网络
+    void setSchedule(NetEmulation::Schedule schedule);
+    void setConditions(const NetEmulation::Conditions& conditions);
+    NetEmulation::Conditions conditions() const;
+    // 字节流管道：丢包一律按重传处理，队列满也不丢，由调用方按 queueBytes 自行停读
+    void setLossless(bool lossless);
+
+    void submit(const BufferRef& msg, DeliverFn deliver);
+    // 丢弃所有在途消息，返回后不再回调
+    void clear();
+
+    Stats stats() const;
+
+private:
+    using Clock = EventLoop::Clock;
+
+    struct Pending {
+        BufferRef msg;
+        DeliverFn deliver;
+    };
+
+    NetEmulation::Conditions currentLocked(Clock::time_point now) const;
+    bool lossLocked(const NetEmulation::Conditions& c);
+    void armLocked(Clock::time_point at);
+    void fire(uint32_t generation);
+
+    EventLoop& loop_;
+
+    mutable std::mutex mtx_;
+    NetEmulation::Schedule schedule_;
+    Clock::time_point scheduleStart_;
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> unit_{0.0, 1.0};
+    bool lossless_ = false;
+    bool bad_ = false;                                  // 突发丢包的坏状态
+    Clock::time_point linkFreeAt_;                      // 瓶颈链路空闲时刻
+    std::multimap<Clock::time_point, size_t> inQueue_;  // 离开瓶颈的时刻 -> 字节数
+    size_t queuedBytes_ = 0;
+    Clock::time_point lastArrival_;                     // 保序：不早于前一条
+    std::multimap<Clock::time_point, Pending> inFlight_;    // 同一时刻按提交顺序
+    Clock::time_point armedAt_ = Clock::time_point::max();
+    uint32_t generation_ = 0;
+    Stats stats_;
+};
+
+// ==================== 传输层装饰器 ====================
+// 在消息层面损伤一个已有的传输：发送经上行管道，接收经下行管道。
+// 用于复现弱网下的关键帧恢复、续连、流复用背压等上层行为；传输层内部的
+// Ping/Pong 和视频到达反馈不经过管道，要让码率控制也感受到损伤，
+// 应在更底层使用 EmulatedLink（UDP）或 EmulatedTcpProxy（TCP）。
+class EmulatedTransport : public ITransport {
+public:
+    EmulatedTransport(std::unique_ptr<ITransport> inner, EventLoop& loop = EventLoop::shared(), uint32_t seed = 1);
+    ~EmulatedTransport();
+
+    NetEmulator& uplink() { return *up_; }
+    NetEmulator& downlink() { return *down_; }
+
+    bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
+    bool isConnected() const override;
+    void disconnect() override;
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+    bool reconnect() override;
+    bool clockEstimate(ClockEstimate& out) const override;
+
+private:
+    std::unique_ptr<ITransport> inner_;
+    std::shared_ptr<NetEmulator> up_;
+    std::shared_ptr<NetEmulator> down_;
+    TransportCallbacks callbacks_;
+};
+
+// 服务端：所有客户端共用一对管道，相当于在服务器出口处损伤
+class EmulatedServerTransport : public IServerTransport {
+public:
+    EmulatedServerTransport(std::unique_ptr<IServerTransport> inner, EventLoop& loop = EventLoop::shared(), uint32_t seed = 1);
+    ~EmulatedServerTransport();
+
+    NetEmulator& uplink() { return *up_; }
+    NetEmulator& downlink() { return *down_; }
+
+    bool start() override;
+    void stop() override;
+    bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
+    bool sendBuffer(const BufferRef& msg) override;
+    bool hasClient() const override;
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+
+    bool sendTo(ClientId id, const BinaryData& data) override;
+    void setSubscribed(ClientId id, bool subscribed) override;
+    size_t clientCount() const override;
+    void disconnectClient(ClientId id) override;
+    void setPacingRate(int bitsPerSec, int fps) override;
+    bool clockEstimate(ClientId id, ClockEstimate& out) const override;
+    int targetBitrate(ClientId id) const override;
+
+private:
+    std::unique_ptr<IServerTransport> inner_;
+    std::shared_ptr<NetEmulator> up_;
+    std::shared_ptr<NetEmulator> down_;
+    TransportCallbacks callbacks_;
+};
+
+// ==================== 数据报链路装饰器 ====================
+// 在 UDP 会话之下逐包损伤，FEC/NACK、带宽估计和节拍都按真实弱网工作。
+// 可以包装 UdpSocketLink，也可以包装理想的 LossyLoopback 在单进程里跑完整链路
+class EmulatedLink : public IDatagramLink {
+public:
+    EmulatedLink(std::unique_ptr<IDatagramLink> inner, uint32_t seed = 1);
+    ~EmulatedLink();
+
+    NetEmulator& uplink() { return *up_; }
+    NetEmulator& downlink() { return *down_; }
+
+    bool open(ReceiveFn onReceive) override;
+    void close() override;
+    bool send(const uint8_t* data, size_t size) override;
+    void lockPeer() override { inner_->lockPeer(); }
+    void releasePeer() override { inner_->releasePeer(); }
+    EventLoop& loop() override { return inner_->loop(); }
+
+private:
+    std::unique_ptr<IDatagramLink> inner_;
+    std::shared_ptr<NetEmulator> up_;
+    std::shared_ptr<NetEmulator> down_;
+    ReceiveFn onReceive_;       // 只在循环线程里访问
+};
+
+// ==================== TCP 转发代理 ====================
+// 在本机回环地址上监听，把每个接入的连接转发到目标地址，两个方向的字节流各经过
+// 一条无损管道：带宽和时延照常生效，丢包表现为重传时延和队头阻塞，瓶颈队列满时
+// 停止从源端读取，让发送方的套接字缓冲和发送调度器像在真实瓶颈后面一样积压。
+// TCP 传输的节拍、带宽估计和加密都原样跑在弱网上，客户端改连 port() 即可。
+class EmulatedTcpProxy {
+public:
+    EmulatedTcpProxy(const std::string& targetIp, int targetPort, EventLoop& loop = EventLoop::shared(), uint32_t seed = 1);
+    ~EmulatedTcpProxy();
+
+    // listenPort 为 0 时由系统分配
+    bool start(int listenPort = 0);
+    void stop();
+    int port() const { return port_; }
+
+    NetEmulator& uplink() { return *up_; }      // 客户端 → 目标
+    NetEmulator& downlink() { return *down_; }  // 目标 → 客户端
+
+private:
+    class Conn;
+
+    void onAcceptable();
+
+    EventLoop& loop_;
+    std::string targetIp_;
+    int targetPort_;
+    std::shared_ptr<NetEmulator> up_;
+    std::shared_ptr<NetEmulator> down_;
+    SOCKET listenSocket_ = INVALID_SOCKET;
+    int port_ = 0;
+    std::vector<std::shared_ptr<Conn>> conns_;  // 只在循环线程里访问
+};
+
+#endif // NET_EMULATOR_H
@@ -0,0 +1,95 @@
+#include "pacer.h"
+#include <algorithm>
+#include <iostream>
+
+namespace {
+    double ToMs(Pacer::Clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    }
+}
+
+void Pacer::setRate(int bitsPerSec, int fps) {
+    bitrate_ = std::max(0, bitsPerSec);
+    fps_ = std::max(1, fps);
+}
+
+void Pacer::refill(Clock::time_point now) {
+    if (refilled_) {
+        double dt = std::chrono::duration<double>(now - lastRefill_).count();
+        if (dt > 0) tokens_ = std::min(burst_, tokens_ + rate_ * dt);
+    } else {
+        tokens_ = burst_;
+        refilled_ = true;
+    }
+    lastRefill_ = now;
+}
+
+void Pacer::beginFrame(size_t bytes, Clock::time_point now) {
+    inFrame_ = true;
+    frameBytes_ = bytes;
+    frameStart_ = now;
+    if (!enabled()) return;
+
+    refill(now);
+    double base = bitrate_ / 8.0 * Pacing::RATE_GAIN;
+    double spread = static_cast<double>(bytes) * fps_;
+    rate_ = std::max(base, spread);
+    burst_ = std::max<double>(Pacing::MIN_BURST_BYTES, rate_ * Pacing::BURST_WINDOW_MS / 1000.0);
+}
+
+std::chrono::microseconds Pacer::delayFor(size_t bytes, Clock::time_point now) {
+    if (!enabled() || rate_ <= 0) return std::chrono::microseconds(0);
+    refill(now);
+    // 一段比桶还大时只要桶满就放行，否则永远等不到
+    double need = std::min<double>(static_cast<double>(bytes), burst_);
+    if (tokens_ >= need) return std::chrono::microseconds(0);
+    return std::chrono::microseconds(static_cast<int64_t>((need - tokens_) / rate_ * 1e6) + 1);
+}
+
+void Pacer::consume(size_t bytes, Clock::time_point now) {
+    if (!enabled()) return;
+    refill(now);
+    tokens_ -= static_cast<double>(bytes);
+}
+
+void Pacer::endFrame(Clock::time_point now) {
+    if (!inFrame_) return;
+    inFrame_ = false;
+
+    double spreadMs = ToMs(now - frameStart_);
+    double burstQueueMs = 0;
+    double pacedQueueMs = 0;
+    int bitrate = bitrate_;
+    if (bitrate > 0) {
+        burstQueueMs = frameBytes_ * 8.0 * 1000.0 / bitrate;
+        pacedQueueMs = std::max(0.0, burstQueueMs - spreadMs);
+    }
+
+    Stats snapshot;
+    {
+        std::lock_guard<std::mutex> lock(statsMtx_);
+        stats_.frames++;
+        stats_.lastFrameBytes = frameBytes_;
+        stats_.lastSpreadMs = spreadMs;
+        stats_.maxSpreadMs = std::max(stats_.maxSpreadMs, spreadMs);
+        sumSpreadMs_ += spreadMs;
+        sumBurstQueueMs_ += burstQueueMs;
+        sumPacedQueueMs_ += pacedQueueMs;
+        stats_.avgSpreadMs = sumSpreadMs_ / stats_.frames;
+        stats_.avgBurstQueueMs = sumBurstQueueMs_ / stats_.frames;
+        stats_.avgPacedQueueMs = sumPacedQueueMs_ / stats_.frames;
+        snapshot = stats_;
+    }
+
+    if (bitrate > 0 && snapshot.frames % Pacing::LOG_EVERY_FRAMES == 0) {
+        std::cout << "[Pacer] frames=" << snapshot.frames
+                  << " spread avg=" << snapshot.avgSpreadMs << "ms max=" << snapshot.maxSpreadMs
+                  << "ms, est. bottleneck queue burst=" << snapshot.avgBurstQueueMs
+                  << "ms paced=" << snapshot.avgPacedQueueMs << "ms" << std::endl;
+    }
+}
+
+Pacer::Stats Pacer::stats() const {
+    std::lock_guard<std::mutex> lock(statsMtx_);
+    return stats_;
+}
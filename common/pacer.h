@@ -0,0 +1,78 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+namespace Pacing {
+    // 平时按码率的倍数发送，给码率波动留余量
+    constexpr double RATE_GAIN = 2.5;
+    // 桶容量：空闲后最多一次性发出这么多
+    constexpr size_t MIN_BURST_BYTES = 16 * 1024;
+    constexpr int BURST_WINDOW_MS = 5;
+    // 每隔多少帧打印一次统计
+    constexpr uint64_t LOG_EVERY_FRAMES = 300;
+}
+
+// ==================== 令牌桶发送节拍器 ====================
+// 把视频帧摊到帧间隔内发出，避免关键帧一次性灌满中继/瓶颈链路的队列，
+// 让排在后面的音频和输入也跟着抖动。速率取 码率 x RATE_GAIN 与
+// 帧长 / 帧间隔 中较大者：普通帧按平滑速率发，大关键帧恰好在一个帧间隔内发完，
+// 积压不会跨帧累积。未设置码率时不限速。
+// 除 setRate() 和 stats() 外只在发送线程（事件循环）里调用。
+class Pacer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t frames = 0;
+        size_t lastFrameBytes = 0;
+        double lastSpreadMs = 0;        // 最近一帧从首字节到末字节的发送时长
+        double avgSpreadMs = 0;
+        double maxSpreadMs = 0;
+        // 按配置码率估算的瓶颈排队时延：整帧突发时最后一个字节要排的队，
+        // 与平滑发送后剩下的排队，两者之差就是节拍器省下的时延
+        double avgBurstQueueMs = 0;
+        double avgPacedQueueMs = 0;
+    };
+
+    // 任意线程调用；bitsPerSec <= 0 关闭限速
+    void setRate(int bitsPerSec, int fps);
+    bool enabled() const { return bitrate_ > 0; }
+
+    // 一帧开始发送，按帧长确定本帧的速率
+    void beginFrame(size_t bytes, Clock::time_point now);
+    // 还需等待多久才能发出 bytes 字节，0 表示立即可发
+    std::chrono::microseconds delayFor(size_t bytes, Clock::time_point now);
+    void consume(size_t bytes, Clock::time_point now);
+    void endFrame(Clock::time_point now);
+
+    Stats stats() const;
+
+private:
+    void refill(Clock::time_point now);
+
+    std::atomic<int> bitrate_{0};
+    std::atomic<int> fps_{30};
+
+    double rate_ = 0;           // 当前帧的速率，字节/秒
+    double burst_ = 0;
+    double tokens_ = 0;
+    Clock::time_point lastRefill_;
+    bool refilled_ = false;
+
+    bool inFrame_ = false;
+    size_t frameBytes_ = 0;
+    Clock::time_point frameStart_;
+
+    mutable std::mutex statsMtx_;
+    Stats stats_;
+    double sumSpreadMs_ = 0;
+    double sumBurstQueueMs_ = 0;
+    double sumPacedQueueMs_ = 0;
+};
+
+#endif // PACER_H
@@ -0,0 +1,261 @@
+#include "path_monitor.h"
+#include "clock_sync.h"
+#include <iostream>
+
+using namespace PathMonitoring;
+
+const char* PathMonitoring::PathName(PathId path) {
+    return path == PathId::Direct ? "direct" : "relay";
+}
+
+namespace {
+    PathMonitoring::PathId Other(PathMonitoring::PathId p) {
+        return p == PathMonitoring::PathId::Direct ? PathMonitoring::PathId::Relay : PathMonitoring::PathId::Direct;
+    }
+}
+
+void PathMonitor::start(SendFn send, SwitchFn onSwitch) {
+    std::weak_ptr<PathMonitor> weak = shared_from_this();
+    uint32_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        onSwitch_ = std::move(onSwitch);
+    }
+    loop_.runSync([this, &send, &generation]() {
+        send_ = std::move(send);
+        running_ = true;
+        generation = ++generation_;
+    });
+    loop_.post([weak, generation]() {
+        if (auto self = weak.lock()) self->tick(generation);
+    });
+}
+
+void PathMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        onSwitch_ = nullptr;
+        for (auto& p : paths_) p = Path();
+        betterSinceUs_ = 0;
+        draining_ = false;
+    }
+    loop_.runSync([this]() {
+        running_ = false;
+        send_ = nullptr;
+    });
+}
+
+void PathMonitor::setUp(PathId path, bool up) {
+    std::vector<std::pair<PathId, PathId>> switches;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Path& p = paths_[static_cast<size_t>(path)];
+        if (p.up == up) return;
+        // 重新建立的路径从头统计
+        p = Path();
+        p.up = up;
+        std::cout << "[Path] " << PathName(path) << " path " << (up ? "up" : "down") << std::endl;
+
+        const Path& cur = paths_[static_cast<size_t>(active_)];
+        if (up && !cur.up) {
+            active_ = path;     // 第一条可用路径直接成为当前路径
+        } else if (!up && path == active_ && paths_[static_cast<size_t>(Other(path))].up) {
+            switchLocked(Other(path), switches);
+        } else if (!up && draining_) {
+            draining_ = false;  // 要迁往的路径断了，留在当前路径
+        }
+    }
+    notify(switches);
+}
+
+bool PathMonitor::anyUp() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return paths_[0].up || paths_[1].up;
+}
+
+PathMonitor::PathId PathMonitor::active() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return active_;
+}
+
+bool PathMonitor::route(PathId& path) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (draining_) return false;
+    path = active_;
+    return true;
+}
+
+PathMonitor::PathStats PathMonitor::stats(PathId path) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const Path& p = paths_[static_cast<size_t>(path)];
+    PathStats s;
+    s.up = p.up;
+    s.rttMs = p.srttMs;
+    s.samples = p.samples;
+    if (!p.outcomes.empty()) {
+        size_t lost = 0;
+        for (bool acked : p.outcomes) lost += acked ? 0 : 1;
+        s.loss = static_cast<double>(lost) / p.outcomes.size();
+    }
+    return s;
+}
+
+bool PathMonitor::intercept(const uint8_t* data, size_t size, const SendFn& reply) {
+    if (size == 0 || data[0] != static_cast<uint8_t>(Desktop::MsgType::PathProbe)) return false;
+    if (size < 1 + sizeof(Desktop::PathProbeMsg)) return true;
+
+    Desktop::PathProbeMsg m;
+    memcpy(&m, data + 1, sizeof(m));
+    if (m.path >= PATH_COUNT) return true;
+    PathId path = static_cast<PathId>(m.path);
+
+    if (!(m.flags & Desktop::PATH_PROBE_ACK)) {
+        if (reply) reply(path, MessageBuilder::PathProbe(m.path, true, m.seq, m.sendUs));
+        return true;
+    }
+
+    int64_t now = ClockSyncing::NowUs();
+    std::vector<std::pair<PathId, PathId>> switches;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Path& p = paths_[m.path];
+        auto it = p.pending.find(m.seq);
+        if (it == p.pending.end()) return true;     // 已判为丢失或路径已重建
+        p.pending.erase(it);
+
+        double rtt = (now - m.sendUs) / 1000.0;
+        if (rtt < 0) rtt = 0;
+        p.srttMs = p.samples == 0 ? rtt : p.srttMs * 0.875 + rtt * 0.125;
+        p.samples++;
+        recordOutcomeLocked(p, true);
+
+        // 排空探测回来了：旧路径上此前发出的消息对端都已收到
+        if (draining_ && path == active_ && m.seq == drainSeq_) switchLocked(Other(active_), switches);
+    }
+    notify(switches);
+    return true;
+}
+
+void PathMonitor::recordOutcomeLocked(Path& p, bool acked) {
+    p.outcomes.push_back(acked);
+    if (p.outcomes.size() > LOSS_WINDOW) p.outcomes.pop_front();
+}
+
+double PathMonitor::scoreLocked(const Path& p) const {
+    size_t lost = 0;
+    for (bool acked : p.outcomes) lost += acked ? 0 : 1;
+    double loss = p.outcomes.empty() ? 0.0 : static_cast<double>(lost) / p.outcomes.size();
+    return p.srttMs + loss * LOSS_PENALTY_MS;
+}
+
+void PathMonitor::switchLocked(PathId to, std::vector<std::pair<PathId, PathId>>& switches) {
+    draining_ = false;
+    if (to == active_) return;
+    switches.push_back({ active_, to });
+    active_ = to;
+    betterSinceUs_ = 0;
+}
+
+void PathMonitor::beginDrainLocked(PathId to, int64_t nowUs, std::vector<std::pair<PathId, BinaryData>>& probes) {
+    Path& cur = paths_[static_cast<size_t>(active_)];
+    uint32_t seq = cur.nextSeq++;
+    cur.pending[seq] = nowUs;
+    probes.push_back({ active_, MessageBuilder::PathProbe(static_cast<uint8_t>(active_), false, seq, nowUs) });
+    draining_ = true;
+    drainSeq_ = seq;
+    drainStartUs_ = nowUs;
+    std::cout << "[Path] Draining " << PathName(active_) << " path before migrating to " << PathName(to) << std::endl;
+}
+
+void PathMonitor::evaluateLocked(int64_t nowUs, std::vector<std::pair<PathId, PathId>>& switches,
+                                 std::vector<std::pair<PathId, BinaryData>>& probes) {
+    const Path& cur = paths_[static_cast<size_t>(active_)];
+    const Path& alt = paths_[static_cast<size_t>(Other(active_))];
+
+    if (!cur.up) {
+        if (alt.up) switchLocked(Other(active_), switches);
+        return;
+    }
+    if (draining_) {
+        // 旧路径迟迟排不空说明它已经很差了，不再等
+        if (nowUs - drainStartUs_ >= static_cast<int64_t>(DRAIN_TIMEOUT_MS) * 1000) {
+            std::cout << "[Path] " << PathName(active_) << " path did not drain in time" << std::endl;
+            switchLocked(Other(active_), switches);
+        }
+        return;
+    }
+    if (!alt.up || alt.samples < MIN_SAMPLES) {
+        betterSinceUs_ = 0;
+        return;
+    }
+
+    // 当前路径的应答全部超时时 RTT 不再更新，丢包率会把评分推高
+    double curScore = scoreLocked(cur);
+    double altScore = scoreLocked(alt);
+    bool better = altScore < curScore * SWITCH_RATIO && curScore - altScore >= SWITCH_MIN_GAIN_MS;
+    if (!better) {
+        betterSinceUs_ = 0;
+        return;
+    }
+    if (betterSinceUs_ == 0) {
+        betterSinceUs_ = nowUs;
+        return;
+    }
+    if (nowUs - betterSinceUs_ >= static_cast<int64_t>(SWITCH_HOLD_MS) * 1000) {
+        std::cout << "[Path] " << PathName(Other(active_)) << " path is better (score "
+                  << altScore << "ms vs " << curScore << "ms)" << std::endl;
+        beginDrainLocked(Other(active_), nowUs, probes);
+    }
+}
+
+void PathMonitor::tick(uint32_t generation) {
+    if (!running_ || generation != generation_) return;
+
+    int64_t now = ClockSyncing::NowUs();
+    std::vector<std::pair<PathId, PathId>> switches;
+    std::vector<std::pair<PathId, BinaryData>> probes;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (size_t i = 0; i < PATH_COUNT; i++) {
+            Path& p = paths_[i];
+            if (!p.up) continue;
+
+            for (auto it = p.pending.begin(); it != p.pending.end();) {
+                if (now - it->second >= static_cast<int64_t>(PROBE_TIMEOUT_MS) * 1000) {
+                    recordOutcomeLocked(p, false);
+                    it = p.pending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            uint32_t seq = p.nextSeq++;
+            p.pending[seq] = now;
+            probes.push_back({ static_cast<PathId>(i), MessageBuilder::PathProbe(static_cast<uint8_t>(i), false, seq, now) });
+        }
+        evaluateLocked(now, switches, probes);
+    }
+
+    if (send_) {
+        for (auto& pr : probes) send_(pr.first, pr.second);
+    }
+    notify(switches);
+
+    std::weak_ptr<PathMonitor> weak = shared_from_this();
+    loop_.runAfter(std::chrono::milliseconds(PROBE_INTERVAL_MS), [weak, generation]() {
+        if (auto self = weak.lock()) self->tick(generation);
+    });
+}
+
+void PathMonitor::notify(const std::vector<std::pair<PathId, PathId>>& switches) {
+    if (switches.empty()) return;
+    SwitchFn fn;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        fn = onSwitch_;
+    }
+    for (auto& sw : switches) {
+        std::cout << "[Path] Migrating from " << PathName(sw.first) << " to " << PathName(sw.second) << std::endl;
+        if (fn) fn(sw.first, sw.second);
+    }
+}
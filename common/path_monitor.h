@@ -0,0 +1,112 @@
+#ifndef PATH_MONITOR_H
+#define PATH_MONITOR_H
+
+#include "protocol.h"
+#include "event_loop.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace PathMonitoring {
+    enum class PathId : uint8_t {
+        Direct = 0,     // 打洞成功的点对点路径
+        Relay  = 1      // 经中继服务器转发
+    };
+    constexpr size_t PATH_COUNT = 2;
+
+    constexpr int PROBE_INTERVAL_MS = 200;
+    // 超过这么久没有应答的探测记为丢失
+    constexpr int PROBE_TIMEOUT_MS = 1000;
+    // 丢包率按最近这么多次探测计算
+    constexpr size_t LOSS_WINDOW = 25;
+    // 评分 = RTT + 丢包率 × 该值（毫秒），10% 丢包约等于多 100ms RTT
+    constexpr double LOSS_PENALTY_MS = 1000.0;
+    // 备用路径评分低于当前路径的这个比例、且至少好这么多毫秒，并持续 SWITCH_HOLD_MS 才迁移，避免来回抖动
+    constexpr double SWITCH_RATIO = 0.75;
+    constexpr double SWITCH_MIN_GAIN_MS = 15.0;
+    constexpr int SWITCH_HOLD_MS = 1000;
+    // 主动迁移前先排空旧路径：等这么久还没收到排空探测的应答就不再等，直接切换
+    constexpr int DRAIN_TIMEOUT_MS = PROBE_TIMEOUT_MS;
+    // 至少有这么多 RTT 样本才参与比较
+    constexpr uint64_t MIN_SAMPLES = 3;
+
+    const char* PathName(PathId path);
+}
+
+// ==================== 路径监测与迁移 ====================
+// P2P 会话同时保持直连和中继两条路径，在两条路径上各自持续探测 RTT 和丢包，
+// 当前路径断开或明显变差时把发送切到另一条。两端各自决定自己的发送路径，
+// 接收对两条路径一视同仁，因此迁移不需要协商，也不影响上层会话和解码器。
+// 两条路径各自有序，但彼此之间没有顺序：旧路径还能用时，迁移前先在旧路径上发一个排空探测，
+// 暂停发送直到它的应答回来（此前发出的消息都已到达对端）或超时，新路径上的消息才不会
+// 跑到旧路径上的可靠消息前面。旧路径断开时上面的消息已经丢了，立即切换。
+// start() 后在事件循环里定时探测；stop() 返回后不再调用回调。
+class PathMonitor : public std::enable_shared_from_this<PathMonitor> {
+public:
+    using PathId = PathMonitoring::PathId;
+    using SendFn = std::function<bool(PathId path, const BinaryData& msg)>;
+    using SwitchFn = std::function<void(PathId from, PathId to)>;
+
+    struct PathStats {
+        bool up = false;
+        double rttMs = 0;       // 平滑 RTT
+        double loss = 0;        // 最近窗口内的丢包率
+        uint64_t samples = 0;
+    };
+
+    explicit PathMonitor(EventLoop& loop = EventLoop::shared()) : loop_(loop) {}
+
+    void start(SendFn send, SwitchFn onSwitch);
+    void stop();
+
+    // 路径建立/断开；当前路径断开时立即切到另一条可用路径
+    void setUp(PathId path, bool up);
+    bool anyUp() const;
+    PathId active() const;
+    // 上层发送数据时用它选路：正在排空旧路径时返回 false，调用方稍后重试
+    bool route(PathId& path) const;
+    PathStats stats(PathId path) const;
+
+    // 传输层收到每条消息时先交给它：探测立即经 reply 从同一路径应答，应答计入统计。
+    // 返回 true 表示消息已处理，不再交给上层
+    bool intercept(const uint8_t* data, size_t size, const SendFn& reply);
+
+private:
+    struct Path {
+        bool up = false;
+        uint32_t nextSeq = 0;
+        std::map<uint32_t, int64_t> pending;    // seq -> 发出时刻
+        std::deque<bool> outcomes;              // 最近的探测是否收到应答
+        double srttMs = 0;
+        uint64_t samples = 0;
+    };
+
+    void tick(uint32_t generation);
+    void recordOutcomeLocked(Path& p, bool acked);
+    double scoreLocked(const Path& p) const;
+    void evaluateLocked(int64_t nowUs, std::vector<std::pair<PathId, PathId>>& switches,
+                        std::vector<std::pair<PathId, BinaryData>>& probes);
+    void switchLocked(PathId to, std::vector<std::pair<PathId, PathId>>& switches);
+    // 当前路径仍可用时的迁移：发出排空探测，应答回来后再切换
+    void beginDrainLocked(PathId to, int64_t nowUs, std::vector<std::pair<PathId, BinaryData>>& probes);
+
+    void notify(const std::vector<std::pair<PathId, PathId>>& switches);
+
+    EventLoop& loop_;
+    SendFn send_;                   // 只在循环线程里访问
+    bool running_ = false;
+    uint32_t generation_ = 0;
+
+    mutable std::mutex mtx_;
+    SwitchFn onSwitch_;             // setUp() 可能在任意线程触发迁移，由 mtx_ 保护
+    Path paths_[PathMonitoring::PATH_COUNT];
+    PathId active_ = PathId::Direct;
+    int64_t betterSinceUs_ = 0;     // 备用路径开始持续占优的时刻，0 表示没有
+    bool draining_ = false;         // 等待旧路径排空，期间不发数据
+    uint32_t drainSeq_ = 0;         // 排空探测在当前路径上的序号
+    int64_t drainStartUs_ = 0;
+};
+
+#endif // PATH_MONITOR_H
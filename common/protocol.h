@@ -3,21 +3,17 @@
 #define PROTOCOL_H
 
 #pragma once
-#define NOMINMAX
-#define WIN32_LEAN_AND_MEAN
 
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <windows.h>
+#include "net_compat.h"
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <vector>
+#include <array>
 #include <atomic>
 #include <mutex>
 #include <functional>
 
-#pragma comment(lib, "ws2_32.lib")
-
 // ==================== 配置 ====================
 namespace Config {
     constexpr int DEFAULT_DESKTOP_PORT = 12345;
@@ -44,7 +40,97 @@ namespace Desktop {
         ClientDisconnect = 0x07, // 客户端断开通知
         AudioData       = 0x08,  // 音频数据（AAC帧）
         AudioConfig     = 0x09,  // 音频配置（AudioSpecificConfig）
-        AudioEnable     = 0x0A   // 客户端→服务器：启用/禁用音频
+        AudioEnable     = 0x0A,  // 客户端→服务器：启用/禁用音频
+        Chunk           = 0x0B,  // 服务器→客户端：大消息的分块，由传输层重组
+        InputPermission = 0x0C,  // 服务器→客户端：是否允许操作（多人观看时只有一人可操作）
+        Ping            = 0x0D,  // 双向：测量 RTT 和时钟偏差，由传输层收发，不交给上层
+        Pong            = 0x0E,
+        VideoFeedback   = 0x0F,  // 客户端→服务器：视频帧到达时刻，由传输层收发，用于带宽估计
+        SessionToken    = 0x10,  // 服务器→客户端：续连令牌，断线后在宽限期内凭它恢复会话
+        ResumeSession   = 0x11,  // 客户端→服务器：重连后出示令牌，代替 ClientReady
+        ResumeResult    = 0x12,  // 服务器→客户端：续连是否成功，失败时客户端重新走 ClientReady
+        StreamOpen      = 0x13,  // 双向：在桌面连接上打开一条字节流，连到对端的某个本地服务
+        StreamData      = 0x14,  // 双向：流数据，受对端发放的额度限制
+        StreamCredit    = 0x15,  // 双向：接收方消费了数据，归还发送额度
+        StreamClose     = 0x16,  // 双向：关闭流，打开被拒也用它回复
+        Hello           = 0x17,  // 客户端→服务器：协议版本和能力；服务器以双方共有的能力回复
+        PathProbe       = 0x18,  // 双向：P2P 直连/中继各自的探测与应答，由传输层收发，不交给上层
+        Fragment        = 0x19,  // 双向：P2P 大消息的分片，带消息号，由传输层重组，视频分片过期即放弃
+        InputBatch      = 0x1A,  // 客户端→服务器：一组按序的输入事件，坐标差分后变长编码
+        MonitorList     = 0x1B,  // 服务器→客户端：可选的显示器及当前选择，布局或选择变化时重发
+        SelectMonitor   = 0x1C,  // 客户端→服务器：切换到某个显示器或拼接全部显示器
+        CursorShape     = 0x1D,  // 服务器→客户端：指针形状，只在形状变化时发送
+        CursorPosition  = 0x1E   // 服务器→客户端：指针位置与可见性，指针单独移动时不产生视频帧
+    };
+
+    // 能力握手：客户端连上后先发 Hello，服务器只对声明过某项能力的观看者启用它。
+    // 旧服务器忽略 Hello，旧客户端不发 Hello，两边都按最初的格式通信
+    constexpr uint16_t PROTOCOL_VERSION = 5;
+    enum Capabilities : uint32_t {
+        CAP_VIDEO_INFO = 0x01,      // 视频帧携带 VideoFrameInfo（序号、流水线时间戳、编码分辨率）
+        CAP_INPUT_BATCH = 0x02,     // 服务器接受 InputBatch；未确认前客户端逐条发 InputEvent
+        CAP_MONITORS = 0x04,        // 客户端理解 MonitorList，可以发 SelectMonitor
+        CAP_CURSOR = 0x08           // 客户端自己绘制指针，服务器发 CursorShape/CursorPosition
+    };
+    constexpr uint32_t SUPPORTED_CAPABILITIES = CAP_VIDEO_INFO | CAP_INPUT_BATCH | CAP_MONITORS | CAP_CURSOR;
+
+    // VideoFrame：[type][flags]，带 VIDEO_HAS_INFO 时紧跟 VideoFrameInfo，之后是编码数据
+    enum VideoFlags : uint8_t {
+        VIDEO_KEYFRAME = 0x01,
+        VIDEO_HAS_INFO = 0x80
+    };
+    constexpr size_t VIDEO_HEADER_SIZE = 2;
+
+    // 续连令牌：服务端随机生成，断线后会话状态（流配置、音频、编码器）保留 RESUME_GRACE_MS
+    constexpr size_t SESSION_TOKEN_SIZE = 16;
+    constexpr uint32_t RESUME_GRACE_MS = 10000;
+    using SessionTokenBytes = std::array<uint8_t, SESSION_TOKEN_SIZE>;
+
+    // Chunk 消息：[type][flags]，首块额外携带 4 字节原消息总长度
+    enum ChunkFlags : uint8_t {
+        CHUNK_FIRST = 0x01,
+        CHUNK_LAST  = 0x02
+    };
+    constexpr size_t CHUNK_HEADER_SIZE = 2;
+    constexpr size_t CHUNK_FIRST_HEADER_SIZE = 6;
+
+    // Fragment 消息：[type][FragmentHeader][负载]。分片自带消息号和序号，
+    // 路径迁移时两条路径上的分片交错到达也能重组
+    enum FragmentFlags : uint8_t {
+        FRAGMENT_DROPPABLE = 0x01   // 视频：超过 deadlineMs 还没凑齐就放弃，不等重传
+    };
+
+    // InputBatch：[type] 之后是若干事件直到消息结尾，每个事件以标记字节开头。
+    // 鼠标事件：标记低 5 位为 key，之后是相对批内上一个鼠标事件的 dx、dy（第一个相对 (0,0)）；
+    // 键盘事件：带 INPUT_BATCH_KEYBOARD，之后是虚拟键码。带 INPUT_BATCH_HAS_FLAGS 时最后跟 flags。
+    // 数值都是 zigzag 变长整数，一次普通的鼠标移动只占 3~5 字节
+    enum InputBatchTag : uint8_t {
+        INPUT_BATCH_KEY_MASK  = 0x1F,
+        INPUT_BATCH_HAS_FLAGS = 0x40,
+        INPUT_BATCH_KEYBOARD  = 0x80
+    };
+
+    // MonitorList：[type][count][selected] 之后是 count 个 MonitorInfo，按服务端枚举顺序编号。
+    // SelectMonitor：[type][index]。MONITOR_SPAN 表示把全部显示器按桌面布局拼成一幅画面
+    constexpr uint8_t MONITOR_SPAN = 0xFF;
+    constexpr size_t MAX_MONITORS = 16;
+    enum MonitorFlags : uint8_t {
+        MONITOR_PRIMARY = 0x01
+    };
+
+    // CursorShape：[type][CursorShapeHeader] 之后是 width*height 个 BGRA 像素（非预乘 alpha）。
+    // 形状按内容哈希编号，两端各自按先进先出保留最近 CURSOR_CACHE_SIZE 个；
+    // 服务器认为对方已有的形状只发消息头，客户端收到完整形状时把它移到队尾，两边的淘汰顺序因此一致
+    constexpr size_t CURSOR_CACHE_SIZE = 32;
+    constexpr int MAX_CURSOR_SIZE = 256;
+
+    // 复用桌面连接的字节流：终端、SFTP 等不必再单独建连和穿透
+    using StreamId = uint32_t;
+    enum class StreamService : uint16_t {
+        Ssh = 1         // 服务端本机的 SSH 服务
+    };
+    enum StreamFlags : uint8_t {
+        STREAM_INTERACTIVE = 0x01   // 交互流（终端）走实时优先级，否则是批量数据，只用视频留下的空隙
     };
 
     #pragma pack(push, 1)
@@ -66,12 +152,159 @@ namespace Desktop {
         int32_t keyframeIntervalSec;
     };
 
+    // 时间戳为各自的单调时钟，微秒
+    struct PingMsg {
+        uint32_t seq;
+        int64_t sendUs;         // t1
+    };
+
+    struct PongMsg {
+        uint32_t seq;
+        int64_t pingSendUs;     // t1，原样回显
+        int64_t recvUs;         // t2
+        int64_t sendUs;         // t3
+    };
+
+    // VideoFeedback：头部之后紧跟 count 个 int64_t 到达时刻（接收端单调时钟，微秒），
+    // 依次对应第 firstIndex、firstIndex+1 ... 个收到的视频帧
+    struct VideoFeedbackHeader {
+        uint32_t firstIndex;
+        uint16_t count;
+    };
+
+    // StreamData：[type][flags][streamId][负载]，flags 放在最前，发送调度据此分类
+    struct StreamOpenMsg {
+        uint32_t streamId;
+        uint16_t service;
+        uint8_t flags;
+    };
+    struct StreamDataHeader {
+        uint8_t flags;
+        uint32_t streamId;
+    };
+    struct StreamCreditMsg {
+        uint32_t streamId;
+        uint32_t bytes;
+    };
+
+    // PathProbe：探测从哪条路径发出，应答就从同一条路径回去，两端据此各自测每条路径的 RTT 和丢包
+    enum PathProbeFlags : uint8_t {
+        PATH_PROBE_ACK = 0x01
+    };
+    struct PathProbeMsg {
+        uint8_t path;           // 发送方所用路径
+        uint8_t flags;
+        uint32_t seq;
+        int64_t sendUs;         // 探测发出时刻（发送方单调时钟），应答原样回显
+    };
+
+    struct FragmentHeader {
+        uint8_t flags;
+        uint32_t msgId;
+        uint16_t index;
+        uint16_t count;
+        uint32_t totalSize;     // 原消息长度
+        uint16_t deadlineMs;    // 可丢弃分片的有效期（发送端的帧间隔），可靠分片为 0
+    };
+    constexpr size_t FRAGMENT_HEADER_SIZE = 1 + sizeof(FragmentHeader);
+
+    struct HelloMsg {
+        uint16_t version;
+        uint32_t capabilities;
+    };
+
+    // 时间戳为服务端单调时钟（ClockSyncing::NowUs），客户端用时钟偏差换算到本地。
+    // size 是本结构的字节数：以后只在末尾追加字段，旧解析方按 size 跳过不认识的部分
+    struct VideoFrameInfo {
+        uint8_t size;
+        uint32_t seq;               // 编码帧序号，连续递增，用于发现缺帧
+        int64_t captureUs;          // 采集完成
+        int64_t encodeStartUs;
+        int64_t encodeEndUs;
+        uint16_t width;             // 编码分辨率
+        uint16_t height;
+    };
+
+    // 坐标为服务端的虚拟桌面坐标（主显示器左上角为原点），物理像素
+    struct MonitorInfo {
+        int32_t left;
+        int32_t top;
+        int32_t width;
+        int32_t height;
+        uint8_t flags;
+    };
+
+    struct CursorShapeHeader {
+        uint32_t shapeId;
+        uint16_t width;
+        uint16_t height;
+        uint16_t hotX;
+        uint16_t hotY;
+    };
+
+    // 热点在编码图像上的坐标，可以落在图像之外
+    struct CursorPositionMsg {
+        int32_t x;
+        int32_t y;
+        uint8_t visible;
+    };
+
     struct AudioConfigMsg {
         int32_t sampleRate;
         uint8_t channels;
         uint8_t asc[2]; // AudioSpecificConfig for AAC LC
     };
     #pragma pack(pop)
+
+    constexpr size_t VIDEO_INFO_HEADER_SIZE = VIDEO_HEADER_SIZE + sizeof(VideoFrameInfo);
+
+    // 解析视频帧头；info 只在帧携带时有效，payloadOffset 是编码数据的起点
+    struct VideoFrameView {
+        bool keyframe = false;
+        bool hasInfo = false;
+        VideoFrameInfo info{};
+        size_t payloadOffset = VIDEO_HEADER_SIZE;
+    };
+
+    inline bool ParseVideoFrame(const uint8_t* data, size_t size, VideoFrameView& out) {
+        if (size < VIDEO_HEADER_SIZE) return false;
+        out = VideoFrameView();
+        out.keyframe = (data[1] & VIDEO_KEYFRAME) != 0;
+        if (!(data[1] & VIDEO_HAS_INFO)) return true;
+
+        if (size < VIDEO_HEADER_SIZE + 1) return false;
+        size_t infoSize = data[VIDEO_HEADER_SIZE];
+        if (infoSize < sizeof(VideoFrameInfo) || size < VIDEO_HEADER_SIZE + infoSize) return false;
+        memcpy(&out.info, data + VIDEO_HEADER_SIZE, sizeof(VideoFrameInfo));
+        out.hasInfo = true;
+        out.payloadOffset = VIDEO_HEADER_SIZE + infoSize;
+        return true;
+    }
+
+    // pixels 为空表示引用已缓存的形状
+    inline bool ParseCursorShape(const uint8_t* data, size_t size, CursorShapeHeader& header, const uint8_t*& pixels) {
+        pixels = nullptr;
+        if (size < 1 + sizeof(CursorShapeHeader)) return false;
+        memcpy(&header, data + 1, sizeof(header));
+        size_t payload = size - 1 - sizeof(header);
+        if (payload == 0) return true;
+        if (header.width == 0 || header.height == 0 ||
+            header.width > MAX_CURSOR_SIZE || header.height > MAX_CURSOR_SIZE ||
+            payload != size_t(header.width) * header.height * 4) return false;
+        pixels = data + 1 + sizeof(header);
+        return true;
+    }
+
+    inline bool ParseMonitorList(const uint8_t* data, size_t size, std::vector<MonitorInfo>& out, uint8_t& selected) {
+        out.clear();
+        if (size < 3) return false;
+        size_t count = data[1];
+        selected = data[2];
+        if (count > MAX_MONITORS || size < 3 + count * sizeof(MonitorInfo)) return false;
+        out.resize(count);
+        if (count > 0) memcpy(out.data(), data + 3, count * sizeof(MonitorInfo));
+        return true;
+    }
 }
 
 
@@ -79,12 +312,18 @@ namespace Desktop {
 // ==================== 二进制数据 ====================
 using BinaryData = std::vector<uint8_t>;
 
+// 只读缓冲片段：分散/聚集发送时描述一段不归自己所有的内存
+struct ConstBuffer {
+    const uint8_t* data;
+    size_t size;
+};
+
 // ==================== 网络工具 ====================
 namespace NetUtil {
     inline bool SendAll(SOCKET sock, const void* data, int len) {
         const char* p = static_cast<const char*>(data);
         while (len > 0) {
-            int sent = send(sock, p, len, 0);
+            int sent = send(sock, p, len, NetCompat::SEND_FLAGS);
             if (sent <= 0) return false;
             p += sent;
             len -= sent;
@@ -104,8 +343,12 @@ namespace NetUtil {
     }
 
     inline bool InitWinsock() {
+#ifdef _WIN32
         WSADATA wsaData;
         return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+        return true;
+#endif
     }
 }
 
@@ -116,6 +359,30 @@ namespace MessageBuilder {
         return { static_cast<uint8_t>(Desktop::MsgType::KeyframeRequest) };
     }
 
+    // 附带客户端缺失的第一个帧序号，旧服务器忽略多出的字节
+    inline BinaryData KeyframeRequest(uint32_t missingSeq) {
+        BinaryData msg(1 + sizeof(missingSeq));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::KeyframeRequest);
+        memcpy(msg.data() + 1, &missingSeq, sizeof(missingSeq));
+        return msg;
+    }
+
+    inline BinaryData PathProbe(uint8_t path, bool ack, uint32_t seq, int64_t sendUs) {
+        Desktop::PathProbeMsg m{ path, static_cast<uint8_t>(ack ? Desktop::PATH_PROBE_ACK : 0), seq, sendUs };
+        BinaryData msg(1 + sizeof(m));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::PathProbe);
+        memcpy(msg.data() + 1, &m, sizeof(m));
+        return msg;
+    }
+
+    inline BinaryData Hello(uint16_t version, uint32_t capabilities) {
+        Desktop::HelloMsg m{ version, capabilities };
+        BinaryData msg(1 + sizeof(m));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::Hello);
+        memcpy(msg.data() + 1, &m, sizeof(m));
+        return msg;
+    }
+
     inline BinaryData StreamConfigMsg(int w, int fps, int kfIntervalSec) {
         BinaryData msg(1 + sizeof(Desktop::StreamConfig));
         msg[0] = static_cast<uint8_t>(Desktop::MsgType::StreamConfig);
@@ -126,11 +393,43 @@ namespace MessageBuilder {
         return msg;
     }
     
+    // 视频帧头（类型 + 关键帧标志），与编码数据分开发送以避免整帧拷贝
+    inline std::array<uint8_t, Desktop::VIDEO_HEADER_SIZE> VideoFrameHeader(bool isKeyframe) {
+        return { static_cast<uint8_t>(Desktop::MsgType::VideoFrame),
+                 static_cast<uint8_t>(isKeyframe ? Desktop::VIDEO_KEYFRAME : 0) };
+    }
+
+    // 带 VideoFrameInfo 的帧头，只发给握手时声明了 CAP_VIDEO_INFO 的观看者
+    inline std::array<uint8_t, Desktop::VIDEO_INFO_HEADER_SIZE> VideoFrameHeader(bool isKeyframe, Desktop::VideoFrameInfo info) {
+        std::array<uint8_t, Desktop::VIDEO_INFO_HEADER_SIZE> hdr{};
+        hdr[0] = static_cast<uint8_t>(Desktop::MsgType::VideoFrame);
+        hdr[1] = static_cast<uint8_t>((isKeyframe ? Desktop::VIDEO_KEYFRAME : 0) | Desktop::VIDEO_HAS_INFO);
+        info.size = static_cast<uint8_t>(sizeof(info));
+        memcpy(hdr.data() + Desktop::VIDEO_HEADER_SIZE, &info, sizeof(info));
+        return hdr;
+    }
+
+    // 分块头：非首块只发送前 CHUNK_HEADER_SIZE 字节
+    inline std::array<uint8_t, Desktop::CHUNK_FIRST_HEADER_SIZE> ChunkHeader(bool first, bool last, uint32_t totalSize) {
+        std::array<uint8_t, Desktop::CHUNK_FIRST_HEADER_SIZE> hdr{};
+        hdr[0] = static_cast<uint8_t>(Desktop::MsgType::Chunk);
+        hdr[1] = static_cast<uint8_t>((first ? Desktop::CHUNK_FIRST : 0) | (last ? Desktop::CHUNK_LAST : 0));
+        memcpy(hdr.data() + 2, &totalSize, sizeof(totalSize));
+        return hdr;
+    }
+
+    inline std::array<uint8_t, Desktop::FRAGMENT_HEADER_SIZE> FragmentHeader(const Desktop::FragmentHeader& h) {
+        std::array<uint8_t, Desktop::FRAGMENT_HEADER_SIZE> hdr{};
+        hdr[0] = static_cast<uint8_t>(Desktop::MsgType::Fragment);
+        memcpy(hdr.data() + 1, &h, sizeof(h));
+        return hdr;
+    }
+
     inline BinaryData VideoFrame(const uint8_t* data, size_t size, bool isKeyframe) {
         BinaryData msg;
         msg.reserve(2 + size);
         msg.push_back(static_cast<uint8_t>(Desktop::MsgType::VideoFrame));
-        msg.push_back(isKeyframe ? 1 : 0);
+        msg.push_back(isKeyframe ? Desktop::VIDEO_KEYFRAME : 0);
         msg.insert(msg.end(), data, data + size);
         return msg;
     }
@@ -151,6 +450,38 @@ namespace MessageBuilder {
         return msg;
     }
 
+    inline BinaryData MonitorList(const std::vector<Desktop::MonitorInfo>& monitors, uint8_t selected) {
+        size_t count = monitors.size() < Desktop::MAX_MONITORS ? monitors.size() : Desktop::MAX_MONITORS;
+        BinaryData msg(3 + count * sizeof(Desktop::MonitorInfo));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::MonitorList);
+        msg[1] = static_cast<uint8_t>(count);
+        msg[2] = selected;
+        if (count > 0) memcpy(msg.data() + 3, monitors.data(), count * sizeof(Desktop::MonitorInfo));
+        return msg;
+    }
+
+    inline BinaryData SelectMonitor(uint8_t index) {
+        return { static_cast<uint8_t>(Desktop::MsgType::SelectMonitor), index };
+    }
+
+    // pixels 为空时只发消息头，引用对方已缓存的同一形状
+    inline BinaryData CursorShape(const Desktop::CursorShapeHeader& header, const uint8_t* pixels) {
+        size_t pixelBytes = pixels ? size_t(header.width) * header.height * 4 : 0;
+        BinaryData msg(1 + sizeof(header) + pixelBytes);
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::CursorShape);
+        memcpy(msg.data() + 1, &header, sizeof(header));
+        if (pixelBytes > 0) memcpy(msg.data() + 1 + sizeof(header), pixels, pixelBytes);
+        return msg;
+    }
+
+    inline BinaryData CursorPosition(int32_t x, int32_t y, bool visible) {
+        Desktop::CursorPositionMsg m{ x, y, static_cast<uint8_t>(visible ? 1 : 0) };
+        BinaryData msg(1 + sizeof(m));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::CursorPosition);
+        memcpy(msg.data() + 1, &m, sizeof(m));
+        return msg;
+    }
+
     inline BinaryData ClientReady() {
         return { static_cast<uint8_t>(Desktop::MsgType::ClientReady) };
     }
@@ -177,6 +508,83 @@ namespace MessageBuilder {
         return msg;
     }
 
+    inline BinaryData InputPermission(bool allowed) {
+        BinaryData msg(2);
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::InputPermission);
+        msg[1] = allowed ? 1 : 0;
+        return msg;
+    }
+
+    inline BinaryData Ping(uint32_t seq, int64_t sendUs) {
+        BinaryData msg(1 + sizeof(Desktop::PingMsg));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::Ping);
+        Desktop::PingMsg ping{ seq, sendUs };
+        memcpy(msg.data() + 1, &ping, sizeof(ping));
+        return msg;
+    }
+
+    inline BinaryData Pong(const Desktop::PingMsg& ping, int64_t recvUs, int64_t sendUs) {
+        BinaryData msg(1 + sizeof(Desktop::PongMsg));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::Pong);
+        Desktop::PongMsg pong{ ping.seq, ping.sendUs, recvUs, sendUs };
+        memcpy(msg.data() + 1, &pong, sizeof(pong));
+        return msg;
+    }
+
+    inline BinaryData VideoFeedback(uint32_t firstIndex, const int64_t* arrivalUs, uint16_t count) {
+        BinaryData msg(1 + sizeof(Desktop::VideoFeedbackHeader) + count * sizeof(int64_t));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::VideoFeedback);
+        Desktop::VideoFeedbackHeader hdr{ firstIndex, count };
+        memcpy(msg.data() + 1, &hdr, sizeof(hdr));
+        if (count > 0) memcpy(msg.data() + 1 + sizeof(hdr), arrivalUs, count * sizeof(int64_t));
+        return msg;
+    }
+
+    inline BinaryData SessionToken(const Desktop::SessionTokenBytes& token, uint32_t graceMs) {
+        BinaryData msg(1 + token.size() + sizeof(graceMs));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::SessionToken);
+        memcpy(msg.data() + 1, token.data(), token.size());
+        memcpy(msg.data() + 1 + token.size(), &graceMs, sizeof(graceMs));
+        return msg;
+    }
+
+    inline BinaryData ResumeSession(const Desktop::SessionTokenBytes& token) {
+        BinaryData msg(1 + token.size());
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::ResumeSession);
+        memcpy(msg.data() + 1, token.data(), token.size());
+        return msg;
+    }
+
+    inline BinaryData ResumeResult(bool ok) {
+        BinaryData msg(2);
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::ResumeResult);
+        msg[1] = ok ? 1 : 0;
+        return msg;
+    }
+
+    inline BinaryData StreamOpen(Desktop::StreamId id, Desktop::StreamService service, uint8_t flags) {
+        Desktop::StreamOpenMsg m{ id, static_cast<uint16_t>(service), flags };
+        BinaryData msg(1 + sizeof(m));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::StreamOpen);
+        memcpy(msg.data() + 1, &m, sizeof(m));
+        return msg;
+    }
+
+    inline BinaryData StreamCredit(Desktop::StreamId id, uint32_t bytes) {
+        Desktop::StreamCreditMsg m{ id, bytes };
+        BinaryData msg(1 + sizeof(m));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::StreamCredit);
+        memcpy(msg.data() + 1, &m, sizeof(m));
+        return msg;
+    }
+
+    inline BinaryData StreamClose(Desktop::StreamId id) {
+        BinaryData msg(1 + sizeof(id));
+        msg[0] = static_cast<uint8_t>(Desktop::MsgType::StreamClose);
+        memcpy(msg.data() + 1, &id, sizeof(id));
+        return msg;
+    }
+
     inline BinaryData AudioEnableMsg(bool enabled) {
         BinaryData msg(2);
         msg[0] = static_cast<uint8_t>(Desktop::MsgType::AudioEnable);
@@ -184,6 +592,17 @@ namespace MessageBuilder {
         return msg;
     }
 
+    // 将分散的片段拼成一条完整消息（不支持分散发送的传输层使用）
+    inline BinaryData Gather(const ConstBuffer* parts, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) total += parts[i].size;
+        BinaryData msg;
+        msg.reserve(total);
+        for (size_t i = 0; i < count; i++)
+            msg.insert(msg.end(), parts[i].data, parts[i].data + parts[i].size);
+        return msg;
+    }
+
 }
 
 #endif // PROTOCOL_H
@@ -0,0 +1,320 @@
+#include "secure_channel.h"
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <bcrypt.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "bcrypt.lib")
+#endif
+#else
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/params.h>
+#endif
+
+using namespace SecureChanneling;
+
+namespace {
+    constexpr size_t HASH_SIZE = 32;
+    const char HKDF_LABEL[] = "remote desktop record v1";
+
+    void WipeBytes(void* p, size_t n) {
+        volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+        while (n--) *v++ = 0;
+    }
+
+    void MakeNonce(const std::array<uint8_t, 4>& salt, uint64_t seq, uint8_t nonce[NONCE_SIZE]) {
+        memcpy(nonce, salt.data(), salt.size());
+        for (int i = 0; i < 8; i++) nonce[4 + i] = static_cast<uint8_t>(seq >> (8 * i));
+    }
+}
+
+// ==================== 平台后端 ====================
+#ifdef _WIN32
+// CNG 的伪句柄（Windows 10 起）不需要打开和关闭算法提供程序
+struct SecureSession::Backend {
+    BCRYPT_KEY_HANDLE keyPair = nullptr;
+    BCRYPT_KEY_HANDLE sendKey = nullptr;
+    BCRYPT_KEY_HANDLE recvKey = nullptr;
+
+    ~Backend() {
+        if (keyPair) BCryptDestroyKey(keyPair);
+        if (sendKey) BCryptDestroyKey(sendKey);
+        if (recvKey) BCryptDestroyKey(recvKey);
+    }
+
+    bool generate(uint8_t pub[PUBLIC_KEY_SIZE]) {
+        if (!BCRYPT_SUCCESS(BCryptGenerateKeyPair(BCRYPT_ECDH_P256_ALG_HANDLE, &keyPair, 256, 0))) return false;
+        if (!BCRYPT_SUCCESS(BCryptFinalizeKeyPair(keyPair, 0))) return false;
+
+        uint8_t blob[sizeof(BCRYPT_ECCKEY_BLOB) + PUBLIC_KEY_SIZE];
+        ULONG len = 0;
+        if (!BCRYPT_SUCCESS(BCryptExportKey(keyPair, nullptr, BCRYPT_ECCPUBLIC_BLOB,
+                                            blob, sizeof(blob), &len, 0)) || len != sizeof(blob)) {
+            return false;
+        }
+        memcpy(pub, blob + sizeof(BCRYPT_ECCKEY_BLOB), PUBLIC_KEY_SIZE);
+        return true;
+    }
+
+    // 输出 SHA-256(Z)，Z 为共享点的 x 坐标
+    bool agree(const uint8_t peerPub[PUBLIC_KEY_SIZE], uint8_t out[HASH_SIZE]) {
+        uint8_t blob[sizeof(BCRYPT_ECCKEY_BLOB) + PUBLIC_KEY_SIZE];
+        auto* hdr = reinterpret_cast<BCRYPT_ECCKEY_BLOB*>(blob);
+        hdr->dwMagic = BCRYPT_ECDH_PUBLIC_P256_MAGIC;
+        hdr->cbKey = PUBLIC_KEY_SIZE / 2;
+        memcpy(blob + sizeof(BCRYPT_ECCKEY_BLOB), peerPub, PUBLIC_KEY_SIZE);
+
+        BCRYPT_KEY_HANDLE peer = nullptr;
+        if (!BCRYPT_SUCCESS(BCryptImportKeyPair(BCRYPT_ECDH_P256_ALG_HANDLE, nullptr, BCRYPT_ECCPUBLIC_BLOB,
+                                                &peer, blob, sizeof(blob), 0))) {
+            return false;
+        }
+        BCRYPT_SECRET_HANDLE secret = nullptr;
+        NTSTATUS st = BCryptSecretAgreement(keyPair, peer, &secret, 0);
+        BCryptDestroyKey(peer);
+        if (!BCRYPT_SUCCESS(st)) return false;
+
+        // 不带前后缀的 KDF_HASH 即对原始共享秘密做一次哈希
+        BCryptBuffer param = { sizeof(BCRYPT_SHA256_ALGORITHM), KDF_HASH_ALGORITHM,
+                               const_cast<wchar_t*>(BCRYPT_SHA256_ALGORITHM) };
+        BCryptBufferDesc desc = { BCRYPTBUFFER_VERSION, 1, &param };
+        ULONG len = 0;
+        st = BCryptDeriveKey(secret, BCRYPT_KDF_HASH, &desc, out, HASH_SIZE, &len, 0);
+        BCryptDestroySecret(secret);
+        return BCRYPT_SUCCESS(st) && len == HASH_SIZE;
+    }
+
+    static bool hmac(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t out[HASH_SIZE]) {
+        return BCRYPT_SUCCESS(BCryptHash(BCRYPT_HMAC_SHA256_ALG_HANDLE,
+                                         const_cast<PUCHAR>(key), static_cast<ULONG>(keyLen),
+                                         const_cast<PUCHAR>(data), static_cast<ULONG>(len),
+                                         out, HASH_SIZE));
+    }
+
+    bool setKeys(const uint8_t send[KEY_SIZE], const uint8_t recv[KEY_SIZE]) {
+        return BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(BCRYPT_AES_GCM_ALG_HANDLE, &sendKey, nullptr, 0,
+                                                         const_cast<PUCHAR>(send), KEY_SIZE, 0))
+            && BCRYPT_SUCCESS(BCryptGenerateSymmetricKey(BCRYPT_AES_GCM_ALG_HANDLE, &recvKey, nullptr, 0,
+                                                         const_cast<PUCHAR>(recv), KEY_SIZE, 0));
+    }
+
+    bool seal(const uint8_t nonce[NONCE_SIZE], uint8_t* data, size_t size, uint8_t tag[TAG_SIZE]) {
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = const_cast<PUCHAR>(nonce);
+        info.cbNonce = NONCE_SIZE;
+        info.pbTag = tag;
+        info.cbTag = TAG_SIZE;
+        ULONG out = 0;
+        return BCRYPT_SUCCESS(BCryptEncrypt(sendKey, data, static_cast<ULONG>(size), &info, nullptr, 0,
+                                            data, static_cast<ULONG>(size), &out, 0));
+    }
+
+    bool open(const uint8_t nonce[NONCE_SIZE], uint8_t* data, size_t size, const uint8_t tag[TAG_SIZE]) {
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = const_cast<PUCHAR>(nonce);
+        info.cbNonce = NONCE_SIZE;
+        info.pbTag = const_cast<PUCHAR>(tag);
+        info.cbTag = TAG_SIZE;
+        ULONG out = 0;
+        return BCRYPT_SUCCESS(BCryptDecrypt(recvKey, data, static_cast<ULONG>(size), &info, nullptr, 0,
+                                            data, static_cast<ULONG>(size), &out, 0));
+    }
+};
+#else
+struct SecureSession::Backend {
+    EVP_PKEY* keyPair = nullptr;
+    EVP_CIPHER_CTX* sendCtx = nullptr;
+    EVP_CIPHER_CTX* recvCtx = nullptr;
+
+    ~Backend() {
+        EVP_PKEY_free(keyPair);
+        EVP_CIPHER_CTX_free(sendCtx);
+        EVP_CIPHER_CTX_free(recvCtx);
+    }
+
+    bool generate(uint8_t pub[PUBLIC_KEY_SIZE]) {
+        keyPair = EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256");
+        if (!keyPair) return false;
+
+        // 未压缩点：0x04 || X || Y
+        uint8_t point[1 + PUBLIC_KEY_SIZE];
+        size_t len = 0;
+        if (EVP_PKEY_get_octet_string_param(keyPair, OSSL_PKEY_PARAM_PUB_KEY, point, sizeof(point), &len) != 1 ||
+            len != sizeof(point) || point[0] != 0x04) {
+            return false;
+        }
+        memcpy(pub, point + 1, PUBLIC_KEY_SIZE);
+        return true;
+    }
+
+    // 输出 SHA-256(Z)，Z 为共享点的 x 坐标
+    bool agree(const uint8_t peerPub[PUBLIC_KEY_SIZE], uint8_t out[HASH_SIZE]) {
+        uint8_t point[1 + PUBLIC_KEY_SIZE];
+        point[0] = 0x04;
+        memcpy(point + 1, peerPub, PUBLIC_KEY_SIZE);
+        char group[] = "P-256";
+        OSSL_PARAM params[] = {
+            OSSL_PARAM_construct_utf8_string(OSSL_PKEY_PARAM_GROUP_NAME, group, 0),
+            OSSL_PARAM_construct_octet_string(OSSL_PKEY_PARAM_PUB_KEY, point, sizeof(point)),
+            OSSL_PARAM_construct_end()
+        };
+
+        EVP_PKEY* peer = nullptr;
+        EVP_PKEY_CTX* fromCtx = EVP_PKEY_CTX_new_from_name(nullptr, "EC", nullptr);
+        bool ok = fromCtx && EVP_PKEY_fromdata_init(fromCtx) == 1 &&
+                  EVP_PKEY_fromdata(fromCtx, &peer, EVP_PKEY_PUBLIC_KEY, params) == 1;
+        EVP_PKEY_CTX_free(fromCtx);
+
+        uint8_t z[32];
+        size_t zLen = sizeof(z);
+        EVP_PKEY_CTX* deriveCtx = ok ? EVP_PKEY_CTX_new(keyPair, nullptr) : nullptr;
+        // set_peer 会校验对端公钥确实在曲线上
+        ok = deriveCtx && EVP_PKEY_derive_init(deriveCtx) == 1 &&
+             EVP_PKEY_derive_set_peer(deriveCtx, peer) == 1 &&
+             EVP_PKEY_derive(deriveCtx, z, &zLen) == 1 && zLen == sizeof(z);
+        EVP_PKEY_CTX_free(deriveCtx);
+        EVP_PKEY_free(peer);
+
+        ok = ok && EVP_Digest(z, sizeof(z), out, nullptr, EVP_sha256(), nullptr) == 1;
+        OPENSSL_cleanse(z, sizeof(z));
+        return ok;
+    }
+
+    static bool hmac(const uint8_t* key, size_t keyLen, const uint8_t* data, size_t len, uint8_t out[HASH_SIZE]) {
+        unsigned int outLen = 0;
+        return HMAC(EVP_sha256(), key, static_cast<int>(keyLen), data, len, out, &outLen) && outLen == HASH_SIZE;
+    }
+
+    bool setKeys(const uint8_t send[KEY_SIZE], const uint8_t recv[KEY_SIZE]) {
+        sendCtx = EVP_CIPHER_CTX_new();
+        recvCtx = EVP_CIPHER_CTX_new();
+        return sendCtx && recvCtx &&
+               EVP_EncryptInit_ex(sendCtx, EVP_aes_256_gcm(), nullptr, send, nullptr) == 1 &&
+               EVP_DecryptInit_ex(recvCtx, EVP_aes_256_gcm(), nullptr, recv, nullptr) == 1;
+    }
+
+    // 密钥已经展开，每条记录只换 nonce
+    bool seal(const uint8_t nonce[NONCE_SIZE], uint8_t* data, size_t size, uint8_t tag[TAG_SIZE]) {
+        int len = 0, fin = 0;
+        return EVP_EncryptInit_ex(sendCtx, nullptr, nullptr, nullptr, nonce) == 1 &&
+               EVP_EncryptUpdate(sendCtx, data, &len, data, static_cast<int>(size)) == 1 &&
+               EVP_EncryptFinal_ex(sendCtx, data + len, &fin) == 1 &&
+               EVP_CIPHER_CTX_ctrl(sendCtx, EVP_CTRL_GCM_GET_TAG, TAG_SIZE, tag) == 1;
+    }
+
+    bool open(const uint8_t nonce[NONCE_SIZE], uint8_t* data, size_t size, const uint8_t tag[TAG_SIZE]) {
+        int len = 0, fin = 0;
+        return EVP_DecryptInit_ex(recvCtx, nullptr, nullptr, nullptr, nonce) == 1 &&
+               EVP_DecryptUpdate(recvCtx, data, &len, data, static_cast<int>(size)) == 1 &&
+               EVP_CIPHER_CTX_ctrl(recvCtx, EVP_CTRL_GCM_SET_TAG, TAG_SIZE, const_cast<uint8_t*>(tag)) == 1 &&
+               EVP_DecryptFinal_ex(recvCtx, data + len, &fin) == 1;
+    }
+};
+#endif
+
+// ==================== 会话 ====================
+SecureSession::SecureSession(Role role, const std::string& psk)
+    : role_(role), psk_(psk), backend_(std::make_unique<Backend>()) {}
+
+SecureSession::~SecureSession() {
+    if (!psk_.empty()) WipeBytes(&psk_[0], psk_.size());
+}
+
+bool SecureSession::init() {
+    memcpy(hello_.data(), &HELLO_MAGIC, sizeof(HELLO_MAGIC));
+    if (!backend_->generate(hello_.data() + sizeof(HELLO_MAGIC))) {
+        std::cerr << "[Secure] Failed to generate ephemeral key pair" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SecureSession::onPeerHello(const uint8_t* data, size_t size) {
+    uint32_t magic = 0;
+    if (size < HELLO_SIZE) return false;
+    memcpy(&magic, data, sizeof(magic));
+    if (magic != HELLO_MAGIC) {
+        std::cerr << "[Secure] Peer did not start an encrypted session (version mismatch?)" << std::endl;
+        return false;
+    }
+    const uint8_t* peerPub = data + sizeof(HELLO_MAGIC);
+    const uint8_t* ownPub = hello_.data() + sizeof(HELLO_MAGIC);
+
+    uint8_t ikm[HASH_SIZE];
+    if (!backend_->agree(peerPub, ikm)) {
+        std::cerr << "[Secure] Key agreement failed (invalid peer key)" << std::endl;
+        return false;
+    }
+
+    // HKDF-SHA256：口令作盐，握手双方的公钥按 客户端||服务端 写进 info，
+    // 绑定这一次握手
+    uint8_t zeroSalt[HASH_SIZE] = {};
+    const uint8_t* salt = psk_.empty() ? zeroSalt : reinterpret_cast<const uint8_t*>(psk_.data());
+    size_t saltLen = psk_.empty() ? sizeof(zeroSalt) : psk_.size();
+    uint8_t prk[HASH_SIZE];
+    bool ok = Backend::hmac(salt, saltLen, ikm, sizeof(ikm), prk);
+    WipeBytes(ikm, sizeof(ikm));
+
+    std::vector<uint8_t> info(HKDF_LABEL, HKDF_LABEL + sizeof(HKDF_LABEL) - 1);
+    const uint8_t* clientPub = role_ == Role::Client ? ownPub : peerPub;
+    const uint8_t* serverPub = role_ == Role::Client ? peerPub : ownPub;
+    info.insert(info.end(), clientPub, clientPub + PUBLIC_KEY_SIZE);
+    info.insert(info.end(), serverPub, serverPub + PUBLIC_KEY_SIZE);
+
+    // 输出：客户端→服务端密钥、服务端→客户端密钥、两个方向的 nonce 前缀
+    uint8_t okm[3 * HASH_SIZE];
+    std::vector<uint8_t> block;
+    for (size_t i = 0; ok && i < 3; i++) {
+        block.assign(i > 0 ? okm + (i - 1) * HASH_SIZE : okm, i > 0 ? okm + i * HASH_SIZE : okm);
+        block.insert(block.end(), info.begin(), info.end());
+        block.push_back(static_cast<uint8_t>(i + 1));
+        ok = Backend::hmac(prk, sizeof(prk), block.data(), block.size(), okm + i * HASH_SIZE);
+    }
+    WipeBytes(prk, sizeof(prk));
+
+    const uint8_t* c2sKey = okm;
+    const uint8_t* s2cKey = okm + KEY_SIZE;
+    const uint8_t* c2sSalt = okm + 2 * KEY_SIZE;
+    const uint8_t* s2cSalt = c2sSalt + sendSalt_.size();
+    bool client = role_ == Role::Client;
+    ok = ok && backend_->setKeys(client ? c2sKey : s2cKey, client ? s2cKey : c2sKey);
+    memcpy(sendSalt_.data(), client ? c2sSalt : s2cSalt, sendSalt_.size());
+    memcpy(recvSalt_.data(), client ? s2cSalt : c2sSalt, recvSalt_.size());
+    WipeBytes(okm, sizeof(okm));
+    if (!block.empty()) WipeBytes(block.data(), block.size());
+
+    if (!ok) {
+        std::cerr << "[Secure] Session key derivation failed" << std::endl;
+        return false;
+    }
+    established_ = true;
+    return true;
+}
+
+bool SecureSession::seal(uint8_t* data, size_t size, uint8_t tag[TAG_SIZE]) {
+    if (!established_) return false;
+    uint8_t nonce[NONCE_SIZE];
+    MakeNonce(sendSalt_, sendSeq_++, nonce);
+    return backend_->seal(nonce, data, size, tag);
+}
+
+bool SecureSession::open(uint8_t* data, size_t size, const uint8_t tag[TAG_SIZE]) {
+    if (!established_) return false;
+    uint8_t nonce[NONCE_SIZE];
+    MakeNonce(recvSalt_, recvSeq_++, nonce);
+    return backend_->open(nonce, data, size, tag);
+}
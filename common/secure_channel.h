@@ -0,0 +1,78 @@
+#ifndef SECURE_CHANNEL_H
+#define SECURE_CHANNEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace SecureChanneling {
+    // 握手：双方连接后立即发送 [magic][P-256 公钥 X||Y]，不等对方
+    constexpr uint32_t HELLO_MAGIC = 0x31455243;    // "CRE1"
+    constexpr size_t PUBLIC_KEY_SIZE = 64;
+    constexpr size_t HELLO_SIZE = sizeof(uint32_t) + PUBLIC_KEY_SIZE;
+
+    // 记录：[4 字节密文长度][AES-256-GCM 密文][16 字节标签]，
+    // 明文是若干条原始帧（长度前缀 + 消息或分块）首尾相接
+    constexpr size_t KEY_SIZE = 32;
+    constexpr size_t TAG_SIZE = 16;
+    constexpr size_t NONCE_SIZE = 12;
+    constexpr size_t RECORD_HEADER_SIZE = sizeof(uint32_t);
+    // 攒够这么多明文就封一条记录；单条超过它的消息独占一条记录
+    constexpr size_t RECORD_BATCH = 64 * 1024;
+    // 对端的第一条记录通过认证之前，发送方可能根本不知道口令，长度只放宽到一批明文加标签，
+    // 免得未认证的连接让接收端按最大消息分配缓冲。发送方的第一条记录据此不超过 RECORD_BATCH，
+    // 第一段就超长时先发一条空记录完成认证
+    constexpr size_t MAX_UNAUTHENTICATED_RECORD = RECORD_BATCH + TAG_SIZE;
+}
+
+// ==================== 加密会话 ====================
+// 临时 ECDH (P-256) 协商出共享秘密，以预共享口令为盐做 HKDF-SHA256，
+// 按方向派生 AES-256-GCM 密钥和 4 字节 nonce 前缀，nonce 其余 8 字节是记录计数，
+// 两端按 TCP 顺序各自递增，不上线路。口令不一致时派生出的密钥不同，
+// 第一条记录就会校验失败，中间人没有口令也无法冒充任一端。
+// 局限：口令只用作 HKDF 的盐，没有 PAKE。主动中间人与一端完成 ECDH 后，
+// 拿到对方的第一条记录就可以离线逐个猜口令验证标签，强度全靠口令本身，弱口令挡不住。
+// 口令为空时盐全为零，只剩匿名 ECDH：挡得住被动窃听，挡不住中间人，不能算作已认证。
+// Windows 走 CNG（bcrypt），其他平台走 OpenSSL libcrypto，两者都使用 AES-NI/PCLMUL。
+// 不是线程安全的：只在所属连接的事件循环线程里使用。
+class SecureSession {
+public:
+    enum class Role { Client, Server };
+
+    SecureSession(Role role, const std::string& psk);
+    ~SecureSession();
+    SecureSession(const SecureSession&) = delete;
+    SecureSession& operator=(const SecureSession&) = delete;
+
+    // 生成本端临时密钥对；失败时不能使用
+    bool init();
+    const std::array<uint8_t, SecureChanneling::HELLO_SIZE>& hello() const { return hello_; }
+
+    // 收到对端握手后派生会话密钥
+    bool onPeerHello(const uint8_t* data, size_t size);
+    bool established() const { return established_; }
+    // 有口令参与密钥派生，对端必须知道同一口令；为空时不认证对端
+    bool authenticated() const { return !psk_.empty(); }
+
+    // 原地加密/解密；open 失败说明数据被篡改或口令不一致，连接必须断开
+    bool seal(uint8_t* data, size_t size, uint8_t tag[SecureChanneling::TAG_SIZE]);
+    bool open(uint8_t* data, size_t size, const uint8_t tag[SecureChanneling::TAG_SIZE]);
+
+private:
+    struct Backend;
+
+    Role role_;
+    std::string psk_;
+    std::unique_ptr<Backend> backend_;
+    std::array<uint8_t, SecureChanneling::HELLO_SIZE> hello_{};
+    bool established_ = false;
+
+    std::array<uint8_t, 4> sendSalt_{};
+    std::array<uint8_t, 4> recvSalt_{};
+    uint64_t sendSeq_ = 0;
+    uint64_t recvSeq_ = 0;
+};
+
+#endif // SECURE_CHANNEL_H
@@ -0,0 +1,229 @@
+#include "send_scheduler.h"
+#include <algorithm>
+#include <iostream>
+
+SendPriority SendScheduling::Classify(const uint8_t* msg, size_t size) {
+    if (!msg || size == 0) return SendPriority::Control;
+    switch (static_cast<Desktop::MsgType>(msg[0])) {
+        case Desktop::MsgType::VideoFrame:
+            return SendPriority::Video;
+        case Desktop::MsgType::InputEvent:
+        case Desktop::MsgType::InputBatch:
+        case Desktop::MsgType::CursorPosition:
+        case Desktop::MsgType::AudioData:
+            return SendPriority::Realtime;
+        case Desktop::MsgType::StreamData:
+            return (size > 1 && (msg[1] & Desktop::STREAM_INTERACTIVE)) ? SendPriority::Realtime : SendPriority::Bulk;
+        default:
+            return SendPriority::Control;
+    }
+}
+
+size_t SendScheduler::Piece::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += parts[i].size;
+    return total;
+}
+
+void SendScheduler::Piece::clear() {
+    count = 0;
+    keep.reset();
+}
+
+bool SendScheduler::isKeyframe(const BufferRef& msg) {
+    return msg.size() > 1 && (msg[1] & Desktop::VIDEO_KEYFRAME) != 0;
+}
+
+bool SendScheduler::submit(const ConstBuffer* parts, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += parts[i].size;
+    if (total == 0) return false;
+
+    BufferRef msg = BufferPool::shared().acquire(total);
+    size_t off = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (parts[i].size == 0) continue;
+        memcpy(msg.data() + off, parts[i].data, parts[i].size);
+        off += parts[i].size;
+    }
+    return submit(msg);
+}
+
+bool SendScheduler::submit(const BufferRef& msg) {
+    if (msg.empty()) return false;
+    SendPriority prio = SendScheduling::Classify(msg.data(), msg.size());
+
+    bool dropped = false;
+    bool wasIdle = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (broken_) return false;
+        wasIdle = !hasPendingLocked();
+
+        if (prio == SendPriority::Video) {
+            enqueueVideoLocked(msg, dropped);
+        } else {
+            auto& q = queues_[static_cast<int>(prio)];
+            if (prio == SendPriority::Realtime && q.size() >= SendScheduling::MAX_QUEUED_REALTIME) {
+                // 音频过期就没有意义了，丢最旧的；流数据和输入必须送达
+                auto audio = std::find_if(q.begin(), q.end(), [](const BufferRef& m) {
+                    return m[0] == static_cast<uint8_t>(Desktop::MsgType::AudioData);
+                });
+                if (audio != q.end()) q.erase(audio);
+            }
+            q.push_back(msg);
+        }
+    }
+    if (wasIdle && onReady_) onReady_();
+    if (dropped && onVideoDropped_) onVideoDropped_();
+    return true;
+}
+
+bool SendScheduler::enqueueVideoLocked(const BufferRef& msg, bool& dropped) {
+    auto& q = queues_[static_cast<int>(SendPriority::Video)];
+    bool key = isKeyframe(msg);
+
+    if (key) {
+        // 新关键帧让所有尚未发出的帧都失去意义
+        if (!q.empty()) {
+            droppedVideo_ += q.size();
+            q.clear();
+        }
+        awaitingKeyframe_ = false;
+        q.push_back(msg);
+        return true;
+    }
+
+    if (awaitingKeyframe_) {
+        // 参考链已断，依赖帧发出去也解不出来
+        droppedVideo_++;
+        return false;
+    }
+
+    if (q.size() >= SendScheduling::MAX_QUEUED_VIDEO) {
+        droppedVideo_ += q.size() + 1;
+        q.clear();
+        awaitingKeyframe_ = true;
+        dropped = true;
+        return false;
+    }
+
+    q.push_back(msg);
+    return true;
+}
+
+bool SendScheduler::hasPendingLocked() const {
+    if (video_) return true;
+    for (auto& q : queues_) if (!q.empty()) return true;
+    return false;
+}
+
+void SendScheduler::reset() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& q : queues_) q.clear();
+    video_.reset();
+    videoSent_ = 0;
+    broken_ = false;
+    awaitingKeyframe_ = false;
+}
+
+void SendScheduler::awaitKeyframe() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    queues_[static_cast<int>(SendPriority::Video)].clear();
+    awaitingKeyframe_ = true;
+}
+
+void SendScheduler::markBroken() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& q : queues_) q.clear();
+    video_.reset();
+    broken_ = true;
+}
+
+bool SendScheduler::pull(Piece& out, int64_t* waitUs) {
+    out.clear();
+    if (waitUs) *waitUs = 0;
+    size_t finishedFrame = 0;
+    bool ok;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ok = pullLocked(out, waitUs, finishedFrame);
+    }
+    if (finishedFrame > 0 && onVideoSent_) onVideoSent_(finishedFrame);
+    return ok;
+}
+
+bool SendScheduler::pullLocked(Piece& out, int64_t* waitUs, size_t& finishedFrame) {
+    if (broken_) return false;
+
+    // 控制 > 实时 > 视频；视频发送中途也先让紧急消息插队
+    for (int p = 0; p < static_cast<int>(SendPriority::Video); p++) {
+        auto& q = queues_[p];
+        if (q.empty()) continue;
+        out.keep = std::move(q.front());
+        q.pop_front();
+        out.parts[0] = { out.keep.data(), out.keep.size() };
+        out.count = 1;
+        return true;
+    }
+
+    if (pullVideoLocked(out, waitUs, finishedFrame)) return true;
+
+    // 批量数据填视频的空隙；视频被节拍器拦住时也照发
+    auto& bq = queues_[static_cast<int>(SendPriority::Bulk)];
+    if (bq.empty()) return false;
+    out.keep = std::move(bq.front());
+    bq.pop_front();
+    out.parts[0] = { out.keep.data(), out.keep.size() };
+    out.count = 1;
+    if (waitUs) *waitUs = 0;
+    return true;
+}
+
+bool SendScheduler::pullVideoLocked(Piece& out, int64_t* waitUs, size_t& finishedFrame) {
+    auto now = Pacer::Clock::now();
+    if (!video_) {
+        auto& vq = queues_[static_cast<int>(SendPriority::Video)];
+        if (vq.empty()) return false;
+        video_ = std::move(vq.front());
+        vq.pop_front();
+        videoSent_ = 0;
+        pacer_.beginFrame(video_.size(), now);
+    }
+
+    size_t total = video_.size();
+    bool first = (videoSent_ == 0);
+    size_t chunkLen = std::min(SendScheduling::CHUNK_SIZE, total - videoSent_);
+    bool last = (videoSent_ + chunkLen == total);
+
+    auto wait = pacer_.delayFor(chunkLen, now);
+    if (wait.count() > 0) {
+        if (waitUs) *waitUs = wait.count();
+        return false;
+    }
+    pacer_.consume(chunkLen, now);
+
+    // 小帧不值得分块，整条发出
+    if (total <= SendScheduling::CHUNK_SIZE) {
+        out.keep = std::move(video_);
+        out.parts[0] = { out.keep.data(), out.keep.size() };
+        out.count = 1;
+        pacer_.endFrame(now);
+        finishedFrame = total;
+        return true;
+    }
+
+    out.header = MessageBuilder::ChunkHeader(first, last, static_cast<uint32_t>(total));
+    out.keep = video_;
+    out.parts[0] = { out.header.data(), first ? out.header.size() : Desktop::CHUNK_HEADER_SIZE };
+    out.parts[1] = { video_.data() + videoSent_, chunkLen };
+    out.count = 2;
+
+    videoSent_ += chunkLen;
+    if (last) {
+        video_.reset();
+        pacer_.endFrame(now);
+        finishedFrame = total;
+    }
+    return true;
+}
@@ -0,0 +1,107 @@
+#ifndef SEND_SCHEDULER_H
+#define SEND_SCHEDULER_H
+
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "pacer.h"
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+
+// ==================== 发送优先级 ====================
+enum class SendPriority : uint8_t {
+    Control  = 0,   // ScreenInfo / StreamConfig / KeyframeRequest 等
+    Realtime = 1,   // 输入事件、指针位置、音频
+    Video    = 2,   // 视频帧（可分块、可丢弃）
+    Bulk     = 3,   // 复用流的批量数据（SFTP）：可靠不丢，只用视频留下的空隙
+    Count
+};
+
+namespace SendScheduling {
+    // 大于该长度的视频消息拆成若干 Chunk 发送，块之间可插入更紧急的消息
+    constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+    // 各优先级队列上限：视频最多积压两帧，音频约一秒
+    constexpr size_t MAX_QUEUED_VIDEO = 2;
+    constexpr size_t MAX_QUEUED_REALTIME = 64;
+
+    SendPriority Classify(const uint8_t* msg, size_t size);
+}
+
+// ==================== 发送调度器 ====================
+// 按优先级排列待发消息，连接在套接字可写时逐段拉取（pull），调用方只入队、
+// 从不阻塞在网络上。视频按块拉取，每块之间先发控制/实时消息。视频队列满时
+// 丢弃尚未开始发送的旧帧（最新帧优先），并在下一个关键帧到来前丢弃所有
+// 依赖帧，同时通过 onVideoDropped 通知编码端尽快产出恢复帧。
+// 设置了节拍速率后，视频段还要等令牌桶放行，控制/实时消息不受限。
+// 批量流数据排在视频之后，视频为空或被节拍器拦住时才发，总量由流的额度限制。
+class SendScheduler {
+public:
+    // 一段待写数据：一条完整消息或视频的一个分块（不含长度前缀）。
+    // 片段指向 keep 持有的缓冲和 header，Piece 自身不可拷贝
+    struct Piece {
+        Piece() = default;
+        Piece(const Piece&) = delete;
+        Piece& operator=(const Piece&) = delete;
+
+        ConstBuffer parts[2] = {};
+        size_t count = 0;
+        BufferRef keep;
+        std::array<uint8_t, Desktop::CHUNK_FIRST_HEADER_SIZE> header{};
+
+        size_t size() const;
+        void clear();
+    };
+
+    SendScheduler() = default;
+
+    // 非拥有的片段会拷贝到池化缓冲；BufferRef 版本只增加引用计数
+    bool submit(const ConstBuffer* parts, size_t count);
+    bool submit(const BufferRef& msg);
+
+    // 取出下一段要写的数据，队列为空或视频被节拍器拦住时返回 false；
+    // 后一种情况 waitUs 给出还需等待的微秒数，否则为 0
+    bool pull(Piece& out, int64_t* waitUs = nullptr);
+
+    // 任意线程调用：按编码码率和帧率设置视频节拍，bitsPerSec <= 0 关闭
+    void setPacingRate(int bitsPerSec, int fps) { pacer_.setRate(bitsPerSec, fps); }
+    Pacer::Stats pacingStats() const { return pacer_.stats(); }
+
+    // 新连接建立或断开时清空队列并清除错误状态
+    void reset();
+    // 中途加入的接收方：丢弃已排队的视频，从下一个关键帧开始接收
+    void awaitKeyframe();
+    // 写失败后调用：清空队列，之后的提交都返回 false
+    void markBroken();
+
+    // 队列从空变为非空时回调，可能在任意线程调用，用于唤醒写端
+    void setOnReady(std::function<void()> cb) { onReady_ = std::move(cb); }
+    void setOnVideoDropped(std::function<void()> cb) { onVideoDropped_ = std::move(cb); }
+    // 一个视频帧的最后一段被取走时回调（写端线程），参数为整帧字节数
+    void setOnVideoSent(std::function<void(size_t)> cb) { onVideoSent_ = std::move(cb); }
+    uint64_t droppedVideoFrames() const { return droppedVideo_; }
+
+private:
+    bool pullLocked(Piece& out, int64_t* waitUs, size_t& finishedFrame);
+    bool pullVideoLocked(Piece& out, int64_t* waitUs, size_t& finishedFrame);
+    bool enqueueVideoLocked(const BufferRef& msg, bool& dropped);
+    bool hasPendingLocked() const;
+    static bool isKeyframe(const BufferRef& msg);
+
+    std::function<void()> onReady_;
+    std::function<void()> onVideoDropped_;
+    std::function<void(size_t)> onVideoSent_;
+
+    std::mutex mtx_;
+    std::deque<BufferRef> queues_[static_cast<int>(SendPriority::Count)];
+    BufferRef video_;           // 正在分块发送的视频帧
+    size_t videoSent_ = 0;
+    bool broken_ = false;
+    bool awaitingKeyframe_ = false;
+    std::atomic<uint64_t> droppedVideo_{0};
+    Pacer pacer_;
+};
+
+#endif // SEND_SCHEDULER_H
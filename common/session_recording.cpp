@@ -0,0 +1,431 @@
+#include "session_recording.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace SessionRecording;
+
+void SessionRecording::ParseReplaySpec(const std::string& spec, std::string& path, Speed& speed) {
+    static const std::string MAX_SUFFIX = ":max";
+    if (spec.size() > MAX_SUFFIX.size() &&
+        spec.compare(spec.size() - MAX_SUFFIX.size(), MAX_SUFFIX.size(), MAX_SUFFIX) == 0) {
+        path = spec.substr(0, spec.size() - MAX_SUFFIX.size());
+        speed = Speed::Maximum;
+    } else {
+        path = spec;
+        speed = Speed::Recorded;
+    }
+}
+
+// ==================== 录制 ====================
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+bool SessionRecorder::open(const std::string& path, Side side) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (file_) return false;
+
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "[Record] Cannot create " << path << std::endl;
+        return false;
+    }
+    buffer_.resize(WRITE_BUFFER_SIZE);
+    setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+
+    FileHeader header{};
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = VERSION;
+    header.side = static_cast<uint8_t>(side);
+    header.startUnixUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (fwrite(&header, sizeof(header), 1, file_) != 1) {
+        std::cerr << "[Record] Cannot write " << path << std::endl;
+        fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+
+    start_ = Clock::now();
+    lastFlush_ = start_;
+    path_ = path;
+    messages_ = 0;
+    bytes_ = 0;
+    std::cout << "[Record] Recording " << (side == Side::Server ? "server" : "client")
+              << " session to " << path << std::endl;
+    return true;
+}
+
+void SessionRecorder::close() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!file_) return;
+    fclose(file_);
+    file_ = nullptr;
+    std::cout << "[Record] Closed " << path_ << ": " << messages_ << " messages, "
+              << bytes_ / 1024 << " KB" << std::endl;
+}
+
+bool SessionRecorder::isOpen() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return file_ != nullptr;
+}
+
+void SessionRecorder::record(RecordKind kind, ClientId id, const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!file_) return;
+
+    Clock::time_point now = Clock::now();
+    RecordHeader header{};
+    header.timeUs = std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count();
+    header.clientId = id;
+    header.size = static_cast<uint32_t>(size);
+    header.kind = static_cast<uint8_t>(kind);
+    bool ok = fwrite(&header, sizeof(header), 1, file_) == 1;
+    if (ok && size > 0) ok = fwrite(data, 1, size, file_) == size;
+    if (!ok) {
+        // 磁盘满之类的错误：停止录制，不影响会话本身
+        std::cerr << "[Record] Write failed, recording stopped" << std::endl;
+        fclose(file_);
+        file_ = nullptr;
+        return;
+    }
+    if (kind == RecordKind::Message) {
+        messages_++;
+        bytes_ += size;
+    }
+    if (now - lastFlush_ >= std::chrono::milliseconds(FLUSH_INTERVAL_MS)) {
+        fflush(file_);
+        lastFlush_ = now;
+    }
+}
+
+// ==================== 回放 ====================
+SessionReplay::~SessionReplay() {
+    close();
+}
+
+bool SessionReplay::open(const std::string& path) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "[Replay] Cannot open " << path << std::endl;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= static_cast<LONGLONG>(FILE_HEADER_SIZE)) {
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        std::cerr << "[Replay] Cannot map " << path << std::endl;
+        return false;
+    }
+    fileHandle_ = file;
+    mapping_ = mapping;
+    base_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "[Replay] Cannot open " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    void* view = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= FILE_HEADER_SIZE) {
+        view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);    // 映射建立后不再需要描述符
+    if (view == MAP_FAILED) {
+        std::cerr << "[Replay] Cannot map " << path << std::endl;
+        return false;
+    }
+    madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    base_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    FileHeader header;
+    memcpy(&header, base_, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION) {
+        std::cerr << "[Replay] " << path << " is not a session recording (or an unsupported version)" << std::endl;
+        close();
+        return false;
+    }
+    side_ = static_cast<Side>(header.side);
+    startUnixUs_ = header.startUnixUs;
+
+    size_t offset = FILE_HEADER_SIZE;
+    while (size_ - offset >= RECORD_HEADER_SIZE) {
+        RecordHeader rec;
+        memcpy(&rec, base_ + offset, sizeof(rec));
+        if (rec.size > size_ - offset - RECORD_HEADER_SIZE) break;
+        index_.push_back(offset);
+        offset += RECORD_HEADER_SIZE + rec.size;
+    }
+    if (offset != size_) {
+        std::cerr << "[Replay] " << path << ": ignoring " << size_ - offset
+                  << " trailing bytes of an incomplete record" << std::endl;
+    }
+    std::cout << "[Replay] " << path << ": " << index_.size() << " records, "
+              << durationUs() / 1000 << "ms" << std::endl;
+    return true;
+}
+
+void SessionReplay::close() {
+    if (base_) {
+#ifdef _WIN32
+        UnmapViewOfFile(base_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        CloseHandle(static_cast<HANDLE>(fileHandle_));
+        mapping_ = nullptr;
+        fileHandle_ = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(base_), size_);
+#endif
+    }
+    base_ = nullptr;
+    size_ = 0;
+    index_.clear();
+}
+
+SessionReplay::Record SessionReplay::at(size_t i) const {
+    RecordHeader header;
+    memcpy(&header, base_ + index_[i], sizeof(header));
+    Record rec;
+    rec.timeUs = header.timeUs;
+    rec.kind = static_cast<RecordKind>(header.kind);
+    rec.client = header.clientId;
+    rec.data = base_ + index_[i] + RECORD_HEADER_SIZE;
+    rec.size = header.size;
+    return rec;
+}
+
+uint64_t SessionReplay::durationUs() const {
+    return index_.empty() ? 0 : at(index_.size() - 1).timeUs;
+}
+
+SessionReplay::Stats SessionReplay::play(const TransportCallbacks& cb, Speed speed,
+                                         const std::atomic<bool>* cancel) const {
+    using Clock = std::chrono::steady_clock;
+    Stats stats;
+    Clock::time_point start = Clock::now();
+
+    for (size_t i = 0; i < index_.size(); i++) {
+        if (cancel && *cancel) break;
+        Record rec = at(i);
+
+        if (speed == Speed::Recorded) {
+            Clock::time_point due = start + std::chrono::microseconds(rec.timeUs);
+            Clock::time_point now = Clock::now();
+            if (due > now) {
+                std::this_thread::sleep_until(due);
+            } else {
+                stats.maxLateMs = std::max(stats.maxLateMs,
+                    std::chrono::duration<double, std::milli>(now - due).count());
+            }
+        }
+
+        switch (rec.kind) {
+            case RecordKind::Connected:
+                if (cb.onClientConnected) cb.onClientConnected(rec.client);
+                else if (cb.onConnected) cb.onConnected();
+                break;
+            case RecordKind::Disconnected:
+                if (cb.onClientDisconnected) cb.onClientDisconnected(rec.client);
+                else if (cb.onDisconnected) cb.onDisconnected();
+                break;
+            case RecordKind::Message:
+                // 与真实传输一样每条消息交出独立的缓冲，上层可以留着它跨线程排队
+                if (cb.onClientMessage) {
+                    cb.onClientMessage(rec.client, BinaryData(rec.data, rec.data + rec.size));
+                } else if (cb.onBuffer) {
+                    cb.onBuffer(BufferPool::shared().copyOf(rec.data, rec.size));
+                } else if (cb.onMessage) {
+                    cb.onMessage(BinaryData(rec.data, rec.data + rec.size));
+                }
+                stats.messages++;
+                stats.bytes += rec.size;
+                break;
+        }
+    }
+
+    stats.elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return stats;
+}
+
+// ==================== 录制装饰器 ====================
+RecordingTransport::RecordingTransport(std::unique_ptr<ITransport> inner, std::shared_ptr<SessionRecorder> recorder)
+    : inner_(std::move(inner)), recorder_(std::move(recorder)) {}
+
+void RecordingTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    TransportCallbacks inner = callbacks;
+    std::shared_ptr<SessionRecorder> recorder = recorder_;
+    inner.onConnected = [recorder, cb = callbacks.onConnected]() {
+        recorder->record(RecordKind::Connected, SINGLE_CLIENT_ID);
+        if (cb) cb();
+    };
+    inner.onDisconnected = [recorder, cb = callbacks.onDisconnected]() {
+        recorder->record(RecordKind::Disconnected, SINGLE_CLIENT_ID);
+        if (cb) cb();
+    };
+    if (callbacks.onBuffer) {
+        inner.onBuffer = [recorder, cb = callbacks.onBuffer](const BufferRef& msg) {
+            recorder->record(RecordKind::Message, SINGLE_CLIENT_ID, msg.data(), msg.size());
+            cb(msg);
+        };
+    }
+    if (callbacks.onMessage) {
+        inner.onMessage = [recorder, cb = callbacks.onMessage](const BinaryData& data) {
+            recorder->record(RecordKind::Message, SINGLE_CLIENT_ID, data.data(), data.size());
+            cb(data);
+        };
+    }
+    inner_->setCallbacks(inner);
+}
+
+RecordingServerTransport::RecordingServerTransport(std::unique_ptr<IServerTransport> inner,
+                                                   std::shared_ptr<SessionRecorder> recorder)
+    : inner_(std::move(inner)), recorder_(std::move(recorder)) {}
+
+void RecordingServerTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    TransportCallbacks inner = callbacks;
+    std::shared_ptr<SessionRecorder> recorder = recorder_;
+    // 单客户端传输只走无 ClientId 的回调，统一记为 SINGLE_CLIENT_ID
+    inner.onConnected = [recorder, cb = callbacks.onConnected]() {
+        recorder->record(RecordKind::Connected, SINGLE_CLIENT_ID);
+        if (cb) cb();
+    };
+    inner.onDisconnected = [recorder, cb = callbacks.onDisconnected]() {
+        recorder->record(RecordKind::Disconnected, SINGLE_CLIENT_ID);
+        if (cb) cb();
+    };
+    if (callbacks.onMessage) {
+        inner.onMessage = [recorder, cb = callbacks.onMessage](const BinaryData& data) {
+            recorder->record(RecordKind::Message, SINGLE_CLIENT_ID, data.data(), data.size());
+            cb(data);
+        };
+    }
+    if (callbacks.onClientConnected) {
+        inner.onClientConnected = [recorder, cb = callbacks.onClientConnected](ClientId id) {
+            recorder->record(RecordKind::Connected, id);
+            cb(id);
+        };
+    }
+    if (callbacks.onClientDisconnected) {
+        inner.onClientDisconnected = [recorder, cb = callbacks.onClientDisconnected](ClientId id) {
+            recorder->record(RecordKind::Disconnected, id);
+            cb(id);
+        };
+    }
+    if (callbacks.onClientMessage) {
+        inner.onClientMessage = [recorder, cb = callbacks.onClientMessage](ClientId id, const BinaryData& data) {
+            recorder->record(RecordKind::Message, id, data.data(), data.size());
+            cb(id, data);
+        };
+    }
+    inner_->setCallbacks(inner);
+}
+
+// ==================== 回放传输 ====================
+ReplayTransport::ReplayTransport(const std::string& path, Speed speed)
+    : path_(path), speed_(speed) {}
+
+ReplayTransport::~ReplayTransport() {
+    disconnect();
+}
+
+bool ReplayTransport::start() {
+    if (thread_.joinable() || !replay_.open(path_)) return false;
+    if (replay_.side() != Side::Client) {
+        std::cerr << "[Replay] " << path_ << " was recorded on the server side" << std::endl;
+        return false;
+    }
+    playing_ = true;
+    cancel_ = false;
+    thread_ = std::thread([this]() {
+        stats_ = replay_.play(callbacks_, speed_, &cancel_);
+        playing_ = false;
+    });
+    return true;
+}
+
+SessionReplay::Stats ReplayTransport::wait() {
+    if (thread_.joinable()) thread_.join();
+    return stats_;
+}
+
+bool ReplayTransport::send(const BinaryData& /*data*/) {
+    if (!playing_) return false;
+    sent_++;
+    return true;
+}
+
+void ReplayTransport::disconnect() {
+    cancel_ = true;
+    wait();
+}
+
+ReplayServerTransport::ReplayServerTransport(const std::string& path, Speed speed)
+    : path_(path), speed_(speed) {}
+
+ReplayServerTransport::~ReplayServerTransport() {
+    stop();
+}
+
+bool ReplayServerTransport::start() {
+    if (thread_.joinable() || !replay_.open(path_)) return false;
+    if (replay_.side() != Side::Server) {
+        std::cerr << "[Replay] " << path_ << " was recorded on the client side" << std::endl;
+        return false;
+    }
+    playing_ = true;
+    cancel_ = false;
+    thread_ = std::thread([this]() {
+        stats_ = replay_.play(callbacks_, speed_, &cancel_);
+        playing_ = false;
+    });
+    return true;
+}
+
+SessionReplay::Stats ReplayServerTransport::wait() {
+    if (thread_.joinable()) thread_.join();
+    return stats_;
+}
+
+void ReplayServerTransport::stop() {
+    cancel_ = true;
+    wait();
+}
+
+bool ReplayServerTransport::send(const BinaryData& /*data*/) {
+    if (!playing_) return false;
+    sent_++;
+    return true;
+}
+
+bool ReplayServerTransport::sendTo(ClientId /*id*/, const BinaryData& data) {
+    return send(data);
+}
@@ -0,0 +1,255 @@
+#ifndef SESSION_RECORDING_H
+#define SESSION_RECORDING_H
+
+#include "transport.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ==================== 会话录制格式 ====================
+// 文件头之后是首尾相接的记录：记录头 + 消息原文，不压缩、不对齐，
+// 回放时整个文件映射进内存，按偏移直接读取，不再拷贝到中间缓冲。
+// 整数按小端序存放（与协议消息一致）。写到一半被打断的文件，最后一条不完整的记录被忽略。
+namespace SessionRecording {
+    constexpr char MAGIC[4] = { 'R', 'C', 'S', 'R' };
+    constexpr uint16_t VERSION = 1;
+
+    // 录制的是哪一端收到的消息：客户端回放进 DesktopWindow，服务端回放进 DesktopService
+    enum class Side : uint8_t {
+        Client = 0,
+        Server = 1
+    };
+
+    enum class RecordKind : uint8_t {
+        Message = 0,
+        Connected = 1,      // 没有消息原文
+        Disconnected = 2
+    };
+
+    enum class Speed {
+        Recorded,       // 按录制时的间隔交付
+        Maximum         // 不等待，测解码、渲染和输入路径的吞吐
+    };
+
+#pragma pack(push, 1)
+    struct FileHeader {
+        char magic[4];
+        uint16_t version;
+        uint8_t side;           // Side
+        uint8_t reserved;
+        int64_t startUnixUs;    // 录制开始的墙上时间，仅供查看
+    };
+
+    struct RecordHeader {
+        uint64_t timeUs;        // 相对录制开始（单调时钟）
+        uint32_t clientId;      // 客户端一侧固定为 SINGLE_CLIENT_ID
+        uint32_t size;          // 消息原文字节数
+        uint8_t kind;           // RecordKind
+    };
+#pragma pack(pop)
+
+    constexpr size_t FILE_HEADER_SIZE = sizeof(FileHeader);
+    constexpr size_t RECORD_HEADER_SIZE = sizeof(RecordHeader);
+
+    // 写缓冲，以及缓冲未满时最迟多久刷一次盘，进程异常退出时最多丢这么多
+    constexpr size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+    constexpr int FLUSH_INTERVAL_MS = 1000;
+
+    // 解析 RC_REPLAY_SESSION 的取值 <路径>[:max]，带 :max 时按最快速度回放。
+    // 只认结尾的 :max，Windows 路径里盘符后面的冒号不受影响
+    void ParseReplaySpec(const std::string& spec, std::string& path, Speed& speed);
+}
+
+// ==================== 录制 ====================
+// 追加写入一个录制文件。record() 可在任意线程调用，按调用顺序落盘
+class SessionRecorder {
+public:
+    SessionRecorder() = default;
+    ~SessionRecorder();
+
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool open(const std::string& path, SessionRecording::Side side);
+    void close();
+    bool isOpen() const;
+
+    void record(SessionRecording::RecordKind kind, ClientId id, const uint8_t* data = nullptr, size_t size = 0);
+
+    uint64_t recordedMessages() const { return messages_; }
+    uint64_t recordedBytes() const { return bytes_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    mutable std::mutex mtx_;
+    FILE* file_ = nullptr;
+    std::vector<char> buffer_;      // setvbuf 的缓冲，生命期须覆盖 file_
+    Clock::time_point start_;
+    Clock::time_point lastFlush_;
+    std::string path_;
+    std::atomic<uint64_t> messages_{0};
+    std::atomic<uint64_t> bytes_{0};
+};
+
+// ==================== 回放 ====================
+// 只读映射一个录制文件，打开时校验并建立记录索引。
+// play() 按传输层的回调约定把记录交给 TransportCallbacks：设置了按客户端区分的回调时
+// 走 onClient*，否则走 onConnected/onDisconnected 和 onBuffer（优先）或 onMessage
+class SessionReplay {
+public:
+    struct Record {
+        uint64_t timeUs = 0;
+        SessionRecording::RecordKind kind = SessionRecording::RecordKind::Message;
+        ClientId client = SINGLE_CLIENT_ID;
+        const uint8_t* data = nullptr;  // 指向映射内存，close() 后失效
+        size_t size = 0;
+    };
+
+    struct Stats {
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        double elapsedMs = 0;
+        double maxLateMs = 0;           // 按录制速度回放时，最晚的一条比计划晚多少
+    };
+
+    SessionReplay() = default;
+    ~SessionReplay();
+
+    SessionReplay(const SessionReplay&) = delete;
+    SessionReplay& operator=(const SessionReplay&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    SessionRecording::Side side() const { return side_; }
+    int64_t startUnixUs() const { return startUnixUs_; }
+    size_t count() const { return index_.size(); }
+    Record at(size_t i) const;
+    // 最后一条记录的时刻，即录制时长
+    uint64_t durationUs() const;
+
+    // 阻塞到全部交付或 cancel 被置位
+    Stats play(const TransportCallbacks& callbacks, SessionRecording::Speed speed,
+               const std::atomic<bool>* cancel = nullptr) const;
+
+private:
+    const uint8_t* base_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+    SessionRecording::Side side_ = SessionRecording::Side::Client;
+    int64_t startUnixUs_ = 0;
+    std::vector<size_t> index_;     // 每条记录头在文件中的偏移
+};
+
+// ==================== 录制装饰器 ====================
+// 把经过 onMessage/onBuffer（及连接事件）的每条消息原样写入录制文件再交给上层，发送不受影响
+class RecordingTransport : public ITransport {
+public:
+    RecordingTransport(std::unique_ptr<ITransport> inner, std::shared_ptr<SessionRecorder> recorder);
+
+    bool send(const BinaryData& data) override { return inner_->send(data); }
+    bool sendv(const ConstBuffer* parts, size_t count) override { return inner_->sendv(parts, count); }
+    bool isConnected() const override { return inner_->isConnected(); }
+    void disconnect() override { inner_->disconnect(); }
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+    bool reconnect() override { return inner_->reconnect(); }
+    bool clockEstimate(ClockEstimate& out) const override { return inner_->clockEstimate(out); }
+
+private:
+    std::unique_ptr<ITransport> inner_;
+    std::shared_ptr<SessionRecorder> recorder_;
+};
+
+class RecordingServerTransport : public IServerTransport {
+public:
+    RecordingServerTransport(std::unique_ptr<IServerTransport> inner, std::shared_ptr<SessionRecorder> recorder);
+
+    bool start() override { return inner_->start(); }
+    void stop() override { inner_->stop(); }
+    bool send(const BinaryData& data) override { return inner_->send(data); }
+    bool sendv(const ConstBuffer* parts, size_t count) override { return inner_->sendv(parts, count); }
+    bool sendBuffer(const BufferRef& msg) override { return inner_->sendBuffer(msg); }
+    bool hasClient() const override { return inner_->hasClient(); }
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+
+    bool sendTo(ClientId id, const BinaryData& data) override { return inner_->sendTo(id, data); }
+    void setSubscribed(ClientId id, bool subscribed) override { inner_->setSubscribed(id, subscribed); }
+    size_t clientCount() const override { return inner_->clientCount(); }
+    void disconnectClient(ClientId id) override { inner_->disconnectClient(id); }
+    void setPacingRate(int bitsPerSec, int fps) override { inner_->setPacingRate(bitsPerSec, fps); }
+    bool clockEstimate(ClientId id, ClockEstimate& out) const override { return inner_->clockEstimate(id, out); }
+    int targetBitrate(ClientId id) const override { return inner_->targetBitrate(id); }
+
+private:
+    std::unique_ptr<IServerTransport> inner_;
+    std::shared_ptr<SessionRecorder> recorder_;
+};
+
+// ==================== 回放传输 ====================
+// 代替真实连接接到 DesktopWindow / DesktopService 上：start() 后在后台线程把录制文件
+// 交给上层回调，上层发出的消息只计数后丢弃。回调须在 start() 之前设置，
+// 回放完成后表现为连接已断开
+class ReplayTransport : public ITransport {
+public:
+    ReplayTransport(const std::string& path, SessionRecording::Speed speed);
+    ~ReplayTransport();
+
+    bool start();
+    // 等待回放完成，返回统计
+    SessionReplay::Stats wait();
+    uint64_t sentMessages() const { return sent_; }
+
+    bool send(const BinaryData& data) override;
+    bool isConnected() const override { return playing_; }
+    void disconnect() override;
+    void setCallbacks(const TransportCallbacks& callbacks) override { callbacks_ = callbacks; }
+    bool reconnect() override { return false; }
+
+private:
+    std::string path_;
+    SessionRecording::Speed speed_;
+    SessionReplay replay_;
+    TransportCallbacks callbacks_;
+    std::thread thread_;
+    std::atomic<bool> playing_{false};
+    std::atomic<bool> cancel_{false};
+    std::atomic<uint64_t> sent_{0};
+    SessionReplay::Stats stats_;
+};
+
+class ReplayServerTransport : public IServerTransport {
+public:
+    ReplayServerTransport(const std::string& path, SessionRecording::Speed speed);
+    ~ReplayServerTransport();
+
+    SessionReplay::Stats wait();
+    uint64_t sentMessages() const { return sent_; }
+
+    bool start() override;
+    void stop() override;
+    bool send(const BinaryData& data) override;
+    bool hasClient() const override { return playing_; }
+    void setCallbacks(const TransportCallbacks& callbacks) override { callbacks_ = callbacks; }
+    bool sendTo(ClientId id, const BinaryData& data) override;
+
+private:
+    std::string path_;
+    SessionRecording::Speed speed_;
+    SessionReplay replay_;
+    TransportCallbacks callbacks_;
+    std::thread thread_;
+    std::atomic<bool> playing_{false};
+    std::atomic<bool> cancel_{false};
+    std::atomic<uint64_t> sent_{0};
+    SessionReplay::Stats stats_;
+};
+
+#endif // SESSION_RECORDING_H
@@ -0,0 +1,327 @@
+#include "stream_bridge.h"
+#include <iostream>
+
+// ==================== 套接字 <-> 流 ====================
+std::shared_ptr<StreamSocketBridge> StreamSocketBridge::create(EventLoop& loop, std::shared_ptr<StreamMux> mux, SOCKET sock) {
+    NetCompat::SetNoInherit(sock);
+    NetCompat::SetNonBlocking(sock, true);
+    int flag = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    return std::shared_ptr<StreamSocketBridge>(new StreamSocketBridge(loop, std::move(mux), sock));
+}
+
+StreamSocketBridge::StreamSocketBridge(EventLoop& loop, std::shared_ptr<StreamMux> mux, SOCKET sock)
+    : loop_(loop), mux_(mux), sock_(sock) {}
+
+StreamMux::Handlers StreamSocketBridge::handlers() {
+    std::weak_ptr<StreamSocketBridge> weak = shared_from_this();
+    StreamMux::Handlers h;
+    h.onData = [weak](const uint8_t* data, size_t size) {
+        if (auto self = weak.lock()) self->onStreamData(data, size);
+    };
+    h.onWritable = [weak]() {
+        if (auto self = weak.lock()) {
+            self->readPaused_ = false;
+            self->readSocket();
+        }
+    };
+    h.onClose = [weak]() {
+        if (auto self = weak.lock()) self->onStreamClosed();
+    };
+    return h;
+}
+
+void StreamSocketBridge::openStream(Desktop::StreamService service, bool interactive) {
+    auto mux = mux_.lock();
+    if (!mux) {
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return;
+    }
+    id_ = mux->open(service, interactive, handlers());
+    if (id_ == 0) {
+        // 桌面链路断开：直接关掉本地连接，客户端会改为直连
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return;
+    }
+    streamOpen_ = true;
+    start();
+}
+
+void StreamSocketBridge::acceptStream(StreamMux::StreamId id) {
+    auto mux = mux_.lock();
+    if (!mux) {
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+        return;
+    }
+    id_ = id;
+    mux->accept(id, handlers());
+    streamOpen_ = true;
+    start();
+}
+
+void StreamSocketBridge::start() {
+    // 处理函数持有强引用，remove() 之后桥随之释放
+    auto self = shared_from_this();
+    interest_ = EventLoop::EV_READ;
+    loop_.add(sock_, interest_, [self](uint32_t events) { self->onIo(events); });
+}
+
+void StreamSocketBridge::onIo(uint32_t events) {
+    if (sock_ == INVALID_SOCKET) return;
+    if (events & EventLoop::EV_WRITE) flushSocket();
+    if (sock_ != INVALID_SOCKET && (events & (EventLoop::EV_READ | EventLoop::EV_ERROR))) readSocket();
+}
+
+void StreamSocketBridge::readSocket() {
+    auto mux = mux_.lock();
+    if (!mux || sock_ == INVALID_SOCKET) return;
+
+    while (!readPaused_) {
+        if (!pendingIn_.empty()) {
+            size_t n = mux->write(id_, pendingIn_.data(), pendingIn_.size());
+            pendingIn_.erase(pendingIn_.begin(), pendingIn_.begin() + n);
+            if (!pendingIn_.empty()) {
+                readPaused_ = true;
+                break;
+            }
+        }
+
+        uint8_t buf[StreamMuxing::MAX_PIECE];
+        long r = NetCompat::Recv(sock_, buf, sizeof(buf));
+        if (r == -1) break;
+        if (r <= 0) {
+            // 本地一端关闭：已排队的数据由复用器发完，再通知对端
+            shutdown(true);
+            return;
+        }
+        size_t n = mux->write(id_, buf, static_cast<size_t>(r));
+        if (n < static_cast<size_t>(r)) {
+            pendingIn_.assign(buf + n, buf + r);
+            readPaused_ = true;
+        }
+    }
+    updateInterest();
+}
+
+void StreamSocketBridge::flushSocket() {
+    size_t written = 0;
+    while (written < pendingOut_.size()) {
+        int r = send(sock_, reinterpret_cast<const char*>(pendingOut_.data() + written),
+                     static_cast<int>(pendingOut_.size() - written), NetCompat::SEND_FLAGS);
+        if (r > 0) {
+            written += static_cast<size_t>(r);
+            continue;
+        }
+        if (r < 0 && NetCompat::WouldBlock(WSAGetLastError())) break;
+        shutdown(true);
+        return;
+    }
+    if (written > 0) {
+        pendingOut_.erase(pendingOut_.begin(), pendingOut_.begin() + written);
+        // 写进套接字才算消费，本地程序读得慢时对端自然被额度挡住
+        if (auto mux = mux_.lock()) {
+            if (streamOpen_) mux->consume(id_, written);
+        }
+    }
+    if (pendingOut_.empty() && peerClosed_) {
+        shutdown(false);
+        return;
+    }
+    updateInterest();
+}
+
+void StreamSocketBridge::updateInterest() {
+    if (sock_ == INVALID_SOCKET) return;
+    uint32_t want = 0;
+    if (!readPaused_ && !peerClosed_) want |= EventLoop::EV_READ;
+    if (!pendingOut_.empty()) want |= EventLoop::EV_WRITE;
+    if (want != interest_) {
+        interest_ = want;
+        loop_.modify(sock_, want);
+    }
+}
+
+void StreamSocketBridge::onStreamData(const uint8_t* data, size_t size) {
+    if (sock_ == INVALID_SOCKET) return;
+    pendingOut_.insert(pendingOut_.end(), data, data + size);
+    flushSocket();
+}
+
+void StreamSocketBridge::onStreamClosed() {
+    streamOpen_ = false;
+    peerClosed_ = true;
+    if (pendingOut_.empty()) shutdown(false);
+    else updateInterest();
+}
+
+void StreamSocketBridge::shutdown(bool closeStream) {
+    if (closeStream && streamOpen_) {
+        if (auto mux = mux_.lock()) mux->close(id_);
+    }
+    streamOpen_ = false;
+    if (sock_ != INVALID_SOCKET) {
+        loop_.remove(sock_);
+        closesocket(sock_);
+        sock_ = INVALID_SOCKET;
+    }
+}
+
+// ==================== 本地转发（客户端） ====================
+LocalStreamForwarder::LocalStreamForwarder(EventLoop& loop, std::shared_ptr<StreamMux> mux,
+                                           Desktop::StreamService service, bool interactive)
+    : loop_(loop), mux_(std::move(mux)), service_(service), interactive_(interactive) {}
+
+LocalStreamForwarder::~LocalStreamForwarder() {
+    stop();
+}
+
+bool LocalStreamForwarder::start() {
+    listenSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket_ == INVALID_SOCKET) {
+        std::cerr << "[Stream] socket() failed: " << WSAGetLastError() << std::endl;
+        return false;
+    }
+    NetCompat::SetNoInherit(listenSocket_);
+
+    // 只监听回环地址，端口由系统分配
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (bind(listenSocket_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        listen(listenSocket_, 8) == SOCKET_ERROR ||
+        getsockname(listenSocket_, (sockaddr*)&addr, &len) == SOCKET_ERROR) {
+        std::cerr << "[Stream] Failed to listen on loopback: " << WSAGetLastError() << std::endl;
+        closesocket(listenSocket_);
+        listenSocket_ = INVALID_SOCKET;
+        return false;
+    }
+    port_ = ntohs(addr.sin_port);
+
+    NetCompat::SetNonBlocking(listenSocket_, true);
+    loop_.add(listenSocket_, EventLoop::EV_READ, [this](uint32_t) { onAcceptable(); });
+    std::cout << "[Stream] Forwarding 127.0.0.1:" << port_ << " to service "
+              << static_cast<int>(service_) << (interactive_ ? " (interactive)" : "") << std::endl;
+    return true;
+}
+
+void LocalStreamForwarder::stop() {
+    if (listenSocket_ == INVALID_SOCKET) return;
+    SOCKET sock = listenSocket_;
+    listenSocket_ = INVALID_SOCKET;
+    // 等循环线程确认移除，之后不会再回调 onAcceptable
+    loop_.runSync([this, sock]() {
+        loop_.remove(sock);
+        closesocket(sock);
+    });
+}
+
+void LocalStreamForwarder::onAcceptable() {
+    for (;;) {
+        SOCKET client = accept(listenSocket_, nullptr, nullptr);
+        if (client == INVALID_SOCKET) break;
+        auto bridge = StreamSocketBridge::create(loop_, mux_, client);
+        bridge->openStream(service_, interactive_);
+    }
+}
+
+// ==================== 流服务（服务端） ====================
+StreamServiceHost::StreamServiceHost(EventLoop& loop, IServerTransport* transport)
+    : loop_(loop), transport_(transport) {}
+
+StreamServiceHost::~StreamServiceHost() {
+    clear();
+}
+
+void StreamServiceHost::allow(Desktop::StreamService service, int port) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    ports_[static_cast<uint16_t>(service)] = port;
+}
+
+std::shared_ptr<StreamMux> StreamServiceHost::muxFor(ClientId id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = muxes_.find(id);
+    if (it != muxes_.end()) return it->second;
+
+    IServerTransport* transport = transport_;
+    auto mux = std::make_shared<StreamMux>(loop_, false,
+        [transport, id](const BinaryData& msg) { return transport->sendTo(id, msg); });
+    std::weak_ptr<StreamMux> weak = mux;
+    mux->setOnOpen([this, weak](StreamMux::StreamId streamId, Desktop::StreamService service) {
+        auto m = weak.lock();
+        return m && onOpen(m, streamId, service);
+    });
+    muxes_[id] = mux;
+    return mux;
+}
+
+bool StreamServiceHost::handleMessage(ClientId id, const BinaryData& data) {
+    if (data.empty()) return false;
+    switch (static_cast<Desktop::MsgType>(data[0])) {
+        case Desktop::MsgType::StreamOpen:
+        case Desktop::MsgType::StreamData:
+        case Desktop::MsgType::StreamCredit:
+        case Desktop::MsgType::StreamClose:
+            return muxFor(id)->handleMessage(data.data(), data.size());
+        default:
+            return false;
+    }
+}
+
+bool StreamServiceHost::onOpen(const std::shared_ptr<StreamMux>& mux, StreamMux::StreamId streamId,
+                               Desktop::StreamService service) {
+    int port = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = ports_.find(static_cast<uint16_t>(service));
+        if (it == ports_.end()) return false;
+        port = it->second;
+    }
+
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) return false;
+
+    // 回环连接要么立即成功要么立即被拒，阻塞连接不会卡住循环
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (::connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        std::cerr << "[Stream] Service " << static_cast<int>(service) << " on port " << port
+                  << " unavailable: " << WSAGetLastError() << std::endl;
+        closesocket(sock);
+        return false;
+    }
+
+    auto bridge = StreamSocketBridge::create(loop_, mux, sock);
+    bridge->acceptStream(streamId);
+    return true;
+}
+
+void StreamServiceHost::onClientDisconnected(ClientId id) {
+    std::shared_ptr<StreamMux> mux;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        auto it = muxes_.find(id);
+        if (it == muxes_.end()) return;
+        mux = std::move(it->second);
+        muxes_.erase(it);
+    }
+    loop_.post([mux]() { mux->reset(); });
+}
+
+void StreamServiceHost::clear() {
+    std::map<ClientId, std::shared_ptr<StreamMux>> muxes;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        muxes.swap(muxes_);
+    }
+    if (muxes.empty()) return;
+    loop_.runSync([&muxes]() {
+        for (auto& kv : muxes) kv.second->reset();
+    });
+}
@@ -0,0 +1,98 @@
+#ifndef STREAM_BRIDGE_H
+#define STREAM_BRIDGE_H
+
+#include "stream_mux.h"
+#include "transport.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ==================== 套接字 <-> 流 ====================
+// 把一个本地 TCP 套接字接到复用流上，两个方向都有背压：
+// 流的发送缓冲满了就暂停读套接字，套接字写不动就不归还流的额度。
+class StreamSocketBridge : public std::enable_shared_from_this<StreamSocketBridge> {
+public:
+    // 接管套接字（阻塞或非阻塞均可），析构前由 close 路径负责关闭
+    static std::shared_ptr<StreamSocketBridge> create(EventLoop& loop, std::shared_ptr<StreamMux> mux, SOCKET sock);
+
+    // 以下在循环线程里调用
+    void openStream(Desktop::StreamService service, bool interactive);
+    void acceptStream(StreamMux::StreamId id);
+
+private:
+    StreamSocketBridge(EventLoop& loop, std::shared_ptr<StreamMux> mux, SOCKET sock);
+
+    StreamMux::Handlers handlers();
+    void start();
+    void onIo(uint32_t events);
+    void readSocket();
+    void flushSocket();
+    void updateInterest();
+    void onStreamData(const uint8_t* data, size_t size);
+    void onStreamClosed();
+    void shutdown(bool closeStream);
+
+    EventLoop& loop_;
+    std::weak_ptr<StreamMux> mux_;
+    SOCKET sock_;
+    StreamMux::StreamId id_ = 0;
+    bool streamOpen_ = false;
+
+    std::vector<uint8_t> pendingIn_;    // 从套接字读到、流还没收下的数据
+    std::vector<uint8_t> pendingOut_;   // 从流收到、还没写进套接字的数据
+    bool readPaused_ = false;
+    bool peerClosed_ = false;           // 流已被对端关闭，写完 pendingOut_ 就关套接字
+    uint32_t interest_ = 0;
+};
+
+// ==================== 本地转发（客户端） ====================
+// 在 127.0.0.1 的临时端口上监听，每个接入的连接开一条流到服务端的指定服务。
+// SSH 客户端连这个端口即可，和 ssh -L 本地转发一样。
+class LocalStreamForwarder {
+public:
+    LocalStreamForwarder(EventLoop& loop, std::shared_ptr<StreamMux> mux,
+                         Desktop::StreamService service, bool interactive);
+    ~LocalStreamForwarder();
+
+    bool start();
+    void stop();
+    int port() const { return port_; }
+
+private:
+    void onAcceptable();
+
+    EventLoop& loop_;
+    std::shared_ptr<StreamMux> mux_;
+    Desktop::StreamService service_;
+    bool interactive_;
+    SOCKET listenSocket_ = INVALID_SOCKET;
+    int port_ = 0;
+};
+
+// ==================== 流服务（服务端） ====================
+// 每个客户端一个复用器，对端打开流时按白名单把服务映射到本机端口并接过去。
+class StreamServiceHost {
+public:
+    StreamServiceHost(EventLoop& loop, IServerTransport* transport);
+    ~StreamServiceHost();
+
+    void allow(Desktop::StreamService service, int port);
+
+    // 可在任意线程调用；是 Stream* 消息就处理并返回 true
+    bool handleMessage(ClientId id, const BinaryData& data);
+    void onClientDisconnected(ClientId id);
+    void clear();
+
+private:
+    std::shared_ptr<StreamMux> muxFor(ClientId id);
+    bool onOpen(const std::shared_ptr<StreamMux>& mux, StreamMux::StreamId streamId, Desktop::StreamService service);
+
+    EventLoop& loop_;
+    IServerTransport* transport_;
+    std::mutex mtx_;
+    std::map<uint16_t, int> ports_;
+    std::map<ClientId, std::shared_ptr<StreamMux>> muxes_;
+};
+
+#endif // STREAM_BRIDGE_H
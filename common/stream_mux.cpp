@@ -0,0 +1,228 @@
+#include "stream_mux.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace StreamMuxing;
+
+StreamMux::StreamMux(EventLoop& loop, bool initiator, SendFn send)
+    : loop_(loop), initiator_(initiator), send_(std::move(send)), nextId_(initiator ? 1 : 2) {}
+
+StreamMux::StreamId StreamMux::open(Desktop::StreamService service, bool interactive, Handlers handlers) {
+    StreamId id = nextId_;
+    nextId_ += 2;
+
+    Stream& s = streams_[id];
+    s.handlers = std::move(handlers);
+    s.flags = interactive ? Desktop::STREAM_INTERACTIVE : 0;
+    s.accepted = true;
+    if (!send_(MessageBuilder::StreamOpen(id, service, s.flags))) {
+        streams_.erase(id);
+        return 0;
+    }
+    return id;
+}
+
+void StreamMux::accept(StreamId id, Handlers handlers) {
+    auto it = streams_.find(id);
+    if (it == streams_.end()) return;
+    it->second.handlers = std::move(handlers);
+    it->second.accepted = true;
+}
+
+size_t StreamMux::write(StreamId id, const uint8_t* data, size_t size) {
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.closing) return 0;
+    Stream& s = it->second;
+
+    size_t room = s.sendQueue.size() < SEND_BUFFER ? SEND_BUFFER - s.sendQueue.size() : 0;
+    size_t take = std::min(room, size);
+    s.sendQueue.insert(s.sendQueue.end(), data, data + take);
+    if (take < size) s.blocked = true;
+    pump();
+    return take;
+}
+
+void StreamMux::consume(StreamId id, size_t bytes) {
+    auto it = streams_.find(id);
+    if (it == streams_.end()) return;
+    Stream& s = it->second;
+
+    uint32_t n = static_cast<uint32_t>(std::min<size_t>(bytes, s.recvOutstanding));
+    s.recvOutstanding -= n;
+    s.consumedPending += n;
+    if (s.consumedPending >= CREDIT_BATCH || (s.recvOutstanding == 0 && s.consumedPending > 0)) {
+        send_(MessageBuilder::StreamCredit(id, s.consumedPending));
+        s.consumedPending = 0;
+    }
+}
+
+void StreamMux::close(StreamId id) {
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.closing) return;
+    it->second.closing = true;
+    it->second.handlers = Handlers();
+    pump();
+}
+
+bool StreamMux::handleMessage(const uint8_t* data, size_t size) {
+    if (size == 0) return false;
+    switch (static_cast<Desktop::MsgType>(data[0])) {
+        case Desktop::MsgType::StreamOpen:
+        case Desktop::MsgType::StreamData:
+        case Desktop::MsgType::StreamCredit:
+        case Desktop::MsgType::StreamClose:
+            break;
+        default:
+            return false;
+    }
+
+    if (loop_.inLoopThread()) {
+        onMessage(data, size);
+    } else {
+        std::weak_ptr<StreamMux> weak = shared_from_this();
+        BinaryData copy(data, data + size);
+        loop_.post([weak, copy]() {
+            if (auto self = weak.lock()) self->onMessage(copy.data(), copy.size());
+        });
+    }
+    return true;
+}
+
+void StreamMux::onMessage(const uint8_t* data, size_t size) {
+    auto type = static_cast<Desktop::MsgType>(data[0]);
+    switch (type) {
+        case Desktop::MsgType::StreamOpen: {
+            if (size < 1 + sizeof(Desktop::StreamOpenMsg)) return;
+            Desktop::StreamOpenMsg m;
+            memcpy(&m, data + 1, sizeof(m));
+            // 对端只能用它那一侧的 ID
+            bool fromInitiator = (m.streamId & 1) != 0;
+            if (fromInitiator == initiator_ || streams_.count(m.streamId)) {
+                send_(MessageBuilder::StreamClose(m.streamId));
+                return;
+            }
+            Stream& s = streams_[m.streamId];
+            s.flags = m.flags & Desktop::STREAM_INTERACTIVE;
+            if (!onOpen_ || !onOpen_(m.streamId, static_cast<Desktop::StreamService>(m.service))) {
+                std::cout << "[Stream] Rejected stream " << m.streamId << " for service " << m.service << std::endl;
+                streams_.erase(m.streamId);
+                send_(MessageBuilder::StreamClose(m.streamId));
+            }
+            break;
+        }
+
+        case Desktop::MsgType::StreamData: {
+            if (size < 1 + sizeof(Desktop::StreamDataHeader)) return;
+            Desktop::StreamDataHeader h;
+            memcpy(&h, data + 1, sizeof(h));
+            auto it = streams_.find(h.streamId);
+            if (it == streams_.end()) return;       // 已在本端关闭，丢弃在途数据
+            Stream& s = it->second;
+
+            size_t len = size - 1 - sizeof(h);
+            if (s.recvOutstanding + len > WINDOW) {
+                std::cerr << "[Stream] Stream " << h.streamId << " exceeded its credit, closing" << std::endl;
+                send_(MessageBuilder::StreamClose(h.streamId));
+                finish(h.streamId, true);
+                return;
+            }
+            s.recvOutstanding += static_cast<uint32_t>(len);
+            if (!s.accepted || s.closing || !s.handlers.onData) {
+                consume(h.streamId, len);
+                return;
+            }
+            // 回调里可能关闭本流，先拷一份再调用
+            auto onData = s.handlers.onData;
+            onData(data + 1 + sizeof(h), len);
+            break;
+        }
+
+        case Desktop::MsgType::StreamCredit: {
+            if (size < 1 + sizeof(Desktop::StreamCreditMsg)) return;
+            Desktop::StreamCreditMsg m;
+            memcpy(&m, data + 1, sizeof(m));
+            auto it = streams_.find(m.streamId);
+            if (it == streams_.end()) return;
+            it->second.sendCredit = std::min<uint32_t>(WINDOW, it->second.sendCredit + m.bytes);
+            pump();
+            break;
+        }
+
+        case Desktop::MsgType::StreamClose: {
+            if (size < 1 + sizeof(StreamId)) return;
+            StreamId id;
+            memcpy(&id, data + 1, sizeof(id));
+            finish(id, true);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void StreamMux::pump() {
+    if (streams_.empty()) return;
+
+    // 从上次服务的下一条流开始轮转，每条流每轮最多一段
+    std::vector<StreamId> writable;
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        auto it = streams_.upper_bound(lastServed_);
+        for (size_t n = 0; n < streams_.size(); n++, ++it) {
+            if (it == streams_.end()) it = streams_.begin();
+            StreamId id = it->first;
+            Stream& s = it->second;
+            size_t len = std::min<size_t>({ s.sendQueue.size(), s.sendCredit, MAX_PIECE });
+            if (len == 0) continue;
+
+            BinaryData msg(1 + sizeof(Desktop::StreamDataHeader) + len);
+            msg[0] = static_cast<uint8_t>(Desktop::MsgType::StreamData);
+            Desktop::StreamDataHeader h{ s.flags, id };
+            memcpy(msg.data() + 1, &h, sizeof(h));
+            std::copy(s.sendQueue.begin(), s.sendQueue.begin() + len, msg.begin() + 1 + sizeof(h));
+            if (!send_(msg)) return;    // 链路已断，由 reset() 收尾
+
+            s.sendQueue.erase(s.sendQueue.begin(), s.sendQueue.begin() + len);
+            s.sendCredit -= static_cast<uint32_t>(len);
+            lastServed_ = id;
+            progress = true;
+            if (s.blocked && s.sendQueue.size() < SEND_BUFFER) writable.push_back(id);
+        }
+    }
+
+    // 本端已关闭且数据发完的流，通知对端
+    for (auto it = streams_.begin(); it != streams_.end();) {
+        if (it->second.closing && it->second.sendQueue.empty()) {
+            send_(MessageBuilder::StreamClose(it->first));
+            it = streams_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (StreamId id : writable) {
+        auto it = streams_.find(id);
+        if (it == streams_.end() || !it->second.blocked) continue;
+        it->second.blocked = false;
+        auto onWritable = it->second.handlers.onWritable;
+        if (onWritable) onWritable();
+    }
+}
+
+void StreamMux::finish(StreamId id, bool notify) {
+    auto it = streams_.find(id);
+    if (it == streams_.end()) return;
+    auto onClose = std::move(it->second.handlers.onClose);
+    streams_.erase(it);
+    if (notify && onClose) onClose();
+}
+
+void StreamMux::reset() {
+    auto streams = std::move(streams_);
+    streams_.clear();
+    for (auto& kv : streams) {
+        if (kv.second.handlers.onClose) kv.second.handlers.onClose();
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef STREAM_MUX_H
+#define STREAM_MUX_H
+
+#include "protocol.h"
+#include "event_loop.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace StreamMuxing {
+    // 每条流的接收窗口：对端最多有这么多未被消费的数据在路上，
+    // 同时也限制了批量流能在发送队列和内核缓冲里堆积多少
+    constexpr uint32_t WINDOW = 128 * 1024;
+    // 消费累计到窗口的四分之一才归还一次额度，免得每个小包都回一条
+    constexpr uint32_t CREDIT_BATCH = WINDOW / 4;
+    // 单条 StreamData 的最大负载，轮转时每条流每轮最多发这么多
+    constexpr size_t MAX_PIECE = 16 * 1024;
+    // 本端待发数据超过这么多时 write() 不再接收，等 onWritable
+    constexpr size_t SEND_BUFFER = WINDOW;
+}
+
+// ==================== 流复用 ====================
+// 在一条桌面连接上承载多条可靠字节流（终端、SFTP）。每条流有独立的 ID、
+// 基于额度的流控（接收方消费后才归还额度，慢的流不会撑爆对端内存），
+// 发送时按流轮转，每轮每条流最多一个 MAX_PIECE，多条批量流公平分享带宽。
+// 交互流和批量流在传输层分别走实时和批量优先级，批量数据饿不死视频。
+// 客户端发起的流 ID 为奇数，服务端为偶数。
+// 只在事件循环线程里使用；handleMessage 可在任意线程调用，会转投到循环线程。
+class StreamMux : public std::enable_shared_from_this<StreamMux> {
+public:
+    using StreamId = Desktop::StreamId;
+    using SendFn = std::function<bool(const BinaryData&)>;
+
+    struct Handlers {
+        // 收到的数据；交付方处理完（例如写进套接字）后调用 consume() 归还额度
+        std::function<void(const uint8_t* data, size_t size)> onData;
+        // 待发数据降回 SEND_BUFFER 以下，可以继续 write()
+        std::function<void()> onWritable;
+        // 对端关闭、打开被拒或链路断开；之后不会再有回调
+        std::function<void()> onClose;
+    };
+    // 对端请求打开流：接受时在回调里调用 accept() 并返回 true
+    using OpenFn = std::function<bool(StreamId id, Desktop::StreamService service)>;
+
+    StreamMux(EventLoop& loop, bool initiator, SendFn send);
+
+    void setOnOpen(OpenFn fn) { onOpen_ = std::move(fn); }
+
+    // 链路不通、请求发不出去时返回 0，不会回调 onClose
+    StreamId open(Desktop::StreamService service, bool interactive, Handlers handlers);
+    void accept(StreamId id, Handlers handlers);
+    // 排队待发，返回实际接收的字节数
+    size_t write(StreamId id, const uint8_t* data, size_t size);
+    void consume(StreamId id, size_t bytes);
+    // 本端关闭：已排队的数据仍会发完，不再回调 onClose
+    void close(StreamId id);
+
+    // 是 Stream* 消息就处理并返回 true
+    bool handleMessage(const uint8_t* data, size_t size);
+    // 链路断开：关闭所有流并回调 onClose
+    void reset();
+
+private:
+    struct Stream {
+        Handlers handlers;
+        uint8_t flags = 0;
+        bool accepted = false;      // 对端打开的流在 accept() 之前不收数据
+        bool closing = false;       // 本端已关闭，发完排队数据后发 StreamClose
+        bool blocked = false;       // write() 曾被拒，缓冲降下来后通知 onWritable
+        std::deque<uint8_t> sendQueue;
+        uint32_t sendCredit = StreamMuxing::WINDOW;
+        uint32_t recvOutstanding = 0;   // 已收到、尚未归还额度的字节
+        uint32_t consumedPending = 0;   // 已消费、攒着一起归还的字节
+    };
+
+    void onMessage(const uint8_t* data, size_t size);
+    void pump();
+    void finish(StreamId id, bool notify);
+
+    EventLoop& loop_;
+    bool initiator_;
+    SendFn send_;
+    OpenFn onOpen_;
+    std::map<StreamId, Stream> streams_;
+    StreamId nextId_;
+    StreamId lastServed_ = 0;      // 轮转起点
+};
+
+#endif // STREAM_MUX_H
@@ -0,0 +1,465 @@
+#include "tcp_connection.h"
+#include <algorithm>
+#include <iostream>
+
+TcpConnection::TcpConnection(EventLoop& loop, SOCKET sock, uint32_t maxMessage)
+    : loop_(loop), sock_(sock), maxMessage_(maxMessage) {}
+
+TcpConnection::~TcpConnection() {
+    if (sock_ == INVALID_SOCKET) return;
+    // 正常情况下 close() 已经注销并关闭；这里兜底，避免循环里残留失效的句柄
+    if (open_) {
+        SOCKET s = sock_;
+        loop_.runSync([this, s]() { loop_.remove(s); });
+    }
+    closesocket(sock_);
+}
+
+bool TcpConnection::enableEncryption(SecureSession::Role role, const std::string& psk) {
+    auto session = std::make_unique<SecureSession>(role, psk);
+    if (!session->init()) return false;
+    secure_ = std::move(session);
+    return true;
+}
+
+void TcpConnection::start(MessageFn onMessage, CloseFn onClose) {
+    onMessage_ = std::move(onMessage);
+    onClose_ = std::move(onClose);
+    staging_.reset(new uint8_t[STAGING_SIZE]);
+
+    NetCompat::SetNonBlocking(sock_, true);
+    open_ = true;
+    if (secure_) {
+        // 握手最先写出，不经过发送队列
+        iov_[0] = NetCompat::MakeIoBuf(secure_->hello().data(), secure_->hello().size());
+        iovCount_ = 1;
+        iovPos_ = 0;
+    }
+
+    std::weak_ptr<TcpConnection> weak = shared_from_this();
+    scheduler_.setOnReady([weak]() {
+        if (auto self = weak.lock()) self->requestFlush();
+    });
+    loop_.add(sock_, EventLoop::EV_READ, [weak](uint32_t events) {
+        if (auto self = weak.lock()) self->onEvents(events);
+    });
+    // start() 之前已经排队的消息
+    requestFlush();
+}
+
+bool TcpConnection::waitAccepted(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(acceptMtx_);
+    acceptCv_.wait_for(lock, timeout, [this]() { return peerMessage_ || !open_; });
+    return peerMessage_ && open_;
+}
+
+void TcpConnection::close() {
+    auto self = shared_from_this();
+    loop_.runSync([self]() {
+        self->flush();
+        self->shutdownNow(false);
+    });
+}
+
+void TcpConnection::shutdownNow(bool notify) {
+    if (!open_.exchange(false)) return;
+    {
+        // 唤醒还在等对端第一条消息的线程
+        std::lock_guard<std::mutex> lock(acceptMtx_);
+    }
+    acceptCv_.notify_all();
+
+    loop_.remove(sock_);
+    shutdown(sock_, SD_BOTH);
+    closesocket(sock_);
+    sock_ = INVALID_SOCKET;
+
+    scheduler_.markBroken();
+    piece_.clear();
+    iovPos_ = iovCount_ = 0;
+    bodyMsg_.reset();
+    assembling_.reset();
+    recordIn_.reset();
+    recordOut_.reset();
+    recordLeft_ = 0;
+
+    if (notify && onClose_) onClose_();
+}
+
+void TcpConnection::onEvents(uint32_t events) {
+    if (events & (EventLoop::EV_READ | EventLoop::EV_ERROR)) onReadable();
+    if (open_ && (events & EventLoop::EV_WRITE)) flush();
+}
+
+// ==================== 读 ====================
+void TcpConnection::onReadable() {
+    // 每次就绪最多读若干次，避免一个高速连接独占循环（水平触发，剩余数据下一轮再读）
+    for (int reads = 0; reads < 16 && open_; reads++) {
+        if (stagingPos_ == stagingLen_) {
+            long n;
+            if (!secure_ && state_ == ReadState::Body && bodyLeft_ >= STAGING_SIZE) {
+                // 大消息体绕过暂存区，直接收进目标缓冲
+                n = NetCompat::Recv(sock_, bodyDst_, std::min<size_t>(bodyLeft_, 1u << 30));
+                if (n > 0) {
+                    bodyDst_ += n;
+                    bodyLeft_ -= n;
+                    if (bodyLeft_ == 0) finishBody();
+                    continue;
+                }
+            } else if (secure_ && recordLeft_ >= STAGING_SIZE) {
+                // 大记录同样直接收进记录缓冲
+                n = NetCompat::Recv(sock_, recordDst_, std::min<size_t>(recordLeft_, 1u << 30));
+                if (n > 0) {
+                    recordDst_ += n;
+                    recordLeft_ -= n;
+                    if (recordLeft_ == 0) openRecord();
+                    continue;
+                }
+            } else {
+                n = NetCompat::Recv(sock_, staging_.get(), STAGING_SIZE);
+                if (n > 0) {
+                    stagingPos_ = 0;
+                    stagingLen_ = n;
+                }
+            }
+            if (n == -1) return;            // 暂无数据
+            if (n <= 0) {                   // 对端关闭或出错
+                shutdownNow(true);
+                return;
+            }
+        }
+        consumeStaging();
+    }
+}
+
+void TcpConnection::consumeStaging() {
+    if (secure_) {
+        consumeRecords();
+        return;
+    }
+    consume(staging_.get() + stagingPos_, stagingLen_ - stagingPos_);
+    stagingPos_ = stagingLen_;
+}
+
+void TcpConnection::consumeRecords() {
+    using namespace SecureChanneling;
+    while (open_ && stagingPos_ < stagingLen_) {
+        size_t avail = stagingLen_ - stagingPos_;
+        const uint8_t* src = staging_.get() + stagingPos_;
+
+        if (!secure_->established()) {
+            size_t take = std::min(avail, HELLO_SIZE - peerHelloGot_);
+            memcpy(peerHello_.data() + peerHelloGot_, src, take);
+            peerHelloGot_ += take;
+            stagingPos_ += take;
+            if (peerHelloGot_ < HELLO_SIZE) continue;
+            if (!secure_->onPeerHello(peerHello_.data(), peerHello_.size())) {
+                shutdownNow(true);
+                return;
+            }
+            // 握手前排队的消息现在可以加密发出了
+            requestFlush();
+        } else if (recordLeft_ == 0) {
+            size_t take = std::min(avail, RECORD_HEADER_SIZE - recordHeadGot_);
+            memcpy(recordHead_ + recordHeadGot_, src, take);
+            recordHeadGot_ += take;
+            stagingPos_ += take;
+            if (recordHeadGot_ < RECORD_HEADER_SIZE) continue;
+            recordHeadGot_ = 0;
+
+            uint32_t len = 0;
+            memcpy(&len, recordHead_, sizeof(len));
+            // 一条记录至多装下一条最大的消息或一批小消息；认证之前只接受一批，空记录只有标签
+            size_t limit = peerAuthenticated_ ? sizeof(uint32_t) + maxMessage_ + RECORD_BATCH + TAG_SIZE
+                                              : MAX_UNAUTHENTICATED_RECORD;
+            if (len < TAG_SIZE || len > limit) {
+                std::cerr << "[TCP] Invalid record size: " << len << ", closing connection" << std::endl;
+                shutdownNow(true);
+                return;
+            }
+            recordIn_ = BufferPool::shared().acquire(len);
+            recordDst_ = recordIn_.data();
+            recordLeft_ = len;
+        } else {
+            size_t take = std::min(avail, recordLeft_);
+            memcpy(recordDst_, src, take);
+            recordDst_ += take;
+            recordLeft_ -= take;
+            stagingPos_ += take;
+            if (recordLeft_ == 0) openRecord();
+        }
+    }
+}
+
+void TcpConnection::openRecord() {
+    using namespace SecureChanneling;
+    BufferRef record = std::move(recordIn_);
+    size_t plain = record.size() - TAG_SIZE;
+    if (!secure_->open(record.data(), plain, record.data() + plain)) {
+        std::cerr << "[TCP] Record authentication failed (wrong password or tampered stream), closing connection"
+                  << std::endl;
+        shutdownNow(true);
+        return;
+    }
+    peerAuthenticated_ = true;
+    consume(record.data(), plain);
+}
+
+void TcpConnection::consume(const uint8_t* src, size_t len) {
+    while (open_ && len > 0) {
+        size_t take;
+        if (state_ != ReadState::Body) {
+            take = std::min(len, headNeed_ - headGot_);
+            memcpy(head_ + headGot_, src, take);
+            headGot_ += take;
+            src += take;
+            len -= take;
+            if (headGot_ == headNeed_ && !onHeader()) {
+                shutdownNow(true);
+                return;
+            }
+        } else {
+            take = std::min(len, bodyLeft_);
+            memcpy(bodyDst_, src, take);
+            bodyDst_ += take;
+            bodyLeft_ -= take;
+            src += take;
+            len -= take;
+            if (bodyLeft_ == 0) finishBody();
+        }
+    }
+}
+
+bool TcpConnection::onHeader() {
+    if (state_ == ReadState::Head) {
+        memcpy(&msgSize_, head_, sizeof(msgSize_));
+        if (msgSize_ == 0 || msgSize_ > maxMessage_) {
+            std::cerr << "[TCP] Invalid message size: " << msgSize_
+                      << ", closing connection to avoid stream desync" << std::endl;
+            return false;
+        }
+
+        uint8_t type = head_[sizeof(uint32_t)];
+        if (type == static_cast<uint8_t>(Desktop::MsgType::Chunk)) {
+            if (msgSize_ < Desktop::CHUNK_HEADER_SIZE) return false;
+            state_ = ReadState::ChunkHead;
+            headNeed_ = FRAME_HEAD_SIZE + 1;    // 再读 flags
+            return true;
+        }
+
+        bodyMsg_ = BufferPool::shared().acquire(msgSize_);
+        bodyMsg_.data()[0] = type;
+        bodyDst_ = bodyMsg_.data() + 1;
+        bodyLeft_ = msgSize_ - 1;
+        bodyIsChunk_ = false;
+        state_ = ReadState::Body;
+        if (bodyLeft_ == 0) finishBody();
+        return true;
+    }
+
+    // 分块：直接收进重组缓冲的对应位置
+    uint8_t flags = head_[FRAME_HEAD_SIZE];
+    size_t payload = msgSize_ - Desktop::CHUNK_HEADER_SIZE;
+
+    if (flags & Desktop::CHUNK_FIRST) {
+        if (headNeed_ == FRAME_HEAD_SIZE + 1) {
+            if (payload < sizeof(uint32_t)) return false;
+            headNeed_ += sizeof(uint32_t);      // 首块还有总长度
+            return true;
+        }
+        uint32_t total = 0;
+        memcpy(&total, head_ + FRAME_HEAD_SIZE + 1, sizeof(total));
+        payload -= sizeof(total);
+        if (total == 0 || total > maxMessage_) {
+            std::cerr << "[TCP] Invalid chunked message size: " << total << std::endl;
+            return false;
+        }
+        assembling_ = BufferPool::shared().acquire(total);
+        assembled_ = 0;
+    }
+
+    if (!assembling_ || assembled_ + payload > assembling_.size()) {
+        std::cerr << "[TCP] Unexpected chunk, closing connection to avoid stream desync" << std::endl;
+        return false;
+    }
+
+    bodyDst_ = assembling_.data() + assembled_;
+    bodyLeft_ = payload;
+    chunkPayload_ = payload;
+    chunkLast_ = (flags & Desktop::CHUNK_LAST) != 0;
+    bodyIsChunk_ = true;
+    state_ = ReadState::Body;
+    if (bodyLeft_ == 0) finishBody();
+    return true;
+}
+
+void TcpConnection::finishBody() {
+    state_ = ReadState::Head;
+    headNeed_ = FRAME_HEAD_SIZE;
+    headGot_ = 0;
+
+    BufferRef msg;
+    if (bodyIsChunk_) {
+        assembled_ += chunkPayload_;
+        if (!chunkLast_) return;
+        if (assembled_ != assembling_.size()) {
+            std::cerr << "[TCP] Chunked message truncated: " << assembled_
+                      << "/" << assembling_.size() << std::endl;
+            shutdownNow(true);
+            return;
+        }
+        msg = std::move(assembling_);
+        assembled_ = 0;
+    } else {
+        msg = std::move(bodyMsg_);
+    }
+
+    if (!open_) return;
+    if (!peerMessage_) {
+        {
+            std::lock_guard<std::mutex> lock(acceptMtx_);
+            peerMessage_ = true;
+        }
+        acceptCv_.notify_all();
+    }
+    if (onMessage_) onMessage_(msg);
+}
+
+// ==================== 写 ====================
+void TcpConnection::requestFlush() {
+    if (flushPosted_.exchange(true)) return;
+    std::weak_ptr<TcpConnection> weak = shared_from_this();
+    loop_.post([weak]() {
+        if (auto self = weak.lock()) {
+            self->flushPosted_ = false;
+            self->flush();
+        }
+    });
+}
+
+void TcpConnection::requestFlushAfter(int64_t waitUs) {
+    if (pacingTimer_.exchange(true)) return;
+    std::weak_ptr<TcpConnection> weak = shared_from_this();
+    auto delay = std::chrono::milliseconds(std::max<int64_t>(1, (waitUs + 999) / 1000));
+    loop_.runAfter(delay, [weak]() {
+        if (auto self = weak.lock()) {
+            self->pacingTimer_ = false;
+            self->flush();
+        }
+    });
+}
+
+void TcpConnection::flush() {
+    // 每轮最多写若干段再让出循环，其余连接不会被一个大队列饿死
+    for (int pieces = 0; open_; ) {
+        if (iovPos_ == iovCount_) {
+            if (pieces++ == 64) {
+                requestFlush();
+                return;
+            }
+            int64_t waitUs = 0;
+            if (!(secure_ ? nextRecord(&waitUs) : nextPiece(&waitUs))) {
+                wantWrite_ = false;
+                updateInterest();
+                // 视频被节拍器拦住：到点再来，不占用可写通知
+                if (waitUs > 0) requestFlushAfter(waitUs);
+                return;
+            }
+        }
+
+        long n = NetCompat::SendV(sock_, iov_ + iovPos_, iovCount_ - iovPos_);
+        if (n < 0) {
+            shutdownNow(true);
+            return;
+        }
+        if (n == 0) {
+            // 内核发送缓冲已满，等可写再继续
+            wantWrite_ = true;
+            updateInterest();
+            return;
+        }
+
+        size_t left = static_cast<size_t>(n);
+        while (left > 0 && iovPos_ < iovCount_) {
+            size_t len = NetCompat::IoLen(iov_[iovPos_]);
+            if (left >= len) {
+                left -= len;
+                iovPos_++;
+            } else {
+                NetCompat::IoAdvance(iov_[iovPos_], left);
+                left = 0;
+            }
+        }
+        if (iovPos_ == iovCount_) {
+            if (secure_) recordOut_.reset();
+            else piece_.clear();
+        }
+    }
+}
+
+bool TcpConnection::nextPiece(int64_t* waitUs) {
+    if (!scheduler_.pull(piece_, waitUs)) return false;
+    pieceSize_ = static_cast<uint32_t>(piece_.size());
+    iov_[0] = NetCompat::MakeIoBuf(&pieceSize_, sizeof(pieceSize_));
+    for (size_t i = 0; i < piece_.count; i++) {
+        iov_[1 + i] = NetCompat::MakeIoBuf(piece_.parts[i].data, piece_.parts[i].size);
+    }
+    iovCount_ = 1 + piece_.count;
+    iovPos_ = 0;
+    return true;
+}
+
+bool TcpConnection::nextRecord(int64_t* waitUs) {
+    using namespace SecureChanneling;
+    // 握手完成前只写握手本身，排队的消息等密钥就绪
+    if (!open_ || !secure_->established()) return false;
+
+    // 把若干段连同长度前缀拷进记录缓冲（广播帧被多个连接共享，不能原地改），
+    // 攒够一批或队列取空后一次加密
+    size_t used = 0;
+    while (piece_.count > 0 || scheduler_.pull(piece_, waitUs)) {
+        size_t need = sizeof(uint32_t) + piece_.size();
+        if (!recordOut_ && !recordSealed_ && need > RECORD_BATCH) {
+            // 对端认证之前不接受超过一批的记录，先用一条空记录让它认证，这一段留给下一条
+            recordOut_ = BufferPool::shared().acquire(RECORD_HEADER_SIZE + TAG_SIZE);
+            break;
+        }
+        if (!recordOut_) {
+            recordOut_ = BufferPool::shared().acquire(RECORD_HEADER_SIZE + std::max(RECORD_BATCH, need) + TAG_SIZE);
+        } else if (RECORD_HEADER_SIZE + used + need + TAG_SIZE > recordOut_.size()) {
+            break;      // 这一段留给下一条记录
+        }
+
+        uint8_t* dst = recordOut_.data() + RECORD_HEADER_SIZE + used;
+        uint32_t size = static_cast<uint32_t>(piece_.size());
+        memcpy(dst, &size, sizeof(size));
+        dst += sizeof(size);
+        for (size_t i = 0; i < piece_.count; i++) {
+            memcpy(dst, piece_.parts[i].data, piece_.parts[i].size);
+            dst += piece_.parts[i].size;
+        }
+        used += need;
+        piece_.clear();
+    }
+    if (!recordOut_) return false;
+    if (waitUs) *waitUs = 0;
+
+    uint8_t* body = recordOut_.data() + RECORD_HEADER_SIZE;
+    if (!secure_->seal(body, used, body + used)) {
+        std::cerr << "[TCP] Record encryption failed, closing connection" << std::endl;
+        shutdownNow(true);
+        return false;
+    }
+    recordSealed_ = true;
+    uint32_t len = static_cast<uint32_t>(used + TAG_SIZE);
+    memcpy(recordOut_.data(), &len, sizeof(len));
+    iov_[0] = NetCompat::MakeIoBuf(recordOut_.data(), RECORD_HEADER_SIZE + len);
+    iovCount_ = 1;
+    iovPos_ = 0;
+    return true;
+}
+
+void TcpConnection::updateInterest() {
+    if (!open_) return;
+    loop_.modify(sock_, EventLoop::EV_READ | (wantWrite_ ? uint32_t(EventLoop::EV_WRITE) : 0u));
+}
@@ -0,0 +1,131 @@
+#ifndef TCP_CONNECTION_H
+#define TCP_CONNECTION_H
+
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "event_loop.h"
+#include "send_scheduler.h"
+#include "secure_channel.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// ==================== 事件驱动 TCP 连接 ====================
+// 非阻塞套接字挂在 EventLoop 上：可读时按 4 字节长度前缀拆出消息，
+// 分块消息（Chunk）直接收进重组缓冲；可写时从 SendScheduler 逐段拉取
+// 数据写出。所有回调都在循环线程里执行。
+// 启用加密后，连接建立即交换握手，之后上述帧流被封装进 AEAD 记录：
+// 写端把若干段连同长度前缀攒成一条记录原地加密，读端解密后交给同一个拆帧状态机。
+class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
+public:
+    using MessageFn = std::function<void(const BufferRef& msg)>;
+    using CloseFn = std::function<void()>;
+
+    TcpConnection(EventLoop& loop, SOCKET sock, uint32_t maxMessage);
+    ~TcpConnection();
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+
+    // 在 start() 之前调用：生成临时密钥，连接建立后先握手再收发记录。
+    // psk 只作为密钥派生的盐，主动中间人可据第一条记录离线猜测口令（见 SecureSession），
+    // 口令要足够强；口令为空时不认证对端，只防被动窃听
+    bool enableEncryption(SecureSession::Role role, const std::string& psk);
+
+    // 套接字转为非阻塞并注册到循环；onClose 在连接断开时回调一次
+    void start(MessageFn onMessage, CloseFn onClose);
+
+    // 任意线程调用：先尽量写出已排队的数据，再关闭。主动关闭不回调 onClose
+    void close();
+
+    bool send(const ConstBuffer* parts, size_t count) { return scheduler_.submit(parts, count); }
+    bool send(const BufferRef& msg) { return scheduler_.submit(msg); }
+
+    // 任意线程调用：等到收到对端的第一条完整消息，对端在此之前关闭连接或超时返回 false。
+    // 对端接受连接后立即关闭（例如已满员）时 TCP 握手照样成功，加密握手也不校验口令；
+    // 启用加密时第一条消息所在的记录通过了认证，说明对端知道口令并接纳了连接
+    bool waitAccepted(std::chrono::milliseconds timeout);
+
+    SendScheduler& scheduler() { return scheduler_; }
+    bool isOpen() const { return open_; }
+    SOCKET socket() const { return sock_; }
+
+private:
+    enum class ReadState { Head, ChunkHead, Body };
+
+    void onEvents(uint32_t events);
+    void onReadable();
+    void consumeStaging();
+    void consumeRecords();
+    void openRecord();
+    void consume(const uint8_t* src, size_t len);
+    bool onHeader();
+    void finishBody();
+    void flush();
+    bool nextPiece(int64_t* waitUs);
+    bool nextRecord(int64_t* waitUs);
+    void requestFlush();
+    void requestFlushAfter(int64_t waitUs);
+    void updateInterest();
+    void shutdownNow(bool notify);
+
+    EventLoop& loop_;
+    SOCKET sock_;
+    const uint32_t maxMessage_;
+    std::atomic<bool> open_{false};
+    MessageFn onMessage_;
+    CloseFn onClose_;
+
+    // ---- 读 ----
+    static constexpr size_t STAGING_SIZE = 64 * 1024;
+    static constexpr size_t FRAME_HEAD_SIZE = sizeof(uint32_t) + 1;   // 长度 + 类型
+    std::unique_ptr<uint8_t[]> staging_;
+    size_t stagingPos_ = 0;
+    size_t stagingLen_ = 0;
+
+    ReadState state_ = ReadState::Head;
+    uint8_t head_[FRAME_HEAD_SIZE + Desktop::CHUNK_FIRST_HEADER_SIZE - 1];
+    size_t headNeed_ = FRAME_HEAD_SIZE;
+    size_t headGot_ = 0;
+    uint32_t msgSize_ = 0;
+
+    BufferRef bodyMsg_;         // 普通消息：整条收进池化缓冲
+    uint8_t* bodyDst_ = nullptr;
+    size_t bodyLeft_ = 0;
+    bool bodyIsChunk_ = false;
+    bool chunkLast_ = false;
+    size_t chunkPayload_ = 0;
+    BufferRef assembling_;      // 分块消息的重组缓冲
+    size_t assembled_ = 0;
+
+    // ---- 写 ----
+    SendScheduler scheduler_;
+    SendScheduler::Piece piece_;
+    uint32_t pieceSize_ = 0;    // 当前段的长度前缀
+    NetCompat::IoBuf iov_[3];
+    size_t iovPos_ = 0;
+    size_t iovCount_ = 0;
+    bool wantWrite_ = false;
+    std::atomic<bool> flushPosted_{false};
+    std::atomic<bool> pacingTimer_{false};
+
+    // ---- 加密（未启用时 secure_ 为空）----
+    std::unique_ptr<SecureSession> secure_;
+    std::array<uint8_t, SecureChanneling::HELLO_SIZE> peerHello_{};
+    size_t peerHelloGot_ = 0;
+    uint8_t recordHead_[SecureChanneling::RECORD_HEADER_SIZE];
+    size_t recordHeadGot_ = 0;
+    BufferRef recordIn_;        // 正在接收的记录（密文 + 标签），收齐后原地解密
+    uint8_t* recordDst_ = nullptr;
+    size_t recordLeft_ = 0;
+    BufferRef recordOut_;       // 正在写出的记录
+    std::mutex acceptMtx_;
+    std::condition_variable acceptCv_;
+    bool peerMessage_ = false;          // 已交付过对端的消息，受 acceptMtx_ 保护
+    bool peerAuthenticated_ = false;    // 对端已有一条记录通过认证，记录长度放宽到最大消息
+    bool recordSealed_ = false;         // 本端已封过记录，之后的记录不受 RECORD_BATCH 限制
+};
+
+#endif // TCP_CONNECTION_H
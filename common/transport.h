@@ -2,15 +2,30 @@
 #define TRANSPORT_H
 
 #include "protocol.h"
+#include "buffer_pool.h"
+#include "clock_sync.h"
 #include <functional>
 #include <memory>
 
+// 服务端连接标识：多观看者时区分各个客户端，单客户端传输固定为 SINGLE_CLIENT_ID
+using ClientId = uint32_t;
+constexpr ClientId SINGLE_CLIENT_ID = 1;
+
 // ==================== 传输层回调 ====================
 struct TransportCallbacks {
     std::function<void()> onConnected;
     std::function<void()> onDisconnected;
     std::function<void(const BinaryData&)> onMessage;
+    // 设置后客户端传输层直接收包到池化缓冲并以引用计数句柄交付，取代 onMessage
+    std::function<void(const BufferRef&)> onBuffer;
     std::function<void(const std::string&)> onError;
+    // 服务端发送队列因拥塞丢弃了视频帧，需要尽快产出恢复帧
+    std::function<void()> onVideoDropped;
+
+    // 多客户端服务端：设置后按连接分别回调，取代上面的 onConnected/onDisconnected/onMessage
+    std::function<void(ClientId)> onClientConnected;
+    std::function<void(ClientId)> onClientDisconnected;
+    std::function<void(ClientId, const BinaryData&)> onClientMessage;
 };
 
 // ==================== 传输层接口 ====================
@@ -19,12 +34,19 @@ public:
     virtual ~ITransport() = default;
     
     virtual bool send(const BinaryData& data) = 0;
+    // 分散/聚集发送：多个片段按顺序组成一条消息，默认实现拼接后走 send()
+    virtual bool sendv(const ConstBuffer* parts, size_t count) {
+        return send(MessageBuilder::Gather(parts, count));
+    }
     virtual bool isConnected() const = 0;
     virtual void disconnect() = 0;
     virtual void setCallbacks(const TransportCallbacks& callbacks) = 0;
     
     // 使用之前保存的参数重新连接
     virtual bool reconnect() = 0;
+
+    // 传输层持续 Ping/Pong 测得的 RTT 与时钟偏差，不支持测量或尚无样本时返回 false
+    virtual bool clockEstimate(ClockEstimate& /*out*/) const { return false; }
 };
 
 // ==================== 服务端传输接口 ====================
@@ -35,13 +57,39 @@ public:
     virtual bool start() = 0;
     virtual void stop() = 0;
     virtual bool send(const BinaryData& data) = 0;
+    virtual bool sendv(const ConstBuffer* parts, size_t count) {
+        return send(MessageBuilder::Gather(parts, count));
+    }
+    // 发送已完整构建在池化缓冲中的消息，支持异步发送的实现只持有引用不拷贝
+    virtual bool sendBuffer(const BufferRef& msg) {
+        ConstBuffer part{ msg.data(), msg.size() };
+        return sendv(&part, 1);
+    }
     virtual bool hasClient() const = 0;
     virtual void setCallbacks(const TransportCallbacks& callbacks) = 0;
+
+    // 以下用于多观看者：send/sendv/sendBuffer 只广播给已订阅的客户端，
+    // 单客户端实现忽略订阅状态，sendTo 退化为 send
+    virtual bool sendTo(ClientId /*id*/, const BinaryData& data) { return send(data); }
+    virtual void setSubscribed(ClientId /*id*/, bool /*subscribed*/) {}
+    virtual size_t clientCount() const { return hasClient() ? 1 : 0; }
+    // 主动断开某个客户端（例如它已在新连接上续连），不触发断开回调
+    virtual void disconnectClient(ClientId /*id*/) {}
+
+    // 按编码码率和帧率平滑视频发送，不支持节拍的实现忽略
+    virtual void setPacingRate(int /*bitsPerSec*/, int /*fps*/) {}
+
+    // 到指定客户端的 RTT 与时钟偏差，不支持测量或尚无样本时返回 false
+    virtual bool clockEstimate(ClientId /*id*/, ClockEstimate& /*out*/) const { return false; }
+
+    // 根据客户端回报的视频帧到达时刻估计的可用码率（bps），没有估计时返回 0
+    virtual int targetBitrate(ClientId /*id*/) const { return 0; }
 };
 
 // ==================== 传输模式 ====================
 enum class TransportMode {
     TCP,
+    UDP,    // 视频走 FEC + NACK，输入和控制走可靠子流
     P2P,
     Relay
 };
@@ -2,7 +2,12 @@
 #include <iostream>
 
 // ==================== P2P客户端 ====================
-P2PClientTransport::P2PClientTransport() {}
+using PathMonitoring::PathId;
+
+P2PClientTransport::P2PClientTransport()
+    : clock_(std::make_shared<ClockSync>()),
+      paths_(std::make_shared<PathMonitor>()),
+      sender_(std::make_shared<FragmentSender>()) {}
 
 P2PClientTransport::~P2PClientTransport() {
     disconnect();
@@ -38,48 +43,44 @@ bool P2PClientTransport::connect(const std::string& signalingUrl,
     });
 
     client_->setOnDisconnected([this](const p2p::Error& err) {
-        connected_ = false;
-        ready_ = false;
-        if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+        onPeerDown();
     });
 
     client_->setOnError([this](const p2p::Error& err) {
         if (callbacks_.onError) callbacks_.onError(err.message);
     });
 
+    // 直连和中继两条路径都可能先通，任一条通了会话就算建立，另一条作为热备
     client_->setOnPeerConnected([this](const std::string& peer) {
-        if (!useRelay_ && peer == peerId_) {
-            connected_ = true;
-            if (callbacks_.onConnected) callbacks_.onConnected();
-        }
+        if (peer == peerId_) onPathUp(PathId::Direct);
     });
 
     client_->setOnPeerDisconnected([this](const std::string& peer) {
-        if (!useRelay_ && peer == peerId_) {
-            connected_ = false;
-            ready_ = false;
-            if (callbacks_.onDisconnected) callbacks_.onDisconnected();
-        }
+        if (peer == peerId_) onPathDown(PathId::Direct);
     });
 
     client_->setOnRelayConnected([this](const std::string& peer) {
-        if (useRelay_ && peer == peerId_) {
-            connected_ = true;
-            if (callbacks_.onConnected) callbacks_.onConnected();
-        }
+        if (peer == peerId_) onPathUp(PathId::Relay);
     });
 
     client_->setOnRelayDisconnected([this](const std::string& peer) {
-        if (useRelay_ && peer == peerId_) {
-            connected_ = false;
-            ready_ = false;
-            if (callbacks_.onDisconnected) callbacks_.onDisconnected();
-        }
+        if (peer == peerId_) onPathDown(PathId::Relay);
     });
 
     client_->setOnBinaryMessage([this](const std::string& from, const p2p::BinaryData& data) {
-        if (from == peerId_ && callbacks_.onMessage) {
-            callbacks_.onMessage(data);
+        if (from != peerId_) return;
+        if (paths_->intercept(data.data(), data.size(),
+                              [this](PathId path, const BinaryData& m) { return sendOn(path, m); })) return;
+        if (clock_->intercept(data.data(), data.size(), [this](const BinaryData& m) { return send(m); })) return;
+        BufferRef msg;
+        if (!assembler_.feed(data.data(), data.size(), msg)) {
+            msg = BufferPool::shared().copyOf(data.data(), data.size());
+        }
+        if (!msg) return;
+        if (callbacks_.onBuffer) {
+            callbacks_.onBuffer(msg);
+        } else if (callbacks_.onMessage) {
+            callbacks_.onMessage(BinaryData(msg.data(), msg.data() + msg.size()));
         }
     });
 
@@ -94,12 +95,71 @@ bool P2PClientTransport::connect(const std::string& signalingUrl,
         client_->connectToPeer(peerId_);
     }
 
-    auto start = GetTickCount();
-    while (!connected_ && (GetTickCount() - start) < 30000) {
-        Sleep(100);
+    // 打洞/中继建立后由 onPeerUp 唤醒，握手耗时不再被轮询间隔放大（连接竞速按它选路）
+    std::unique_lock<std::mutex> lock(connectMtx_);
+    connectCV_.wait_for(lock, std::chrono::milliseconds(CONNECT_TIMEOUT_MS), [this]() { return connected_.load(); });
+    return connected_;
+}
+
+void P2PClientTransport::onPathUp(PathId path) {
+    paths_->setUp(path, true);
+    if (!connected_) {
+        onPeerUp();
+        // 会话建立后在后台拉起另一条路径作为热备
+        bringUpStandby(path == PathId::Direct ? PathId::Relay : PathId::Direct);
     }
+}
 
-    return connected_;
+void P2PClientTransport::onPathDown(PathId path) {
+    paths_->setUp(path, false);
+    // 还有一条路径时会话继续，PathMonitor 已把发送切过去
+    if (connected_ && !paths_->anyUp()) onPeerDown();
+}
+
+void P2PClientTransport::bringUpStandby(PathId path) {
+    if (!client_) return;
+    if (path == PathId::Direct) {
+        client_->connectToPeer(peerId_);
+        return;
+    }
+    if (savedRelayPassword_.empty()) {
+        std::cout << "[P2P Client] No relay password, running without a standby path" << std::endl;
+        return;
+    }
+    // 中继认证是阻塞调用，不能占住 P2P 回调线程
+    if (standbyThread_.joinable()) standbyThread_.join();
+    standbyThread_ = std::thread([this]() {
+        if (!client_->authenticateRelay(savedRelayPassword_) || !client_->connectToPeerViaRelay(peerId_)) {
+            std::cerr << "[P2P Client] Standby relay path failed" << std::endl;
+        }
+    });
+}
+
+void P2PClientTransport::onPeerUp() {
+    {
+        std::lock_guard<std::mutex> lock(connectMtx_);
+        connected_ = true;
+    }
+    connectCV_.notify_all();
+    assembler_.reset();
+    // 排空旧路径期间 route() 返回 false，分片发送器按通道拒收处理，稍后重试
+    sender_->start([this](const BinaryData& m) {
+        PathId path;
+        return paths_->route(path) && sendOn(path, m);
+    });
+    clock_->start([this](const BinaryData& m) { return send(m); });
+    paths_->start([this](PathId path, const BinaryData& m) { return sendOn(path, m); },
+                  [](PathId, PathId) {});
+    if (callbacks_.onConnected) callbacks_.onConnected();
+}
+
+void P2PClientTransport::onPeerDown() {
+    clock_->stop();
+    paths_->stop();
+    sender_->stop();
+    connected_ = false;
+    ready_ = false;
+    if (callbacks_.onDisconnected) callbacks_.onDisconnected();
 }
 
 bool P2PClientTransport::reconnect() {
@@ -119,8 +179,12 @@ bool P2PClientTransport::reconnect() {
 
 bool P2PClientTransport::send(const BinaryData& data) {
     if (!connected_ || !client_) return false;
-    
-    if (useRelay_) {
+    return sender_->submit(BufferPool::shared().copyOf(data.data(), data.size()));
+}
+
+bool P2PClientTransport::sendOn(PathId path, const BinaryData& data) {
+    if (!client_) return false;
+    if (path == PathId::Relay) {
         return client_->sendBinaryViaRelay(peerId_, data);
     } else {
         return client_->sendBinary(peerId_, data);
@@ -132,14 +196,15 @@ bool P2PClientTransport::isConnected() const {
 }
 
 void P2PClientTransport::disconnect() {
+    clock_->stop();
+    paths_->stop();
+    sender_->stop();
     connected_ = false;
     ready_ = false;
+    if (standbyThread_.joinable()) standbyThread_.join();
     if (client_) {
-        if (useRelay_) {
-            client_->disconnectFromPeerViaRelay(peerId_);
-        } else {
-            client_->disconnectFromPeer(peerId_);
-        }
+        client_->disconnectFromPeerViaRelay(peerId_);
+        client_->disconnectFromPeer(peerId_);
         client_->disconnect();
         client_.reset();
     }
@@ -149,8 +214,22 @@ void P2PClientTransport::setCallbacks(const TransportCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
+bool P2PClientTransport::clockEstimate(ClockEstimate& out) const {
+    out = clock_->estimate();
+    return out.valid;
+}
+
 // ==================== P2P服务端 ====================
-P2PServerTransport::P2PServerTransport(ServiceType service) : service_(service) {}
+P2PServerTransport::P2PServerTransport(ServiceType service)
+    : clock_(std::make_shared<ClockSync>()),
+      paths_(std::make_shared<PathMonitor>()),
+      sender_(std::make_shared<FragmentSender>()),
+      service_(service) {
+    // 过期放弃了视频分片，和发送队列丢帧一样请求恢复帧
+    sender_->setOnVideoDropped([this]() {
+        if (callbacks_.onVideoDropped) callbacks_.onVideoDropped();
+    });
+}
 
 P2PServerTransport::~P2PServerTransport() {
     stop();
@@ -192,62 +271,121 @@ bool P2PServerTransport::start(const std::string& signalingUrl, const std::strin
         if (callbacks_.onError) callbacks_.onError(err.message);
     });
 
+    // 同一客户端的第二条路径作为热备接受，其他对端在已有客户端时拒绝
     client_->setOnPeerConnected([this](const std::string& peer) {
-        if (hasClient_) {
-            client_->disconnectFromPeer(peer);
-            return;
-        }
-        clientPeerId_ = peer;
-        clientIsRelay_ = false;
-        hasClient_ = true;
-        if (callbacks_.onConnected) callbacks_.onConnected();
+        onPathUp(peer, PathId::Direct);
     });
 
     client_->setOnPeerDisconnected([this](const std::string& peer) {
-        if (peer == clientPeerId_ && !clientIsRelay_) {
-            hasClient_ = false;
-            ready_ = false;
-            clientPeerId_.clear();
-            if (callbacks_.onDisconnected) callbacks_.onDisconnected();
-        }
+        onPathDown(peer, PathId::Direct);
     });
 
     client_->setOnRelayConnected([this](const std::string& peer) {
-        if (hasClient_) {
-            client_->disconnectFromPeerViaRelay(peer);
-            return;
-        }
-        clientPeerId_ = peer;
-        clientIsRelay_ = true;
-        hasClient_ = true;
-        if (callbacks_.onConnected) callbacks_.onConnected();
+        onPathUp(peer, PathId::Relay);
     });
 
     client_->setOnRelayDisconnected([this](const std::string& peer) {
-        if (peer == clientPeerId_ && clientIsRelay_) {
-            hasClient_ = false;
-            ready_ = false;
-            clientPeerId_.clear();
-            if (callbacks_.onDisconnected) callbacks_.onDisconnected();
-        }
+        onPathDown(peer, PathId::Relay);
     });
 
     client_->setOnBinaryMessage([this](const std::string& from, const p2p::BinaryData& data) {
-        if (from == clientPeerId_ && callbacks_.onMessage) {
-            callbacks_.onMessage(data);
+        {
+            std::lock_guard<std::mutex> lock(peerMtx_);
+            if (from != clientPeerId_) return;
+        }
+        if (paths_->intercept(data.data(), data.size(),
+                              [this](PathId path, const BinaryData& m) { return sendOn(path, m); })) return;
+        if (clock_->intercept(data.data(), data.size(), [this](const BinaryData& m) { return send(m); })) return;
+        BufferRef msg;
+        if (!assembler_.feed(data.data(), data.size(), msg)) {
+            if (callbacks_.onMessage) callbacks_.onMessage(data);
+            return;
         }
+        if (msg && callbacks_.onMessage) callbacks_.onMessage(BinaryData(msg.data(), msg.data() + msg.size()));
     });
 
     return client_->connect();
 }
 
+void P2PServerTransport::onPathUp(const std::string& peer, PathId path) {
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(peerMtx_);
+        if (hasClient_ && peer != clientPeerId_) {
+            if (path == PathId::Relay) client_->disconnectFromPeerViaRelay(peer);
+            else client_->disconnectFromPeer(peer);
+            return;
+        }
+        first = !hasClient_;
+        clientPeerId_ = peer;
+        hasClient_ = true;
+    }
+    paths_->setUp(path, true);
+    if (!first) return;
+
+    assembler_.reset();
+    // 排空旧路径期间 route() 返回 false，分片发送器按通道拒收处理，稍后重试
+    sender_->start([this](const BinaryData& m) {
+        PathId path;
+        return paths_->route(path) && sendOn(path, m);
+    });
+    clock_->start([this](const BinaryData& m) { return send(m); });
+    // 迁移后新路径上的首帧可能落在丢弃过的参考帧之后，按丢帧处理请求关键帧恢复
+    paths_->start([this](PathId p, const BinaryData& m) { return sendOn(p, m); },
+                  [this](PathId, PathId) {
+                      if (callbacks_.onVideoDropped) callbacks_.onVideoDropped();
+                  });
+    if (callbacks_.onConnected) callbacks_.onConnected();
+}
+
+void P2PServerTransport::onPathDown(const std::string& peer, PathId path) {
+    {
+        std::lock_guard<std::mutex> lock(peerMtx_);
+        if (!hasClient_ || peer != clientPeerId_) return;
+    }
+    paths_->setUp(path, false);
+    // 另一条路径仍在时客户端不算断开
+    if (!paths_->anyUp()) dropClient();
+}
+
+void P2PServerTransport::dropClient() {
+    clock_->stop();
+    paths_->stop();
+    sender_->stop();
+    {
+        std::lock_guard<std::mutex> lock(peerMtx_);
+        hasClient_ = false;
+        clientPeerId_.clear();
+    }
+    ready_ = false;
+    if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+}
+
 bool P2PServerTransport::send(const BinaryData& data) {
     if (!hasClient_ || !client_) return false;
-    
-    if (clientIsRelay_) {
-        return client_->sendBinaryViaRelay(clientPeerId_, data);
+    return sender_->submit(BufferPool::shared().copyOf(data.data(), data.size()));
+}
+
+bool P2PServerTransport::sendBuffer(const BufferRef& msg) {
+    if (!hasClient_ || !client_) return false;
+    return sender_->submit(msg);
+}
+
+void P2PServerTransport::setPacingRate(int bitsPerSec, int fps) {
+    sender_->setPacingRate(bitsPerSec, fps);
+}
+
+bool P2PServerTransport::sendOn(PathId path, const BinaryData& data) {
+    std::string peer;
+    {
+        std::lock_guard<std::mutex> lock(peerMtx_);
+        peer = clientPeerId_;
+    }
+    if (!client_ || peer.empty()) return false;
+    if (path == PathId::Relay) {
+        return client_->sendBinaryViaRelay(peer, data);
     } else {
-        return client_->sendBinary(clientPeerId_, data);
+        return client_->sendBinary(peer, data);
     }
 }
 
@@ -256,6 +394,9 @@ bool P2PServerTransport::hasClient() const {
 }
 
 void P2PServerTransport::stop() {
+    clock_->stop();
+    paths_->stop();
+    sender_->stop();
     hasClient_ = false;
     ready_ = false;
     if (client_) {
@@ -268,6 +409,12 @@ void P2PServerTransport::setCallbacks(const TransportCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
+bool P2PServerTransport::clockEstimate(ClientId id, ClockEstimate& out) const {
+    if (id != SINGLE_CLIENT_ID || !hasClient_) return false;
+    out = clock_->estimate();
+    return out.valid;
+}
+
 std::string P2PServerTransport::getLocalId() const {
     return client_ ? client_->getLocalId() : "";
 }
\ No newline at end of file
@@ -2,10 +2,22 @@
 #define TRANSPORT_P2P_H
 
 #include "transport.h"
+#include "path_monitor.h"
+#include "fragmenter.h"
 #include <p2p/p2p_client.hpp>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+
+// 注意：本文件目前不在任何构建目标里。它依赖的 P2P 信令客户端库（p2p/p2p_client.hpp）
+// 不随仓库提供，应用里的 P2P/中继路径走 EasyTier 虚拟网卡上的 TCP/UDP 传输。
+// 接入该库时把 transport_p2p.cpp 加进 CMakeLists.txt 的 APP_SOURCES 并链接它；
+// 它用到的 PathMonitor 和 FragmentSender 已在 netcore 中编译
 
 // ==================== P2P客户端传输 ====================
+// 连上后同时保持直连和中继两条路径，由 PathMonitor 选择发送路径，
+// 当前路径断开或变差时会话不中断地迁移到另一条。大消息经 FragmentSender 分片
 class P2PClientTransport : public ITransport {
 public:
     P2PClientTransport();
@@ -22,14 +34,32 @@ public:
     void disconnect() override;
     void setCallbacks(const TransportCallbacks& callbacks) override;
     bool reconnect() override;
+    bool clockEstimate(ClockEstimate& out) const override;
 
 private:
+    using PathId = PathMonitoring::PathId;
+
+    void onPathUp(PathId path);
+    void onPathDown(PathId path);
+    void bringUpStandby(PathId path);
+    bool sendOn(PathId path, const BinaryData& data);
+    void onPeerUp();
+    void onPeerDown();
+
     std::unique_ptr<p2p::P2PClient> client_;
+    std::shared_ptr<ClockSync> clock_;     // 定时器挂在共享事件循环上
+    std::shared_ptr<PathMonitor> paths_;
+    std::shared_ptr<FragmentSender> sender_;
+    FragmentAssembler assembler_;
+    std::thread standbyThread_;            // 后台建立热备中继路径
     std::string peerId_;
     ServiceType service_;
     std::atomic<bool> connected_{false};
     std::atomic<bool> ready_{false};
     bool useRelay_ = false;
+    static constexpr int CONNECT_TIMEOUT_MS = 30000;
+    std::mutex connectMtx_;
+    std::condition_variable connectCV_;
     TransportCallbacks callbacks_;
     
     // 保存连接参数用于重连
@@ -41,6 +71,7 @@ private:
 };
 
 // ==================== P2P服务端传输 ====================
+// 视频分片按帧间隔设有效期，拥塞时过期即放弃而不是排队重传；控制和输入完整可靠
 class P2PServerTransport : public IServerTransport {
 public:
     P2PServerTransport(ServiceType service);
@@ -51,8 +82,11 @@ public:
     bool start() override;
     void stop() override;
     bool send(const BinaryData& data) override;
+    bool sendBuffer(const BufferRef& msg) override;
     bool hasClient() const override;
     void setCallbacks(const TransportCallbacks& callbacks) override;
+    void setPacingRate(int bitsPerSec, int fps) override;
+    bool clockEstimate(ClientId id, ClockEstimate& out) const override;
     
     void setConfig(const std::string& signalingUrl, const std::string& peerId = "") {
         signalingUrl_ = signalingUrl;
@@ -62,14 +96,25 @@ public:
     std::string getLocalId() const;
 
 private:
+    using PathId = PathMonitoring::PathId;
+
+    void onPathUp(const std::string& peer, PathId path);
+    void onPathDown(const std::string& peer, PathId path);
+    bool sendOn(PathId path, const BinaryData& data);
+    void dropClient();
+
     std::unique_ptr<p2p::P2PClient> client_;
+    std::shared_ptr<ClockSync> clock_;
+    std::shared_ptr<PathMonitor> paths_;
+    std::shared_ptr<FragmentSender> sender_;
+    FragmentAssembler assembler_;
+    std::mutex peerMtx_;                   // 保护 clientPeerId_，两条路径的回调可能并发
     std::string clientPeerId_;
     std::string signalingUrl_;
     std::string peerId_;
     ServiceType service_;
     std::atomic<bool> hasClient_{false};
     std::atomic<bool> ready_{false};
-    bool clientIsRelay_ = false;
     TransportCallbacks callbacks_;
 };
 
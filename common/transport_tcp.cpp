@@ -1,38 +1,49 @@
 #include "transport_tcp.h"
 #include <iostream>
+#include <algorithm>
 
 // ==================== TCP客户端 ====================
-TCPClientTransport::TCPClientTransport() {}
+TCPClientTransport::TCPClientTransport(EventLoop& loop)
+    : loop_(loop), clock_(std::make_shared<ClockSync>(loop)) {}
 
 TCPClientTransport::~TCPClientTransport() {
     disconnect();
 }
 
+void TCPClientTransport::setEncryption(bool enabled, const std::string& psk) {
+    encrypted_ = enabled;
+    psk_ = psk;
+    if (enabled && psk.empty()) {
+        std::cerr << "[TCP Client] WARNING: no password set, the link is encrypted but the server "
+                     "is not authenticated (open to man-in-the-middle)" << std::endl;
+    }
+}
+
 bool TCPClientTransport::connect(const std::string& ip, int port) {
     // 保存连接参数用于重连
     savedIp_ = ip;
     savedPort_ = port;
 
-    socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (socket_ == INVALID_SOCKET) {
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == INVALID_SOCKET) {
         std::cerr << "[TCP Client] socket() failed: " << WSAGetLastError() << std::endl;
         return false;
     }
-    SetHandleInformation((HANDLE)socket_, HANDLE_FLAG_INHERIT, 0);
+    NetCompat::SetNoInherit(sock);
 
     sockaddr_in addr = {};
     addr.sin_family = AF_INET;
     if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
         std::cerr << "[TCP Client] Invalid IP: " << ip << std::endl;
-        closesocket(socket_);
-        socket_ = INVALID_SOCKET;
+        closesocket(sock);
         return false;
     }
     addr.sin_port = htons(port);
 
     std::cout << "[TCP Client] Connecting to " << ip << ":" << port << "..." << std::endl;
 
-    if (::connect(socket_, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
+    // 连接阶段仍是阻塞的，建立后再交给事件循环
+    if (::connect(sock, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR) {
         int err = WSAGetLastError();
         std::cerr << "[TCP Client] connect() failed: " << err;
         switch (err) {
@@ -42,23 +53,45 @@ bool TCPClientTransport::connect(const std::string& ip, int port) {
             case WSAEADDRNOTAVAIL: std::cerr << " (Address not available)"; break;
         }
         std::cerr << std::endl;
-        closesocket(socket_);
-        socket_ = INVALID_SOCKET;
+        closesocket(sock);
         return false;
     }
 
     int flag = 1;
-    setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char*)&flag, sizeof(flag));
 
     int bufSize = 2 * 1024 * 1024;
-    setsockopt(socket_, SOL_SOCKET, SO_RCVBUF, (char*)&bufSize, sizeof(bufSize));
-    setsockopt(socket_, SOL_SOCKET, SO_SNDBUF, (char*)&bufSize, sizeof(bufSize));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&bufSize, sizeof(bufSize));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&bufSize, sizeof(bufSize));
 
+    auto conn = std::make_shared<TcpConnection>(loop_, sock, MAXMSG);
+    if (encrypted_ && !conn->enableEncryption(SecureSession::Role::Client, psk_)) {
+        std::cerr << "[TCP Client] Failed to set up encryption" << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(connMtx_);
+        conn_ = conn;
+    }
+    feedback_.reset();
+
+    conn->start([this](const BufferRef& msg) { deliver(msg); },
+                [this]() { onClosed(); });
+    // 服务端满员时接受后立即关闭，TCP 握手照样成功；口令不对时加密握手也照样完成。
+    // 服务端接纳连接后马上发出第一个 Ping，收到它（加密时即通过认证）才算连上，
+    // 连接竞速才不会选中一条随后就被对端关掉的连接
+    if (!conn->waitAccepted(std::chrono::milliseconds(HANDSHAKE_TIMEOUT_MS))) {
+        std::cerr << "[TCP Client] Server did not accept the connection (full, wrong password, or not a desktop server)"
+                  << std::endl;
+        disconnect();
+        return false;
+    }
     connected_ = true;
 
-    std::cout << "[TCP Client] Connected!" << std::endl;
+    std::cout << "[TCP Client] Connected"
+              << (!encrypted_ ? "" : psk_.empty() ? " (encrypted, unauthenticated)" : " (encrypted)") << "!" << std::endl;
 
-    recvThread_ = std::thread(&TCPClientTransport::recvLoop, this);
+    clock_->start([this](const BinaryData& m) { return send(m); });
 
     if (callbacks_.onConnected) callbacks_.onConnected();
     return true;
@@ -69,48 +102,53 @@ bool TCPClientTransport::reconnect() {
         std::cerr << "[TCP Client] No saved connection parameters for reconnect" << std::endl;
         return false;
     }
-    
+
     std::cout << "[TCP Client] Attempting reconnect to " << savedIp_ << ":" << savedPort_ << std::endl;
-    
+
     // 先断开旧连接
     disconnect();
-    
+
     // 使用保存的参数重连
     return connect(savedIp_, savedPort_);
 }
 
-void TCPClientTransport::recvLoop() {
-    std::vector<uint8_t> buffer;
-
-    while (connected_) {
-        uint32_t msgSize = 0;
-        if (!NetUtil::RecvAll(socket_, &msgSize, sizeof(msgSize))) break;
+std::shared_ptr<TcpConnection> TCPClientTransport::connection() const {
+    std::lock_guard<std::mutex> lock(connMtx_);
+    return conn_;
+}
 
-        if (msgSize == 0 || msgSize > MAXMSG) {
-            std::cerr << "[TCP Client] Invalid message size: " << msgSize
-                      << ", closing connection to avoid stream desync" << std::endl;
-            break;
-        }
+void TCPClientTransport::deliver(const BufferRef& msg) {
+    // Ping/Pong 在传输层消化，不交给上层
+    if (clock_->intercept(msg.data(), msg.size(), [this](const BinaryData& m) { return send(m); })) return;
 
-        buffer.resize(msgSize);
-        if (!NetUtil::RecvAll(socket_, buffer.data(), msgSize)) break;
+    // TCP 有序可靠，第 n 个收到的视频帧就是服务端发出的第 n 个
+    if (!msg.empty() && msg[0] == static_cast<uint8_t>(Desktop::MsgType::VideoFrame)) {
+        BinaryData fb = feedback_.onFrameArrived(ClockSyncing::NowUs());
+        if (!fb.empty()) send(fb);
+    }
 
-        if (callbacks_.onMessage) {
-            callbacks_.onMessage(buffer);
-        }
+    if (callbacks_.onBuffer) {
+        callbacks_.onBuffer(msg);
+    } else if (callbacks_.onMessage) {
+        callbacks_.onMessage(BinaryData(msg.data(), msg.data() + msg.size()));
     }
+}
 
-    connected_ = false;
-    if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+void TCPClientTransport::onClosed() {
+    if (connected_.exchange(false) && callbacks_.onDisconnected) {
+        callbacks_.onDisconnected();
+    }
 }
 
 bool TCPClientTransport::send(const BinaryData& data) {
-    if (!connected_) return false;
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
 
-    std::lock_guard<std::mutex> lock(sendMtx_);
-    uint32_t size = static_cast<uint32_t>(data.size());
-    if (!NetUtil::SendAll(socket_, &size, sizeof(size))) return false;
-    return NetUtil::SendAll(socket_, data.data(), static_cast<int>(data.size()));
+bool TCPClientTransport::sendv(const ConstBuffer* parts, size_t count) {
+    if (!connected_) return false;
+    auto conn = connection();
+    return conn && conn->send(parts, count);
 }
 
 bool TCPClientTransport::isConnected() const {
@@ -118,33 +156,50 @@ bool TCPClientTransport::isConnected() const {
 }
 
 void TCPClientTransport::disconnect() {
-    connected_ = false;
-    if (socket_ != INVALID_SOCKET) {
-        shutdown(socket_, SD_BOTH);
-        closesocket(socket_);
-        socket_ = INVALID_SOCKET;
+    clock_->stop();
+    std::shared_ptr<TcpConnection> conn;
+    {
+        std::lock_guard<std::mutex> lock(connMtx_);
+        conn.swap(conn_);
     }
-    if (recvThread_.joinable()) recvThread_.detach();
+    // close() 返回后不会再有该连接的回调
+    if (conn) conn->close();
+    onClosed();
 }
 
 void TCPClientTransport::setCallbacks(const TransportCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
 
+bool TCPClientTransport::clockEstimate(ClockEstimate& out) const {
+    out = clock_->estimate();
+    return out.valid;
+}
+
 // ==================== TCP服务端 ====================
-TCPServerTransport::TCPServerTransport(int port) : port_(port) {}
+TCPServerTransport::TCPServerTransport(int port, int maxClients, EventLoop& loop)
+    : loop_(loop), port_(port), maxClients_(std::max(1, maxClients)) {}
 
 TCPServerTransport::~TCPServerTransport() {
     stop();
 }
 
+void TCPServerTransport::setEncryption(bool enabled, const std::string& psk) {
+    encrypted_ = enabled;
+    psk_ = psk;
+    if (enabled && psk.empty()) {
+        std::cerr << "[TCP Server] WARNING: no password set, connections are encrypted but clients "
+                     "are not authenticated (open to man-in-the-middle)" << std::endl;
+    }
+}
+
 bool TCPServerTransport::start() {
     listenSocket_ = socket(AF_INET, SOCK_STREAM, 0);
     if (listenSocket_ == INVALID_SOCKET) {
         std::cerr << "[TCP Server] socket() failed: " << WSAGetLastError() << std::endl;
         return false;
     }
-    SetHandleInformation((HANDLE)listenSocket_, HANDLE_FLAG_INHERIT, 0);
+    NetCompat::SetNoInherit(listenSocket_);
 
     int opt = 1;
     setsockopt(listenSocket_, SOL_SOCKET, SO_REUSEADDR, (char*)&opt, sizeof(opt));
@@ -166,36 +221,43 @@ bool TCPServerTransport::start() {
         return false;
     }
 
-    if (listen(listenSocket_, 2) == SOCKET_ERROR) {
+    if (listen(listenSocket_, std::max(2, maxClients_)) == SOCKET_ERROR) {
         std::cerr << "[TCP Server] listen() failed: " << WSAGetLastError() << std::endl;
         closesocket(listenSocket_);
         listenSocket_ = INVALID_SOCKET;
         return false;
     }
 
+    NetCompat::SetNonBlocking(listenSocket_, true);
     running_ = true;
-    listenThread_ = std::thread(&TCPServerTransport::listenLoop, this);
+    loop_.add(listenSocket_, EventLoop::EV_READ, [this](uint32_t) { onAcceptable(); });
 
-    std::cout << "[TCP Server] Listening on port " << port_ << std::endl;
+    std::cout << "[TCP Server] Listening on port " << port_
+              << " (max " << maxClients_ << " clients"
+              << (!encrypted_ ? "" : psk_.empty() ? ", encrypted, unauthenticated" : ", encrypted") << ")" << std::endl;
     return true;
 }
 
-void TCPServerTransport::listenLoop() {
-    while (running_) {
+void TCPServerTransport::onAcceptable() {
+    // 一次就绪可能对应多个待接受的连接
+    for (int i = 0; i < 64 && running_; i++) {
         sockaddr_in caddr;
-        int clen = sizeof(caddr);
+        socklen_t clen = sizeof(caddr);
         SOCKET client = accept(listenSocket_, (sockaddr*)&caddr, &clen);
 
         if (client == INVALID_SOCKET) {
-            if (running_) {
-                std::cerr << "[TCP Server] accept() failed: " << WSAGetLastError() << std::endl;
+            int err = WSAGetLastError();
+            if (!NetCompat::WouldBlock(err)) {
+                std::cerr << "[TCP Server] accept() failed: " << err << std::endl;
             }
-            break;
+            return;
         }
-        SetHandleInformation((HANDLE)client, HANDLE_FLAG_INHERIT, 0);
+        NetCompat::SetNoInherit(client);
 
-        if (hasClient_) {
-            std::cout << "[TCP Server] Reject extra client (already has one)" << std::endl;
+        if (clientCount() >= static_cast<size_t>(maxClients_)) reapStaleClients();
+        if (clientCount() >= static_cast<size_t>(maxClients_)) {
+            std::cout << "[TCP Server] Reject extra client (already has "
+                      << maxClients_ << ")" << std::endl;
             closesocket(client);
             continue;
         }
@@ -205,101 +267,239 @@ void TCPServerTransport::listenLoop() {
 
         int bufSize = 2 * 1024 * 1024;
         setsockopt(client, SOL_SOCKET, SO_RCVBUF, (char*)&bufSize, sizeof(bufSize));
-        setsockopt(client, SOL_SOCKET, SO_SNDBUF, (char*)&bufSize, sizeof(bufSize));
-
-        std::cout << "[TCP Server] Client connected on port " << port_ << std::endl;
+        // 发送缓冲不宜过大：积压应留在应用层队列里，才能丢弃过期帧
+        int sndBufSize = SERVER_SNDBUF;
+        setsockopt(client, SOL_SOCKET, SO_SNDBUF, (char*)&sndBufSize, sizeof(sndBufSize));
 
+        auto conn = std::make_shared<TcpConnection>(loop_, client, MAXMSG);
+        if (encrypted_ && !conn->enableEncryption(SecureSession::Role::Server, psk_)) {
+            std::cerr << "[TCP Server] Failed to set up encryption, rejecting client" << std::endl;
+            continue;
+        }
+        auto clock = std::make_shared<ClockSync>(loop_);
+        auto lastRecvUs = std::make_shared<std::atomic<int64_t>>(ClockSyncing::NowUs());
+        std::shared_ptr<BandwidthEstimator> bwe;
+        ClientId id;
         {
-            std::lock_guard<std::mutex> lock(sendMtx_);
-            clientSocket_ = client;
-            hasClient_ = true;
+            std::lock_guard<std::mutex> lock(clientsMtx_);
+            id = nextClientId_++;
+            bwe = std::make_shared<BandwidthEstimator>(pacingBitrate_ > 0 ? pacingBitrate_ : Config::VIDEO_BITRATE);
+            clients_[id].conn = conn;
+            clients_[id].clock = clock;
+            clients_[id].bwe = bwe;
+            clients_[id].lastRecvUs = lastRecvUs;
+            conn->scheduler().setPacingRate(pacingBitrate_, pacingFps_);
         }
+        conn->scheduler().setOnVideoDropped([this, bwe]() {
+            bwe->onSenderDrop();
+            if (callbacks_.onVideoDropped) callbacks_.onVideoDropped();
+        });
+        conn->scheduler().setOnVideoSent([bwe](size_t bytes) {
+            bwe->onFrameSent(ClockSyncing::NowUs(), bytes);
+        });
+
+        std::cout << "[TCP Server] Client " << id << " connected on port " << port_ << std::endl;
+
+        // 连接持有时钟的回复函数，时钟只弱引用连接，避免循环引用
+        std::weak_ptr<TcpConnection> weakConn = conn;
+        ClockSync::SendFn reply = [weakConn](const BinaryData& m) {
+            auto c = weakConn.lock();
+            ConstBuffer part{ m.data(), m.size() };
+            return c && c->send(&part, 1);
+        };
+
+        conn->start(
+            [this, id, clock, bwe, reply, lastRecvUs](const BufferRef& msg) {
+                lastRecvUs->store(ClockSyncing::NowUs());
+                if (clock->intercept(msg.data(), msg.size(), reply)) return;
+                if (!msg.empty() && msg[0] == static_cast<uint8_t>(Desktop::MsgType::VideoFeedback)) {
+                    bwe->onFeedback(msg.data(), msg.size(), clock->estimate().rttMs);
+                    return;
+                }
+                BinaryData data(msg.data(), msg.data() + msg.size());
+                if (callbacks_.onClientMessage) {
+                    callbacks_.onClientMessage(id, data);
+                } else if (callbacks_.onMessage) {
+                    callbacks_.onMessage(data);
+                }
+            },
+            [this, id]() { onClientClosed(id); });
+        clock->start(reply);
+
+        if (callbacks_.onClientConnected) callbacks_.onClientConnected(id);
+        else if (callbacks_.onConnected) callbacks_.onConnected();
+    }
+}
 
-        if (callbacks_.onConnected) callbacks_.onConnected();
+void TCPServerTransport::onClientClosed(ClientId id) {
+    std::shared_ptr<ClockSync> clock;
+    {
+        std::lock_guard<std::mutex> lock(clientsMtx_);
+        auto it = clients_.find(id);
+        if (it != clients_.end()) {
+            clock = it->second.clock;
+            clients_.erase(it);
+        }
+    }
+    if (clock) clock->stop();
 
-        recvThread_ = std::thread(&TCPServerTransport::recvLoop, this);
-        recvThread_.join();
+    std::cout << "[TCP Server] Client " << id << " disconnected from port " << port_ << std::endl;
 
-        std::cout << "[TCP Server] Client disconnected from port " << port_ << std::endl;
+    if (!running_) return;
+    if (callbacks_.onClientDisconnected) callbacks_.onClientDisconnected(id);
+    else if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+}
 
-        {
-            std::lock_guard<std::mutex> lock(sendMtx_);
-            hasClient_ = false;
-            if (clientSocket_ != INVALID_SOCKET) {
-                shutdown(clientSocket_, SD_BOTH);
-                closesocket(clientSocket_);
-                clientSocket_ = INVALID_SOCKET;
+void TCPServerTransport::reapStaleClients() {
+    int64_t now = ClockSyncing::NowUs();
+    std::vector<std::pair<ClientId, Client>> stale;
+    {
+        std::lock_guard<std::mutex> lock(clientsMtx_);
+        for (auto it = clients_.begin(); it != clients_.end();) {
+            if (now - it->second.lastRecvUs->load() >= LIVENESS_TIMEOUT_MS * 1000LL) {
+                stale.emplace_back(it->first, it->second);
+                it = clients_.erase(it);
+            } else {
+                ++it;
             }
         }
-
-        if (callbacks_.onDisconnected) callbacks_.onDisconnected();
-
-        std::cout << "[TCP Server] Ready for next client on port " << port_ << std::endl;
+    }
+    for (auto& kv : stale) {
+        std::cout << "[TCP Server] Client " << kv.first << " silent for over "
+                  << LIVENESS_TIMEOUT_MS << "ms, dropping half-open connection" << std::endl;
+        kv.second.clock->stop();
+        kv.second.conn->close();
+        // 和对端断开一样通知上层，观看者的会话留给它续连
+        if (callbacks_.onClientDisconnected) callbacks_.onClientDisconnected(kv.first);
+        else if (callbacks_.onDisconnected) callbacks_.onDisconnected();
     }
 }
 
-void TCPServerTransport::recvLoop() {
-    std::vector<uint8_t> buffer;
+std::shared_ptr<TcpConnection> TCPServerTransport::findClient(ClientId id) const {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    auto it = clients_.find(id);
+    return it != clients_.end() ? it->second.conn : nullptr;
+}
 
-    while (running_ && hasClient_) {
-        uint32_t msgSize;
-        if (!NetUtil::RecvAll(clientSocket_, &msgSize, sizeof(msgSize))) {
-            break;
-        }
+bool TCPServerTransport::send(const BinaryData& data) {
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
 
-        if (msgSize == 0 || msgSize > MAXMSG) {
-            std::cerr << "[TCP Server] Invalid message size: " << msgSize
-                    << ", closing connection to avoid stream desync" << std::endl;
-            break;
-        }
+bool TCPServerTransport::sendv(const ConstBuffer* parts, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) total += parts[i].size;
+    if (total == 0 || !hasClient()) return false;
+
+    // 只拷贝一次到池化缓冲，各个客户端队列共享同一份
+    BufferRef msg = BufferPool::shared().acquire(total);
+    size_t off = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (parts[i].size == 0) continue;
+        memcpy(msg.data() + off, parts[i].data, parts[i].size);
+        off += parts[i].size;
+    }
+    return sendBuffer(msg);
+}
 
-        buffer.resize(msgSize);
-        if (!NetUtil::RecvAll(clientSocket_, buffer.data(), msgSize)) {
-            break;
-        }
+bool TCPServerTransport::sendBuffer(const BufferRef& msg) {
+    // 入队后由事件循环在套接字可写时按优先级写出，调用方不会阻塞在网络上
+    bool queued = false;
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    for (auto& kv : clients_) {
+        if (!kv.second.subscribed) continue;
+        if (kv.second.conn->send(msg)) queued = true;
+    }
+    return queued;
+}
 
-        if (callbacks_.onMessage) {
-            callbacks_.onMessage(buffer);
-        }
+bool TCPServerTransport::sendTo(ClientId id, const BinaryData& data) {
+    auto conn = findClient(id);
+    if (!conn) return false;
+    ConstBuffer part{ data.data(), data.size() };
+    return conn->send(&part, 1);
+}
+
+void TCPServerTransport::setSubscribed(ClientId id, bool subscribed) {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    auto it = clients_.find(id);
+    if (it == clients_.end() || it->second.subscribed == subscribed) return;
+    if (subscribed) {
+        // 中途加入时其他人正在收依赖帧，必须从关键帧开始
+        it->second.conn->scheduler().awaitKeyframe();
     }
+    it->second.subscribed = subscribed;
 }
 
-bool TCPServerTransport::send(const BinaryData& data) {
-    if (!hasClient_) return false;
+void TCPServerTransport::setPacingRate(int bitsPerSec, int fps) {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    pacingBitrate_ = bitsPerSec;
+    pacingFps_ = fps;
+    for (auto& kv : clients_) kv.second.conn->scheduler().setPacingRate(bitsPerSec, fps);
+}
 
-    std::lock_guard<std::mutex> lock(sendMtx_);
-    if (clientSocket_ == INVALID_SOCKET) return false;
+int TCPServerTransport::targetBitrate(ClientId id) const {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    auto it = clients_.find(id);
+    return it != clients_.end() ? it->second.bwe->targetBitrate() : 0;
+}
 
-    uint32_t size = static_cast<uint32_t>(data.size());
-    if (!NetUtil::SendAll(clientSocket_, &size, sizeof(size))) return false;
-    return NetUtil::SendAll(clientSocket_, data.data(), static_cast<int>(data.size()));
+bool TCPServerTransport::clockEstimate(ClientId id, ClockEstimate& out) const {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    auto it = clients_.find(id);
+    if (it == clients_.end()) return false;
+    out = it->second.clock->estimate();
+    return out.valid;
+}
+
+void TCPServerTransport::disconnectClient(ClientId id) {
+    Client client;
+    {
+        std::lock_guard<std::mutex> lock(clientsMtx_);
+        auto it = clients_.find(id);
+        if (it == clients_.end()) return;
+        client = it->second;
+        clients_.erase(it);
+    }
+    std::cout << "[TCP Server] Dropping client " << id << " on port " << port_ << std::endl;
+    // close() 返回后不会再有该连接的回调
+    client.clock->stop();
+    client.conn->close();
 }
 
 bool TCPServerTransport::hasClient() const {
-    return hasClient_;
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    return !clients_.empty();
 }
 
-void TCPServerTransport::stop() {
-    running_ = false;
-    hasClient_ = false;
+size_t TCPServerTransport::clientCount() const {
+    std::lock_guard<std::mutex> lock(clientsMtx_);
+    return clients_.size();
+}
 
-    // Close sockets to unblock accept() / recv() immediately
-    if (listenSocket_ != INVALID_SOCKET) {
-        closesocket(listenSocket_);
-        listenSocket_ = INVALID_SOCKET;
-    }
-    if (clientSocket_ != INVALID_SOCKET) {
-        shutdown(clientSocket_, SD_BOTH);
-        closesocket(clientSocket_);
-        clientSocket_ = INVALID_SOCKET;
-    }
+void TCPServerTransport::stop() {
+    if (!running_.exchange(false)) return;
+
+    // 在循环线程里注销并关闭，返回后不会再有任何回调
+    loop_.runSync([this]() {
+        if (listenSocket_ != INVALID_SOCKET) {
+            loop_.remove(listenSocket_);
+            closesocket(listenSocket_);
+            listenSocket_ = INVALID_SOCKET;
+        }
 
-    // Detach threads — they will see running_==false and exit promptly.
-    // The kernel will clean up remaining threads on process exit.
-    if (listenThread_.joinable()) listenThread_.detach();
-    if (recvThread_.joinable()) recvThread_.detach();
+        std::map<ClientId, Client> clients;
+        {
+            std::lock_guard<std::mutex> lock(clientsMtx_);
+            clients.swap(clients_);
+        }
+        for (auto& kv : clients) {
+            kv.second.clock->stop();
+            kv.second.conn->close();
+        }
+    });
 }
 
 void TCPServerTransport::setCallbacks(const TransportCallbacks& callbacks) {
     callbacks_ = callbacks;
-}
\ No newline at end of file
+}
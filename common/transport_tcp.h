@@ -2,66 +2,120 @@
 #define TRANSPORT_TCP_H
 
 #include "transport.h"
-#include <thread>
+#include "event_loop.h"
+#include "tcp_connection.h"
+#include "bandwidth_estimator.h"
 #include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 
 // ==================== TCP客户端传输 ====================
+// 连接建立后挂在事件循环上收发，不再单独占用接收线程
 class TCPClientTransport : public ITransport {
 public:
-    TCPClientTransport();
+    explicit TCPClientTransport(EventLoop& loop = EventLoop::shared());
     ~TCPClientTransport();
 
+    // 默认加密；psk 须与服务端一致，否则第一条记录就校验失败而断开。connect() 之前调用
+    void setEncryption(bool enabled, const std::string& psk = std::string());
     bool connect(const std::string& ip, int port);
     
     bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
     bool isConnected() const override;
     void disconnect() override;
     void setCallbacks(const TransportCallbacks& callbacks) override;
     bool reconnect() override;
+    bool clockEstimate(ClockEstimate& out) const override;
 
 private:
-    void recvLoop();
+    void deliver(const BufferRef& msg);
+    void onClosed();
+    std::shared_ptr<TcpConnection> connection() const;
 
-    SOCKET socket_ = INVALID_SOCKET;
+    EventLoop& loop_;
+    std::shared_ptr<TcpConnection> conn_;
+    mutable std::mutex connMtx_;
     std::atomic<bool> connected_{false};
-    std::thread recvThread_;
     TransportCallbacks callbacks_;
-    std::mutex sendMtx_;
+    std::shared_ptr<ClockSync> clock_;
+    VideoFeedbackRecorder feedback_;    // 只在循环线程里访问（连接建立前重置）
+    bool encrypted_ = true;
+    std::string psk_;
     
     // 保存连接参数用于重连
     std::string savedIp_;
     int savedPort_ = 0;
 
-    const int MAXMSG = 64 * 1024 * 1024;
+    const uint32_t MAXMSG = 64 * 1024 * 1024;
+    const int HANDSHAKE_TIMEOUT_MS = 5000;
 };
 
 // ==================== TCP服务端传输 ====================
+// 监听套接字和所有客户端连接共用一个事件循环线程，每个连接有独立的
+// 发送调度器，慢速观看者只会在自己的队列里丢帧，不会拖慢其他人。
+// 广播的视频帧以同一个池化缓冲的引用分发到各个队列，不按人数拷贝。
+// 所有回调都在事件循环线程里执行。
 class TCPServerTransport : public IServerTransport {
 public:
-    TCPServerTransport(int port);
+    TCPServerTransport(int port, int maxClients = 1, EventLoop& loop = EventLoop::shared());
     ~TCPServerTransport();
 
+    // 默认加密，所有连接共用同一个预共享口令。start() 之前调用
+    void setEncryption(bool enabled, const std::string& psk = std::string());
+
     bool start() override;
     void stop() override;
     bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
+    bool sendBuffer(const BufferRef& msg) override;
     bool hasClient() const override;
     void setCallbacks(const TransportCallbacks& callbacks) override;
 
+    bool sendTo(ClientId id, const BinaryData& data) override;
+    void setSubscribed(ClientId id, bool subscribed) override;
+    size_t clientCount() const override;
+    void disconnectClient(ClientId id) override;
+    void setPacingRate(int bitsPerSec, int fps) override;
+    bool clockEstimate(ClientId id, ClockEstimate& out) const override;
+    int targetBitrate(ClientId id) const override;
+
 private:
-    void listenLoop();
-    void recvLoop();
+    struct Client {
+        std::shared_ptr<TcpConnection> conn;
+        std::shared_ptr<ClockSync> clock;
+        std::shared_ptr<BandwidthEstimator> bwe;
+        // 最近一次收到消息的时刻（微秒），双方每秒互相 Ping，据此发现半开的连接
+        std::shared_ptr<std::atomic<int64_t>> lastRecvUs;
+        bool subscribed = false;
+    };
 
+    void onAcceptable();
+    void onClientClosed(ClientId id);
+    // 满员时先断开 LIVENESS_TIMEOUT_MS 内没有收到任何消息的连接（网络切换后留下的半开连接），
+    // 否则客户端换了网络重连会一直被拒，等不到续连旧会话
+    void reapStaleClients();
+    std::shared_ptr<TcpConnection> findClient(ClientId id) const;
+
+    EventLoop& loop_;
     int port_;
+    int maxClients_;
     SOCKET listenSocket_ = INVALID_SOCKET;
-    SOCKET clientSocket_ = INVALID_SOCKET;
     std::atomic<bool> running_{false};
-    std::atomic<bool> hasClient_{false};
-    std::thread listenThread_;
-    std::thread recvThread_;
     TransportCallbacks callbacks_;
-    std::mutex sendMtx_;
 
-    const int MAXMSG = 100 * 1024 * 1024;
+    std::map<ClientId, Client> clients_;
+    mutable std::mutex clientsMtx_;
+    ClientId nextClientId_ = SINGLE_CLIENT_ID;
+    int pacingBitrate_ = 0;     // 受 clientsMtx_ 保护，新连接沿用
+    int pacingFps_ = Config::FPS;
+    bool encrypted_ = true;
+    std::string psk_;
+
+    static constexpr int LIVENESS_TIMEOUT_MS = 3 * ClockSyncing::PING_INTERVAL_MS;
+    const uint32_t MAXMSG = 100 * 1024 * 1024;
+    const int SERVER_SNDBUF = 512 * 1024;
 };
 
-#endif // TRANSPORT_TCP_H
\ No newline at end of file
+#endif // TRANSPORT_TCP_H
@@ -0,0 +1,248 @@
+#include "transport_udp.h"
+#include <iostream>
+
+namespace {
+    // 片段只拷贝一次到池化缓冲，会话在循环线程里持有引用
+    BufferRef GatherPooled(const ConstBuffer* parts, size_t count) {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) total += parts[i].size;
+        if (total == 0) return BufferRef();
+
+        BufferRef msg = BufferPool::shared().acquire(total);
+        size_t off = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (parts[i].size == 0) continue;
+            memcpy(msg.data() + off, parts[i].data, parts[i].size);
+            off += parts[i].size;
+        }
+        return msg;
+    }
+}
+
+// ==================== UDP客户端 ====================
+UDPClientTransport::UDPClientTransport(EventLoop& loop)
+    : loop_(loop), clock_(std::make_shared<ClockSync>(loop)) {}
+
+UDPClientTransport::~UDPClientTransport() {
+    disconnect();
+}
+
+bool UDPClientTransport::connect(const std::string& ip, int port) {
+    savedIp_ = ip;
+    savedPort_ = port;
+
+    std::cout << "[UDP Client] Connecting to " << ip << ":" << port << "..." << std::endl;
+
+    auto link = std::make_unique<UdpSocketLink>(loop_);
+    if (!link->connect(ip, port)) return false;
+    return connect(std::move(link));
+}
+
+bool UDPClientTransport::connect(std::unique_ptr<IDatagramLink> link) {
+    auto session = std::make_shared<UdpSession>(std::move(link), UdpSession::Role::Client);
+
+    UdpSession::Callbacks cb;
+    cb.onMessage = [this](const BufferRef& msg) { deliver(msg); };
+    cb.onClose = [this]() { onClosed(); };
+    if (!session->start(cb)) {
+        std::cerr << "[UDP Client] Failed to open datagram link" << std::endl;
+        return false;
+    }
+
+    // 握手阶段阻塞等待，与 TCP 的阻塞 connect 一致
+    if (!session->waitOpen(HANDSHAKE_TIMEOUT)) {
+        std::cerr << "[UDP Client] Handshake timed out (server not running or UDP blocked?)" << std::endl;
+        session->close();
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sessionMtx_);
+        session_ = session;
+    }
+    connected_ = true;
+
+    std::cout << "[UDP Client] Connected!" << std::endl;
+    clock_->start([this](const BinaryData& m) { return send(m); });
+
+    if (callbacks_.onConnected) callbacks_.onConnected();
+    return true;
+}
+
+bool UDPClientTransport::reconnect() {
+    if (savedIp_.empty() || savedPort_ == 0) {
+        std::cerr << "[UDP Client] No saved connection parameters for reconnect" << std::endl;
+        return false;
+    }
+
+    std::cout << "[UDP Client] Attempting reconnect to " << savedIp_ << ":" << savedPort_ << std::endl;
+
+    disconnect();
+    return connect(savedIp_, savedPort_);
+}
+
+std::shared_ptr<UdpSession> UDPClientTransport::session() const {
+    std::lock_guard<std::mutex> lock(sessionMtx_);
+    return session_;
+}
+
+void UDPClientTransport::deliver(const BufferRef& msg) {
+    if (clock_->intercept(msg.data(), msg.size(), [this](const BinaryData& m) { return send(m); })) return;
+
+    if (callbacks_.onBuffer) {
+        callbacks_.onBuffer(msg);
+    } else if (callbacks_.onMessage) {
+        callbacks_.onMessage(BinaryData(msg.data(), msg.data() + msg.size()));
+    }
+}
+
+void UDPClientTransport::onClosed() {
+    if (connected_.exchange(false) && callbacks_.onDisconnected) {
+        callbacks_.onDisconnected();
+    }
+}
+
+bool UDPClientTransport::send(const BinaryData& data) {
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
+
+bool UDPClientTransport::sendv(const ConstBuffer* parts, size_t count) {
+    if (!connected_) return false;
+    auto s = session();
+    if (!s) return false;
+    return s->send(GatherPooled(parts, count));
+}
+
+bool UDPClientTransport::isConnected() const {
+    return connected_;
+}
+
+void UDPClientTransport::disconnect() {
+    clock_->stop();
+    std::shared_ptr<UdpSession> s;
+    {
+        std::lock_guard<std::mutex> lock(sessionMtx_);
+        s.swap(session_);
+    }
+    // close() 返回后不会再有该会话的回调
+    if (s) s->close();
+    onClosed();
+}
+
+void UDPClientTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    callbacks_ = callbacks;
+}
+
+bool UDPClientTransport::clockEstimate(ClockEstimate& out) const {
+    out = clock_->estimate();
+    return out.valid;
+}
+
+// ==================== UDP服务端 ====================
+UDPServerTransport::UDPServerTransport(int port, EventLoop& loop)
+    : loop_(loop), port_(port), clock_(std::make_shared<ClockSync>(loop)) {}
+
+UDPServerTransport::UDPServerTransport(std::unique_ptr<IDatagramLink> link)
+    : loop_(link->loop()), port_(0), link_(std::move(link)),
+      clock_(std::make_shared<ClockSync>(loop_)) {}
+
+UDPServerTransport::~UDPServerTransport() {
+    stop();
+}
+
+bool UDPServerTransport::start() {
+    if (!link_) {
+        auto link = std::make_unique<UdpSocketLink>(loop_);
+        if (!link->bind(port_)) return false;
+        link_ = std::move(link);
+    }
+
+    session_ = std::make_shared<UdpSession>(std::move(link_), UdpSession::Role::Server);
+    session_->setPacingRate(pacingBitrate_, pacingFps_);
+
+    UdpSession::Callbacks cb;
+    cb.onOpen = [this]() { onOpen(); };
+    cb.onClose = [this]() { onClosed(); };
+    cb.onMessage = [this](const BufferRef& msg) { onMessage(msg); };
+    cb.onVideoLost = [this]() {
+        if (callbacks_.onVideoDropped) callbacks_.onVideoDropped();
+    };
+    if (!session_->start(cb)) {
+        std::cerr << "[UDP Server] Failed to open datagram link" << std::endl;
+        session_.reset();
+        return false;
+    }
+    running_ = true;
+
+    std::cout << "[UDP Server] Listening on port " << port_ << std::endl;
+    return true;
+}
+
+void UDPServerTransport::onOpen() {
+    std::cout << "[UDP Server] Client connected on port " << port_ << std::endl;
+    clock_->start([this](const BinaryData& m) { return send(m); });
+    if (callbacks_.onClientConnected) callbacks_.onClientConnected(SINGLE_CLIENT_ID);
+    else if (callbacks_.onConnected) callbacks_.onConnected();
+}
+
+void UDPServerTransport::onClosed() {
+    std::cout << "[UDP Server] Client disconnected from port " << port_ << std::endl;
+    clock_->stop();
+    if (!running_) return;
+    if (callbacks_.onClientDisconnected) callbacks_.onClientDisconnected(SINGLE_CLIENT_ID);
+    else if (callbacks_.onDisconnected) callbacks_.onDisconnected();
+}
+
+void UDPServerTransport::onMessage(const BufferRef& msg) {
+    if (clock_->intercept(msg.data(), msg.size(), [this](const BinaryData& m) { return send(m); })) return;
+
+    BinaryData data(msg.data(), msg.data() + msg.size());
+    if (callbacks_.onClientMessage) {
+        callbacks_.onClientMessage(SINGLE_CLIENT_ID, data);
+    } else if (callbacks_.onMessage) {
+        callbacks_.onMessage(data);
+    }
+}
+
+bool UDPServerTransport::send(const BinaryData& data) {
+    ConstBuffer part{ data.data(), data.size() };
+    return sendv(&part, 1);
+}
+
+bool UDPServerTransport::sendv(const ConstBuffer* parts, size_t count) {
+    if (!hasClient()) return false;
+    return sendBuffer(GatherPooled(parts, count));
+}
+
+bool UDPServerTransport::sendBuffer(const BufferRef& msg) {
+    // 会话只持有引用，切片和校验在事件循环线程里完成
+    return session_ && session_->send(msg);
+}
+
+bool UDPServerTransport::hasClient() const {
+    return running_ && session_ && session_->isOpen();
+}
+
+void UDPServerTransport::stop() {
+    if (!running_.exchange(false)) return;
+    clock_->stop();
+    // close() 返回后不会再有任何回调
+    session_->close();
+}
+
+void UDPServerTransport::setPacingRate(int bitsPerSec, int fps) {
+    pacingBitrate_ = bitsPerSec;
+    pacingFps_ = fps;
+    if (session_) session_->setPacingRate(bitsPerSec, fps);
+}
+
+bool UDPServerTransport::clockEstimate(ClientId id, ClockEstimate& out) const {
+    if (id != SINGLE_CLIENT_ID || !hasClient()) return false;
+    out = clock_->estimate();
+    return out.valid;
+}
+
+void UDPServerTransport::setCallbacks(const TransportCallbacks& callbacks) {
+    callbacks_ = callbacks;
+}
@@ -0,0 +1,85 @@
+#ifndef TRANSPORT_UDP_H
+#define TRANSPORT_UDP_H
+
+#include "transport.h"
+#include "event_loop.h"
+#include "datagram_link.h"
+#include "udp_session.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+// ==================== UDP客户端传输 ====================
+// 视频帧走 FEC + NACK 的不可靠子流，输入和控制消息走可靠子流，
+// 弱网下丢一个包只影响所在的那一帧。回调在事件循环线程里执行。
+class UDPClientTransport : public ITransport {
+public:
+    explicit UDPClientTransport(EventLoop& loop = EventLoop::shared());
+    ~UDPClientTransport();
+
+    bool connect(const std::string& ip, int port);
+    // 使用现成的链路（例如 LossyLoopback 的一端），不支持 reconnect
+    bool connect(std::unique_ptr<IDatagramLink> link);
+
+    bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
+    bool isConnected() const override;
+    void disconnect() override;
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+    bool reconnect() override;
+    bool clockEstimate(ClockEstimate& out) const override;
+
+private:
+    void deliver(const BufferRef& msg);
+    void onClosed();
+    std::shared_ptr<UdpSession> session() const;
+
+    EventLoop& loop_;
+    std::shared_ptr<UdpSession> session_;
+    mutable std::mutex sessionMtx_;
+    std::atomic<bool> connected_{false};
+    TransportCallbacks callbacks_;
+    std::shared_ptr<ClockSync> clock_;
+
+    std::string savedIp_;
+    int savedPort_ = 0;
+
+    const std::chrono::milliseconds HANDSHAKE_TIMEOUT{3000};
+};
+
+// ==================== UDP服务端传输 ====================
+// 单个 UDP 端口上同一时间只服务一个客户端：握手后锁定对端地址，
+// 对端断开或超时后再接受下一个。不支持多观看者。
+class UDPServerTransport : public IServerTransport {
+public:
+    explicit UDPServerTransport(int port, EventLoop& loop = EventLoop::shared());
+    explicit UDPServerTransport(std::unique_ptr<IDatagramLink> link);
+    ~UDPServerTransport();
+
+    bool start() override;
+    void stop() override;
+    bool send(const BinaryData& data) override;
+    bool sendv(const ConstBuffer* parts, size_t count) override;
+    bool sendBuffer(const BufferRef& msg) override;
+    bool hasClient() const override;
+    void setCallbacks(const TransportCallbacks& callbacks) override;
+    void setPacingRate(int bitsPerSec, int fps) override;
+    bool clockEstimate(ClientId id, ClockEstimate& out) const override;
+
+private:
+    void onOpen();
+    void onClosed();
+    void onMessage(const BufferRef& msg);
+
+    EventLoop& loop_;
+    int port_;
+    std::unique_ptr<IDatagramLink> link_;   // start() 之前持有，之后交给会话
+    std::shared_ptr<UdpSession> session_;
+    std::shared_ptr<ClockSync> clock_;
+    std::atomic<bool> running_{false};
+    TransportCallbacks callbacks_;
+    int pacingBitrate_ = 0;     // start() 之前设置的值在会话创建时应用
+    int pacingFps_ = Config::FPS;
+};
+
+#endif // TRANSPORT_UDP_H
@@ -0,0 +1,672 @@
+#include "udp_session.h"
+#include <algorithm>
+#include <iostream>
+#include <random>
+
+using namespace UdpProto;
+
+namespace {
+    template <typename T>
+    void Put(uint8_t* p, T v) { memcpy(p, &v, sizeof(v)); }
+
+    template <typename T>
+    T Get(const uint8_t* p) {
+        T v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    // 32 位序号回绕比较
+    bool SeqBefore(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) < 0;
+    }
+
+    int64_t ElapsedMs(EventLoop::Clock::time_point from, EventLoop::Clock::time_point to) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+    }
+
+    uint64_t NowMs() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            EventLoop::Clock::now().time_since_epoch()).count());
+    }
+
+    void XorInto(uint8_t* dst, const uint8_t* src, size_t len) {
+        for (size_t i = 0; i < len; i++) dst[i] ^= src[i];
+    }
+}
+
+UdpSession::UdpSession(std::unique_ptr<IDatagramLink> link, Role role)
+    : link_(std::move(link)), loop_(link_->loop()), role_(role) {
+    if (role_ == Role::Client) {
+        std::random_device rd;
+        nonce_ = rd();
+    }
+}
+
+UdpSession::~UdpSession() {
+    close();
+}
+
+bool UdpSession::start(Callbacks callbacks) {
+    if (started_.exchange(true)) return false;
+    callbacks_ = std::move(callbacks);
+
+    std::weak_ptr<UdpSession> weak = shared_from_this();
+    bool ok = link_->open([weak](const uint8_t* data, size_t size) {
+        if (auto self = weak.lock()) self->onPacket(data, size);
+    });
+    if (!ok) {
+        closed_ = true;
+        return false;
+    }
+    loop_.post([weak]() {
+        if (auto self = weak.lock()) self->onTick();
+    });
+    return true;
+}
+
+void UdpSession::close() {
+    if (!started_ || closed_) return;
+    loop_.runSync([this]() {
+        if (closed_.exchange(true)) return;
+        if (open_) {
+            // 对端收不到也会在超时后自行断开，多发一次提高送达概率
+            sendControl(PacketType::Bye, nonce_);
+            sendControl(PacketType::Bye, nonce_);
+        }
+        open_ = false;
+        link_->close();
+        resetStreams();
+    });
+    openCv_.notify_all();
+}
+
+bool UdpSession::waitOpen(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(openMtx_);
+    return openCv_.wait_for(lock, timeout, [this]() { return open_.load() || closed_.load(); })
+           && open_;
+}
+
+bool UdpSession::send(const BufferRef& msg) {
+    if (!open_ || msg.empty()) return false;
+    std::weak_ptr<UdpSession> weak = shared_from_this();
+    loop_.post([weak, msg]() {
+        auto self = weak.lock();
+        if (!self || !self->open_) return;
+        if (msg[0] == static_cast<uint8_t>(Desktop::MsgType::VideoFrame)) {
+            self->sendVideo(msg);
+        } else {
+            self->sendReliable(msg);
+        }
+    });
+    return true;
+}
+
+// ==================== 连接管理 ====================
+void UdpSession::scheduleTick() {
+    std::weak_ptr<UdpSession> weak = shared_from_this();
+    loop_.runAfter(std::chrono::milliseconds(TICK_MS), [weak]() {
+        if (auto self = weak.lock()) self->onTick();
+    });
+}
+
+void UdpSession::onTick() {
+    if (closed_) return;
+    auto now = Clock::now();
+
+    if (!open_) {
+        if (role_ == Role::Client && ElapsedMs(lastHello_, now) >= HELLO_INTERVAL_MS) {
+            sendControl(PacketType::Hello, nonce_);
+            lastHello_ = now;
+        }
+        scheduleTick();
+        return;
+    }
+
+    if (ElapsedMs(lastRecv_, now) > PEER_TIMEOUT_MS) {
+        std::cout << "[UDP] Peer timed out" << std::endl;
+        peerLeft();
+        scheduleTick();
+        return;
+    }
+    if (ElapsedMs(lastPing_, now) >= KEEPALIVE_MS) sendPing(now);
+
+    retransmitReliable(now);
+    pumpReliable(now);
+
+    sendNacks(now);
+    deliverFrames(now);
+    if (awaitingKeyframe_) reportLoss(now);
+    purgeHistory(now);
+
+    scheduleTick();
+}
+
+void UdpSession::sendPacket(const uint8_t* data, size_t size) {
+    link_->send(data, size);
+}
+
+void UdpSession::sendControl(PacketType type, uint32_t value) {
+    uint8_t pkt[5];
+    pkt[0] = static_cast<uint8_t>(type);
+    Put<uint32_t>(pkt + 1, value);
+    sendPacket(pkt, sizeof(pkt));
+}
+
+void UdpSession::sendPing(Clock::time_point now) {
+    uint8_t pkt[9];
+    pkt[0] = static_cast<uint8_t>(PacketType::Ping);
+    Put<uint64_t>(pkt + 1, NowMs());
+    sendPacket(pkt, sizeof(pkt));
+    lastPing_ = now;
+}
+
+void UdpSession::openWith(uint32_t nonce) {
+    nonce_ = nonce;
+    resetStreams();
+    lastRecv_ = Clock::now();
+    lastPing_ = Clock::time_point();    // 下一次定时处理立即测一次 RTT
+    rttMeasured_ = false;
+    {
+        std::lock_guard<std::mutex> lock(openMtx_);
+        open_ = true;
+    }
+    openCv_.notify_all();
+    if (callbacks_.onOpen) callbacks_.onOpen();
+}
+
+void UdpSession::peerLeft() {
+    if (!open_) return;
+    open_ = false;
+    resetStreams();
+    // 服务端回到等待状态，接受下一个客户端的握手
+    if (role_ == Role::Server) link_->releasePeer();
+    if (callbacks_.onClose) callbacks_.onClose();
+}
+
+void UdpSession::resetStreams() {
+    sendSeq_ = 0;
+    unacked_.clear();
+    backlog_.clear();
+    recvSeq_ = 0;
+    outOfOrder_.clear();
+    assembling_.clear();
+
+    nextFrameId_ = 0;
+    history_.clear();
+    paced_.clear();
+
+    frames_.clear();
+    haveExpect_ = false;
+    awaitingKeyframe_ = false;
+}
+
+void UdpSession::onPacket(const uint8_t* data, size_t size) {
+    if (closed_ || size < 1) return;
+    auto type = static_cast<PacketType>(data[0]);
+
+    if (!open_) {
+        if (size < 5) return;
+        uint32_t nonce = Get<uint32_t>(data + 1);
+        if (role_ == Role::Server && type == PacketType::Hello) {
+            link_->lockPeer();
+            openWith(nonce);
+            sendControl(PacketType::HelloAck, nonce_);
+            std::cout << "[UDP] Client connected" << std::endl;
+        } else if (role_ == Role::Client && type == PacketType::HelloAck && nonce == nonce_) {
+            openWith(nonce);
+        }
+        return;
+    }
+
+    lastRecv_ = Clock::now();
+
+    switch (type) {
+    case PacketType::Hello:
+        if (size < 5 || role_ != Role::Server) break;
+        if (Get<uint32_t>(data + 1) == nonce_) {
+            // 确认包丢了，客户端还在重发
+            sendControl(PacketType::HelloAck, nonce_);
+        } else {
+            // 同一地址上的新会话：旧会话作废
+            uint32_t nonce = Get<uint32_t>(data + 1);
+            peerLeft();
+            link_->lockPeer();
+            openWith(nonce);
+            sendControl(PacketType::HelloAck, nonce_);
+        }
+        break;
+    case PacketType::Bye:
+        if (size >= 5 && Get<uint32_t>(data + 1) == nonce_) {
+            std::cout << "[UDP] Peer closed the session" << std::endl;
+            peerLeft();
+        }
+        break;
+    case PacketType::Ping:
+        if (size >= 9) {
+            uint8_t pkt[9];
+            memcpy(pkt, data, 9);
+            pkt[0] = static_cast<uint8_t>(PacketType::Pong);
+            sendPacket(pkt, sizeof(pkt));
+        }
+        break;
+    case PacketType::Pong:
+        if (size >= 9) {
+            int64_t sample = static_cast<int64_t>(NowMs() - Get<uint64_t>(data + 1));
+            if (sample >= 0 && sample < 10000) {
+                srttMs_ = rttMeasured_ ? static_cast<int>((srttMs_ * 7 + sample) / 8)
+                                       : static_cast<int>(sample);
+                rttMeasured_ = true;
+            }
+        }
+        break;
+    case PacketType::Video:
+        onVideo(data, size);
+        break;
+    case PacketType::Nack:
+        onNack(data, size);
+        break;
+    case PacketType::Reliable:
+        onReliable(data, size);
+        break;
+    case PacketType::Ack:
+        if (size >= 5) onAck(Get<uint32_t>(data + 1));
+        break;
+    case PacketType::KeyframeLoss:
+        if (role_ == Role::Server && callbacks_.onVideoLost) callbacks_.onVideoLost();
+        break;
+    default:
+        break;
+    }
+}
+
+int UdpSession::rtoMs() const {
+    return std::min(1000, std::max(50, srttMs_ * 2));
+}
+
+// ==================== 可靠子流 ====================
+void UdpSession::sendReliable(const BufferRef& msg) {
+    size_t off = 0;
+    const size_t total = msg.size();
+    while (off < total) {
+        size_t len = std::min(RELIABLE_PAYLOAD, total - off);
+        uint8_t flags = 0;
+        if (off == 0) flags |= FRAG_FIRST;
+        if (off + len == total) flags |= FRAG_LAST;
+
+        BufferRef pkt = BufferPool::shared().acquire(RELIABLE_HEADER_SIZE + len);
+        pkt.data()[0] = static_cast<uint8_t>(PacketType::Reliable);
+        Put<uint32_t>(pkt.data() + 1, sendSeq_++);
+        pkt.data()[5] = flags;
+        memcpy(pkt.data() + RELIABLE_HEADER_SIZE, msg.data() + off, len);
+        backlog_.push_back(std::move(pkt));
+        off += len;
+    }
+    pumpReliable(Clock::now());
+}
+
+void UdpSession::pumpReliable(Clock::time_point now) {
+    while (!backlog_.empty() && unacked_.size() < RELIABLE_WINDOW) {
+        BufferRef pkt = std::move(backlog_.front());
+        backlog_.pop_front();
+        sendPacket(pkt.data(), pkt.size());
+        unacked_.push_back({ Get<uint32_t>(pkt.data() + 1), std::move(pkt), now });
+    }
+}
+
+void UdpSession::retransmitReliable(Clock::time_point now) {
+    const int rto = rtoMs();
+    for (auto& out : unacked_) {
+        if (ElapsedMs(out.sentAt, now) < rto) continue;
+        sendPacket(out.packet.data(), out.packet.size());
+        out.sentAt = now;
+    }
+}
+
+void UdpSession::onAck(uint32_t next) {
+    while (!unacked_.empty() && SeqBefore(unacked_.front().seq, next)) {
+        unacked_.pop_front();
+    }
+    pumpReliable(Clock::now());
+}
+
+void UdpSession::onReliable(const uint8_t* data, size_t size) {
+    if (size < RELIABLE_HEADER_SIZE) return;
+    uint32_t seq = Get<uint32_t>(data + 1);
+
+    if (seq == recvSeq_) {
+        processFragment(data, size);
+        recvSeq_++;
+        // 补上之前乱序到达的包
+        for (auto it = outOfOrder_.find(recvSeq_); it != outOfOrder_.end();
+             it = outOfOrder_.find(recvSeq_)) {
+            BufferRef pkt = std::move(it->second);
+            outOfOrder_.erase(it);
+            processFragment(pkt.data(), pkt.size());
+            recvSeq_++;
+        }
+    } else if (SeqBefore(recvSeq_, seq) && seq - recvSeq_ < RELIABLE_WINDOW * 2) {
+        if (outOfOrder_.find(seq) == outOfOrder_.end()) {
+            outOfOrder_[seq] = BufferPool::shared().copyOf(data, size);
+        }
+    }
+    // 重复包也要确认：上一次的确认可能丢了
+    sendControl(PacketType::Ack, recvSeq_);
+}
+
+void UdpSession::processFragment(const uint8_t* data, size_t size) {
+    uint8_t flags = data[5];
+    if (flags & FRAG_FIRST) assembling_.clear();
+    assembling_.insert(assembling_.end(), data + RELIABLE_HEADER_SIZE, data + size);
+    if (!(flags & FRAG_LAST) || assembling_.empty()) return;
+
+    BufferRef msg = BufferPool::shared().copyOf(assembling_.data(), assembling_.size());
+    assembling_.clear();
+    if (callbacks_.onMessage) callbacks_.onMessage(msg);
+}
+
+// ==================== 视频子流：发送端 ====================
+void UdpSession::sendVideo(const BufferRef& msg) {
+    const size_t size = msg.size();
+    size_t k = (size + SHARD_SIZE - 1) / SHARD_SIZE;
+    size_t m = std::max<size_t>(1, (k * FEC_PERCENT + 99) / 100);
+    if (k + m > MAX_VIDEO_SHARDS) {
+        std::cerr << "[UDP] Video frame too large: " << size << " bytes" << std::endl;
+        return;
+    }
+
+    SentFrame f{ nextFrameId_++, msg, static_cast<uint16_t>(k), static_cast<uint16_t>(m), Clock::now() };
+
+    // 校验包：未满一片的部分按补零参与异或
+    BufferRef parity = BufferPool::shared().acquire(m * SHARD_SIZE);
+    memset(parity.data(), 0, parity.size());
+    for (size_t i = 0; i < k; i++) {
+        size_t off = i * SHARD_SIZE;
+        XorInto(parity.data() + (i % m) * SHARD_SIZE, msg.data() + off, std::min(SHARD_SIZE, size - off));
+    }
+
+    history_.push_back(f);
+    PacedFrame pf;
+    pf.frame = std::move(f);
+    pf.parity = std::move(parity);
+    paced_.push_back(std::move(pf));
+    drainPaced();
+}
+
+void UdpSession::drainPaced() {
+    auto now = Clock::now();
+    while (!paced_.empty()) {
+        PacedFrame& pf = paced_.front();
+        const SentFrame& f = pf.frame;
+        const size_t total = static_cast<size_t>(f.k) + f.m;
+        if (!pf.started) {
+            pacer_.beginFrame(f.msg.size() + f.m * SHARD_SIZE + total * VIDEO_HEADER_SIZE, now);
+            pf.started = true;
+        }
+
+        size_t len = VIDEO_HEADER_SIZE;
+        if (pf.next < f.k) len += std::min(SHARD_SIZE, f.msg.size() - static_cast<size_t>(pf.next) * SHARD_SIZE);
+        else len += SHARD_SIZE;
+
+        auto wait = pacer_.delayFor(len, now);
+        if (wait.count() > 0) {
+            if (paceTimer_) return;
+            paceTimer_ = true;
+            std::weak_ptr<UdpSession> weak = shared_from_this();
+            auto delay = std::chrono::milliseconds(std::max<int64_t>(1, (wait.count() + 999) / 1000));
+            loop_.runAfter(delay, [weak]() {
+                if (auto self = weak.lock()) {
+                    self->paceTimer_ = false;
+                    if (self->open_) self->drainPaced();
+                }
+            });
+            return;
+        }
+        pacer_.consume(len, now);
+
+        const uint8_t* parity = nullptr;
+        if (pf.next >= f.k) parity = pf.parity.data() + static_cast<size_t>(pf.next - f.k) * SHARD_SIZE;
+        sendVideoShard(f, pf.next, parity);
+        if (++pf.next == total) {
+            pacer_.endFrame(now);
+            paced_.pop_front();
+        }
+    }
+}
+
+void UdpSession::sendVideoShard(const SentFrame& f, uint16_t index, const uint8_t* parity) {
+    const uint8_t* payload;
+    size_t len;
+    if (index < f.k) {
+        size_t off = static_cast<size_t>(index) * SHARD_SIZE;
+        payload = f.msg.data() + off;
+        len = std::min(SHARD_SIZE, f.msg.size() - off);
+    } else {
+        payload = parity;
+        len = SHARD_SIZE;
+    }
+
+    scratch_[0] = static_cast<uint8_t>(PacketType::Video);
+    Put<uint32_t>(scratch_ + 1, f.id);
+    Put<uint16_t>(scratch_ + 5, index);
+    Put<uint16_t>(scratch_ + 7, f.k);
+    Put<uint16_t>(scratch_ + 9, f.m);
+    Put<uint32_t>(scratch_ + 11, static_cast<uint32_t>(f.msg.size()));
+    memcpy(scratch_ + VIDEO_HEADER_SIZE, payload, len);
+    sendPacket(scratch_, VIDEO_HEADER_SIZE + len);
+}
+
+void UdpSession::onNack(const uint8_t* data, size_t size) {
+    if (size < 7) return;
+    uint32_t frameId = Get<uint32_t>(data + 1);
+    uint16_t count = Get<uint16_t>(data + 5);
+    if (size < 7 + static_cast<size_t>(count) * 2) return;
+
+    auto it = std::find_if(history_.begin(), history_.end(),
+                           [frameId](const SentFrame& f) { return f.id == frameId; });
+    // 已过期的帧不再重传，接收方会放弃它并请求关键帧
+    if (it == history_.end() || ElapsedMs(it->sentAt, Clock::now()) > FRAME_DEADLINE_MS) return;
+
+    // 还在节拍队列里没发出的分片不算丢失
+    uint16_t unsentFrom = it->k;
+    for (auto& pf : paced_) {
+        if (pf.frame.id == frameId) unsentFrom = std::min(unsentFrom, pf.next);
+    }
+
+    // 重传已经在和期限赛跑，不排队等节拍，但占用令牌让后续分片相应让路
+    auto now = Clock::now();
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t index = Get<uint16_t>(data + 7 + i * 2);
+        if (index >= unsentFrom) continue;
+        sendVideoShard(*it, index, nullptr);
+        pacer_.consume(VIDEO_HEADER_SIZE + SHARD_SIZE, now);
+    }
+}
+
+void UdpSession::purgeHistory(Clock::time_point now) {
+    while (!history_.empty() && ElapsedMs(history_.front().sentAt, now) > FRAME_DEADLINE_MS) {
+        history_.pop_front();
+    }
+}
+
+// ==================== 视频子流：接收端 ====================
+size_t UdpSession::shardLen(const FrameAsm& f, uint16_t index) const {
+    if (index >= f.k) return SHARD_SIZE;
+    size_t off = static_cast<size_t>(index) * SHARD_SIZE;
+    return std::min(SHARD_SIZE, static_cast<size_t>(f.size) - off);
+}
+
+void UdpSession::onVideo(const uint8_t* data, size_t size) {
+    if (size < VIDEO_HEADER_SIZE) return;
+    uint32_t frameId = Get<uint32_t>(data + 1);
+    uint16_t index = Get<uint16_t>(data + 5);
+    uint16_t k = Get<uint16_t>(data + 7);
+    uint16_t m = Get<uint16_t>(data + 9);
+    uint32_t msgSize = Get<uint32_t>(data + 11);
+
+    if (k == 0 || m == 0 || index >= k + m || msgSize == 0 ||
+        msgSize > static_cast<size_t>(k) * SHARD_SIZE ||
+        msgSize <= static_cast<size_t>(k - 1) * SHARD_SIZE) {
+        return;
+    }
+
+    if (!haveExpect_) {
+        expectFrame_ = frameId;
+        haveExpect_ = true;
+    }
+    if (SeqBefore(frameId, expectFrame_)) return;    // 已交付或已放弃
+
+    auto now = Clock::now();
+    auto it = frames_.find(frameId);
+    if (it == frames_.end()) {
+        if (frames_.size() >= MAX_PENDING_FRAMES) return;
+        FrameAsm f;
+        f.k = k;
+        f.m = m;
+        f.size = msgSize;
+        f.data = BufferPool::shared().acquire(msgSize);
+        f.parity = BufferPool::shared().acquire(static_cast<size_t>(m) * SHARD_SIZE);
+        f.have.assign(static_cast<size_t>(k) + m, 0);
+        f.firstSeen = now;
+        f.lastNack = now;
+        it = frames_.emplace(frameId, std::move(f)).first;
+    }
+
+    FrameAsm& f = it->second;
+    if (f.k != k || f.m != m || f.size != msgSize) return;
+    f.lastPacket = now;
+    if (f.complete || f.have[index]) return;
+
+    size_t len = shardLen(f, index);
+    if (size - VIDEO_HEADER_SIZE != len) return;
+
+    if (index < k) {
+        memcpy(f.data.data() + static_cast<size_t>(index) * SHARD_SIZE, data + VIDEO_HEADER_SIZE, len);
+        f.dataHave++;
+    } else {
+        memcpy(f.parity.data() + static_cast<size_t>(index - k) * SHARD_SIZE, data + VIDEO_HEADER_SIZE, len);
+    }
+    f.have[index] = 1;
+
+    if (f.dataHave < k) tryRecover(f);
+    if (f.dataHave == k) {
+        f.complete = true;
+        f.parity.reset();
+        deliverFrames(now);
+    }
+}
+
+void UdpSession::tryRecover(FrameAsm& f) {
+    uint8_t tmp[SHARD_SIZE];
+    for (uint16_t g = 0; g < f.m; g++) {
+        if (!f.have[f.k + g]) continue;
+
+        int missing = 0;
+        uint16_t lost = 0;
+        for (uint32_t i = g; i < f.k; i += f.m) {
+            if (!f.have[i]) {
+                missing++;
+                lost = static_cast<uint16_t>(i);
+            }
+        }
+        if (missing != 1) continue;
+
+        memcpy(tmp, f.parity.data() + static_cast<size_t>(g) * SHARD_SIZE, SHARD_SIZE);
+        for (uint32_t i = g; i < f.k; i += f.m) {
+            if (i == lost) continue;
+            XorInto(tmp, f.data.data() + i * SHARD_SIZE, shardLen(f, static_cast<uint16_t>(i)));
+        }
+        memcpy(f.data.data() + static_cast<size_t>(lost) * SHARD_SIZE, tmp, shardLen(f, lost));
+        f.have[lost] = 1;
+        f.dataHave++;
+    }
+}
+
+void UdpSession::sendNacks(Clock::time_point now) {
+    // 重传大约一个 RTT 后到达，留一点余量再重发 NACK
+    const int interval = std::max(20, srttMs_ + srttMs_ / 4);
+    // 帧号回绕后 map 的顺序不再是时间顺序，按序号回绕比较找最新的帧
+    uint32_t newest = frames_.empty() ? 0 : frames_.begin()->first;
+    for (auto& kv : frames_) {
+        if (SeqBefore(newest, kv.first)) newest = kv.first;
+    }
+
+    for (auto& kv : frames_) {
+        FrameAsm& f = kv.second;
+        if (f.complete) continue;
+        // 重传到达前帧就会过期的话不值得再请求
+        if (ElapsedMs(f.firstSeen, now) + srttMs_ > FRAME_DEADLINE_MS) continue;
+        // 校验包排在数据包后面：等这一帧的包停止到达（或下一帧已开始）再判断丢失
+        if (kv.first == newest && ElapsedMs(f.lastPacket, now) < NACK_IDLE_MS) continue;
+        if (f.lastNack != f.firstSeen && ElapsedMs(f.lastNack, now) < interval) continue;
+
+        uint8_t* p = scratch_;
+        const uint16_t maxCount = static_cast<uint16_t>((MAX_PACKET - 7) / 2);
+        uint16_t count = 0;
+        auto flush = [&]() {
+            if (count == 0) return;
+            p[0] = static_cast<uint8_t>(PacketType::Nack);
+            Put<uint32_t>(p + 1, kv.first);
+            Put<uint16_t>(p + 5, count);
+            sendPacket(p, 7 + static_cast<size_t>(count) * 2);
+            count = 0;
+        };
+        for (uint16_t i = 0; i < f.k; i++) {
+            if (f.have[i]) continue;
+            Put<uint16_t>(p + 7 + count * 2, i);
+            if (++count == maxCount) flush();
+        }
+        flush();
+        f.lastNack = now;
+    }
+}
+
+void UdpSession::deliverFrames(Clock::time_point now) {
+    while (haveExpect_ && !frames_.empty()) {
+        auto it = frames_.find(expectFrame_);
+        if (it == frames_.end()) {
+            // 整帧一个包都没到：等一小段乱序时间后跳到它之后最早的一帧。
+            // 缓存里的帧都不早于 expectFrame_，按与它的距离比较，帧号回绕时也成立
+            auto first = frames_.begin();
+            for (auto f = frames_.begin(); f != frames_.end(); ++f) {
+                if (f->first - expectFrame_ < first->first - expectFrame_) first = f;
+            }
+            if (ElapsedMs(first->second.firstSeen, now) < REORDER_WAIT_MS) return;
+            expectFrame_ = first->first;
+            reportLoss(now);
+            continue;
+        }
+        if (it->second.complete) {
+            BufferRef msg = std::move(it->second.data);
+            frames_.erase(it);
+            expectFrame_++;
+            deliverVideo(msg);
+            continue;
+        }
+        if (ElapsedMs(it->second.firstSeen, now) > FRAME_DEADLINE_MS) {
+            frames_.erase(it);
+            expectFrame_++;
+            reportLoss(now);
+            continue;
+        }
+        return;
+    }
+}
+
+void UdpSession::deliverVideo(const BufferRef& msg) {
+    // 丢帧后解码器缺少参考帧，在下一个关键帧之前的帧都无法正确解码
+    if (awaitingKeyframe_) {
+        if (msg.size() < 2 || !(msg[1] & Desktop::VIDEO_KEYFRAME)) return;
+        awaitingKeyframe_ = false;
+    }
+    if (callbacks_.onMessage) callbacks_.onMessage(msg);
+}
+
+void UdpSession::reportLoss(Clock::time_point now) {
+    // 连续放弃多帧时只报告一次，之后由定时器按间隔重发直到关键帧到达
+    if (awaitingKeyframe_ && ElapsedMs(lastLossReport_, now) < LOSS_REPORT_INTERVAL_MS) return;
+    awaitingKeyframe_ = true;
+    lastLossReport_ = now;
+    uint8_t pkt = static_cast<uint8_t>(PacketType::KeyframeLoss);
+    sendPacket(&pkt, 1);
+}
@@ -0,0 +1,220 @@
+#ifndef UDP_SESSION_H
+#define UDP_SESSION_H
+
+#include "protocol.h"
+#include "buffer_pool.h"
+#include "datagram_link.h"
+#include "event_loop.h"
+#include "pacer.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// ==================== UDP 报文格式 ====================
+// 所有多字节字段与 Chunk 头一致，按主机字节序 memcpy
+namespace UdpProto {
+    enum class PacketType : uint8_t {
+        Hello        = 1,   // 客户端→服务器：[nonce u32]，握手，定期重发直到收到确认
+        HelloAck     = 2,   // 服务器→客户端：[nonce u32]
+        Bye          = 3,   // 任一方：[nonce u32]，主动断开
+        Ping         = 4,   // [发送时刻 u64 ms]
+        Pong         = 5,   // 原样回显 Ping 的时刻，用于估计 RTT
+        Video        = 6,   // [frameId u32][index u16][k u16][m u16][size u32] + 分片
+        Nack         = 7,   // [frameId u32][count u16][index u16 * count]
+        Reliable     = 8,   // [seq u32][flags u8] + 消息片段
+        Ack          = 9,   // [下一个期望的 seq u32]，累计确认
+        KeyframeLoss = 10   // 客户端→服务器：有帧无法恢复，需要关键帧
+    };
+
+    enum ReliableFlags : uint8_t {
+        FRAG_FIRST = 0x01,
+        FRAG_LAST  = 0x02
+    };
+
+    // 4G 和 EasyTier 隧道下都不会触发 IP 分片的报文上限
+    constexpr size_t MAX_PACKET = 1200;
+    constexpr size_t VIDEO_HEADER_SIZE = 15;
+    constexpr size_t SHARD_SIZE = MAX_PACKET - VIDEO_HEADER_SIZE;
+    constexpr size_t RELIABLE_HEADER_SIZE = 6;
+    constexpr size_t RELIABLE_PAYLOAD = MAX_PACKET - RELIABLE_HEADER_SIZE;
+    constexpr size_t MAX_VIDEO_SHARDS = 60000;
+
+    // 每帧校验包数量为数据包的 10%（至少 1 个），校验包 j 是第 i % m == j 个数据包的异或，
+    // 每组可以恢复一个丢失的数据包
+    constexpr int FEC_PERCENT = 10;
+
+    // 超过该时长还没凑齐的帧即使重传成功也已过时，放弃并请求关键帧
+    constexpr int FRAME_DEADLINE_MS = 250;
+    // 帧停止到达多久后开始 NACK，以及整帧缺失时等待乱序的时长
+    constexpr int NACK_IDLE_MS = 5;
+    constexpr int REORDER_WAIT_MS = 40;
+    constexpr int LOSS_REPORT_INTERVAL_MS = 300;
+
+    constexpr int TICK_MS = 10;
+    constexpr int HELLO_INTERVAL_MS = 200;
+    constexpr int KEEPALIVE_MS = 500;
+    constexpr int PEER_TIMEOUT_MS = 5000;
+    constexpr size_t RELIABLE_WINDOW = 512;
+    constexpr size_t MAX_PENDING_FRAMES = 64;
+}
+
+// ==================== UDP 会话 ====================
+// 在一条数据报链路上提供两条子流：视频帧（VideoFrame）按 MTU 切片并附加 XOR
+// 校验，丢包先靠 FEC 恢复，恢复不了且帧仍在期限内时按 NACK 选择性重传，过期
+// 则放弃并请求关键帧，不会像 TCP 那样让一个丢包阻塞后面所有帧；其余消息（输入、
+// 控制、音频）走按序可靠子流。所有状态只在链路的事件循环线程里访问。
+class UdpSession : public std::enable_shared_from_this<UdpSession> {
+public:
+    enum class Role { Client, Server };
+
+    struct Callbacks {
+        std::function<void()> onOpen;
+        // 对端断开或超时；主动 close() 不回调
+        std::function<void()> onClose;
+        std::function<void(const BufferRef&)> onMessage;
+        // 服务端：接收方有帧无法恢复
+        std::function<void()> onVideoLost;
+    };
+
+    UdpSession(std::unique_ptr<IDatagramLink> link, Role role);
+    ~UdpSession();
+    UdpSession(const UdpSession&) = delete;
+    UdpSession& operator=(const UdpSession&) = delete;
+
+    // 打开链路并开始定时处理；客户端随即发起握手
+    bool start(Callbacks callbacks);
+    // 任意线程调用：通知对端后关闭链路，返回后不会再有回调
+    void close();
+
+    // 客户端：等待握手完成
+    bool waitOpen(std::chrono::milliseconds timeout);
+    bool isOpen() const { return open_; }
+
+    // 任意线程调用，只入队不阻塞；视频帧走 FEC 子流，其余走可靠子流
+    bool send(const BufferRef& msg);
+
+    // 任意线程调用：视频分片按令牌桶节拍发出，bitsPerSec <= 0 关闭
+    void setPacingRate(int bitsPerSec, int fps) { pacer_.setRate(bitsPerSec, fps); }
+    Pacer::Stats pacingStats() const { return pacer_.stats(); }
+
+private:
+    using Clock = EventLoop::Clock;
+
+    struct OutPacket {
+        uint32_t seq;
+        BufferRef packet;
+        Clock::time_point sentAt;
+    };
+
+    struct SentFrame {
+        uint32_t id;
+        BufferRef msg;
+        uint16_t k;
+        uint16_t m;
+        Clock::time_point sentAt;
+    };
+
+    struct PacedFrame {
+        SentFrame frame;
+        BufferRef parity;
+        uint16_t next = 0;
+        bool started = false;
+    };
+
+    struct FrameAsm {
+        uint16_t k = 0;
+        uint16_t m = 0;
+        uint32_t size = 0;
+        BufferRef data;             // 按原消息长度分配，最后一片不补零
+        BufferRef parity;           // m * SHARD_SIZE
+        std::vector<uint8_t> have;  // k + m
+        uint16_t dataHave = 0;
+        bool complete = false;
+        Clock::time_point firstSeen;
+        Clock::time_point lastPacket;
+        Clock::time_point lastNack;
+    };
+
+    void onPacket(const uint8_t* data, size_t size);
+    void onTick();
+    void scheduleTick();
+    void sendPacket(const uint8_t* data, size_t size);
+    void sendControl(UdpProto::PacketType type, uint32_t value);
+    void sendPing(Clock::time_point now);
+    void openWith(uint32_t nonce);
+    void peerLeft();
+    void resetStreams();
+
+    // ---- 可靠子流 ----
+    void sendReliable(const BufferRef& msg);
+    void pumpReliable(Clock::time_point now);
+    void retransmitReliable(Clock::time_point now);
+    void onReliable(const uint8_t* data, size_t size);
+    void onAck(uint32_t next);
+    void processFragment(const uint8_t* data, size_t size);
+
+    // ---- 视频子流：发送端 ----
+    void sendVideo(const BufferRef& msg);
+    void sendVideoShard(const SentFrame& f, uint16_t index, const uint8_t* parity);
+    void drainPaced();
+    void onNack(const uint8_t* data, size_t size);
+    void purgeHistory(Clock::time_point now);
+
+    // ---- 视频子流：接收端 ----
+    void onVideo(const uint8_t* data, size_t size);
+    void tryRecover(FrameAsm& f);
+    void sendNacks(Clock::time_point now);
+    void deliverFrames(Clock::time_point now);
+    void deliverVideo(const BufferRef& msg);
+    void reportLoss(Clock::time_point now);
+    size_t shardLen(const FrameAsm& f, uint16_t index) const;
+
+    int rtoMs() const;
+
+    std::unique_ptr<IDatagramLink> link_;
+    EventLoop& loop_;
+    const Role role_;
+    Callbacks callbacks_;
+
+    std::atomic<bool> started_{false};
+    std::atomic<bool> closed_{false};
+    std::atomic<bool> open_{false};
+    std::mutex openMtx_;
+    std::condition_variable openCv_;
+
+    uint32_t nonce_ = 0;
+    int srttMs_ = 100;
+    bool rttMeasured_ = false;
+    Clock::time_point lastRecv_;
+    Clock::time_point lastPing_;
+    Clock::time_point lastHello_;
+    uint8_t scratch_[UdpProto::MAX_PACKET];
+
+    // 可靠子流
+    uint32_t sendSeq_ = 0;
+    std::deque<OutPacket> unacked_;
+    std::deque<BufferRef> backlog_;
+    uint32_t recvSeq_ = 0;
+    std::map<uint32_t, BufferRef> outOfOrder_;
+    BinaryData assembling_;
+
+    // 视频发送端：期限内的帧保留引用以响应 NACK
+    uint32_t nextFrameId_ = 0;
+    std::deque<SentFrame> history_;
+    std::deque<PacedFrame> paced_;
+    Pacer pacer_;
+    bool paceTimer_ = false;
+
+    // 视频接收端
+    std::map<uint32_t, FrameAsm> frames_;
+    uint32_t expectFrame_ = 0;
+    bool haveExpect_ = false;
+    bool awaitingKeyframe_ = false;
+    Clock::time_point lastLossReport_;
+};
+
+#endif // UDP_SESSION_H
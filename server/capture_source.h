@@ -0,0 +1,82 @@
+
+#ifndef CAPTURE_SOURCE_H
+#define CAPTURE_SOURCE_H
+
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <cstdint>
+#include <vector>
+
+// 一帧相对上一帧的变化，坐标为画布上的像素。
+// 移动矩形的目标区域同时计入 dirty：画布里已是移动后的内容，按 dirty 从新图像拷贝即可，
+// moves 只作为提示保留给下游
+struct FrameChanges {
+    bool full = true;       // 变化区域未知（首帧、复制重建、GDI、元数据读取失败），按整帧处理
+    std::vector<RECT> dirty;
+    std::vector<DXGI_OUTDUPL_MOVE_RECT> moves;
+
+    // 画面没有变化，只有鼠标指针更新
+    bool unchanged() const { return !full && dirty.empty(); }
+    void setFull() { full = true; dirty.clear(); moves.clear(); }
+};
+
+// 编码器的画面来源：采集线程从这里取 D3D11 纹理形式的画布，按 region() 取当前选择的部分。
+// ScreenCapture 截取真实桌面；FrameSourceCapture 把合成画面或原始帧文件上传成纹理，
+// 不需要桌面会话，用于压测和长时间运行测试。所有方法都在采集线程调用
+class ICaptureSource {
+public:
+    // 拼接全部显示器
+    static constexpr int SPAN = -1;
+
+    struct Monitor {
+        RECT desktop;       // 虚拟桌面坐标
+        bool primary;
+    };
+
+    // 画面不含指针，指针的位置和形状单独取得，由客户端自己绘制
+    struct Cursor {
+        bool visible = false;
+        POINT position = {};            // 热点在画布上的坐标
+        uint32_t positionSerial = 0;    // 位置或可见性变化时递增
+        int width = 0;
+        int height = 0;
+        POINT hotSpot = {};
+        std::vector<uint8_t> bgra;      // 非预乘 alpha
+        uint32_t shapeSerial = 0;       // 形状变化时递增，0 表示还没有取到形状
+    };
+
+    virtual ~ICaptureSource() = default;
+
+    virtual bool init() = 0;
+    virtual void cleanup() = 0;
+
+    // changes 非空时给出本帧的变化区域；画面未变时返回 false。
+    // 纹理是整张画布，调用方按 region() 取当前选择的部分
+    virtual bool captureTexture(ID3D11Texture2D** outTex, FrameChanges* changes = nullptr) = 0;
+    // 下一次 captureTexture 即使画面没变也交出整张画布并按整帧上报。
+    // 编码器重建或源区域改变后丢了上一帧，静止的桌面要靠它补出第一帧
+    virtual void forceFullFrame() = 0;
+    // 纹理所在的设备，编码器在同一设备上处理
+    virtual ID3D11Device* getDevice() const = 0;
+
+    // 画布尺寸
+    virtual int getWidth() const = 0;
+    virtual int getHeight() const = 0;
+
+    virtual const std::vector<Monitor>& monitors() const = 0;
+    // index 为 monitors() 的下标或 SPAN；选择变化后的下一帧按整帧上报
+    virtual bool selectMonitor(int index) = 0;
+    virtual int selectedMonitor() const = 0;
+    // 当前选择在画布上的区域
+    virtual RECT region() const = 0;
+    // 画布左上角的虚拟桌面坐标，画布坐标加上它就是 SetCursorPos 的坐标
+    virtual POINT desktopOrigin() const = 0;
+    // 显示器增减、分辨率或排列变化后递增，调用方据此重发显示器列表、检查画布尺寸
+    virtual uint32_t layoutVersion() const = 0;
+    // 随 captureTexture 更新，指针单独移动时它返回 false，这里照样变化
+    virtual const Cursor& cursor() const = 0;
+    // 画面来自本机桌面，客户端的输入注入到本机才有意义
+    virtual bool acceptsInput() const = 0;
+};
+
+#endif // CAPTURE_SOURCE_H
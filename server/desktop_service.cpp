@@ -1,24 +1,51 @@
 #include "desktop_service.h"
+#include "screen_capture.h"
+#include "../common/stream_bridge.h"
+#include "../common/input_batch.h"
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
+#include <random>
+
+namespace {
+    Desktop::SessionTokenBytes NewSessionToken() {
+        std::random_device rd;
+        Desktop::SessionTokenBytes token;
+        for (size_t i = 0; i < token.size(); i += sizeof(uint32_t)) {
+            uint32_t r = rd();
+            memcpy(token.data() + i, &r, std::min(sizeof(r), token.size() - i));
+        }
+        return token;
+    }
+}
 
-DesktopService::DesktopService() {}
+DesktopService::DesktopService() : capture_(std::make_unique<ScreenCapture>()) {}
 DesktopService::~DesktopService() { stop(); }
 
+void DesktopService::setCaptureSource(std::unique_ptr<ICaptureSource> source) {
+    capture_ = std::move(source);
+}
+
 bool DesktopService::init() {
-    if (!capture_.init()) { return false; }
+    if (!capture_->init()) { return false; }
     
-    targetWidth_ = capture_.getWidth();
-    targetHeight_ = capture_.getHeight();
+    // 画布是全部显示器的外接矩形，编码分辨率按选中的显示器计算
+    RECT region = capture_->region();
+    targetWidth_ = region.right - region.left;
+    targetHeight_ = region.bottom - region.top;
     targetFps_ = Config::FPS;
     targetKfIntervalSec_ = 5;
 
-    int bitrate = std::max(10000000, targetWidth_ * targetHeight_ * 4);
-    if (!encoder_.init(capture_.getDevice(), capture_.getWidth(), capture_.getHeight(),
-                        targetWidth_, targetHeight_, targetFps_, bitrate)) {
+    maxBitrate_ = std::max(10000000, targetWidth_ * targetHeight_ * 4);
+    bitrate_ = maxBitrate_;
+    if (!encoder_.init(capture_->getDevice(), capture_->getWidth(), capture_->getHeight(),
+                        targetWidth_, targetHeight_, targetFps_, bitrate_)) {
         std::cerr << "[Desktop] Encoder init failed" << std::endl;
         return false;
     }
+    encoder_.setSourceRect(region);
+    monitorLayout_ = capture_->layoutVersion();
+    publishMonitors();
 
     return true;
 }
@@ -38,10 +65,19 @@ bool DesktopService::initAudio() {
 
     audioCapture_.setDataCallback([this](const uint8_t* pcm, int samples) {
         if (!clientReady_ || !transport_ || !transport_->hasClient()) return;
+        std::vector<ClientId> recipients;
+        {
+            std::lock_guard<std::mutex> lock(audioViewersMtx_);
+            recipients = audioViewers_;
+        }
+        if (recipients.empty()) return;
         std::vector<uint8_t> aacFrame;
         if (audioEncoder_.encode(pcm, samples, aacFrame) && !aacFrame.empty()) {
-            auto msg = MessageBuilder::AudioData(aacFrame.data(), aacFrame.size());
-            transport_->send(msg);
+            // 只发给要音频的观看者，不走广播
+            BinaryData msg(1 + aacFrame.size());
+            msg[0] = static_cast<uint8_t>(Desktop::MsgType::AudioData);
+            memcpy(msg.data() + 1, aacFrame.data(), aacFrame.size());
+            for (ClientId id : recipients) transport_->sendTo(id, msg);
         }
     });
 
@@ -54,45 +90,268 @@ void DesktopService::setTransport(IServerTransport* transport) {
     transport_ = transport;
 
     TransportCallbacks callbacks;
-    callbacks.onConnected = [this]() { onClientConnected(); };
-    callbacks.onDisconnected = [this]() { onClientDisconnected(); };
-    callbacks.onMessage = [this](const BinaryData& data) { onMessage(data); };
+    // 单客户端传输只走这三个回调，固定映射到 SINGLE_CLIENT_ID
+    callbacks.onConnected = [this]() { onClientConnected(SINGLE_CLIENT_ID); };
+    callbacks.onDisconnected = [this]() { onClientDisconnected(SINGLE_CLIENT_ID); };
+    callbacks.onMessage = [this](const BinaryData& data) { onMessage(SINGLE_CLIENT_ID, data); };
+    callbacks.onClientConnected = [this](ClientId id) { onClientConnected(id); };
+    callbacks.onClientDisconnected = [this](ClientId id) { onClientDisconnected(id); };
+    callbacks.onClientMessage = [this](ClientId id, const BinaryData& data) { onMessage(id, data); };
+    callbacks.onVideoDropped = [this]() { requestKeyframe(); };
     transport_->setCallbacks(callbacks);
+    transport_->setPacingRate(bitrate_, targetFps_);
+    streams_ = std::make_unique<StreamServiceHost>(EventLoop::shared(), transport_);
+}
+
+void DesktopService::allowStreamService(Desktop::StreamService service, int port) {
+    if (streams_) streams_->allow(service, port);
 }
 
-void DesktopService::onClientConnected() {
-    std::cout << "[Desktop] Transport connected (waiting for ClientReady)" << std::endl;
+void DesktopService::onClientConnected(ClientId id) {
+    std::cout << "[Desktop] Viewer " << id << " connected (waiting for ClientReady)" << std::endl;
     // 不再在这里发 ScreenInfo！等客户端准备好再发
+
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    Viewer& viewer = viewers_[id];
+    // 第一个连上的观看者获得操作权限，其余只能观看
+    bool hasController = false;
+    for (auto& kv : viewers_) hasController = hasController || kv.second.canInput;
+    viewer.canInput = !hasController;
 }
 
-void DesktopService::onClientDisconnected() {
-    std::cout << "[Desktop] Client disconnected" << std::endl;
-    clientReady_ = false;
+void DesktopService::onClientDisconnected(ClientId id) {
+    std::cout << "[Desktop] Viewer " << id << " disconnected" << std::endl;
+    if (streams_) streams_->onClientDisconnected(id);
+
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    auto it = viewers_.find(id);
+    if (it == viewers_.end()) return;
+    bool wasController = it->second.canInput;
+    // 正在观看时掉线多半是网络切换，先保留会话等它续连；主动断开的不保留
+    if (it->second.ready && it->second.hasToken) {
+        ParkedSession& parked = parked_[it->second.token];
+        parked.viewer = it->second;
+        parked.viewer.canInput = false;
+        parked.encodedWidth = encoder_.encodedWidth();
+        parked.encodedHeight = encoder_.encodedHeight();
+        parked.parkedTick = GetTickCount();
+        std::cout << "[Desktop] Session of viewer " << id << " kept for "
+                  << Desktop::RESUME_GRACE_MS << "ms awaiting resume" << std::endl;
+    }
+    stopViewingLocked(id, it->second);
+    viewers_.erase(it);
+
+    // 操作者离开后，权限交给最早加入的观看者
+    if (wasController && !viewers_.empty()) {
+        auto next = viewers_.begin();
+        next->second.canInput = true;
+        if (transport_) transport_->sendTo(next->first, MessageBuilder::InputPermission(true));
+        std::cout << "[Desktop] Input control passed to viewer " << next->first << std::endl;
+    }
+    updateViewersLocked();
+}
+
+void DesktopService::stopViewingLocked(ClientId id, Viewer& viewer) {
+    if (transport_) transport_->setSubscribed(id, false);
+    viewer.ready = false;
+    viewer.audioConfigSent = false;
+    if (viewer.canInput) {
+        std::lock_guard<std::mutex> inputLock(inputMtx_);
+        while (!inputQueue_.empty()) inputQueue_.pop();
+    }
+}
+
+bool DesktopService::resumeSessionLocked(ClientId id, const Desktop::SessionTokenBytes& token) {
+    Viewer restored;
+    int encodedWidth = 0, encodedHeight = 0;
+
+    auto parked = parked_.find(token);
+    if (parked != parked_.end()) {
+        restored = parked->second.viewer;
+        encodedWidth = parked->second.encodedWidth;
+        encodedHeight = parked->second.encodedHeight;
+        parked_.erase(parked);
+    } else {
+        // 旧连接可能还没被发现已断（半开的 TCP），直接接管它的会话
+        auto old = std::find_if(viewers_.begin(), viewers_.end(), [&](const std::pair<const ClientId, Viewer>& kv) {
+            return kv.first != id && kv.second.hasToken && kv.second.token == token;
+        });
+        if (old == viewers_.end()) return false;
+        ClientId oldId = old->first;
+        restored = old->second;
+        encodedWidth = encoder_.encodedWidth();
+        encodedHeight = encoder_.encodedHeight();
+        stopViewingLocked(oldId, old->second);
+        viewers_.erase(old);
+        transport_->disconnectClient(oldId);
+    }
+
+    // 操作权限只在没有其他操作者时归还
+    bool hasController = false;
+    for (auto& kv : viewers_) hasController = hasController || (kv.first != id && kv.second.canInput);
+    Viewer& viewer = viewers_[id];
+    restored.canInput = viewer.canInput || !hasController;
+    restored.ready = true;
+    // 能力以新连接上的 Hello 为准，客户端可能已经换了版本
+    restored.capabilities = viewer.capabilities;
+    // 客户端的音频解码器随会话保留，音频一直开着就不必再发 AudioConfig
+    restored.audioConfigSent = restored.wantsAudio && audioEnabled_;
+    viewer = restored;
+
+    std::cout << "[Desktop] Viewer " << id << " resumed its session" << std::endl;
+    transport_->sendTo(id, MessageBuilder::ResumeResult(true));
+    if (encodedWidth != encoder_.encodedWidth() || encodedHeight != encoder_.encodedHeight()) {
+        transport_->sendTo(id, MessageBuilder::ScreenInfo(encoder_.encodedWidth(), encoder_.encodedHeight()));
+    }
+    transport_->sendTo(id, MessageBuilder::InputPermission(viewer.canInput));
+    sendMonitorListLocked(id, viewer);
+    transport_->setSubscribed(id, true);
+    cursorResync_ = true;
+    return true;
+}
+
+void DesktopService::expireParkedSessions() {
+    DWORD now = GetTickCount();
+    if (now - lastParkedCheckTick_ < PARKED_CHECK_INTERVAL_MS) return;
+    lastParkedCheckTick_ = now;
+
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    bool expired = false;
+    for (auto it = parked_.begin(); it != parked_.end();) {
+        if (now - it->second.parkedTick >= Desktop::RESUME_GRACE_MS) {
+            it = parked_.erase(it);
+            expired = true;
+        } else {
+            ++it;
+        }
+    }
+    if (!expired) return;
+    std::cout << "[Desktop] Parked session expired without resume" << std::endl;
+    updateViewersLocked();
+}
+
+void DesktopService::updateViewersLocked() {
+    bool anyReady = false;
+    bool anyAudio = false;
+    bool hasConfig = false;
+    Desktop::StreamConfig merged{};
+
+    // 编码只有一路：分辨率和帧率取观看者要求的最大值，关键帧间隔取最小值
+    auto merge = [&](const Viewer& v) {
+        anyAudio = anyAudio || v.wantsAudio;
+        if (!v.hasConfig) return;
+        if (!hasConfig) {
+            merged = v.config;
+            hasConfig = true;
+        } else {
+            merged.width = std::max(merged.width, v.config.width);
+            merged.fps = std::max(merged.fps, v.config.fps);
+            merged.keyframeIntervalSec = std::min(merged.keyframeIntervalSec, v.config.keyframeIntervalSec);
+        }
+    };
+    bool allInfo = true;
+    for (auto& kv : viewers_) {
+        if (!kv.second.ready) continue;
+        anyReady = true;
+        allInfo = allInfo && (kv.second.capabilities & Desktop::CAP_VIDEO_INFO);
+        merge(kv.second);
+    }
+    videoInfo_ = anyReady && allInfo;
+    // 等待续连的会话不接收视频，但保留它的配置，续连后不必重建编码器
+    for (auto& kv : parked_) merge(kv.second.viewer);
+
+    clientReady_ = anyReady;
+    if (!anyReady) {
+        configChanged_ = false;
+        reinitEncoder_ = false;
+    }
     clientCV_.notify_all();
 
-    std::lock_guard<std::mutex> lock(inputMtx_);
-    while (!inputQueue_.empty()) inputQueue_.pop();
+    // 开关音频要启动或等待音频线程退出，不能在锁里、更不能在事件循环线程上做，交给采集线程
+    audioWanted_ = anyAudio;
+
+    // 每个要音频的观看者各自收到一次 AudioConfig
+    std::vector<ClientId> audioViewers;
+    for (auto& kv : viewers_) {
+        Viewer& v = kv.second;
+        bool wants = audioEnabled_ && v.ready && v.wantsAudio;
+        if (wants && !v.audioConfigSent && transport_) {
+            auto& asc = audioEncoder_.audioSpecificConfig();
+            auto msg = MessageBuilder::AudioConfig(
+                audioCapture_.sampleRate(), audioCapture_.channels(),
+                asc.data(), (int)asc.size());
+            transport_->sendTo(kv.first, msg);
+        }
+        v.audioConfigSent = wants;
+        if (wants) audioViewers.push_back(kv.first);
+    }
+    {
+        std::lock_guard<std::mutex> lock(audioViewersMtx_);
+        audioViewers_ = std::move(audioViewers);
+    }
+
+    if (hasConfig) applyStreamConfig(merged);
+}
+
+void DesktopService::requestKeyframe() {
+    keyframeRequested_ = true;
 }
 
-void DesktopService::onMessage(const BinaryData& data) {
+void DesktopService::onMessage(ClientId id, const BinaryData& data) {
     if (data.empty()) return;
+    if (streams_ && streams_->handleMessage(id, data)) return;
 
     auto type = static_cast<Desktop::MsgType>(data[0]);
 
     switch (type) {
         case Desktop::MsgType::ClientReady: {
-            std::cout << "[Desktop] ClientReady received, sending ScreenInfo and starting stream" << std::endl;
-            if (transport_ && transport_->hasClient()) {
-                auto msg = MessageBuilder::ScreenInfo(encoder_.encodedWidth(), encoder_.encodedHeight());
-                transport_->send(msg);
+            std::cout << "[Desktop] ClientReady received from viewer " << id
+                      << ", sending ScreenInfo and starting stream" << std::endl;
+            std::lock_guard<std::mutex> lock(viewersMtx_);
+            auto it = viewers_.find(id);
+            if (it == viewers_.end() || !transport_) break;
+            transport_->sendTo(id, MessageBuilder::ScreenInfo(encoder_.encodedWidth(), encoder_.encodedHeight()));
+            transport_->sendTo(id, MessageBuilder::InputPermission(it->second.canInput));
+            sendMonitorListLocked(id, it->second);
+            transport_->setSubscribed(id, true);
+            it->second.ready = true;
+            if (!it->second.hasToken) {
+                it->second.token = NewSessionToken();
+                it->second.hasToken = true;
+                transport_->sendTo(id, MessageBuilder::SessionToken(it->second.token, Desktop::RESUME_GRACE_MS));
             }
-            clientReady_ = true;
-            clientCV_.notify_one();
+            updateViewersLocked();
+            cursorResync_ = true;
+            // 新观看者要从关键帧开始解码
+            requestKeyframe();
+            break;
+        }
+
+        case Desktop::MsgType::ResumeSession: {
+            if (data.size() < 1 + Desktop::SESSION_TOKEN_SIZE) break;
+            Desktop::SessionTokenBytes token;
+            memcpy(token.data(), data.data() + 1, token.size());
+
+            std::lock_guard<std::mutex> lock(viewersMtx_);
+            if (viewers_.find(id) == viewers_.end() || !transport_) break;
+            if (!resumeSessionLocked(id, token)) {
+                std::cout << "[Desktop] Viewer " << id << " presented an unknown or expired session token" << std::endl;
+                transport_->sendTo(id, MessageBuilder::ResumeResult(false));
+                break;
+            }
+            updateViewersLocked();
+            // 解码器还在，只需要一个关键帧就能接着显示
+            requestKeyframe();
             break;
         }
 
         case Desktop::MsgType::InputEvent:
             if (data.size() >= 1 + sizeof(Desktop::InputEvent)) {
+                {
+                    std::lock_guard<std::mutex> lock(viewersMtx_);
+                    auto it = viewers_.find(id);
+                    if (it == viewers_.end() || !it->second.canInput) break;
+                }
                 Desktop::InputEvent ev;
                 memcpy(&ev, data.data() + 1, sizeof(ev));
                 std::lock_guard<std::mutex> lock(inputMtx_);
@@ -100,28 +359,79 @@ void DesktopService::onMessage(const BinaryData& data) {
             }
             break;
 
+        case Desktop::MsgType::InputBatch: {
+            {
+                std::lock_guard<std::mutex> lock(viewersMtx_);
+                auto it = viewers_.find(id);
+                if (it == viewers_.end() || !it->second.canInput) break;
+            }
+            std::vector<Desktop::InputEvent> events;
+            if (!InputBatching::Decode(data.data(), data.size(), events)) {
+                std::cerr << "[Desktop] Malformed input batch from viewer " << id << std::endl;
+                break;
+            }
+            // 整批一起入队，与其他消息里的输入保持到达顺序
+            std::lock_guard<std::mutex> lock(inputMtx_);
+            for (const auto& ev : events) inputQueue_.push(ev);
+            break;
+        }
+
         case Desktop::MsgType::KeyframeRequest:
-            keyframeRequested_ = true;
+            if (data.size() >= 1 + sizeof(uint32_t)) {
+                uint32_t missingSeq;
+                memcpy(&missingSeq, data.data() + 1, sizeof(missingSeq));
+                std::cout << "[Desktop] Viewer " << id << " is missing frame #" << missingSeq
+                          << " (current #" << videoSeq_.load() << ")" << std::endl;
+            }
+            requestKeyframe();
+            break;
+
+        case Desktop::MsgType::Hello: {
+            if (data.size() < 1 + sizeof(Desktop::HelloMsg)) break;
+            Desktop::HelloMsg hello;
+            memcpy(&hello, data.data() + 1, sizeof(hello));
+            uint32_t caps = hello.capabilities & Desktop::SUPPORTED_CAPABILITIES;
+            std::lock_guard<std::mutex> lock(viewersMtx_);
+            auto it = viewers_.find(id);
+            if (it == viewers_.end() || !transport_) break;
+            std::cout << "[Desktop] Viewer " << id << " speaks protocol v" << hello.version
+                      << ", capabilities 0x" << std::hex << caps << std::dec << std::endl;
+            it->second.capabilities = caps;
+            transport_->sendTo(id, MessageBuilder::Hello(Desktop::PROTOCOL_VERSION, caps));
+            updateViewersLocked();
             break;
+        }
         
-        case Desktop::MsgType::ClientDisconnect:
-            std::cout << "[Desktop] Client requested disconnect, stopping stream" << std::endl;
-            clientReady_ = false;
-            configChanged_ = false;
-            reinitEncoder_ = false;
-            disableAudio();
+        case Desktop::MsgType::SelectMonitor: {
+            if (data.size() < 2) break;
             {
-                std::lock_guard<std::mutex> lock(inputMtx_);
-                while (!inputQueue_.empty()) inputQueue_.pop();
+                // 只有一路编码，切换对所有观看者生效，和输入一样只交给可操作的观看者
+                std::lock_guard<std::mutex> lock(viewersMtx_);
+                auto it = viewers_.find(id);
+                if (it == viewers_.end() || !it->second.canInput) break;
             }
+            requestedMonitor_ = (data[1] == Desktop::MONITOR_SPAN) ? ICaptureSource::SPAN : static_cast<int>(data[1]);
             break;
+        }
+
+        case Desktop::MsgType::ClientDisconnect: {
+            std::cout << "[Desktop] Viewer " << id << " requested disconnect, stopping stream" << std::endl;
+            std::lock_guard<std::mutex> lock(viewersMtx_);
+            auto it = viewers_.find(id);
+            if (it == viewers_.end()) break;
+            stopViewingLocked(id, it->second);
+            it->second.wantsAudio = false;
+            updateViewersLocked();
+            break;
+        }
 
         case Desktop::MsgType::AudioEnable: {
             bool enable = (data.size() > 1 && data[1] != 0);
-            if (enable != audioEnabled_) {
-                if (enable) enableAudio();
-                else disableAudio();
-            }
+            std::lock_guard<std::mutex> lock(viewersMtx_);
+            auto it = viewers_.find(id);
+            if (it == viewers_.end()) break;
+            it->second.wantsAudio = enable;
+            updateViewersLocked();
             break;
         }
 
@@ -130,27 +440,14 @@ void DesktopService::onMessage(const BinaryData& data) {
                 Desktop::StreamConfig cfg;
                 memcpy(&cfg, data.data() + 1, sizeof(cfg));
 
-                int origW = capture_.getWidth();
-                int origH = capture_.getHeight();
-
-                int calcWidth = std::max(cfg.width , MINWIDTH);
-                int newH = (origW > 0) ? (origH * calcWidth / origW) : origH;
-                
-                // 【修改】强制 16 像素对齐，防止 HEVC 编码器内部 padding 导致步长错乱花屏
-                calcWidth = (calcWidth + 15) & ~15;
-                newH = (newH + 15) & ~15;
-
-                targetWidth_ = calcWidth;
-                targetHeight_ = newH;
-                targetFps_ = cfg.fps > 0 ? cfg.fps : 1;
-                targetKfIntervalSec_ = cfg.keyframeIntervalSec > 0 ? cfg.keyframeIntervalSec : 5;
-                
-                configChanged_ = true;
-                configChangeCV_.notify_all();
-                
-                std::cout << "[Desktop] Client specified Stream Config: " 
-                          << targetWidth_ << "x" << targetHeight_ 
-                          << " @ " << targetFps_ << "fps." << std::endl;
+                std::lock_guard<std::mutex> lock(viewersMtx_);
+                auto it = viewers_.find(id);
+                if (it == viewers_.end()) break;
+                it->second.config = cfg;
+                it->second.hasConfig = true;
+                std::cout << "[Desktop] Viewer " << id << " specified Stream Config: "
+                          << cfg.width << " @ " << cfg.fps << "fps." << std::endl;
+                updateViewersLocked();
             }
             break;
         }
@@ -159,20 +456,45 @@ void DesktopService::onMessage(const BinaryData& data) {
     }
 }
 
+void DesktopService::applyStreamConfig(const Desktop::StreamConfig& cfg) {
+    int origW = regionWidth_;
+    int origH = regionHeight_;
+
+    int calcWidth = std::max(cfg.width , MINWIDTH);
+    int newH = (origW > 0) ? (origH * calcWidth / origW) : origH;
+    
+    // 【修改】强制 16 像素对齐，防止 HEVC 编码器内部 padding 导致步长错乱花屏
+    calcWidth = (calcWidth + 15) & ~15;
+    newH = (newH + 15) & ~15;
+
+    int fps = cfg.fps > 0 ? cfg.fps : 1;
+    int kfSec = cfg.keyframeIntervalSec > 0 ? cfg.keyframeIntervalSec : 5;
+
+    // 其他观看者的加入或离开不一定改变合并结果，没变就不重建编码器
+    if (calcWidth == targetWidth_ && newH == targetHeight_ &&
+        fps == targetFps_ && kfSec == targetKfIntervalSec_) {
+        return;
+    }
+
+    targetWidth_ = calcWidth;
+    targetHeight_ = newH;
+    targetFps_ = fps;
+    targetKfIntervalSec_ = kfSec;
+    
+    configChanged_ = true;
+    configChangeCV_.notify_all();
+    
+    std::cout << "[Desktop] Applying Stream Config: " 
+              << targetWidth_ << "x" << targetHeight_ 
+              << " @ " << targetFps_ << "fps." << std::endl;
+}
+
 void DesktopService::enableAudio() {
     if (audioEnabled_) return;
     if (!audioCapture_.initialized() && !initAudio()) return;
     audioCapture_.start();
     audioEnabled_ = true;
     std::cout << "[Desktop] Audio enabled" << std::endl;
-
-    if (transport_ && transport_->hasClient()) {
-        auto& asc = audioEncoder_.audioSpecificConfig();
-        auto msg = MessageBuilder::AudioConfig(
-            audioCapture_.sampleRate(), audioCapture_.channels(),
-            asc.data(), (int)asc.size());
-        transport_->send(msg);
-    }
 }
 
 void DesktopService::disableAudio() {
@@ -182,6 +504,19 @@ void DesktopService::disableAudio() {
     std::cout << "[Desktop] Audio disabled" << std::endl;
 }
 
+void DesktopService::applyAudioState() {
+    bool wanted = audioWanted_;
+    if (wanted == audioApplied_) return;
+    // 每次切换只试一次，初始化失败不会每轮重试
+    audioApplied_ = wanted;
+    if (wanted) enableAudio();
+    else disableAudio();
+
+    // 音频开关的结果变了：补发 AudioConfig，更新音频接收名单
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    updateViewersLocked();
+}
+
 void DesktopService::start() {
     running_ = true;
     captureThread_ = std::thread(&DesktopService::captureLoop, this);
@@ -191,22 +526,26 @@ void DesktopService::start() {
 void DesktopService::stop() {
     running_ = false;
     clientReady_ = false;
-    disableAudio();
     clientCV_.notify_all();
     configChangeCV_.notify_all();
     if (captureThread_.joinable()) captureThread_.join();
     if (configChangeLoopThread_.joinable()) configChangeLoopThread_.join();
+    // 采集线程已退出，不会再与它同时启停音频
+    disableAudio();
+    if (streams_) streams_->clear();
 }
 
 void DesktopService::captureLoop() {
-    std::vector<uint8_t> encoded;
-    encoded.reserve(256 * 1024);
+    BufferRef frame;   // 编码输出直接落在池化缓冲里，前面预留帧头
     const DWORD frameMs = 1000 / Config::FPS;
     int64_t pts = 0;
 
     std::cout << "[Desktop] Capture loop started" << std::endl;
 
     while (running_) {
+        // 没有观看者时也要清理过期的续连会话、关掉音频
+        expireParkedSessions();
+        applyAudioState();
         {
             std::unique_lock<std::mutex> lock(clientMtx_);
             clientCV_.wait_for(lock, std::chrono::milliseconds(50), [this]() {
@@ -220,10 +559,17 @@ void DesktopService::captureLoop() {
         // 【动态修改1】实时帧率导致的单帧延迟时间
         DWORD frameMs = 1000 / targetFps_;
 
+        checkMonitors();
         processInput();
+        logLinkStats();
+        adaptBitrate();
 
         // 【动态修改2】判断本次是否应该发送关键帧
-        bool kfRequested = keyframeRequested_.exchange(false);
+        // 距上一个关键帧太近的请求先保留，间隔到了再一并满足
+        bool kfRequested = false;
+        if (keyframeRequested_ && GetTickCount() - lastKeyframeTick_ >= KEYFRAME_MIN_INTERVAL_MS) {
+            kfRequested = keyframeRequested_.exchange(false);
+        }
         // 根据客户端指定的帧率和秒数计算关键帧间隔
         bool isTimeForKeyframe = (pts % (targetFps_ * targetKfIntervalSec_) == 0) || kfRequested;
         
@@ -231,14 +577,20 @@ void DesktopService::captureLoop() {
         if (reinitEncoder_ && isTimeForKeyframe) {
             std::cout << "[Desktop] Applying new config and forcing keyframe..." << std::endl;
             encoder_.cleanup();
-            int configBitrate = std::max(10000000, targetWidth_ * targetHeight_ * 4);
-            if (!encoder_.init(capture_.getDevice(), capture_.getWidth(), capture_.getHeight(),
-                               targetWidth_, targetHeight_, targetFps_, configBitrate)) {
+            // 新分辨率有新的上限，但不超过带宽估计已经给出的值，免得一开始就灌满链路
+            maxBitrate_ = std::max(10000000, targetWidth_ * targetHeight_ * 4);
+            bitrate_ = bitrateAdapted_ ? std::min(maxBitrate_, bitrate_) : maxBitrate_;
+            if (!encoder_.init(capture_->getDevice(), capture_->getWidth(), capture_->getHeight(),
+                               targetWidth_, targetHeight_, targetFps_, bitrate_, bitrateAdapted_)) {
                 std::cerr << "[Desktop] Encoder init failed during config change" << std::endl;
                 reinitEncoder_ = false;
                 return;
             }
+            encoder_.setSourceRect(capture_->region());
+            // 新编码器没有上一帧，画面静止时 DXGI 不会再给出变化，要主动取一次整帧
+            capture_->forceFullFrame();
             reinitEncoder_ = false;
+            if (transport_) transport_->setPacingRate(bitrate_, targetFps_);
 
             // 极为关键的一步：告诉客户端分辨率变了，让它的解码器也立即重新初始化！
             if (transport_ && transport_->hasClient()) {
@@ -250,25 +602,71 @@ void DesktopService::captureLoop() {
         }
 
         bool encodeOk = false;
+        // 所有观看者都声明了 CAP_VIDEO_INFO 才带扩展帧头，同一份缓冲要发给每个人
+        bool withInfo = videoInfo_;
+        size_t headerSize = withInfo ? Desktop::VIDEO_INFO_HEADER_SIZE : Desktop::VIDEO_HEADER_SIZE;
+        Desktop::VideoFrameInfo info{};
 
         ID3D11Texture2D* tex = nullptr;
-        if (capture_.captureTexture(&tex)) {
-            encodeOk = encoder_.encodeFromTexture(tex, pts, encoded, isTimeForKeyframe);
+        FrameChanges changes;   // 只有变化区域被拷贝、回读；只动了指针时不会产出新画面
+        bool keyframe = isTimeForKeyframe;
+        int refinePass = -1;
+        if (capture_->captureTexture(&tex, &changes)) {
+            lastChangeTick_ = GetTickCount();
+            refinePasses_ = 0;
+            info.captureUs = ClockSyncing::NowUs();
+            info.encodeStartUs = info.captureUs;
+            encodeOk = encoder_.encodeFromTexture(tex, pts, frame, headerSize, keyframe, &changes);
+            info.encodeEndUs = ClockSyncing::NowUs();
             if (!encodeOk && pts % 30 == 0)
                 std::cerr << "[Desktop] GPU encode failed, dropping frame" << std::endl;
+        } else if (encoder_.hasHeldFrame()) {
+            // 画面静止：周期关键帧没有意义，只在有人请求时补发；静止够久后精化几遍就不再发帧
+            keyframe = kfRequested;
+            if (refinePasses_ < MediaEncoder::REFINE_PASSES &&
+                GetTickCount() - lastChangeTick_ >= STATIC_REFINE_MS * (refinePasses_ + 1)) {
+                refinePass = refinePasses_;
+            }
+            if (keyframe || refinePass >= 0) {
+                info.captureUs = ClockSyncing::NowUs();
+                info.encodeStartUs = info.captureUs;
+                encodeOk = encoder_.encodeHeld(pts, frame, headerSize, keyframe, refinePass);
+                info.encodeEndUs = ClockSyncing::NowUs();
+                if (encodeOk && refinePass >= 0) refinePasses_++;
+            }
         }
+        // 指针在视频帧之前发出，画面静止时也照常更新
+        sendCursor();
+        if (encodeOk && keyframe) lastKeyframeTick_ = GetTickCount();
+        // 这一轮没能编出关键帧（静止且编码器还没有图像、或编码失败），请求留到下一轮
+        if (kfRequested && !(encodeOk && keyframe)) keyframeRequested_ = true;
 
         if (encodeOk) {
-            if (!encoded.empty() && transport_ && transport_->hasClient()) {
-                auto msg = MessageBuilder::VideoFrame(encoded.data(), encoded.size(), isTimeForKeyframe);
-                if (!transport_->send(msg)) {
-                    clientReady_ = false;
+            if (frame && transport_ && transport_->hasClient()) {
+                // 帧头写进预留位置，整条消息以引用交给发送队列，不阻塞采集
+                if (withInfo) {
+                    info.seq = videoSeq_;
+                    info.width = static_cast<uint16_t>(encoder_.encodedWidth());
+                    info.height = static_cast<uint16_t>(encoder_.encodedHeight());
+                    auto header = MessageBuilder::VideoFrameHeader(keyframe, info);
+                    memcpy(frame.data(), header.data(), header.size());
+                } else {
+                    auto header = MessageBuilder::VideoFrameHeader(keyframe);
+                    memcpy(frame.data(), header.data(), header.size());
                 }
+                // 没有观看者接收时由各连接的断开回调更新状态
+                transport_->sendBuffer(frame);
                 if (pts % 30 == 0)
                     std::cout << "[Desktop] Sent frame pts=" << pts
-                              << " size=" << encoded.size()
-                              << " kf=" << (isTimeForKeyframe ? 1 : 0) << std::endl;
+                              << " seq=" << videoSeq_
+                              << " size=" << frame.size() - headerSize
+                              << " kf=" << (keyframe ? 1 : 0) << std::endl;
+                if (refinePass >= 0)
+                    std::cout << "[Desktop] Static screen refinement " << refinePass + 1
+                              << "/" << MediaEncoder::REFINE_PASSES
+                              << " size=" << frame.size() - headerSize << std::endl;
             }
+            videoSeq_++;
         }
 
         pts++;
@@ -277,6 +675,192 @@ void DesktopService::captureLoop() {
     }
 }
 
+bool DesktopService::viewerClockEstimate(ClientId id, ClockEstimate& out) const {
+    return transport_ && transport_->clockEstimate(id, out);
+}
+
+void DesktopService::logLinkStats() {
+    DWORD now = GetTickCount();
+    if (now - lastLinkLogTick_ < LINK_LOG_INTERVAL_MS) return;
+    lastLinkLogTick_ = now;
+
+    std::vector<ClientId> ids;
+    {
+        std::lock_guard<std::mutex> lock(viewersMtx_);
+        for (auto& kv : viewers_) ids.push_back(kv.first);
+    }
+    for (ClientId id : ids) {
+        ClockEstimate est;
+        if (!viewerClockEstimate(id, est)) continue;
+        std::cout << "[Desktop] Viewer " << id << " RTT=" << est.rttMs
+                  << "ms (min " << est.minRttMs << "ms) offset=" << est.offsetMs << "ms" << std::endl;
+    }
+}
+
+void DesktopService::adaptBitrate() {
+    DWORD now = GetTickCount();
+    if (now - lastBitrateCheckTick_ < BITRATE_CHECK_INTERVAL_MS) return;
+    lastBitrateCheckTick_ = now;
+    if (!transport_ || !encoder_.initialized() || reinitEncoder_) return;
+
+    // 只有一路编码：取所有观看者估计值中最小的，最慢的链路决定码率
+    int target = 0;
+    {
+        std::lock_guard<std::mutex> lock(viewersMtx_);
+        for (auto& kv : viewers_) {
+            if (!kv.second.ready) continue;
+            int t = transport_->targetBitrate(kv.first);
+            if (t > 0 && (target == 0 || t < target)) target = t;
+        }
+    }
+    if (target <= 0) return;   // 对端不回报到达时刻（UDP、P2P、旧客户端），编码器保持质量模式
+    target = std::min(target, maxBitrate_);
+
+    // 第一次拿到估计值：质量模式不理会目标码率，在下一个关键帧处按码率控制重建编码器
+    if (!encoder_.bitrateDriven()) {
+        std::cout << "[Desktop] Bandwidth estimate available (" << target / 1000
+                  << " kbps), switching the encoder to bitrate-driven rate control" << std::endl;
+        bitrate_ = target;
+        bitrateAdapted_ = true;
+        reinitEncoder_ = true;
+        requestKeyframe();
+        transport_->setPacingRate(bitrate_, targetFps_);
+        return;
+    }
+
+    // 变化不到 5% 不值得打扰编码器
+    if (std::abs(target - bitrate_) < bitrate_ / 20) return;
+    if (!encoder_.setBitrate(target)) return;
+
+    std::cout << "[Desktop] Bitrate " << bitrate_ / 1000 << " -> " << target / 1000 << " kbps" << std::endl;
+    bitrate_ = target;
+    bitrateAdapted_ = true;
+    transport_->setPacingRate(bitrate_, targetFps_);
+}
+
+void DesktopService::checkMonitors() {
+    bool changed = false;
+    int requested = requestedMonitor_.exchange(NO_MONITOR_REQUEST);
+    if (requested != NO_MONITOR_REQUEST && requested != capture_->selectedMonitor()) {
+        if (capture_->selectMonitor(requested)) {
+            std::cout << "[Desktop] Switched to "
+                      << (requested == ICaptureSource::SPAN ? std::string("all monitors")
+                                                           : "monitor #" + std::to_string(requested)) << std::endl;
+        }
+        // 无效的选择也重发列表，让客户端回到实际的选择上
+        changed = true;
+    }
+    if (capture_->layoutVersion() != monitorLayout_) {
+        monitorLayout_ = capture_->layoutVersion();
+        // 画布尺寸变了，视频处理器要按新尺寸重建，走流配置变化时的重建路径
+        if (capture_->getWidth() != encoder_.sourceWidth() || capture_->getHeight() != encoder_.sourceHeight())
+            reinitEncoder_ = true;
+        changed = true;
+    }
+    if (!changed) return;
+
+    // 切换只改编码器的源区域，复制对象和编码器都不重建；宽高比不同时先留黑边，
+    // 客户端下次发来流配置时编码分辨率再按新区域的比例计算
+    encoder_.setSourceRect(capture_->region());
+    // 改了源区域后编码器保留的那一帧作废，静止的画面也要从整张画布重新读回
+    capture_->forceFullFrame();
+    requestKeyframe();
+    publishMonitors();
+}
+
+void DesktopService::publishMonitors() {
+    std::vector<Desktop::MonitorInfo> list;
+    for (const auto& m : capture_->monitors()) {
+        list.push_back({ m.desktop.left, m.desktop.top,
+                         m.desktop.right - m.desktop.left, m.desktop.bottom - m.desktop.top,
+                         static_cast<uint8_t>(m.primary ? Desktop::MONITOR_PRIMARY : 0) });
+    }
+    int selected = capture_->selectedMonitor();
+    auto msg = MessageBuilder::MonitorList(list,
+        selected == ICaptureSource::SPAN ? Desktop::MONITOR_SPAN : static_cast<uint8_t>(selected));
+
+    RECT region = capture_->region();
+    regionWidth_ = region.right - region.left;
+    regionHeight_ = region.bottom - region.top;
+
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    monitorList_ = std::move(msg);
+    for (auto& kv : viewers_) {
+        if (kv.second.ready) sendMonitorListLocked(kv.first, kv.second);
+    }
+}
+
+void DesktopService::sendMonitorListLocked(ClientId id, const Viewer& viewer) {
+    if (!transport_ || monitorList_.empty() || !(viewer.capabilities & Desktop::CAP_MONITORS)) return;
+    transport_->sendTo(id, monitorList_);
+}
+
+void DesktopService::sendCursor() {
+    if (!transport_) return;
+    const ICaptureSource::Cursor& cursor = capture_->cursor();
+    bool resync = cursorResync_.exchange(false);
+
+    BinaryData shapeMsg;
+    if (cursor.shapeSerial != 0 && (resync || cursor.shapeSerial != cursorShapeSerial_)) {
+        cursorShapeSerial_ = cursor.shapeSerial;
+        Desktop::CursorShapeHeader header{};
+        header.width = static_cast<uint16_t>(cursor.width);
+        header.height = static_cast<uint16_t>(cursor.height);
+        header.hotX = static_cast<uint16_t>(std::clamp(int(cursor.hotSpot.x), 0, cursor.width - 1));
+        header.hotY = static_cast<uint16_t>(std::clamp(int(cursor.hotSpot.y), 0, cursor.height - 1));
+        // 形状按内容编号（FNV-1a），反复切换的几种指针只有第一次要发像素
+        uint32_t hash = 2166136261u;
+        auto mix = [&hash](const uint8_t* p, size_t n) {
+            for (size_t i = 0; i < n; i++) hash = (hash ^ p[i]) * 16777619u;
+        };
+        mix(reinterpret_cast<const uint8_t*>(&header.width), sizeof(uint16_t) * 4);
+        mix(cursor.bgra.data(), cursor.bgra.size());
+        header.shapeId = hash;
+
+        if (resync) sentCursorShapes_.clear();
+        if (resync || header.shapeId != cursorShapeId_) {
+            cursorShapeId_ = header.shapeId;
+            auto cached = std::find(sentCursorShapes_.begin(), sentCursorShapes_.end(), header.shapeId);
+            if (cached != sentCursorShapes_.end()) {
+                shapeMsg = MessageBuilder::CursorShape(header, nullptr);
+            } else {
+                shapeMsg = MessageBuilder::CursorShape(header, cursor.bgra.data());
+                sentCursorShapes_.push_back(header.shapeId);
+                if (sentCursorShapes_.size() > Desktop::CURSOR_CACHE_SIZE) sentCursorShapes_.pop_front();
+            }
+        }
+    }
+
+    // 热点从画布坐标映射到编码图像上，不在所选区域内的指针对客户端不可见
+    Desktop::CursorPositionMsg pos{ 0, 0, 0 };
+    RECT source = encoder_.sourceRect();
+    RECT content = encoder_.contentRect();
+    int sourceW = source.right - source.left;
+    int sourceH = source.bottom - source.top;
+    POINT p = cursor.position;
+    if (cursor.visible && cursor.shapeSerial != 0 && sourceW > 0 && sourceH > 0 &&
+        p.x >= source.left && p.x < source.right && p.y >= source.top && p.y < source.bottom) {
+        pos.x = content.left + int32_t(int64_t(p.x - source.left) * (content.right - content.left) / sourceW);
+        pos.y = content.top + int32_t(int64_t(p.y - source.top) * (content.bottom - content.top) / sourceH);
+        pos.visible = 1;
+    }
+    BinaryData posMsg;
+    if (resync || !shapeMsg.empty() || pos.visible != cursorSent_.visible ||
+        (pos.visible && (pos.x != cursorSent_.x || pos.y != cursorSent_.y))) {
+        cursorSent_ = pos;
+        posMsg = MessageBuilder::CursorPosition(pos.x, pos.y, pos.visible != 0);
+    }
+    if (shapeMsg.empty() && posMsg.empty()) return;
+
+    // 每个观看者都收到同样的形状消息，各自的缓存与 sentCursorShapes_ 保持一致
+    std::lock_guard<std::mutex> lock(viewersMtx_);
+    for (auto& kv : viewers_) {
+        if (!kv.second.ready || !(kv.second.capabilities & Desktop::CAP_CURSOR)) continue;
+        if (!shapeMsg.empty()) transport_->sendTo(kv.first, shapeMsg);
+        if (!posMsg.empty()) transport_->sendTo(kv.first, posMsg);
+    }
+}
+
 void DesktopService::processInput() {
     Desktop::InputEvent ev;
     INPUT input = {};
@@ -285,18 +869,24 @@ void DesktopService::processInput() {
     while (!inputQueue_.empty()) {
         ev = inputQueue_.front();
         inputQueue_.pop();
+        // 画面不是本机桌面时，输入照常收取（便于压测输入路径）但不注入
+        if (!capture_->acceptsInput()) continue;
 
         if (ev.type == 0) {
             // Client sends coordinates in the encoded-image space (targetWidth_ x targetHeight_).
-            // Scale them to the physical capture space (capture_.getWidth() x capture_.getHeight())
-            // so that SetCursorPos / mouse_event land on the correct pixel.
+            // Map the content area of that image back onto the selected monitor's region of the
+            // capture canvas, then into virtual-desktop coordinates for SetCursorPos / mouse_event.
             int physX = ev.x, physY = ev.y;
-            int capW = capture_.getWidth(), capH = capture_.getHeight();
-            int encW = encoder_.encodedWidth();
-            int encH = encoder_.encodedHeight();
-            if (encW > 0 && encH > 0 && capW > 0 && capH > 0) {
-                physX = ev.x * capW / encW;
-                physY = ev.y * capH / encH;
+            RECT content = encoder_.contentRect();
+            RECT source = encoder_.sourceRect();
+            POINT origin = capture_->desktopOrigin();
+            int contentW = content.right - content.left;
+            int contentH = content.bottom - content.top;
+            if (contentW > 0 && contentH > 0) {
+                int x = std::clamp(ev.x - int(content.left), 0, contentW - 1);
+                int y = std::clamp(ev.y - int(content.top), 0, contentH - 1);
+                physX = origin.x + source.left + int(int64_t(x) * (source.right - source.left) / contentW);
+                physY = origin.y + source.top + int(int64_t(y) * (source.bottom - source.top) / contentH);
             }
             SetCursorPos(physX, physY);
             switch (ev.key) {
@@ -4,34 +4,81 @@
 
 #include "../common/protocol.h"
 #include "../common/transport.h"
-#include "screen_capture.h"
+#include "capture_source.h"
 #include "media_encoder.h"
 #include "audio_capture.h"
 #include "audio_encoder.h"
 #include <queue>
+#include <deque>
+#include <map>
 #include <thread>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
+
+class StreamServiceHost;
 
 class DesktopService {
 public:
     DesktopService();
     ~DesktopService();
 
+    // 默认截取本机桌面；换成其他画面来源（合成画面、原始帧回放）须在 init() 之前
+    void setCaptureSource(std::unique_ptr<ICaptureSource> source);
     bool init();
     void setTransport(IServerTransport* transport);
+    // 允许客户端经桌面连接打开到本机端口的复用流（终端、SFTP），setTransport 之后调用
+    void allowStreamService(Desktop::StreamService service, int port);
     
     void start();
     void stop();
     
-    int getWidth() const { return capture_.getWidth(); }
-    int getHeight() const { return capture_.getHeight(); }
+    int getWidth() const { return capture_->getWidth(); }
+    int getHeight() const { return capture_->getHeight(); }
+    // 到某个观看者的 RTT 与时钟偏差，传输层尚无样本时返回 false
+    bool viewerClockEstimate(ClientId id, ClockEstimate& out) const;
     const int ConfigWaitSeconds = 5;
 
 private:
-    void onClientConnected();
-    void onClientDisconnected();
-    void onMessage(const BinaryData& data);
+    // 每个观看者的状态；ClientId 按连接先后递增，map 的顺序即加入顺序
+    struct Viewer {
+        bool ready = false;             // 已发送 ClientReady，正在接收视频
+        bool canInput = false;          // 同一时刻只有一个观看者可以操作
+        bool wantsAudio = false;
+        bool audioConfigSent = false;
+        bool hasConfig = false;
+        Desktop::StreamConfig config{};
+        bool hasToken = false;          // 首次 ClientReady 时发放续连令牌
+        Desktop::SessionTokenBytes token{};
+        uint32_t capabilities = 0;      // Hello 中声明且本端支持的能力，旧客户端为 0
+    };
+
+    // 断线的观看者在宽限期内保留状态，凭令牌在新连接上恢复；
+    // 仍参与流配置和音频的合并，编码器因此不会在短暂断线时被重建
+    struct ParkedSession {
+        Viewer viewer;
+        int encodedWidth = 0;           // 断线时的编码分辨率，恢复时变了才重发 ScreenInfo
+        int encodedHeight = 0;
+        DWORD parkedTick = 0;
+    };
+
+    void onClientConnected(ClientId id);
+    void onClientDisconnected(ClientId id);
+    void onMessage(ClientId id, const BinaryData& data);
+    void stopViewingLocked(ClientId id, Viewer& viewer);
+    bool resumeSessionLocked(ClientId id, const Desktop::SessionTokenBytes& token);
+    void expireParkedSessions();
+    void updateViewersLocked();
+    void applyStreamConfig(const Desktop::StreamConfig& cfg);
+    void requestKeyframe();
+    void logLinkStats();
+    void adaptBitrate();
+    // 采集线程：应用客户端选择的显示器，显示器布局变化时跟进
+    void checkMonitors();
+    void publishMonitors();
+    void sendMonitorListLocked(ClientId id, const Viewer& viewer);
+    // 采集线程：把指针的形状和位置单独发给声明了 CAP_CURSOR 的观看者
+    void sendCursor();
     
     void captureLoop();
     void processInput();
@@ -40,16 +87,27 @@ private:
     bool initAudio();
     void enableAudio();
     void disableAudio();
+    // 采集线程：按 audioWanted_ 启停音频采集
+    void applyAudioState();
 
-    ScreenCapture capture_;
+    std::unique_ptr<ICaptureSource> capture_;
     MediaEncoder encoder_;
     AudioCapture audioCapture_;
     AudioEncoder audioEncoder_;
     IServerTransport* transport_ = nullptr;
+    std::unique_ptr<StreamServiceHost> streams_;
 
     std::queue<Desktop::InputEvent> inputQueue_;
     std::mutex inputMtx_;
 
+    std::map<ClientId, Viewer> viewers_;
+    // 要音频的观看者，由 updateViewersLocked 更新；音频回调不取 viewersMtx_，
+    // 否则关闭音频时等待采集线程退出会与回调互相等待
+    std::vector<ClientId> audioViewers_;
+    std::mutex audioViewersMtx_;
+    std::map<Desktop::SessionTokenBytes, ParkedSession> parked_;   // 同样由 viewersMtx_ 保护
+    std::mutex viewersMtx_;
+
     std::thread captureThread_;
     std::thread audioThread_;
     std::thread configChangeLoopThread_;
@@ -57,15 +115,50 @@ private:
     std::atomic<bool> clientReady_{false};
     std::atomic<bool> keyframeRequested_{false};
     std::atomic<bool> audioEnabled_{false};
+    std::atomic<bool> audioWanted_{false};  // 有观看者要音频，由 updateViewersLocked 更新
+    bool audioApplied_ = false;             // 已按其启停过的 audioWanted_，只由采集线程访问
     std::condition_variable clientCV_;
     std::condition_variable configChangeCV_;
     std::mutex clientMtx_;
     // --- 新增：动态流控配置目标值 ---
     static constexpr int MINWIDTH = 270;
+    std::atomic<bool> videoInfo_{false};    // 帧头是否携带 VideoFrameInfo
+    std::atomic<uint32_t> videoSeq_{0};     // 下一个编码帧的序号，只由采集线程递增
+    // 多个观看者同时加入或丢帧时，关键帧请求在该间隔内合并为一个
+    static constexpr DWORD KEYFRAME_MIN_INTERVAL_MS = 300;
+    DWORD lastKeyframeTick_ = 0;
+    // 画面静止这么久后用更高质量重编码一遍（共 MediaEncoder::REFINE_PASSES 遍，每遍再隔这么久），
+    // 之后不再发帧，直到画面再次变化
+    static constexpr DWORD STATIC_REFINE_MS = 500;
+    DWORD lastChangeTick_ = 0;
+    int refinePasses_ = 0;      // 本次静止已发出的精化帧，只由采集线程访问
+    static constexpr DWORD LINK_LOG_INTERVAL_MS = 5000;
+    DWORD lastLinkLogTick_ = 0;
     int targetWidth_ = 0;
     int targetHeight_ = 0;
     int targetFps_ = 0;
     int targetKfIntervalSec_ = 0;
+    int bitrate_ = 0;           // 当前编码码率，同时决定传输层的发送节拍
+    int maxBitrate_ = 0;        // 当前分辨率下的码率上限，带宽估计只在其下调整
+    bool bitrateAdapted_ = false;      // 收到过带宽估计，此后编码器按码率控制（而不是质量模式）重建
+    static constexpr DWORD BITRATE_CHECK_INTERVAL_MS = 200;
+    DWORD lastBitrateCheckTick_ = 0;
+    // 客户端请求切换的显示器，由采集线程应用
+    static constexpr int NO_MONITOR_REQUEST = -2;
+    std::atomic<int> requestedMonitor_{NO_MONITOR_REQUEST};
+    uint32_t monitorLayout_ = 0;            // 已发布的 ICaptureSource::layoutVersion，只由采集线程访问
+    BinaryData monitorList_;                // 最近一次发布的 MonitorList，由 viewersMtx_ 保护
+    // 当前选择的显示器区域尺寸，流配置按它的宽高比计算编码分辨率
+    std::atomic<int> regionWidth_{0};
+    std::atomic<int> regionHeight_{0};
+    // 指针：以下只由采集线程访问，cursorResync_ 在观看者开始接收时置位，重发形状和位置
+    std::atomic<bool> cursorResync_{false};
+    uint32_t cursorShapeSerial_ = 0;
+    uint32_t cursorShapeId_ = 0;
+    std::deque<uint32_t> sentCursorShapes_;  // 与客户端的形状缓存按同样的顺序淘汰
+    Desktop::CursorPositionMsg cursorSent_{ 0, 0, 0 };
+    static constexpr DWORD PARKED_CHECK_INTERVAL_MS = 500;
+    DWORD lastParkedCheckTick_ = 0;
     std::atomic<bool> configChanged_{false};
     std::atomic<bool> reinitEncoder_{false}; // 标记是否需要重新初始化编码器
     std::mutex ConfigChangeLoopMtx_;
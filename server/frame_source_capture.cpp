@@ -0,0 +1,94 @@
+
+#define NOMINMAX
+#include "frame_source_capture.h"
+#include <iostream>
+
+FrameSourceCapture::FrameSourceCapture(std::unique_ptr<IFrameSource> source)
+    : source_(std::move(source)) {}
+
+FrameSourceCapture::~FrameSourceCapture() {
+    cleanup();
+}
+
+bool FrameSourceCapture::init() {
+    if (canvas_) return true;
+
+    D3D_FEATURE_LEVEL fl;
+    UINT flags = D3D11_CREATE_DEVICE_VIDEO_SUPPORT;
+    HRESULT hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, flags,
+                                   nullptr, 0, D3D11_SDK_VERSION, &device_, &fl, &context_);
+    if (FAILED(hr)) {
+        hr = D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_WARP, nullptr, flags,
+                               nullptr, 0, D3D11_SDK_VERSION, &device_, &fl, &context_);
+        if (FAILED(hr)) {
+            std::cerr << "[Capture] No D3D11 device for the frame source, hr=0x" << std::hex << hr << std::dec << std::endl;
+            return false;
+        }
+        std::cout << "[Capture] Using the WARP software device" << std::endl;
+    }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = getWidth();
+    desc.Height = getHeight();
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    hr = device_->CreateTexture2D(&desc, nullptr, &canvas_);
+    if (FAILED(hr)) {
+        cleanup();
+        return false;
+    }
+
+    monitors_.assign(1, { { 0, 0, getWidth(), getHeight() }, true });
+    forceFull_ = true;
+    std::cout << "[Capture] Frame source initialized: " << getWidth() << "x" << getHeight() << std::endl;
+    return true;
+}
+
+void FrameSourceCapture::cleanup() {
+    if (canvas_) { canvas_->Release(); canvas_ = nullptr; }
+    if (context_) { context_->Release(); context_ = nullptr; }
+    if (device_) { device_->Release(); device_ = nullptr; }
+}
+
+bool FrameSourceCapture::captureTexture(ID3D11Texture2D** outTex, FrameChanges* changes) {
+    if (!canvas_) return false;
+    // 画面没变但要求整帧时，把当前画面再交一次
+    bool advanced = source_->next(changes_);
+    const uint8_t* pixels = source_->pixels();
+    if (!advanced && !(forceFull_ && pixels)) return false;
+
+    // 首帧和重新选择之后整张上传，此前纹理里的内容不可信
+    const UINT pitch = UINT(getWidth()) * 4;
+    bool full = !advanced || changes_.full || forceFull_;
+    forceFull_ = false;
+    if (full) {
+        context_->UpdateSubresource(canvas_, 0, nullptr, pixels, pitch, 0);
+    } else {
+        for (const FrameSourcing::Rect& r : changes_.dirty) {
+            D3D11_BOX box = { UINT(r.left), UINT(r.top), 0, UINT(r.right), UINT(r.bottom), 1 };
+            context_->UpdateSubresource(canvas_, 0, &box,
+                                        pixels + size_t(r.top) * pitch + size_t(r.left) * 4, pitch, 0);
+        }
+    }
+
+    if (changes) {
+        changes->setFull();
+        if (!full) {
+            changes->full = false;
+            for (const FrameSourcing::Rect& r : changes_.dirty)
+                changes->dirty.push_back({ r.left, r.top, r.right, r.bottom });
+        }
+    }
+    *outTex = canvas_;
+    return true;
+}
+
+bool FrameSourceCapture::selectMonitor(int index) {
+    if (index != 0 && index != SPAN) return false;
+    forceFull_ = true;
+    return true;
+}
@@ -0,0 +1,47 @@
+
+#ifndef FRAME_SOURCE_CAPTURE_H
+#define FRAME_SOURCE_CAPTURE_H
+
+#include "capture_source.h"
+#include "../common/frame_source.h"
+#include <memory>
+
+// 把 IFrameSource 的画面上传成 D3D11 纹理交给编码器，每帧只上传变化的区域。
+// 只有一个虚拟显示器、没有指针，客户端的输入不注入本机。
+// 设备优先用硬件适配器，没有时用 WARP，因此也能跑在没有显示器的机器上
+class FrameSourceCapture : public ICaptureSource {
+public:
+    explicit FrameSourceCapture(std::unique_ptr<IFrameSource> source);
+    ~FrameSourceCapture();
+
+    bool init() override;
+    void cleanup() override;
+
+    bool captureTexture(ID3D11Texture2D** outTex, FrameChanges* changes = nullptr) override;
+    void forceFullFrame() override { forceFull_ = true; }
+    ID3D11Device* getDevice() const override { return device_; }
+
+    int getWidth() const override { return source_->width(); }
+    int getHeight() const override { return source_->height(); }
+
+    const std::vector<Monitor>& monitors() const override { return monitors_; }
+    bool selectMonitor(int index) override;
+    int selectedMonitor() const override { return 0; }
+    RECT region() const override { return { 0, 0, getWidth(), getHeight() }; }
+    POINT desktopOrigin() const override { return { 0, 0 }; }
+    uint32_t layoutVersion() const override { return 1; }
+    const Cursor& cursor() const override { return cursor_; }
+    bool acceptsInput() const override { return false; }
+
+private:
+    std::unique_ptr<IFrameSource> source_;
+    ID3D11Device* device_ = nullptr;
+    ID3D11DeviceContext* context_ = nullptr;
+    ID3D11Texture2D* canvas_ = nullptr;
+    std::vector<Monitor> monitors_;
+    Cursor cursor_;                     // 始终不可见
+    FrameSourcing::Changes changes_;
+    bool forceFull_ = true;
+};
+
+#endif // FRAME_SOURCE_CAPTURE_H
@@ -1,8 +1,10 @@
 
 #define NOMINMAX
 #include "media_encoder.h"
+#include "screen_capture.h"
 #include <iostream>
 #include <algorithm>
+#include <cstdlib>
 #include <mfapi.h>
 #include <mfidl.h>
 #include <mftransform.h>
@@ -18,12 +20,14 @@
 static const GUID CLSID_H264EncoderMFT =
     {0x6CA50344, 0x051A, 0x4DED, {0x97, 0x79, 0xA4, 0x33, 0x05, 0x16, 0x5E, 0x35}};
 
+// 只转换目标图像中 [x0,x1) x [y0,y1) 的部分（坐标为偶数），其余像素保持不变
 static void bgraToNv12(const uint8_t* bgra, int sw, int sh,
                         uint8_t* yPlane, uint8_t* uvPlane,
-                        int dw, int dh) {
-    for (int y = 0; y < dh; y++) {
+                        int dw, int dh,
+                        int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
         int srcY = std::min(y * sh / dh, sh - 1);
-        for (int x = 0; x < dw; x++) {
+        for (int x = x0; x < x1; x++) {
             int srcX = std::min(x * sw / dw, sw - 1);
             const uint8_t* p = bgra + (srcY * sw + srcX) * 4;
             uint8_t b = p[0], g = p[1], r = p[2];
@@ -66,7 +70,8 @@ MediaEncoder::~MediaEncoder() {
     cleanup();
 }
 
-bool MediaEncoder::init(ID3D11Device* device, int srcW, int srcH, int dstW, int dstH, int fps, int bitrate) {
+bool MediaEncoder::init(ID3D11Device* device, int srcW, int srcH, int dstW, int dstH, int fps, int bitrate,
+                        bool bitrateDriven) {
     std::lock_guard<std::mutex> lock(mtx_);
 
     HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
@@ -102,6 +107,11 @@ bool MediaEncoder::init(ID3D11Device* device, int srcW, int srcH, int dstW, int
         std::cout << "[MediaEncoder] Aligned to " << alignedW_ << "x" << alignedH_ << std::endl;
     fps_ = fps;
     bitrate_ = bitrate;
+    bitrateDriven_ = bitrateDriven;
+    srcRect_ = { 0, 0, srcW, srcH };
+    dstRect_ = { 0, 0, alignedW_, alignedH_ };
+    nv12Buf_.assign(size_t(alignedW_) * alignedH_ * 3 / 2, 0);
+    nv12Valid_ = false;
 
     if (device) {
         d3dDevice_ = device;
@@ -218,6 +228,10 @@ bool MediaEncoder::initVideoProcessor() {
 
     // Enable hardware filter: edge enhancement (noise reduction removed - it blurs image)
     videoCtx->VideoProcessorSetStreamFilter(vp, 0, D3D11_VIDEO_PROCESSOR_FILTER_EDGE_ENHANCEMENT, TRUE, 15);
+    // 源区域按比例缩放后留下的黑边
+    D3D11_VIDEO_COLOR black = {};
+    black.RGBA.A = 1.0f;
+    videoCtx->VideoProcessorSetOutputBackgroundColor(vp, FALSE, &black);
 
     nv12Texture_ = nv12Tex;
     nv12Staging_ = staging;
@@ -231,12 +245,132 @@ bool MediaEncoder::initVideoProcessor() {
 }
 
 bool MediaEncoder::encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts,
-                                      std::vector<uint8_t>& output, bool keyframe) {
+                                      std::vector<uint8_t>& output, bool keyframe,
+                                      const FrameChanges* changes) {
     std::lock_guard<std::mutex> lock(mtx_);
     output.clear();
     if (!initialized_ || !hasGPUPath_) return false;
 
+    if (!submitTexture(bgraTex, pts, keyframe, changes)) return false;
+    processOutput(output);
+    return true;
+}
+
+bool MediaEncoder::encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts,
+                                      BufferRef& output, size_t headroom, bool keyframe,
+                                      const FrameChanges* changes) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    output.reset();
+    if (!initialized_ || !hasGPUPath_) return false;
+
+    if (!submitTexture(bgraTex, pts, keyframe, changes)) return false;
+    processOutput(output, headroom);
+    return true;
+}
+
+bool MediaEncoder::setSourceRect(const RECT& rect) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!initialized_ || !hasGPUPath_) return false;
+
+    RECT src = { std::max<LONG>(rect.left, 0), std::max<LONG>(rect.top, 0),
+                 std::min<LONG>(rect.right, srcWidth_), std::min<LONG>(rect.bottom, srcHeight_) };
+    if (src.left >= src.right || src.top >= src.bottom) return false;
+    if (EqualRect(&src, &srcRect_)) return true;
+
+    int sw = src.right - src.left;
+    int sh = src.bottom - src.top;
+    RECT dst = { 0, 0, alignedW_, alignedH_ };
+    int64_t wide = int64_t(sw) * alignedH_;
+    int64_t tall = int64_t(sh) * alignedW_;
+    if (std::abs(wide - tall) * 100 > std::max(wide, tall) * LETTERBOX_TOLERANCE_PERCENT) {
+        // NV12 的色度按 2x2 采样，黑边和内容的边界取偶数
+        if (wide > tall) {
+            LONG h = LONG(int64_t(sh) * alignedW_ / sw) & ~1;
+            dst.top = ((alignedH_ - h) / 2) & ~1;
+            dst.bottom = dst.top + h;
+        } else {
+            LONG w = LONG(int64_t(sw) * alignedH_ / sh) & ~1;
+            dst.left = ((alignedW_ - w) / 2) & ~1;
+            dst.right = dst.left + w;
+        }
+    }
+
+    srcRect_ = src;
+    dstRect_ = dst;
+    videoContext_->VideoProcessorSetStreamSourceRect(videoProcessor_, 0, TRUE, &srcRect_);
+    videoContext_->VideoProcessorSetStreamDestRect(videoProcessor_, 0, TRUE, &dstRect_);
+    // 整幅图像都变了，下一帧整帧转换和回读
+    nv12Valid_ = false;
+
+    std::cout << "[MediaEncoder] Source " << sw << "x" << sh << " at (" << src.left << "," << src.top
+              << ") -> (" << dst.left << "," << dst.top << ")-(" << dst.right << "," << dst.bottom << ")" << std::endl;
+    return true;
+}
+
+RECT MediaEncoder::sourceRect() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return srcRect_;
+}
+
+RECT MediaEncoder::contentRect() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    // 铺满时按编码分辨率换算，与客户端看到的图像尺寸一致
+    if (dstRect_.left == 0 && dstRect_.top == 0 && dstRect_.right == alignedW_ && dstRect_.bottom == alignedH_)
+        return { 0, 0, width_, height_ };
+    return dstRect_;
+}
+
+bool MediaEncoder::hasHeldFrame() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return initialized_ && nv12Valid_;
+}
+
+bool MediaEncoder::encodeHeld(int64_t pts, BufferRef& output, size_t headroom, bool keyframe, int refinePass) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    output.reset();
+    if (!initialized_ || !nv12Valid_) return false;
+
+    int qp = 0;
+    if (refinePass >= 0) {
+        qp = REFINE_MAX_QP[std::min(refinePass, REFINE_PASSES - 1)];
+        setQualityLocked(qp, bitrate_ * REFINE_BITRATE_FACTOR);
+    }
+    bool ok = createInputSample(nv12Buf_.data(), pts, keyframe, qp);
+    if (ok) processOutput(output, headroom);
+    if (refinePass >= 0) setQualityLocked(DEFAULT_MAX_QP, bitrate_);
+    return ok;
+}
+
+void MediaEncoder::setQualityLocked(int maxQp, int bitrate) {
+    ICodecAPI* codecApi = nullptr;
+    if (!encoder_ || FAILED(encoder_->QueryInterface(IID_PPV_ARGS(&codecApi)))) return;
+    // 码率控制模式下单帧 QP 提示可能被忽略，QP 上限和放宽的码率才能保证精化帧的质量；
+    // 不支持动态修改的编码器照常编码，只是精化效果有限
+    VARIANT var;
+    var.vt = VT_UI4;
+    var.ulVal = static_cast<ULONG>(maxQp);
+    codecApi->SetValue(&CODECAPI_AVEncVideoMaxQP, &var);
+    var.ulVal = static_cast<ULONG>(bitrate);
+    codecApi->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &var);
+    codecApi->Release();
+}
+
+void MediaEncoder::processOutput(BufferRef& output, size_t headroom) {
+    // 编码输出通常只有一个样本，直接从 MF 缓冲拷进池化缓冲
+    processOutput([&](const uint8_t* data, size_t size) {
+        size_t oldSize = output ? output.size() : headroom;
+        BufferRef grown = BufferPool::shared().acquire(oldSize + size);
+        if (output) memcpy(grown.data(), output.data(), oldSize);
+        memcpy(grown.data() + oldSize, data, size);
+        output = std::move(grown);
+    });
+}
+
+bool MediaEncoder::submitTexture(ID3D11Texture2D* bgraTex, int64_t pts, bool keyframe, const FrameChanges* changes) {
     HRESULT hr;
+    // 这一帧的变化没能读回时，下一帧要整帧处理才不会留下旧画面
+    bool wasValid = nv12Valid_;
+    nv12Valid_ = false;
 
     D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC ivDesc = {};
     ivDesc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
@@ -260,11 +394,17 @@ bool MediaEncoder::encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts,
         return false;
     }
 
-    d3dContext_->CopyResource(nv12Staging_, nv12Texture_);
+    // GPU 上的颜色转换很便宜，真正的开销在回读：只把变化的区域拷到暂存纹理并读回
+    std::vector<D3D11_BOX> boxes;
+    bool partial = wasValid && changedBoxes(changes, boxes);
+    if (partial) {
+        for (const D3D11_BOX& box : boxes)
+            d3dContext_->CopySubresourceRegion(nv12Staging_, 0, box.left, box.top, 0, nv12Texture_, 0, &box);
+    } else {
+        d3dContext_->CopyResource(nv12Staging_, nv12Texture_);
+    }
 
     size_t ySize = size_t(alignedW_) * alignedH_;
-    size_t uvSize = ySize / 2;
-    std::vector<uint8_t> nv12Buf(ySize + uvSize);
 
     D3D11_MAPPED_SUBRESOURCE mapped = {};
     hr = d3dContext_->Map(nv12Staging_, 0, D3D11_MAP_READ, 0, &mapped);
@@ -274,28 +414,68 @@ bool MediaEncoder::encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts,
     }
 
     uint8_t* base = (uint8_t*)mapped.pData;
-    for (int y = 0; y < alignedH_; y++)
-        memcpy(nv12Buf.data() + y * alignedW_, base + y * mapped.RowPitch, alignedW_);
-
     uint8_t* uvSrc = base + mapped.RowPitch * alignedH_;
     UINT uvRowPitch = (alignedW_ / 2) * 2;
-    for (int y = 0; y < alignedH_ / 2; y++)
-        memcpy(nv12Buf.data() + ySize + y * uvRowPitch,
-               uvSrc + y * mapped.RowPitch, uvRowPitch);
+    if (partial) {
+        // NV12 的 UV 交错存放，偶数对齐的区域在 UV 平面上是同样的字节列、一半的行
+        for (const D3D11_BOX& box : boxes) {
+            size_t rowBytes = box.right - box.left;
+            for (UINT y = box.top; y < box.bottom; y++)
+                memcpy(nv12Buf_.data() + size_t(y) * alignedW_ + box.left,
+                       base + size_t(y) * mapped.RowPitch + box.left, rowBytes);
+            for (UINT y = box.top / 2; y < box.bottom / 2; y++)
+                memcpy(nv12Buf_.data() + ySize + size_t(y) * uvRowPitch + box.left,
+                       uvSrc + size_t(y) * mapped.RowPitch + box.left, rowBytes);
+        }
+    } else {
+        for (int y = 0; y < alignedH_; y++)
+            memcpy(nv12Buf_.data() + y * alignedW_, base + y * mapped.RowPitch, alignedW_);
+        for (int y = 0; y < alignedH_ / 2; y++)
+            memcpy(nv12Buf_.data() + ySize + y * uvRowPitch,
+                   uvSrc + y * mapped.RowPitch, uvRowPitch);
+    }
 
     d3dContext_->Unmap(nv12Staging_, 0);
+    nv12Valid_ = true;
 
-    if (!createInputSample(nv12Buf.data(), pts, keyframe)) {
+    if (!createInputSample(nv12Buf_.data(), pts, keyframe)) {
         std::cerr << "[MediaEncoder] createInputSample failed" << std::endl;
         return false;
     }
 
-    output.clear();
-    processOutput(output);
-
     return true;
 }
 
+bool MediaEncoder::changedBoxes(const FrameChanges* changes, std::vector<D3D11_BOX>& boxes) const {
+    boxes.clear();
+    int sw = srcRect_.right - srcRect_.left;
+    int sh = srcRect_.bottom - srcRect_.top;
+    int dw = dstRect_.right - dstRect_.left;
+    int dh = dstRect_.bottom - dstRect_.top;
+    if (!changes || changes->full || sw <= 0 || sh <= 0) return false;
+
+    // 视频处理器把采集图像的源区域缩放到 NV12 纹理的目标区域上；CPU 路径两者都是整幅
+    int64_t area = 0;
+    for (const RECT& d : changes->dirty) {
+        RECT r;
+        if (!IntersectRect(&r, &d, &srcRect_)) continue;
+        r.left -= srcRect_.left; r.right -= srcRect_.left;
+        r.top -= srcRect_.top; r.bottom -= srcRect_.top;
+        int x0 = dstRect_.left + int(int64_t(r.left) * dw / sw) - CHANGE_MARGIN;
+        int y0 = dstRect_.top + int(int64_t(r.top) * dh / sh) - CHANGE_MARGIN;
+        int x1 = dstRect_.left + int((int64_t(r.right) * dw + sw - 1) / sw) + CHANGE_MARGIN;
+        int y1 = dstRect_.top + int((int64_t(r.bottom) * dh + sh - 1) / sh) + CHANGE_MARGIN;
+        x0 = std::max(0, x0 & ~(CHANGE_ALIGN - 1));
+        y0 = std::max(0, y0 & ~(CHANGE_ALIGN - 1));
+        x1 = std::min(alignedW_, (x1 + CHANGE_ALIGN - 1) & ~(CHANGE_ALIGN - 1));
+        y1 = std::min(alignedH_, (y1 + CHANGE_ALIGN - 1) & ~(CHANGE_ALIGN - 1));
+        if (x0 >= x1 || y0 >= y1) continue;
+        boxes.push_back({ UINT(x0), UINT(y0), 0, UINT(x1), UINT(y1), 1 });
+        area += int64_t(x1 - x0) * (y1 - y0);
+    }
+    return area * 100 <= int64_t(alignedW_) * alignedH_ * FULL_FRAME_PERCENT;
+}
+
 bool MediaEncoder::initEncoder() {
     HRESULT hr;
 
@@ -355,14 +535,30 @@ bool MediaEncoder::initEncoder() {
     if (SUCCEEDED(encoder_->QueryInterface(IID_PPV_ARGS(&rcApi)))) {
         VARIANT var;
         var.vt = VT_UI4;
-        var.ulVal = eAVEncCommonRateControlMode_Quality;
-        rcApi->SetValue(&CODECAPI_AVEncCommonRateControlMode, &var);
-        var.ulVal = 100;
-        rcApi->SetValue(&CODECAPI_AVEncCommonQuality, &var);
+        if (bitrateDriven_) {
+            // 码率要跟随带宽估计，质量模式会忽略目标码率；优先低延迟 VBR，不支持时退回 CBR
+            var.ulVal = eAVEncCommonRateControlMode_LowDelayVBR;
+            if (FAILED(rcApi->SetValue(&CODECAPI_AVEncCommonRateControlMode, &var))) {
+                var.ulVal = eAVEncCommonRateControlMode_CBR;
+                rcApi->SetValue(&CODECAPI_AVEncCommonRateControlMode, &var);
+            }
+            var.ulVal = static_cast<ULONG>(bitrate_);
+            rcApi->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &var);
+        } else {
+            // 没有带宽估计驱动时保持原来的质量模式
+            var.ulVal = eAVEncCommonRateControlMode_Quality;
+            rcApi->SetValue(&CODECAPI_AVEncCommonRateControlMode, &var);
+            var.ulVal = 100;
+            rcApi->SetValue(&CODECAPI_AVEncCommonQuality, &var);
+        }
         var.ulVal = 100;
         rcApi->SetValue(&CODECAPI_AVEncCommonQualityVsSpeed, &var);
         rcApi->Release();
-        std::cout << "[MediaEncoder] Quality mode (VBR, Q=100, QvS=100) set before SetOutputType" << std::endl;
+        if (bitrateDriven_)
+            std::cout << "[MediaEncoder] Bitrate-driven rate control (" << bitrate_ / 1000
+                      << " kbps) set before SetOutputType" << std::endl;
+        else
+            std::cout << "[MediaEncoder] Quality mode (VBR, Q=100, QvS=100) set before SetOutputType" << std::endl;
     }
 
     IMFMediaType* outputType = nullptr;
@@ -432,7 +628,7 @@ bool MediaEncoder::initEncoder() {
     return true;
 }
 
-bool MediaEncoder::createInputSample(const uint8_t* nv12Data, int64_t pts, bool keyframe) {
+bool MediaEncoder::createInputSample(const uint8_t* nv12Data, int64_t pts, bool keyframe, int qp) {
     size_t bufSize = size_t(alignedW_) * alignedH_ * 3 / 2;
 
     IMFSample* sample = nullptr;
@@ -460,6 +656,9 @@ bool MediaEncoder::createInputSample(const uint8_t* nv12Data, int64_t pts, bool
     if (keyframe) {
         sample->SetUINT32(CODECAPI_AVEncVideoForceKeyFrame, TRUE);
     }
+    if (qp > 0) {
+        sample->SetUINT64(MFSampleExtension_VideoEncodeQP, static_cast<UINT64>(qp));
+    }
 
     hr = encoder_->ProcessInput(0, sample, 0);
 
@@ -483,20 +682,29 @@ bool MediaEncoder::createInputSample(const uint8_t* nv12Data, int64_t pts, bool
     return true;
 }
 
-bool MediaEncoder::encode(const uint8_t* bgra, int64_t pts, std::vector<uint8_t>& output, bool keyframe) {
+bool MediaEncoder::encode(const uint8_t* bgra, int64_t pts, std::vector<uint8_t>& output, bool keyframe,
+                          const FrameChanges* changes) {
     std::lock_guard<std::mutex> lock(mtx_);
     output.clear();
     if (!initialized_) return false;
 
     size_t ySize = size_t(alignedW_) * alignedH_;
-    size_t uvSize = ySize / 2;
-    std::vector<uint8_t> nv12Buf(ySize + uvSize);
-    uint8_t* yPlane = nv12Buf.data();
-    uint8_t* uvPlane = nv12Buf.data() + ySize;
-
-    bgraToNv12(bgra, srcWidth_, srcHeight_, yPlane, uvPlane, alignedW_, alignedH_);
+    uint8_t* yPlane = nv12Buf_.data();
+    uint8_t* uvPlane = nv12Buf_.data() + ySize;
+
+    // 光标闪烁之类的小变化只转换受影响的宏块
+    std::vector<D3D11_BOX> boxes;
+    if (nv12Valid_ && changedBoxes(changes, boxes)) {
+        for (const D3D11_BOX& box : boxes)
+            bgraToNv12(bgra, srcWidth_, srcHeight_, yPlane, uvPlane, alignedW_, alignedH_,
+                       box.left, box.top, box.right, box.bottom);
+    } else {
+        bgraToNv12(bgra, srcWidth_, srcHeight_, yPlane, uvPlane, alignedW_, alignedH_,
+                   0, 0, alignedW_, alignedH_);
+    }
+    nv12Valid_ = true;
 
-    if (!createInputSample(nv12Buf.data(), pts, keyframe)) {
+    if (!createInputSample(nv12Buf_.data(), pts, keyframe)) {
         return false;
     }
 
@@ -506,6 +714,13 @@ bool MediaEncoder::encode(const uint8_t* bgra, int64_t pts, std::vector<uint8_t>
 }
 
 bool MediaEncoder::processOutput(std::vector<uint8_t>& output) {
+    return processOutput([&](const uint8_t* data, size_t size) {
+        output.insert(output.end(), data, data + size);
+    });
+}
+
+bool MediaEncoder::processOutput(const OutputSink& sink) {
+    bool gotOutput = false;
     MFT_OUTPUT_STREAM_INFO streamInfo = {};
     encoder_->GetOutputStreamInfo(0, &streamInfo);
     while (true) {
@@ -552,9 +767,8 @@ bool MediaEncoder::processOutput(std::vector<uint8_t>& output) {
                 DWORD curLen = 0;
                 hr = buf->Lock(&dataPtr, nullptr, &curLen);
                 if (SUCCEEDED(hr) && curLen > 0) {
-                    size_t oldSize = output.size();
-                    output.resize(oldSize + curLen);
-                    memcpy(output.data() + oldSize, dataPtr, curLen);
+                    sink(dataPtr, curLen);
+                    gotOutput = true;
                     buf->Unlock();
                 }
                 buf->Release();
@@ -567,7 +781,7 @@ bool MediaEncoder::processOutput(std::vector<uint8_t>& output) {
         break;
     }
 
-    return !output.empty();
+    return gotOutput;
 }
 
 bool MediaEncoder::flushEncoder(std::vector<uint8_t>& output) {
@@ -577,6 +791,26 @@ bool MediaEncoder::flushEncoder(std::vector<uint8_t>& output) {
     return true;
 }
 
+bool MediaEncoder::setBitrate(int bitrate) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!encoder_ || !bitrateDriven_ || bitrate <= 0) return false;
+    if (bitrate == bitrate_) return true;
+
+    ICodecAPI* codecApi = nullptr;
+    if (FAILED(encoder_->QueryInterface(IID_PPV_ARGS(&codecApi)))) return false;
+    VARIANT var;
+    var.vt = VT_UI4;
+    var.ulVal = static_cast<ULONG>(bitrate);
+    HRESULT hr = codecApi->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &var);
+    codecApi->Release();
+    if (FAILED(hr)) {
+        std::cerr << "[MediaEncoder] Dynamic bitrate change failed: 0x" << std::hex << hr << std::dec << std::endl;
+        return false;
+    }
+    bitrate_ = bitrate;
+    return true;
+}
+
 void MediaEncoder::cleanup() {
     std::lock_guard<std::mutex> lock(mtx_);
 
@@ -604,6 +838,8 @@ void MediaEncoder::cleanup() {
     MFShutdown();
 
     srcWidth_ = srcHeight_ = width_ = height_ = 0;
+    nv12Buf_.clear();
+    nv12Valid_ = false;
     hasGPUPath_ = false;
     initialized_ = false;
 }
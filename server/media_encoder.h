@@ -5,8 +5,11 @@
 #include <vector>
 #include <mutex>
 #include <cstdint>
+#include <functional>
 #include <d3d11.h>
+#include "../common/buffer_pool.h"
 
+struct FrameChanges;
 struct IMFTransform;
 struct IMFMediaType;
 struct IMFSample;
@@ -16,11 +19,41 @@ public:
     MediaEncoder();
     ~MediaEncoder();
 
-    bool init(ID3D11Device* device, int srcW, int srcH, int dstW, int dstH, int fps, int bitrate = 3000000);
+    // bitrateDriven 为 false 时用质量模式（固定质量，码率随画面内容变化），bitrate 只作参考；
+    // 为 true 时按 bitrate 做低延迟码率控制，之后可用 setBitrate 跟随带宽估计
+    bool init(ID3D11Device* device, int srcW, int srcH, int dstW, int dstH, int fps, int bitrate = 3000000,
+              bool bitrateDriven = false);
     void cleanup();
 
-    bool encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts, std::vector<uint8_t>& output, bool keyframe = false);
-    bool encode(const uint8_t* bgra, int64_t pts, std::vector<uint8_t>& output, bool keyframe = false);
+    // changes 为采集层给出的变化区域：只转换/回读这些区域，其余沿用上一帧的 NV12；
+    // 为空或整帧变化时全部处理
+    bool encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts, std::vector<uint8_t>& output, bool keyframe = false,
+                           const FrameChanges* changes = nullptr);
+    // 输出直接写入池化缓冲，前 headroom 字节留给调用方填消息头
+    bool encodeFromTexture(ID3D11Texture2D* bgraTex, int64_t pts, BufferRef& output, size_t headroom, bool keyframe = false,
+                           const FrameChanges* changes = nullptr);
+    bool encode(const uint8_t* bgra, int64_t pts, std::vector<uint8_t>& output, bool keyframe = false,
+                const FrameChanges* changes = nullptr);
+    // 画面没有变化时重编码上一帧的图像，不需要新的纹理，也不回读。
+    // refinePass >= 0 为静止画面的精化帧：QP 上限逐遍降低、码率临时放宽，文字逐步变清晰；
+    // 小于 0 时按正常质量编码（例如给静止时加入的观看者补一个关键帧）
+    bool encodeHeld(int64_t pts, BufferRef& output, size_t headroom, bool keyframe, int refinePass = -1);
+    bool hasHeldFrame();
+    static constexpr int REFINE_PASSES = 2;
+
+    // 只编码采集画面中的一块区域（多显示器时的某一个），保持原比例缩放、居中，其余填黑；
+    // 只改视频处理器的源/目标矩形，编码器不重建。没有 GPU 路径时总是编码整幅画面
+    bool setSourceRect(const RECT& rect);
+    RECT sourceRect();
+    // 画面内容在编码图像中的位置，用来把客户端坐标换算回采集坐标
+    RECT contentRect();
+    int sourceWidth() const { return srcWidth_; }
+    int sourceHeight() const { return srcHeight_; }
+
+    // 运行中调整目标码率，不重建编码器；质量模式或编码器不支持动态码率时返回 false
+    bool setBitrate(int bitrate);
+    int bitrate() const { return bitrate_; }
+    bool bitrateDriven() const { return bitrateDriven_; }
 
     bool initialized() const { return initialized_; }
     bool hasGPUPath() const { return hasGPUPath_; }
@@ -30,8 +63,19 @@ public:
 private:
     bool initEncoder();
     bool initVideoProcessor();
+    using OutputSink = std::function<void(const uint8_t* data, size_t size)>;
+
+    bool submitTexture(ID3D11Texture2D* bgraTex, int64_t pts, bool keyframe, const FrameChanges* changes);
+    // 把采集分辨率下的变化区域换算到 NV12 缓冲上，外扩并按宏块对齐；
+    // 返回 false 表示应按整帧处理（没有区域信息或变化面积过大）
+    bool changedBoxes(const FrameChanges* changes, std::vector<D3D11_BOX>& boxes) const;
     bool processOutput(std::vector<uint8_t>& output);
-    bool createInputSample(const uint8_t* nv12Data, int64_t pts, bool keyframe);
+    bool processOutput(const OutputSink& sink);
+    void processOutput(BufferRef& output, size_t headroom);
+    // qp 大于 0 时作为本帧的量化参数提示
+    bool createInputSample(const uint8_t* nv12Data, int64_t pts, bool keyframe, int qp = 0);
+    // 精化期间临时调整 QP 上限和平均码率，结束后恢复
+    void setQualityLocked(int maxQp, int bitrate);
     bool flushEncoder(std::vector<uint8_t>& output);
 
     ID3D11Device* d3dDevice_ = nullptr;
@@ -51,12 +95,31 @@ private:
 
     int srcWidth_ = 0;
     int srcHeight_ = 0;
+    RECT srcRect_ = {};     // 采集画面中要编码的区域
+    RECT dstRect_ = {};     // 它在 NV12 图像（对齐尺寸）中的位置
+    // 源区域与编码图像的宽高比相差不到这个比例时直接拉伸，不留黑边
+    static constexpr int LETTERBOX_TOLERANCE_PERCENT = 3;
     int width_ = 0;
     int height_ = 0;
     int alignedW_ = 0;
     int alignedH_ = 0;
     int fps_ = 0;
     int bitrate_ = 3000000;
+    bool bitrateDriven_ = false;
+
+    // 上一帧的 NV12 图像，部分更新时其余区域直接沿用
+    std::vector<uint8_t> nv12Buf_;
+    bool nv12Valid_ = false;
+    // 缩放和边缘增强会影响变化区域周围几个像素
+    static constexpr int CHANGE_MARGIN = 4;
+    static constexpr int CHANGE_ALIGN = 16;
+    // 变化区域超过画面的一半时整帧处理更省事
+    static constexpr int FULL_FRAME_PERCENT = 50;
+
+    // 每一遍精化的 QP 上限（H.264 的 QP 范围 0~51）
+    static constexpr int REFINE_MAX_QP[REFINE_PASSES] = { 24, 18 };
+    static constexpr int DEFAULT_MAX_QP = 51;
+    static constexpr int REFINE_BITRATE_FACTOR = 4;
 
     bool initialized_ = false;
     bool hasGPUPath_ = false;
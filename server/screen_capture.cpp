@@ -1,6 +1,9 @@
 
+#define NOMINMAX
 #include "screen_capture.h"
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 ScreenCapture::ScreenCapture() {}
 
@@ -38,26 +41,103 @@ bool ScreenCapture::initDuplication() {
     dxgiDev->Release();
     if (FAILED(hr)) return false;
 
-    IDXGIOutput* output = nullptr;
-    hr = adapter->EnumOutputs(0, &output);
+    // 复制只能在创建设备的适配器上进行，接在其他显卡上的显示器不在列表里
+    std::vector<Output> outputs;
+    for (UINT i = 0; ; i++) {
+        IDXGIOutput* output = nullptr;
+        if (FAILED(adapter->EnumOutputs(i, &output))) break;
+
+        DXGI_OUTPUT_DESC desc;
+        output->GetDesc(&desc);
+        IDXGIOutput1* output1 = nullptr;
+        hr = desc.AttachedToDesktop ? output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1) : E_FAIL;
+        output->Release();
+        if (FAILED(hr)) continue;
+
+        Output o;
+        hr = output1->DuplicateOutput(device_, &o.duplication);
+        output1->Release();
+        if (FAILED(hr)) {
+            std::cerr << "[Capture] DuplicateOutput failed for output " << i
+                      << ", hr=0x" << std::hex << hr << std::dec << std::endl;
+            continue;
+        }
+        o.desktop = desc.DesktopCoordinates;
+        o.width = desc.DesktopCoordinates.right - desc.DesktopCoordinates.left;
+        o.height = desc.DesktopCoordinates.bottom - desc.DesktopCoordinates.top;
+        outputs.push_back(o);
+    }
     adapter->Release();
-    if (FAILED(hr)) return false;
+    if (outputs.empty()) return false;
+
+    RECT box = outputs[0].desktop;
+    for (const Output& o : outputs) {
+        box.left = std::min(box.left, o.desktop.left);
+        box.top = std::min(box.top, o.desktop.top);
+        box.right = std::max(box.right, o.desktop.right);
+        box.bottom = std::max(box.bottom, o.desktop.bottom);
+    }
+    origin_ = { box.left, box.top };
+    width_ = box.right - box.left;
+    height_ = box.bottom - box.top;
+
+    int primary = 0;
+    monitors_.clear();
+    for (size_t i = 0; i < outputs.size(); i++) {
+        Output& o = outputs[i];
+        o.offset = { o.desktop.left - box.left, o.desktop.top - box.top };
+        // 主显示器的左上角就是虚拟桌面的原点
+        bool isPrimary = o.desktop.left == 0 && o.desktop.top == 0;
+        if (isPrimary) primary = static_cast<int>(i);
+        monitors_.push_back({ o.desktop, isPrimary });
+    }
+    outputs_ = std::move(outputs);
 
-    DXGI_OUTPUT_DESC desc;
-    output->GetDesc(&desc);
+    if (!ensureCanvas()) {
+        cleanupDuplicationOnly();
+        return false;
+    }
 
-    IDXGIOutput1* output1 = nullptr;
-    hr = output->QueryInterface(__uuidof(IDXGIOutput1), (void**)&output1);
-    output->Release();
-    if (FAILED(hr)) return false;
+    // 首次默认主显示器；重建后原来的显示器不在了也回到主显示器
+    if (layoutVersion_ == 0 || (selected_ != SPAN && selected_ >= static_cast<int>(outputs_.size())))
+        selected_ = primary;
+    layoutVersion_++;
 
-    hr = output1->DuplicateOutput(device_, &duplication_);
-    output1->Release();
-    if (FAILED(hr)) return false;
+    useGDI_ = false;
+    initialized_ = true;
+    forceFull_ = true;
 
-    width_ = desc.DesktopCoordinates.right - desc.DesktopCoordinates.left;
-    height_ = desc.DesktopCoordinates.bottom - desc.DesktopCoordinates.top;
+    std::cout << "[Capture] DXGI initialized: "
+            << width_ << "x" << height_
+            << ", " << outputs_.size() << " monitor(s)"
+            << ", bufferSize=" << size_t(width_) * height_ * 4
+            << std::endl;
+    for (size_t i = 0; i < monitors_.size(); i++) {
+        const RECT& r = monitors_[i].desktop;
+        std::cout << "[Capture]   #" << i << " " << r.right - r.left << "x" << r.bottom - r.top
+                  << " at (" << r.left << "," << r.top << ")"
+                  << (monitors_[i].primary ? " primary" : "")
+                  << (static_cast<int>(i) == selected_ ? " selected" : "") << std::endl;
+    }
+    return true;
+}
+
+bool ScreenCapture::ensureCanvas() {
+    // 布局变化后画布尺寸可能不同，旧的纹理和回读缓冲作废
+    auto sameSize = [this](ID3D11Texture2D* tex) {
+        D3D11_TEXTURE2D_DESC d;
+        tex->GetDesc(&d);
+        return static_cast<int>(d.Width) == width_ && static_cast<int>(d.Height) == height_;
+    };
+    if (gpuCopyTexture_ && !sameSize(gpuCopyTexture_)) {
+        gpuCopyTexture_->Release(); gpuCopyTexture_ = nullptr;
+        if (!useGDI_ && frameBuffer_) { delete[] frameBuffer_; frameBuffer_ = nullptr; }
+    }
+    if (stagingTexture_ && !sameSize(stagingTexture_)) {
+        stagingTexture_->Release(); stagingTexture_ = nullptr;
+    }
 
+    HRESULT hr;
     if (!stagingTexture_) {
         D3D11_TEXTURE2D_DESC td = {};
         td.Width = width_;
@@ -69,13 +149,11 @@ bool ScreenCapture::initDuplication() {
         td.Usage = D3D11_USAGE_STAGING;
         td.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
         hr = device_->CreateTexture2D(&td, nullptr, &stagingTexture_);
-        if (FAILED(hr)) {
-            duplication_->Release(); duplication_ = nullptr;
-            return false;
-        }
+        if (FAILED(hr)) return false;
     }
 
     if (!gpuCopyTexture_) {
+        // 新建的纹理内容为零，显示器没有覆盖到的画布区域拼接时是黑色
         D3D11_TEXTURE2D_DESC gpuDesc = {};
         gpuDesc.Width = width_;
         gpuDesc.Height = height_;
@@ -88,7 +166,6 @@ bool ScreenCapture::initDuplication() {
         hr = device_->CreateTexture2D(&gpuDesc, nullptr, &gpuCopyTexture_);
         if (FAILED(hr)) {
             stagingTexture_->Release(); stagingTexture_ = nullptr;
-            duplication_->Release(); duplication_ = nullptr;
             return false;
         }
     }
@@ -97,14 +174,6 @@ bool ScreenCapture::initDuplication() {
         frameBuffer_ = new uint8_t[size_t(width_) * height_ * 4];
         memset(frameBuffer_, 0, size_t(width_) * height_ * 4);
     }
-
-    useGDI_ = false;
-    initialized_ = true;
-
-    std::cout << "[Capture] DXGI initialized: "
-            << width_ << "x" << height_
-            << ", bufferSize=" << size_t(width_) * height_ * 4
-            << std::endl;
     return true;
 }
 
@@ -135,6 +204,12 @@ bool ScreenCapture::initGDI() {
     useGDI_ = true;
     initialized_ = true;
 
+    // GDI 只截主显示器
+    monitors_.assign(1, { RECT{ 0, 0, width_, height_ }, true });
+    selected_ = 0;
+    origin_ = { 0, 0 };
+    layoutVersion_++;
+
     std::cout << "[Capture] GDI: " << width_ << "x" << height_ << std::endl;
     return true;
 }
@@ -156,8 +231,11 @@ void ScreenCapture::cleanup() {
     initialized_ = false;
 }
 
-const uint8_t* ScreenCapture::capture(bool& hasNew) {
+const uint8_t* ScreenCapture::capture(bool& hasNew, FrameChanges* changes) {
     hasNew = false;
+    FrameChanges local;
+    FrameChanges& ch = changes ? *changes : local;
+    ch.setFull();
     if (!initialized_) return nullptr;
 
     if (useGDI_) {
@@ -166,112 +244,337 @@ const uint8_t* ScreenCapture::capture(bool& hasNew) {
         return frameBuffer_;
     }
 
-    if (frameAcquired_) {
-        duplication_->ReleaseFrame();
-        frameAcquired_ = false;
-    }
-
-    DXGI_OUTDUPL_FRAME_INFO fi;
-    IDXGIResource* res = nullptr;
-    HRESULT hr = duplication_->AcquireNextFrame(16, &fi, &res);
-
-    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-        return frameBuffer_;
-    }
-
-    if (hr == DXGI_ERROR_ACCESS_LOST) {
+    bool lost = false;
+    bool changed = acquire(ch, lost);
+    if (lost) {
         std::cerr << "[Capture] DXGI access lost, recreating duplication" << std::endl;
         resetDXGI();
+        ch.setFull();
         return nullptr;
     }
-
-    if (FAILED(hr)) {
-        static int failCount = 0;
-        if (++failCount % 60 == 0) {
-            std::cerr << "[Capture] DXGI AcquireNextFrame failed, hr=0x"
-                    << std::hex << hr << std::dec << std::endl;
-        }
-
-        return nullptr;
-    }
-
-    frameAcquired_ = true;
+    if (!changed) return frameBuffer_;
     hasNew = true;
 
-    ID3D11Texture2D* tex = nullptr;
-    hr = res->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&tex);
-    res->Release();
-    if (FAILED(hr)) return frameBuffer_;
-
-    context_->CopyResource(stagingTexture_, tex);
-    tex->Release();
+    // 画布上变化的部分拷到暂存纹理再读回；暂存纹理和 frameBuffer_ 里其余区域仍是上一帧的内容
+    std::vector<RECT> rects;
+    if (ch.full) rects.push_back({ 0, 0, width_, height_ });
+    else rects = ch.dirty;
+    for (const RECT& r : rects) {
+        D3D11_BOX box = { static_cast<UINT>(r.left), static_cast<UINT>(r.top), 0,
+                          static_cast<UINT>(r.right), static_cast<UINT>(r.bottom), 1 };
+        context_->CopySubresourceRegion(stagingTexture_, 0, r.left, r.top, 0, gpuCopyTexture_, 0, &box);
+    }
 
     D3D11_MAPPED_SUBRESOURCE mapped;
     if (SUCCEEDED(context_->Map(stagingTexture_, 0, D3D11_MAP_READ, 0, &mapped))) {
-        if (mapped.RowPitch == width_ * 4) {
+        if (ch.full && mapped.RowPitch == UINT(width_) * 4) {
             memcpy(frameBuffer_, mapped.pData, size_t(width_) * height_ * 4);
         } else {
-            for (int y = 0; y < height_; y++) {
-                memcpy(frameBuffer_ + y * width_ * 4,
-                       (uint8_t*)mapped.pData + y * mapped.RowPitch, width_ * 4);
+            for (const RECT& r : rects) {
+                size_t rowBytes = size_t(r.right - r.left) * 4;
+                for (LONG y = r.top; y < r.bottom; y++) {
+                    memcpy(frameBuffer_ + (size_t(y) * width_ + r.left) * 4,
+                           (uint8_t*)mapped.pData + size_t(y) * mapped.RowPitch + size_t(r.left) * 4, rowBytes);
+                }
             }
         }
         context_->Unmap(stagingTexture_, 0);
+    } else {
+        forceFull_ = true;
     }
 
     return frameBuffer_;
 }
 
-bool ScreenCapture::captureTexture(ID3D11Texture2D** outTex) {
+bool ScreenCapture::captureTexture(ID3D11Texture2D** outTex, FrameChanges* changes) {
+    FrameChanges local;
+    FrameChanges& ch = changes ? *changes : local;
+    ch.setFull();
     if (!outTex) return false;
     *outTex = nullptr;
     if (!initialized_ || useGDI_) return false;
 
-    if (frameAcquired_) {
-        duplication_->ReleaseFrame();
-        frameAcquired_ = false;
+    bool lost = false;
+    bool changed = acquire(ch, lost);
+    if (lost) {
+        resetDXGI();
+        ch.setFull();
+        return false;
     }
+    // 光标闪烁、指针移动、其他显示器的变化都不产生新画面，也就不必转换和编码
+    if (!changed) return false;
 
-    DXGI_OUTDUPL_FRAME_INFO fi;
-    IDXGIResource* res = nullptr;
-    HRESULT hr = duplication_->AcquireNextFrame(16, &fi, &res);
+    *outTex = gpuCopyTexture_;
+    return true;
+}
 
-    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-        return false;
+bool ScreenCapture::selectMonitor(int index) {
+    if (index != SPAN && (index < 0 || index >= static_cast<int>(monitors_.size()))) return false;
+    if (useGDI_) index = 0;
+    if (index == selected_) return true;
+    selected_ = index;
+    // 新区域在画布上一直是最新的，只是之前没有上报，下一帧整帧交给编码器
+    forceFull_ = true;
+    return true;
+}
+
+RECT ScreenCapture::region() const {
+    if (useGDI_ || selected_ == SPAN || selected_ >= static_cast<int>(outputs_.size()))
+        return { 0, 0, width_, height_ };
+    const Output& o = outputs_[selected_];
+    return { o.offset.x, o.offset.y, o.offset.x + o.width, o.offset.y + o.height };
+}
+
+bool ScreenCapture::inSelection(size_t index) const {
+    return selected_ == SPAN || static_cast<int>(index) == selected_;
+}
+
+bool ScreenCapture::acquire(FrameChanges& out, bool& lost) {
+    out.full = false;
+    out.dirty.clear();
+    out.moves.clear();
+    if (outputs_.empty()) return false;
+
+    // 先在选中的（拼接时为第一个）显示器上等新帧，其余显示器只取已就绪的，
+    // 选择之外的变化照样拷进画布，只是不上报
+    FrameChanges outside;
+    bool changed = false;
+    size_t first = selected_ == SPAN ? 0 : static_cast<size_t>(selected_);
+    for (size_t k = 0; k < outputs_.size() && !lost; k++) {
+        size_t i = (first + k) % outputs_.size();
+        bool mine = inSelection(i);
+        if (acquireOutput(i, k == 0 ? ACQUIRE_TIMEOUT_MS : 0, mine ? out : outside, lost) && mine)
+            changed = true;
+        outside.dirty.clear();
+        outside.moves.clear();
     }
+    if (lost) return false;
 
+    if (forceFull_) {
+        forceFull_ = false;
+        out.setFull();
+        return true;
+    }
+    return changed;
+}
+
+bool ScreenCapture::acquireOutput(size_t index, UINT timeoutMs, FrameChanges& out, bool& lost) {
+    Output& o = outputs_[index];
+    if (o.frameAcquired) {
+        o.duplication->ReleaseFrame();
+        o.frameAcquired = false;
+    }
+
+    DXGI_OUTDUPL_FRAME_INFO fi;
+    IDXGIResource* res = nullptr;
+    HRESULT hr = o.duplication->AcquireNextFrame(timeoutMs, &fi, &res);
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT) return false;
     if (hr == DXGI_ERROR_ACCESS_LOST) {
-        resetDXGI();
+        lost = true;
         return false;
     }
-
     if (FAILED(hr)) {
+        static int failCount = 0;
+        if (++failCount % 60 == 0) {
+            std::cerr << "[Capture] DXGI AcquireNextFrame failed, hr=0x"
+                    << std::hex << hr << std::dec << std::endl;
+        }
         return false;
     }
 
-    frameAcquired_ = true;
+    o.frameAcquired = true;
+    updateCursor(index, fi);
+    FrameChanges ch;
+    readChanges(o, fi, ch);
+    if (ch.unchanged()) {
+        // 只有指针变化：画面和上一帧相同，不做任何拷贝
+        res->Release();
+        return false;
+    }
 
     ID3D11Texture2D* tex = nullptr;
     hr = res->QueryInterface(__uuidof(ID3D11Texture2D), (void**)&tex);
     res->Release();
-    if (FAILED(hr)) return false;
+    if (FAILED(hr)) {
+        o.forceFull = true;
+        return false;
+    }
 
-    context_->CopyResource(gpuCopyTexture_, tex);
+    // 显示器坐标平移到画布上；整帧变化就是这个显示器的整块区域
+    const LONG ox = o.offset.x, oy = o.offset.y;
+    if (ch.full) {
+        ch.full = false;
+        ch.dirty.assign(1, RECT{ 0, 0, o.width, o.height });
+        ch.moves.clear();
+    }
+    for (const RECT& r : ch.dirty) {
+        D3D11_BOX box = { static_cast<UINT>(r.left), static_cast<UINT>(r.top), 0,
+                          static_cast<UINT>(r.right), static_cast<UINT>(r.bottom), 1 };
+        context_->CopySubresourceRegion(gpuCopyTexture_, 0, ox + r.left, oy + r.top, 0, tex, 0, &box);
+        out.dirty.push_back({ r.left + ox, r.top + oy, r.right + ox, r.bottom + oy });
+    }
+    for (DXGI_OUTDUPL_MOVE_RECT m : ch.moves) {
+        m.SourcePoint.x += ox;
+        m.SourcePoint.y += oy;
+        OffsetRect(&m.DestinationRect, ox, oy);
+        out.moves.push_back(m);
+    }
     tex->Release();
+    return true;
+}
 
-    *outTex = gpuCopyTexture_;
+void ScreenCapture::updateCursor(size_t index, const DXGI_OUTDUPL_FRAME_INFO& fi) {
+    Output& o = outputs_[index];
+    // LastMouseUpdateTime 为 0 表示这一帧指针没有变化。每个显示器各自报告指针是否在自己上面，
+    // 以最新的报告为准：指针移到别的显示器时，旧显示器报告不可见可能晚于新显示器报告可见
+    if (fi.LastMouseUpdateTime.QuadPart != 0) {
+        bool visible = fi.PointerPosition.Visible != FALSE;
+        bool owner = cursorOutput_ == static_cast<int>(index);
+        if (visible || (owner && fi.LastMouseUpdateTime.QuadPart >= cursorUpdateTime_.QuadPart)) {
+            // DXGI 给的是指针图像左上角相对该显示器的位置
+            POINT pos = { o.offset.x + fi.PointerPosition.Position.x + cursor_.hotSpot.x,
+                          o.offset.y + fi.PointerPosition.Position.y + cursor_.hotSpot.y };
+            if (visible != cursor_.visible || pos.x != cursor_.position.x || pos.y != cursor_.position.y) {
+                cursor_.visible = visible;
+                cursor_.position = pos;
+                cursor_.positionSerial++;
+            }
+            cursorOutput_ = static_cast<int>(index);
+            cursorUpdateTime_ = fi.LastMouseUpdateTime;
+        }
+    }
+
+    if (fi.PointerShapeBufferSize == 0) return;
+    pointerShape_.resize(fi.PointerShapeBufferSize);
+    UINT required = 0;
+    DXGI_OUTDUPL_POINTER_SHAPE_INFO info = {};
+    HRESULT hr = o.duplication->GetFramePointerShape(static_cast<UINT>(pointerShape_.size()),
+                                                     pointerShape_.data(), &required, &info);
+    if (FAILED(hr) || !convertPointerShape(info, pointerShape_.data())) return;
+
+    // 热点变了，位置跟着平移，客户端按热点对齐绘制
+    LONG dx = info.HotSpot.x - cursor_.hotSpot.x;
+    LONG dy = info.HotSpot.y - cursor_.hotSpot.y;
+    cursor_.hotSpot = info.HotSpot;
+    if (dx != 0 || dy != 0) {
+        cursor_.position.x += dx;
+        cursor_.position.y += dy;
+        cursor_.positionSerial++;
+    }
+    cursor_.shapeSerial++;
+}
+
+bool ScreenCapture::convertPointerShape(const DXGI_OUTDUPL_POINTER_SHAPE_INFO& info, const uint8_t* data) {
+    const bool mono = info.Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME;
+    const int w = static_cast<int>(info.Width);
+    // 单色指针上半是 AND 掩码、下半是 XOR 掩码
+    const int h = static_cast<int>(mono ? info.Height / 2 : info.Height);
+    if (w <= 0 || h <= 0 || w > MAX_POINTER_SIZE || h > MAX_POINTER_SIZE) return false;
+
+    std::vector<uint8_t> bgra(size_t(w) * h * 4, 0);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t* out = bgra.data() + (size_t(y) * w + x) * 4;
+            switch (info.Type) {
+                case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME: {
+                    uint8_t bit = static_cast<uint8_t>(0x80 >> (x % 8));
+                    bool andBit = (data[size_t(y) * info.Pitch + x / 8] & bit) != 0;
+                    bool xorBit = (data[size_t(y + h) * info.Pitch + x / 8] & bit) != 0;
+                    if (!andBit) {
+                        uint8_t v = xorBit ? 0xFF : 0x00;
+                        out[0] = out[1] = out[2] = v;
+                        out[3] = 0xFF;
+                    } else if (xorBit) {
+                        out[3] = 0xFF;      // 反色
+                    }
+                    break;
+                }
+                case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR:
+                    memcpy(out, data + size_t(y) * info.Pitch + size_t(x) * 4, 4);
+                    break;
+                case DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MASKED_COLOR: {
+                    // alpha 为 0 时直接用颜色，为 0xFF 时与屏幕异或：异或黑色等于透明，其余近似为反色
+                    const uint8_t* in = data + size_t(y) * info.Pitch + size_t(x) * 4;
+                    if (in[3] == 0) {
+                        memcpy(out, in, 3);
+                        out[3] = 0xFF;
+                    } else if (in[0] | in[1] | in[2]) {
+                        out[3] = 0xFF;
+                    }
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    cursor_.width = w;
+    cursor_.height = h;
+    cursor_.bgra = std::move(bgra);
     return true;
 }
 
-void ScreenCapture::cleanupDuplicationOnly() {
-    if (frameAcquired_ && duplication_) {
-        duplication_->ReleaseFrame();
-        frameAcquired_ = false;
+void ScreenCapture::readChanges(Output& o, const DXGI_OUTDUPL_FRAME_INFO& fi, FrameChanges& out) {
+    out.setFull();
+    if (o.forceFull) {
+        o.forceFull = false;
+        return;
+    }
+    // LastPresentTime 为 0 表示桌面图像没有更新，只有指针位置或形状变了
+    if (fi.LastPresentTime.QuadPart == 0) {
+        out.full = false;
+        return;
+    }
+    if (fi.TotalMetadataBufferSize == 0) return;
+
+    metadata_.resize(fi.TotalMetadataBufferSize);
+    UINT moveBytes = 0;
+    HRESULT hr = o.duplication->GetFrameMoveRects(static_cast<UINT>(metadata_.size()),
+        reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT*>(metadata_.data()), &moveBytes);
+    if (FAILED(hr)) return;
+    UINT dirtyBytes = 0;
+    hr = o.duplication->GetFrameDirtyRects(static_cast<UINT>(metadata_.size()) - moveBytes,
+        reinterpret_cast<RECT*>(metadata_.data() + moveBytes), &dirtyBytes);
+    if (FAILED(hr)) return;
+
+    const auto* moves = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT*>(metadata_.data());
+    const auto* dirty = reinterpret_cast<const RECT*>(metadata_.data() + moveBytes);
+    size_t moveCount = moveBytes / sizeof(DXGI_OUTDUPL_MOVE_RECT);
+    size_t dirtyCount = dirtyBytes / sizeof(RECT);
+
+    out.full = false;
+    out.moves.assign(moves, moves + moveCount);
+    auto add = [&](const RECT& r) {
+        RECT c = { std::max<LONG>(r.left, 0), std::max<LONG>(r.top, 0),
+                   std::min<LONG>(r.right, o.width), std::min<LONG>(r.bottom, o.height) };
+        if (c.left < c.right && c.top < c.bottom) out.dirty.push_back(c);
+    };
+    for (size_t i = 0; i < moveCount; i++) add(moves[i].DestinationRect);
+    for (size_t i = 0; i < dirtyCount; i++) add(dirty[i]);
+
+    if (out.dirty.size() > MAX_DIRTY_RECTS) {
+        RECT box = out.dirty[0];
+        for (const RECT& r : out.dirty) {
+            box.left = std::min(box.left, r.left);
+            box.top = std::min(box.top, r.top);
+            box.right = std::max(box.right, r.right);
+            box.bottom = std::max(box.bottom, r.bottom);
+        }
+        out.dirty.assign(1, box);
     }
-    if (duplication_) {
-        duplication_->Release();
-        duplication_ = nullptr;
+}
+
+void ScreenCapture::cleanupDuplicationOnly() {
+    for (Output& o : outputs_) {
+        if (!o.duplication) continue;
+        if (o.frameAcquired) o.duplication->ReleaseFrame();
+        o.duplication->Release();
     }
+    outputs_.clear();
+    // 重建后的第一帧会重新报告指针位置和形状
+    cursorOutput_ = -1;
+    cursorUpdateTime_ = {};
 }
 
 void ScreenCapture::cleanupDXGIOnly() {
@@ -2,46 +2,102 @@
 #ifndef SCREEN_CAPTURE_H
 #define SCREEN_CAPTURE_H
 
+#include "capture_source.h"
 #include <d3d11.h>
 #include <dxgi1_2.h>
 #include <cstdint>
+#include <vector>
 
 #pragma comment(lib, "d3d11.lib")
 #pragma comment(lib, "dxgi.lib")
 
-class ScreenCapture {
+// 适配器上的每个显示器各有一个复制对象，各自把画面拷进一张按桌面布局排列的画布，
+// 画布是所有显示器的外接矩形。选择某个显示器只改变上报变化的范围和 region()，
+// 其余显示器照常更新画布，切换时画面立即可用，不需要重建复制对象或编码器。
+// DXGI 复制出的画面不含指针，指针的位置和形状由 cursor() 单独给出。
+// 所有方法都在采集线程调用
+class ScreenCapture : public ICaptureSource {
 public:
     ScreenCapture();
     ~ScreenCapture();
 
-    bool init();
-    void cleanup();
+    bool init() override;
+    void cleanup() override;
     
-    const uint8_t* capture(bool& hasNew);
-    bool captureTexture(ID3D11Texture2D** outTex);
+    // changes 非空时给出本帧的变化区域，只有这些区域被重新拷贝，因此两种方式不能交替使用；
+    // 画面未变（只有指针动了）时 hasNew 为 false / captureTexture 返回 false。
+    // 两者都给出整张画布，调用方按 region() 取当前选择的部分
+    const uint8_t* capture(bool& hasNew, FrameChanges* changes = nullptr);
+    bool captureTexture(ID3D11Texture2D** outTex, FrameChanges* changes = nullptr) override;
+    void forceFullFrame() override { forceFull_ = true; }
     
-    ID3D11Device* getDevice() const { return device_; }
+    ID3D11Device* getDevice() const override { return device_; }
     ID3D11DeviceContext* getContext() const { return context_; }
     
-    int getWidth() const { return width_; }
-    int getHeight() const { return height_; }
+    int getWidth() const override { return width_; }
+    int getHeight() const override { return height_; }
+
+    const std::vector<Monitor>& monitors() const override { return monitors_; }
+    bool selectMonitor(int index) override;
+    int selectedMonitor() const override { return selected_; }
+    RECT region() const override;
+    POINT desktopOrigin() const override { return origin_; }
+    uint32_t layoutVersion() const override { return layoutVersion_; }
+    const Cursor& cursor() const override { return cursor_; }
+    bool acceptsInput() const override { return true; }
 
 private:
+    struct Output {
+        IDXGIOutputDuplication* duplication = nullptr;
+        RECT desktop = {};              // 虚拟桌面坐标
+        POINT offset = {};              // 在画布上的位置
+        int width = 0;
+        int height = 0;
+        bool frameAcquired = false;
+        bool forceFull = true;          // 复制刚建立，之前拷贝的内容不可信
+    };
+
     bool initDXGI();
     bool initDuplication();
     bool initGDI();
+    bool ensureCanvas();
 
     void cleanupDuplicationOnly();
     void cleanupDXGIOnly();
     bool resetDXGI();
+    // 从各个显示器取新帧拷进画布，当前选择内的变化累加到 out；
+    // 返回 false 表示选择范围内没有新画面，lost 表示需要重建复制
+    bool acquire(FrameChanges& out, bool& lost);
+    bool acquireOutput(size_t index, UINT timeoutMs, FrameChanges& out, bool& lost);
+    void updateCursor(size_t index, const DXGI_OUTDUPL_FRAME_INFO& fi);
+    // 把三种 DXGI 指针格式统一转换成 BGRA；单色和带掩码指针的反色像素无法在客户端还原，画成黑色
+    bool convertPointerShape(const DXGI_OUTDUPL_POINTER_SHAPE_INFO& info, const uint8_t* data);
+    bool inSelection(size_t index) const;
+    // 读取刚取得的帧的移动/脏矩形（显示器自身坐标），失败时退化为整帧
+    void readChanges(Output& o, const DXGI_OUTDUPL_FRAME_INFO& fi, FrameChanges& out);
+
+    // 脏矩形超过这个数目时合并为外接矩形，逐块拷贝的调用开销反而更大
+    static constexpr size_t MAX_DIRTY_RECTS = 32;
+    // 等新帧的时间只花在一个显示器上，其余显示器只取已经就绪的帧
+    static constexpr UINT ACQUIRE_TIMEOUT_MS = 16;
+    static constexpr int MAX_POINTER_SIZE = 256;
 
     // DXGI
     ID3D11Device* device_ = nullptr;
     ID3D11DeviceContext* context_ = nullptr;
-    IDXGIOutputDuplication* duplication_ = nullptr;
+    std::vector<Output> outputs_;
+    std::vector<Monitor> monitors_;
     ID3D11Texture2D* stagingTexture_ = nullptr;
-    ID3D11Texture2D* gpuCopyTexture_ = nullptr;
-    bool frameAcquired_ = false;
+    ID3D11Texture2D* gpuCopyTexture_ = nullptr;     // 画布
+    std::vector<uint8_t> metadata_;     // GetFrameMoveRects/GetFrameDirtyRects 的缓冲
+    std::vector<uint8_t> pointerShape_; // GetFramePointerShape 的缓冲
+    Cursor cursor_;
+    int cursorOutput_ = -1;             // 指针所在的显示器
+    LARGE_INTEGER cursorUpdateTime_ = {};
+    int selected_ = 0;
+    bool forceFull_ = true;             // 选择变了或上次读回失败，下一帧按整帧上报
+    POINT origin_ = {};
+    uint32_t layoutVersion_ = 0;
 
     // GDI fallback
     HDC hdcScreen_ = nullptr;
@@ -0,0 +1,364 @@
+// 弱网回归测试：在进程内的损伤链路上跑完整的 UDP 会话和加密 TCP 传输，
+// 检查 FEC/NACK 能恢复视频帧、可靠消息不丢不乱序、口令不一致的连接被拒绝、
+// 满员时半开的旧连接会被回收。
+// 不依赖测试框架，任一检查失败时返回非零，由 CTest 判定
+#include "common/datagram_link.h"
+#include "common/net_emulator.h"
+#include "common/transport_tcp.h"
+#include "common/udp_session.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    int g_failures = 0;
+
+    void Check(bool ok, const std::string& what) {
+        std::cout << (ok ? "[PASS] " : "[FAIL] ") << what << std::endl;
+        if (!ok) g_failures++;
+    }
+
+    bool WaitFor(const std::function<bool()>& done, int timeoutMs) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while (!done()) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+
+    // [type][序号 u32][按序号生成的填充]，收到后按序号重新生成逐字节比较
+    BinaryData MakeMessage(Desktop::MsgType type, uint32_t seq, size_t size) {
+        BinaryData msg(size);
+        msg[0] = static_cast<uint8_t>(type);
+        memcpy(msg.data() + 1, &seq, sizeof(seq));
+        for (size_t i = 1 + sizeof(seq); i < size; i++) msg[i] = static_cast<uint8_t>(seq * 31 + i);
+        return msg;
+    }
+
+    bool ReadSeq(const uint8_t* data, size_t size, size_t offset, uint32_t& seq) {
+        if (size < offset + sizeof(seq)) return false;
+        memcpy(&seq, data + offset, sizeof(seq));
+        return true;
+    }
+
+    bool Intact(const uint8_t* data, size_t size, size_t offset, uint32_t seq) {
+        for (size_t i = offset + sizeof(seq); i < size; i++) {
+            if (data[i] != static_cast<uint8_t>(seq * 31 + (i - offset + 1))) return false;
+        }
+        return true;
+    }
+
+    // 视频帧：[VideoFrame][flags][序号 u32][填充]
+    BinaryData MakeVideoFrame(uint32_t seq, size_t size) {
+        BinaryData payload = MakeMessage(Desktop::MsgType::VideoFrame, seq, size);
+        BinaryData frame;
+        frame.reserve(size + 1);
+        frame.push_back(static_cast<uint8_t>(Desktop::MsgType::VideoFrame));
+        // 每帧都是关键帧：丢一帧不影响后面的帧交付，交付数就是恢复成功的帧数
+        frame.push_back(Desktop::VIDEO_KEYFRAME);
+        frame.insert(frame.end(), payload.begin() + 1, payload.end());
+        return frame;
+    }
+
+    // ---- UDP 会话经 EmulatedLink：丢包、时延、抖动、重排 ----
+    void TestUdpSessionRecovery() {
+        std::cout << "[Test] UDP session over impaired datagram link" << std::endl;
+        constexpr uint32_t RELIABLE_COUNT = 300;
+        constexpr uint32_t VIDEO_COUNT = 90;
+        constexpr size_t VIDEO_SIZE = 24 * 1024;
+
+        auto pair = LossyLoopback::CreatePair(LossyLoopback::Params{});
+        auto clientLink = std::make_unique<EmulatedLink>(std::move(pair.first), 11);
+        auto serverLink = std::make_unique<EmulatedLink>(std::move(pair.second), 21);
+        NetEmulation::Conditions c;
+        c.delayMs = 15;
+        c.jitterMs = 5;
+        c.lossRate = 0.03;
+        c.reorderRate = 0.02;
+        c.reorderDelayMs = 20;
+        clientLink->uplink().setConditions(c);
+        serverLink->uplink().setConditions(c);
+        EmulatedLink* clientEmu = clientLink.get();
+        EmulatedLink* serverEmu = serverLink.get();
+
+        auto server = std::make_shared<UdpSession>(std::move(serverLink), UdpSession::Role::Server);
+        auto client = std::make_shared<UdpSession>(std::move(clientLink), UdpSession::Role::Client);
+
+        std::mutex mtx;
+        std::vector<uint32_t> reliable;
+        uint32_t videoDelivered = 0;
+        bool videoIntact = true;
+
+        UdpSession::Callbacks sc;
+        sc.onMessage = [&](const BufferRef& msg) {
+            uint32_t seq;
+            if (!ReadSeq(msg.data(), msg.size(), 1, seq)) return;
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!Intact(msg.data(), msg.size(), 1, seq)) seq = UINT32_MAX;
+            reliable.push_back(seq);
+        };
+        UdpSession::Callbacks cc;
+        cc.onMessage = [&](const BufferRef& msg) {
+            uint32_t seq;
+            if (msg.size() < 2 || msg[0] != static_cast<uint8_t>(Desktop::MsgType::VideoFrame)) return;
+            if (!ReadSeq(msg.data(), msg.size(), 2, seq)) return;
+            std::lock_guard<std::mutex> lock(mtx);
+            videoDelivered++;
+            if (!Intact(msg.data() + 1, msg.size() - 1, 1, seq)) videoIntact = false;
+        };
+        Check(server->start(sc), "server session starts");
+        Check(client->start(cc), "client session starts");
+        if (!client->waitOpen(std::chrono::seconds(5))) {
+            Check(false, "handshake completes over the impaired link");
+            client->close();
+            server->close();
+            return;
+        }
+        WaitFor([&]() { return server->isOpen(); }, 2000);
+
+        // 视频按 30fps 发出，可靠消息穿插其间
+        server->setPacingRate(20 * 1000 * 1000, 30);
+        for (uint32_t i = 0; i < VIDEO_COUNT; i++) {
+            BinaryData frame = MakeVideoFrame(i, VIDEO_SIZE);
+            server->send(BufferPool::shared().copyOf(frame.data(), frame.size()));
+            for (uint32_t j = i * RELIABLE_COUNT / VIDEO_COUNT; j < (i + 1) * RELIABLE_COUNT / VIDEO_COUNT; j++) {
+                BinaryData msg = MakeMessage(Desktop::MsgType::StreamData, j, 64 + (j % 7) * 300);
+                client->send(BufferPool::shared().copyOf(msg.data(), msg.size()));
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(33));
+        }
+
+        WaitFor([&]() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return reliable.size() >= RELIABLE_COUNT;
+        }, 10000);
+        // 最后几帧的 NACK 重传再等一会儿
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        NetEmulator::Stats up = clientEmu->uplink().stats();
+        NetEmulator::Stats down = serverEmu->uplink().stats();
+        client->close();
+        server->close();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        bool inOrder = reliable.size() == RELIABLE_COUNT;
+        for (uint32_t i = 0; inOrder && i < RELIABLE_COUNT; i++) inOrder = reliable[i] == i;
+        std::cout << "[Test] link lost " << up.lost + down.lost << " packets, reordered "
+                  << up.reordered + down.reordered << "; video delivered " << videoDelivered
+                  << "/" << VIDEO_COUNT << std::endl;
+        Check(down.lost > 0 && up.lost > 0, "the emulated link actually dropped packets in both directions");
+        Check(inOrder, "every reliable message arrives once, intact and in order");
+        Check(videoIntact, "delivered video frames are byte-identical to what was sent");
+        // 3% 独立丢包下单靠 FEC 约有一成帧缺不止一片，剩下的要靠 NACK 补齐
+        Check(videoDelivered >= VIDEO_COUNT * 95 / 100, "FEC and NACK recover at least 95% of video frames");
+    }
+
+    // ---- 加密 TCP 经 EmulatedTcpProxy：时延、丢包重传 ----
+    void TestEncryptedTcpOverProxy() {
+        std::cout << "[Test] Encrypted TCP transport through impaired proxy" << std::endl;
+        constexpr uint32_t MESSAGE_COUNT = 200;
+        // 传输层不解释 Hello，它和其他控制类消息同在一个优先级队列里，按提交顺序发出；
+        // StreamData 会按第二个字节的标志分到不同队列，彼此之间本来就不保序
+        constexpr Desktop::MsgType TYPE = Desktop::MsgType::Hello;
+        // 第一条消息超过一批记录：发送方要先发空记录，接收方在认证前才不会拒收
+        constexpr size_t FIRST_SIZE = 300 * 1024;
+        const int port = 30000 + static_cast<int>(std::chrono::steady_clock::now().time_since_epoch().count() % 20000);
+        const std::string password = "correct horse battery staple";
+
+        TCPServerTransport server(port, 1);
+        server.setEncryption(true, password);
+        std::mutex mtx;
+        std::vector<uint32_t> received;
+        std::vector<size_t> sizes;
+        std::atomic<int> connected{0};
+        std::atomic<int> disconnected{0};
+        TransportCallbacks sc;
+        sc.onClientConnected = [&](ClientId) { connected++; };
+        sc.onClientDisconnected = [&](ClientId) { disconnected++; };
+        sc.onClientMessage = [&](ClientId, const BinaryData& msg) {
+            uint32_t seq;
+            if (!ReadSeq(msg.data(), msg.size(), 1, seq)) return;
+            std::lock_guard<std::mutex> lock(mtx);
+            received.push_back(Intact(msg.data(), msg.size(), 1, seq) ? seq : UINT32_MAX);
+            sizes.push_back(msg.size());
+        };
+        server.setCallbacks(sc);
+        if (!server.start()) {
+            Check(false, "TCP server starts on port " + std::to_string(port));
+            return;
+        }
+
+        EmulatedTcpProxy proxy("127.0.0.1", port);
+        NetEmulation::Conditions c;
+        c.delayMs = 20;
+        c.jitterMs = 5;
+        c.bandwidthKbps = 50000;
+        c.lossRate = 0.01;
+        proxy.uplink().setConditions(c);
+        proxy.downlink().setConditions(c);
+        Check(proxy.start(), "proxy starts");
+
+        TCPClientTransport client;
+        client.setEncryption(true, password);
+        Check(client.connect("127.0.0.1", proxy.port()), "client connects through the proxy");
+        client.send(MakeMessage(TYPE, 0, FIRST_SIZE));
+        for (uint32_t i = 1; i < MESSAGE_COUNT; i++) {
+            client.send(MakeMessage(TYPE, i, 16 + (i % 13) * 700));
+        }
+        WaitFor([&]() {
+            std::lock_guard<std::mutex> lock(mtx);
+            return received.size() >= MESSAGE_COUNT;
+        }, 10000);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            bool inOrder = received.size() == MESSAGE_COUNT;
+            for (uint32_t i = 0; inOrder && i < MESSAGE_COUNT; i++) inOrder = received[i] == i;
+            Check(inOrder, "every message arrives once, intact and in order");
+            Check(!sizes.empty() && sizes[0] == FIRST_SIZE, "an oversized first message survives the pre-auth record cap");
+        }
+
+        // 满员的服务端接受后立即关闭：TCP 握手成功也不能算连上，否则连接竞速会选中它
+        TCPClientTransport extra;
+        extra.setEncryption(true, password);
+        Check(!extra.connect("127.0.0.1", proxy.port()), "a connection the full server closes is not reported as connected");
+
+        client.disconnect();
+        WaitFor([&]() { return disconnected > 0; }, 5000);
+
+        // 口令不一致：加密握手照样完成，但第一条记录认证失败，两端都断开，消息不会交给上层，
+        // connect 也不能报告成功，否则连接竞速会选中这条路径
+        size_t before;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            before = received.size();
+        }
+        int closedBefore = disconnected;
+        TCPClientTransport intruder;
+        intruder.setEncryption(true, "wrong password");
+        Check(!intruder.connect("127.0.0.1", proxy.port()), "a client with the wrong password is not reported as connected");
+        intruder.send(MakeMessage(TYPE, 0, 128));
+        WaitFor([&]() { return disconnected > closedBefore && !intruder.isConnected(); }, 5000);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            Check(received.size() == before, "a client with the wrong password delivers nothing");
+        }
+        Check(!intruder.isConnected(), "a client with the wrong password is disconnected");
+        intruder.disconnect();
+
+        proxy.stop();
+        server.stop();
+    }
+
+    // ---- 不加密的 TCP：满员的服务端同样不能被当成连上 ----
+    void TestPlainTcpAdmission() {
+        std::cout << "[Test] Unencrypted TCP transport at its client limit" << std::endl;
+        const int port = 30000 + static_cast<int>(std::chrono::steady_clock::now().time_since_epoch().count() % 20000);
+
+        TCPServerTransport server(port, 1);
+        server.setEncryption(false);
+        if (!server.start()) {
+            Check(false, "TCP server starts on port " + std::to_string(port));
+            return;
+        }
+        TCPClientTransport first;
+        first.setEncryption(false);
+        Check(first.connect("127.0.0.1", port), "an unencrypted client is accepted");
+        TCPClientTransport extra;
+        extra.setEncryption(false);
+        Check(!extra.connect("127.0.0.1", port), "a connection the full unencrypted server closes is not reported as connected");
+
+        extra.disconnect();
+        first.disconnect();
+        server.stop();
+    }
+
+    // ---- 满员时旧连接半开（换网后旧路径不通但没有断开），客户端从新路径重连 ----
+    void TestReconnectOverHalfOpenConnection() {
+        std::cout << "[Test] Reconnect while the old connection is half-open" << std::endl;
+        const int port = 30000 + static_cast<int>(std::chrono::steady_clock::now().time_since_epoch().count() % 20000);
+        const std::string password = "correct horse battery staple";
+
+        TCPServerTransport server(port, 1);
+        server.setEncryption(true, password);
+        std::mutex mtx;
+        std::vector<ClientId> connectedIds;
+        std::vector<ClientId> disconnectedIds;
+        std::atomic<int> messages{0};
+        TransportCallbacks sc;
+        sc.onClientConnected = [&](ClientId id) {
+            std::lock_guard<std::mutex> lock(mtx);
+            connectedIds.push_back(id);
+        };
+        sc.onClientDisconnected = [&](ClientId id) {
+            std::lock_guard<std::mutex> lock(mtx);
+            disconnectedIds.push_back(id);
+        };
+        sc.onClientMessage = [&](ClientId, const BinaryData&) { messages++; };
+        server.setCallbacks(sc);
+        if (!server.start()) {
+            Check(false, "TCP server starts on port " + std::to_string(port));
+            return;
+        }
+
+        // 旧路径经代理，之后让它什么都不转发，两端的套接字都还开着。
+        // 代理按 TCP 语义不丢数据，用远超测试时长的时延让数据停在半路
+        EmulatedTcpProxy oldPath("127.0.0.1", port);
+        Check(oldPath.start(), "proxy for the old path starts");
+        TCPClientTransport old;
+        old.setEncryption(true, password);
+        Check(old.connect("127.0.0.1", oldPath.port()), "the first connection is accepted");
+        NetEmulation::Conditions dead;
+        dead.delayMs = 120000;
+        oldPath.uplink().setConditions(dead);
+        oldPath.downlink().setConditions(dead);
+
+        // 旧连接刚刚还有消息，此时满员拒绝是对的
+        TCPClientTransport fresh;
+        fresh.setEncryption(true, password);
+        Check(!fresh.connect("127.0.0.1", port), "a reconnect is refused while the old connection was recently alive");
+
+        // 按客户端自动重连的节奏重试，旧连接静默超时后被回收，新连接进来
+        bool reconnected = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(Desktop::RESUME_GRACE_MS);
+        while (!reconnected && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            reconnected = fresh.connect("127.0.0.1", port);
+        }
+        Check(reconnected, "the reconnect succeeds within the resume grace period");
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            Check(!connectedIds.empty() && disconnectedIds.size() == 1 && disconnectedIds[0] == connectedIds[0],
+                  "the half-open connection is reported disconnected so its session can be resumed");
+        }
+        int before = messages;
+        fresh.send(MakeMessage(Desktop::MsgType::Hello, 0, 64));
+        Check(WaitFor([&]() { return messages > before; }, 5000), "the new connection delivers messages");
+        Check(server.clientCount() == 1, "the server stays within its client limit");
+
+        fresh.disconnect();
+        old.disconnect();
+        oldPath.stop();
+        server.stop();
+    }
+}
+
+int main() {
+    TestUdpSessionRecovery();
+    TestEncryptedTcpOverProxy();
+    TestPlainTcpAdmission();
+    TestReconnectOverHalfOpenConnection();
+    if (g_failures > 0) {
+        std::cout << "[Test] " << g_failures << " check(s) failed" << std::endl;
+        return 1;
+    }
+    std::cout << "[Test] All checks passed" << std::endl;
+    return 0;
+}